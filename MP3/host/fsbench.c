@@ -0,0 +1,156 @@
+/*
+ * host benchmark of the file system readers
+ * "fsbench [-r runs] filesys_img" loads the image, then times
+ * read_dentry_by_name over every name, read_data over every file a block at a
+ * time and dir_read over the directory, each the best of runs (default
+ * DEF_RUNS) passes. results are "BENCH <name> <value> <unit>" lines like
+ * those of the kernel benchmark run, bench_compare.py compares them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kfs.h"
+
+#define DEF_RUNS    200
+#define NS_PER_S    1000000000ULL
+#define KB          1024
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+/* the whole image, block aligned like the boot module */
+static void* load(const char* path, unsigned int* size)
+{
+    FILE* f;
+    void* img;
+    long len;
+
+    if ((f = fopen(path, "rb")) == NULL || fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) <= 0) {
+        perror(path);
+        exit(1);
+    }
+    rewind(f);
+    if (posix_memalign(&img, KFS_BLOCK_SIZE, len) != 0 || fread(img, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "%s: cannot read the image\n", path);
+        exit(1);
+    }
+    fclose(f);
+    *size = len;
+    return img;
+}
+
+static void report(const char* name, unsigned long long value, const char* unit)
+{
+    printf("BENCH %s %llu %s\n", name, value, unit);
+}
+
+static void bench_lookup(int runs)
+{
+    kfs_dentry_t dentry;
+    unsigned char names[KFS_MAX_DENTRY][KFS_NAME_LEN + 1];
+    unsigned int n, i;
+    unsigned long long start, t, best = ~0ULL;
+    int run;
+
+    for (n = 0; n < KFS_MAX_DENTRY && read_dentry_by_index(n, &dentry) == 0; n++) {
+        memcpy(names[n], dentry.file_name, KFS_NAME_LEN);
+        names[n][KFS_NAME_LEN] = '\0';
+    }
+    if (n == 0)
+        return;
+
+    for (run = 0; run < runs; run++) {
+        start = now_ns();
+        for (i = 0; i < n; i++)
+            read_dentry_by_name(names[i], &dentry);
+        if ((t = now_ns() - start) < best)
+            best = t;
+    }
+    report("host_dentry_lookup", best / n, "ns");
+}
+
+static void bench_read_data(int runs)
+{
+    static unsigned char buf[KFS_BLOCK_SIZE];
+    kfs_dentry_t dentry;
+    unsigned int i, offset, total = 0;
+    unsigned long long start, t, best = ~0ULL;
+    int run;
+
+    for (run = 0; run < runs; run++) {
+        total = 0;
+        start = now_ns();
+        for (i = 0; read_dentry_by_index(i, &dentry) == 0; i++) {
+            if (dentry.file_type != KFS_FILE_TYPE)
+                continue;
+            for (offset = 0; offset < get_file_size(&dentry); offset += KFS_BLOCK_SIZE)
+                read_data(dentry.inode_idx, offset, buf, KFS_BLOCK_SIZE);
+            total += get_file_size(&dentry);
+        }
+        if ((t = now_ns() - start) < best)
+            best = t;
+    }
+    if (total >= KB)
+        report("host_read_data", best / (total / KB), "ns/KB");
+}
+
+static void bench_dir_read(int runs)
+{
+    char name[KFS_NAME_LEN];
+    unsigned int n = 0;
+    unsigned long long start, t, best = ~0ULL;
+    int run;
+
+    for (run = 0; run < runs; run++) {
+        n = 0;
+        start = now_ns();
+        dir_open(".");
+        while (dir_read(0, name, KFS_NAME_LEN) > 0)
+            n++;
+        if ((t = now_ns() - start) < best)
+            best = t;
+    }
+    if (n > 0)
+        report("host_dir_read", best / n, "ns");
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int size;
+    void* img;
+    int runs = DEF_RUNS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        if (opt != 'r' || (runs = atoi(optarg)) <= 0) {
+            fprintf(stderr, "usage: %s [-r runs] filesys_img\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-r runs] filesys_img\n", argv[0]);
+        return 2;
+    }
+
+    img = load(argv[optind], &size);
+    if (filesys_check(img, size) != 0) {
+        fprintf(stderr, "%s: inconsistent file system image\n", argv[optind]);
+        return 1;
+    }
+    filesys_init(img);
+
+    bench_lookup(runs);
+    bench_read_data(runs);
+    bench_dir_read(runs);
+    printf("BENCH end 0\n");
+    return 0;
+}
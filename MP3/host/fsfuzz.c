@@ -0,0 +1,106 @@
+/*
+ * fuzz entry of the file system readers
+ * every input is taken as a file system image: images filesys_check accepts
+ * are walked with read_dentry_by_name, read_data and dir_read. built with
+ * FSFUZZ_LIBFUZZER it is a libFuzzer target, otherwise "fsfuzz [file...]"
+ * runs the files given, or stdin, for AFL and for replaying a crash.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kfs.h"
+
+/* read sizes, odd ones cross block boundaries at odd places */
+static const unsigned int chunks[] = {1, 37, KFS_BLOCK_SIZE, 3 * KFS_BLOCK_SIZE + 5};
+
+int LLVMFuzzerTestOneInput(const unsigned char* data, size_t size)
+{
+    static unsigned char buf[3 * KFS_BLOCK_SIZE + 5];
+    unsigned char name[KFS_NAME_LEN + 1];
+    kfs_dentry_t dentry, found;
+    unsigned char* img;
+    unsigned int i, c, offset, fsize;
+    int ret;
+
+    /* an exact copy, so reads past the image are caught by the sanitizers */
+    if (size == 0 || (img = malloc(size)) == NULL)
+        return 0;
+    memcpy(img, data, size);
+    if (filesys_check(img, size) != 0) {
+        free(img);
+        return 0;
+    }
+    filesys_init(img);
+
+    for (i = 0; read_dentry_by_index(i, &dentry) == 0; i++) {
+        memcpy(name, dentry.file_name, KFS_NAME_LEN);
+        name[KFS_NAME_LEN] = '\0';
+        if (read_dentry_by_name(name, &found) != 0)
+            abort();
+        if (dentry.file_type != KFS_FILE_TYPE)
+            continue;
+        fsize = get_file_size(&dentry);
+        for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            for (offset = 0; offset <= fsize; offset += ret) {
+                if ((ret = read_data(dentry.inode_idx, offset, buf, chunks[c])) <= 0)
+                    break;
+            }
+        }
+        /* past the end */
+        if (read_data(dentry.inode_idx, fsize + KFS_BLOCK_SIZE, buf, chunks[0]) != 0)
+            abort();
+    }
+
+    dir_open(".");
+    while (dir_read(0, name, KFS_NAME_LEN) > 0)
+        ;
+
+    free(img);
+    return 0;
+}
+
+#ifndef FSFUZZ_LIBFUZZER
+/* run one input, the whole file */
+static void run(FILE* f, const char* what)
+{
+    unsigned char* data = NULL;
+    size_t size = 0, cap = 0, n;
+
+    for (;;) {
+        if (size == cap) {
+            cap = cap ? 2 * cap : KFS_BLOCK_SIZE;
+            if ((data = realloc(data, cap)) == NULL) {
+                fprintf(stderr, "%s: out of memory\n", what);
+                exit(1);
+            }
+        }
+        if ((n = fread(data + size, 1, cap - size, f)) == 0)
+            break;
+        size += n;
+    }
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+}
+
+int main(int argc, char** argv)
+{
+    FILE* f;
+    int i;
+
+    if (argc == 1) {
+        run(stdin, "stdin");
+        return 0;
+    }
+    for (i = 1; i < argc; i++) {
+        if ((f = fopen(argv[i], "rb")) == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        run(f, argv[i]);
+        fclose(f);
+    }
+    return 0;
+}
+#endif
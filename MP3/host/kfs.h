@@ -0,0 +1,39 @@
+#ifndef _KFS_H
+#define _KFS_H
+
+/*
+ * the part of student-distrib/filesys.h the host programs use, in host
+ * types: types.h cannot be mixed with the C library headers. the libc names of
+ * lib.c (strlen, memcpy...) get a k_ prefix when it is built for the host, see
+ * kernel.syms
+ */
+
+#define KFS_BLOCK_SIZE      4096
+#define KFS_NAME_LEN        32
+#define KFS_FILE_TYPE       2
+#define KFS_MAX_DENTRY      63
+
+typedef struct kfs_dentry_t {
+    char file_name[KFS_NAME_LEN];
+    unsigned int file_type;
+    unsigned int inode_idx;
+    unsigned char reserved[24];
+} kfs_dentry_t;
+
+/* boot block counts */
+typedef struct kfs_boot_t {
+    unsigned int dir_num;
+    unsigned int inode_num;
+    unsigned int data_block_num;
+} kfs_boot_t;
+
+extern void filesys_init(void* filesys);
+extern int filesys_check(const void* filesys, unsigned int size);
+extern int read_dentry_by_name(const unsigned char* fname, kfs_dentry_t* dentry);
+extern int read_dentry_by_index(unsigned int idx, kfs_dentry_t* dentry);
+extern int read_data(unsigned int inode_idx, unsigned int offset, unsigned char* buf, unsigned int nbytes);
+extern int dir_open(const char* filename);
+extern int dir_read(int fd, void* buf, int nbytes);
+extern unsigned int get_file_size(kfs_dentry_t* dentry);
+
+#endif /* _KFS_H */
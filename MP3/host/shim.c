@@ -0,0 +1,61 @@
+/*
+ * the kernel functions filesys.c and lib.c call that the host has no use for,
+ * built with the kernel headers like the modules themselves
+ */
+#include "lib.h"
+#include "syscall.h"
+#include "fpu.h"
+#include "serial.h"
+
+/* the process lib.c asks about, the screen functions are not used on the host */
+static pcb_t host_pcb;
+
+/*
+ * get_pcb_ptr
+ * DESCRIPTION: the process control block of every pid, one static block
+ * INPUT: pid -- not used
+ * OUTPUT: none
+ * RETURN: pointer to host_pcb
+ * SIDE AFFECTS: none
+ */
+pcb_t* get_pcb_ptr(uint32_t pid)
+{
+    return &host_pcb;
+}
+
+/*
+ * kernel_fpu_begin
+ * DESCRIPTION: a host process owns its SSE registers, nothing to do
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 0
+ * SIDE AFFECTS: none
+ */
+uint32_t kernel_fpu_begin()
+{
+    return 0;
+}
+
+/*
+ * kernel_fpu_end
+ * DESCRIPTION: nothing to do, see kernel_fpu_begin
+ * INPUT: flags -- not used
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void kernel_fpu_end(uint32_t flags)
+{
+}
+
+/*
+ * serial_putc
+ * DESCRIPTION: there is no COM1, the byte is dropped
+ * INPUT: c -- not used
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void serial_putc(uint8_t c)
+{
+}
@@ -0,0 +1,580 @@
+#include "apic.h"
+#include "types.h"
+#include "lib.h"
+#include "i8259.h"
+#include "paging.h"
+#include "schedule.h"
+#include "klog.h"
+
+/* Reference: https://wiki.osdev.org/APIC, https://wiki.osdev.org/IOAPIC, https://wiki.osdev.org/MADT */
+
+/* regions mapped while reading ACPI tables, unmapped after */
+#define ACPI_MAX_MAPS   8
+/* polls of the delivery status before an IPI is given up */
+#define ICR_SPIN_MAX    100000
+
+/* LAPIC and IOAPIC registers, identity mapped uncached */
+static volatile uint32_t* lapic = NULL;
+static volatile uint32_t* ioapic = NULL;
+/* number of IOAPIC redirection entries */
+static uint32_t ioapic_entries = 0;
+/* LAPIC id of the boot processor, destination of every IRQ */
+static uint32_t bsp_apic_id = 0;
+
+/* 4MB regions and low memory ranges mapped for ACPI tables */
+static uint32_t acpi_maps[ACPI_MAX_MAPS];
+static uint32_t acpi_nmaps = 0;
+static uint32_t acpi_low_start[ACPI_MAX_MAPS];
+static uint32_t acpi_low_end[ACPI_MAX_MAPS];
+static uint32_t acpi_nlows = 0;
+
+static uint32_t lapic_read(uint32_t reg);
+static void lapic_write(uint32_t reg, uint32_t val);
+static uint32_t ioapic_read(uint32_t reg);
+static void ioapic_write(uint32_t reg, uint32_t val);
+static int32_t cpu_has_apic();
+static int32_t acpi_map(uint32_t phys, uint32_t len);
+static void acpi_unmap_all();
+static int32_t acpi_checksum(const void* p, uint32_t len);
+static rsdp_t* acpi_find_rsdp();
+static int32_t acpi_parse_madt();
+static void madt_parse(acpi_header_t* h);
+static uint32_t lapic_calibrate();
+static void lapic_timer_start();
+
+/*
+ * apic_init
+ * DESCRIPTION: find the LAPIC and IOAPIC from the ACPI MADT, enable the LAPIC, calibrate
+ *              its timer against the PIT and switch IRQs and the scheduler tick to them.
+ *              the 8259 is kept as it is and used if anything is missing
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 0 if the APICs are used, -1 if the 8259 and the PIT are
+ * SIDE AFFECTS: LAPIC and IOAPIC registers mapped, madt filled in
+ */
+int32_t apic_init()
+{
+    uint32_t i;
+
+    apic_mode = 0;
+    lapic_ticks_per_tick = 0;
+
+    if (!USE_APIC || !cpu_has_apic())
+    {
+        klog(KLOG_INFO, "apic: not available, using 8259");
+        return -1;
+    }
+    if (acpi_parse_madt() != 0 || madt.ioapic_addr == 0)
+    {
+        klog(KLOG_INFO, "apic: no MADT or IOAPIC, using 8259");
+        return -1;
+    }
+    if (map_phys_4mb(madt.lapic_addr, 1) < 0 || map_phys_4mb(madt.ioapic_addr, 1) < 0)
+    {
+        klog(KLOG_WARN, "apic: cannot map LAPIC %#x or IOAPIC %#x", madt.lapic_addr, madt.ioapic_addr);
+        return -1;
+    }
+    lapic = (volatile uint32_t*)madt.lapic_addr;
+    ioapic = (volatile uint32_t*)madt.ioapic_addr;
+
+    /* software enable the LAPIC, accept every priority, LINT0/1 are left as the BIOS set them */
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_VEC);
+    bsp_apic_id = lapic_id();
+
+    /* mask every IOAPIC input, apic_enable routes those the drivers enable */
+    ioapic_entries = ((ioapic_read(IOAPIC_VER) >> IOAPIC_MAX_RED_SHIFT) & 0xFF) + 1;
+    for (i = 0; i < ioapic_entries; i++)
+    {
+        ioapic_write(IOAPIC_REDTBL(i), RED_MASKED);
+        ioapic_write(IOAPIC_REDTBL(i) + 1, 0);
+    }
+
+    if (0 == (lapic_ticks_per_tick = lapic_calibrate()))
+    {
+        klog(KLOG_WARN, "apic: LAPIC timer calibration failed, using 8259");
+        return -1;
+    }
+
+    klog(KLOG_INFO, "apic: %u cpus, LAPIC %#x, IOAPIC %#x with %u inputs",
+         madt.ncpus, madt.lapic_addr, madt.ioapic_addr, ioapic_entries);
+    klog(KLOG_INFO, "apic: %u LAPIC timer counts per tick", lapic_ticks_per_tick);
+    return apic_enable();
+}
+
+/*
+ * apic_enable
+ * DESCRIPTION: mask the 8259, route the IRQs enabled by drivers through the IOAPIC
+ *              and start the LAPIC timer as the scheduler tick at PIT_FREQ
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 if apic_init did not find the APICs
+ * SIDE AFFECTS: apic_mode set
+ */
+int32_t apic_enable()
+{
+    uint32_t flags;
+    uint32_t irq;
+
+    if (lapic == NULL || lapic_ticks_per_tick == 0)
+        return -1;
+
+    cli_and_save(flags);
+    i8259_mask_all();
+    apic_mode = 1;
+    for (irq = 0; irq < ISA_IRQ_NUM; irq++)
+    {
+        if (irq_enabled(irq))
+            ioapic_unmask(irq);
+    }
+    lapic_timer_start();
+    restore_flags(flags);
+
+    return 0;
+}
+
+/*
+ * apic_disable
+ * DESCRIPTION: stop the LAPIC timer, mask the IOAPIC and give the IRQs enabled by drivers
+ *              and the scheduler tick back to the 8259 and the PIT
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: apic_mode cleared
+ */
+void apic_disable()
+{
+    uint32_t flags;
+    uint32_t irq;
+
+    cli_and_save(flags);
+    if (apic_mode)
+    {
+        lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+        lapic_write(LAPIC_TIMER_INIT, 0);
+        for (irq = 0; irq < ISA_IRQ_NUM; irq++)
+            ioapic_mask(irq);
+        apic_mode = 0;
+        i8259_restore();
+    }
+    restore_flags(flags);
+}
+
+/*
+ * lapic_eoi
+ * DESCRIPTION: acknowledge the interrupt in service, one register write instead of port I/O
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void lapic_eoi()
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+ * lapic_id
+ * DESCRIPTION: get the LAPIC id of the processor running this
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: LAPIC id
+ * SIDE AFFECTS: none
+ */
+uint32_t lapic_id()
+{
+    return lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+}
+
+/*
+ * lapic_init_ap
+ * DESCRIPTION: software enable the LAPIC of an application processor, accept every
+ *              priority and start its timer as the scheduler tick of that processor,
+ *              with the calibration done on the boot processor
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: LAPIC of this processor changed
+ */
+void lapic_init_ap()
+{
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_VEC);
+    lapic_timer_start();
+}
+
+/*
+ * lapic_ipi
+ * DESCRIPTION: send an inter-processor interrupt and wait until it is accepted
+ * INPUT: apic_id -- LAPIC id of the destination
+ *        icr -- delivery mode and vector, low word of the ICR
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 if there is no LAPIC or it is never accepted
+ * SIDE AFFECTS: none
+ */
+int32_t lapic_ipi(uint32_t apic_id, uint32_t icr)
+{
+    uint32_t spin;
+
+    if (lapic == NULL)
+        return -1;
+    lapic_write(LAPIC_ICR_HIGH, apic_id << ICR_DEST_SHIFT);
+    lapic_write(LAPIC_ICR_LOW, icr);
+    for (spin = 0; spin < ICR_SPIN_MAX; spin++)
+    {
+        if (!(lapic_read(LAPIC_ICR_LOW) & ICR_PENDING))
+            return 0;
+        asm volatile ("pause");
+    }
+    return -1;
+}
+
+/*
+ * ioapic_unmask
+ * DESCRIPTION: route an ISA IRQ through the IOAPIC to the boot processor, with the
+ *              polarity and trigger of the MADT overrides. the PIT is left masked,
+ *              the LAPIC timer replaces it, and the cascade IRQ has no meaning here
+ * INPUT: irq -- ISA IRQ number
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: IOAPIC redirection entry changed
+ */
+void ioapic_unmask(uint32_t irq)
+{
+    uint32_t gsi, low;
+
+    if (ioapic == NULL || irq >= ISA_IRQ_NUM || irq == PIT_IRQ || irq == SLAVE_IRQ)
+        return;
+    gsi = madt.irq_gsi[irq] - madt.ioapic_gsi_base;
+    if (gsi >= ioapic_entries)
+        return;
+
+    low = IRQ_VECTOR_BASE + irq;
+    if ((madt.irq_flags[irq] & MADT_POLARITY_MASK) == MADT_POLARITY_LOW)
+        low |= RED_ACTIVE_LOW;
+    if ((madt.irq_flags[irq] & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL)
+        low |= RED_LEVEL;
+    ioapic_write(IOAPIC_REDTBL(gsi) + 1, bsp_apic_id << IOAPIC_DEST_SHIFT);
+    ioapic_write(IOAPIC_REDTBL(gsi), low);
+}
+
+/*
+ * ioapic_mask
+ * DESCRIPTION: stop an ISA IRQ at the IOAPIC
+ * INPUT: irq -- ISA IRQ number
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: IOAPIC redirection entry changed
+ */
+void ioapic_mask(uint32_t irq)
+{
+    uint32_t gsi;
+
+    if (ioapic == NULL || irq >= ISA_IRQ_NUM)
+        return;
+    gsi = madt.irq_gsi[irq] - madt.ioapic_gsi_base;
+    if (gsi >= ioapic_entries)
+        return;
+    ioapic_write(IOAPIC_REDTBL(gsi), RED_MASKED);
+}
+
+/* LAPIC register access */
+static uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg >> 2];
+}
+
+static void lapic_write(uint32_t reg, uint32_t val)
+{
+    lapic[reg >> 2] = val;
+}
+
+/* IOAPIC register access, select then read/write the window */
+static uint32_t ioapic_read(uint32_t reg)
+{
+    ioapic[IOAPIC_REGSEL >> 2] = reg;
+    return ioapic[IOAPIC_WIN >> 2];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t val)
+{
+    ioapic[IOAPIC_REGSEL >> 2] = reg;
+    ioapic[IOAPIC_WIN >> 2] = val;
+}
+
+/*
+ * cpu_has_apic
+ * DESCRIPTION: check CPUID for an on-chip LAPIC
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 1 if there is one, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+static int32_t cpu_has_apic()
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx & CPUID_FEAT_EDX_APIC) != 0;
+}
+
+/*
+ * acpi_map
+ * DESCRIPTION: make a physical range readable at the same virtual address, 4kB pages
+ *              below 4MB and 4MB pages above. acpi_unmap_all removes them
+ * INPUT: phys -- start of the range
+ *        len -- length of the range
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 if it cannot be mapped
+ * SIDE AFFECTS: page directory or page table changed
+ */
+static int32_t acpi_map(uint32_t phys, uint32_t len)
+{
+    uint32_t addr;
+    int32_t ret;
+
+    for (addr = phys & ~(PAGE_4MB_SIZE - 1); addr < phys + len; addr += PAGE_4MB_SIZE)
+    {
+        if (addr == 0)
+        {
+            /* low memory, the video pages are never in ACPI tables or BIOS areas */
+            if (acpi_nlows >= ACPI_MAX_MAPS)
+                return -1;
+            acpi_low_start[acpi_nlows] = phys;
+            acpi_low_end[acpi_nlows] = (phys + len < PAGE_4MB_SIZE) ? phys + len : PAGE_4MB_SIZE;
+            set_low_pages(acpi_low_start[acpi_nlows], acpi_low_end[acpi_nlows], 1);
+            acpi_nlows++;
+            continue;
+        }
+        if ((ret = map_phys_4mb(addr, 0)) < 0)
+            return -1;
+        if (ret == 0)
+        {
+            if (acpi_nmaps >= ACPI_MAX_MAPS)
+            {
+                unmap_phys_4mb(addr);
+                return -1;
+            }
+            acpi_maps[acpi_nmaps++] = addr;
+        }
+    }
+    return 0;
+}
+
+/*
+ * acpi_unmap_all
+ * DESCRIPTION: remove every mapping made by acpi_map
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: page directory and page table changed
+ */
+static void acpi_unmap_all()
+{
+    while (acpi_nmaps > 0)
+        unmap_phys_4mb(acpi_maps[--acpi_nmaps]);
+    while (acpi_nlows > 0)
+    {
+        acpi_nlows--;
+        set_low_pages(acpi_low_start[acpi_nlows], acpi_low_end[acpi_nlows], 0);
+    }
+}
+
+/*
+ * acpi_checksum
+ * DESCRIPTION: check that the bytes of an ACPI structure sum to 0
+ * INPUT: p -- structure
+ *        len -- length
+ * OUTPUT: none
+ * RETURN: 1 if valid, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+static int32_t acpi_checksum(const void* p, uint32_t len)
+{
+    const uint8_t* b = p;
+    uint8_t sum = 0;
+
+    while (len-- > 0)
+        sum += *b++;
+    return sum == 0;
+}
+
+/*
+ * acpi_find_rsdp
+ * DESCRIPTION: search the first 1kB of the EBDA and the BIOS ROM area for the RSDP,
+ *              the areas MUST be mapped by the caller
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: the RSDP, NULL if not found
+ * SIDE AFFECTS: none
+ */
+static rsdp_t* acpi_find_rsdp()
+{
+    uint32_t ebda = (uint32_t)(*(uint16_t*)BDA_EBDA_SEG) << 4;
+    uint32_t addr;
+
+    if (ebda != 0 && ebda < BIOS_ROM_START && acpi_map(ebda, EBDA_SCAN_SIZE) == 0)
+    {
+        for (addr = ebda; addr < ebda + EBDA_SCAN_SIZE; addr += RSDP_ALIGN)
+        {
+            if (strncmp((int8_t*)addr, "RSD PTR ", 8) == 0 && acpi_checksum((void*)addr, RSDP_CHECKSUM_SIZE))
+                return (rsdp_t*)addr;
+        }
+    }
+    for (addr = BIOS_ROM_START; addr < BIOS_ROM_END; addr += RSDP_ALIGN)
+    {
+        if (strncmp((int8_t*)addr, "RSD PTR ", 8) == 0 && acpi_checksum((void*)addr, RSDP_CHECKSUM_SIZE))
+            return (rsdp_t*)addr;
+    }
+    return NULL;
+}
+
+/*
+ * acpi_parse_madt
+ * DESCRIPTION: find the MADT through the RSDP and RSDT, and record the processors,
+ *              the first IOAPIC and the ISA interrupt overrides in madt
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 if there is no valid MADT
+ * SIDE AFFECTS: madt filled in, every mapping made for the tables is removed after
+ */
+static int32_t acpi_parse_madt()
+{
+    rsdp_t* rsdp;
+    acpi_header_t* rsdt;
+    acpi_header_t* h;
+    uint32_t* entries;
+    uint32_t i, n;
+    int32_t ret = -1;
+
+    /* ISA IRQs are identity mapped to GSIs unless overridden */
+    memset(&madt, 0, sizeof(madt));
+    for (i = 0; i < ISA_IRQ_NUM; i++)
+        madt.irq_gsi[i] = i;
+
+    /* the BIOS data area and ROM are not mapped normally */
+    if (acpi_map(0, PAGE_4KB_SIZE) != 0 || acpi_map(BIOS_ROM_START, BIOS_ROM_END - BIOS_ROM_START) != 0)
+        goto done;
+    if ((rsdp = acpi_find_rsdp()) == NULL)
+        goto done;
+
+    rsdt = (acpi_header_t*)rsdp->rsdt_addr;
+    if (acpi_map((uint32_t)rsdt, sizeof(acpi_header_t)) != 0 || acpi_map((uint32_t)rsdt, rsdt->length) != 0 ||
+        strncmp(rsdt->sig, "RSDT", ACPI_SIG_LEN) != 0 || !acpi_checksum(rsdt, rsdt->length))
+        goto done;
+
+    n = (rsdt->length - sizeof(acpi_header_t)) / sizeof(uint32_t);
+    entries = (uint32_t*)(rsdt + 1);
+    for (i = 0; i < n; i++)
+    {
+        h = (acpi_header_t*)entries[i];
+        if (acpi_map((uint32_t)h, sizeof(acpi_header_t)) != 0)
+            continue;
+        if (strncmp(h->sig, "APIC", ACPI_SIG_LEN) != 0 || acpi_map((uint32_t)h, h->length) != 0 ||
+            !acpi_checksum(h, h->length))
+            continue;
+        madt_parse(h);
+        ret = 0;
+        break;
+    }
+
+done:
+    acpi_unmap_all();
+    return ret;
+}
+
+/*
+ * madt_parse
+ * DESCRIPTION: walk the MADT entries
+ * INPUT: h -- MADT, mapped
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: madt filled in
+ */
+static void madt_parse(acpi_header_t* h)
+{
+    uint8_t* p = (uint8_t*)(h + 1);
+    uint8_t* end = (uint8_t*)h + h->length;
+    uint8_t src;
+
+    /* LAPIC address and flags come first */
+    madt.lapic_addr = *(uint32_t*)p;
+    if (madt.lapic_addr == 0)
+        madt.lapic_addr = LAPIC_DEFAULT_ADDR;
+    p += 2 * sizeof(uint32_t);
+
+    /* entries are type, length, data */
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end)
+    {
+        switch (p[0])
+        {
+            case MADT_LAPIC:
+                /* processor id, APIC id, flags */
+                if ((*(uint32_t*)(p + 4) & MADT_LAPIC_ENABLED) && madt.ncpus < MAX_CPUS)
+                    madt.cpu_apic_id[madt.ncpus++] = p[3];
+                break;
+            case MADT_IOAPIC:
+                /* id, reserved, address, GSI base, only the first IOAPIC is used */
+                if (madt.ioapic_addr == 0)
+                {
+                    madt.ioapic_id = p[2];
+                    madt.ioapic_addr = *(uint32_t*)(p + 4);
+                    madt.ioapic_gsi_base = *(uint32_t*)(p + 8);
+                }
+                break;
+            case MADT_ISO:
+                /* bus, source IRQ, GSI, flags */
+                src = p[3];
+                if (src < ISA_IRQ_NUM)
+                {
+                    madt.irq_gsi[src] = *(uint32_t*)(p + 4);
+                    madt.irq_flags[src] = *(uint16_t*)(p + 8);
+                }
+                break;
+            default:
+                break;
+        }
+        p += p[1];
+    }
+}
+
+/*
+ * lapic_calibrate
+ * DESCRIPTION: count LAPIC timer decrements during one scheduler tick, timed by PIT
+ *              channel 2 in one-shot mode and polled, so no interrupt is needed
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: LAPIC timer counts per tick at divide 16, 0 if the timer did not run
+ * SIDE AFFECTS: PIT channel 2 reprogrammed
+ */
+static uint32_t lapic_calibrate()
+{
+    uint32_t count;
+
+    /* start the LAPIC timer masked right after the PIT one-shot */
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+    pit_oneshot_start(PIT_LATCH);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+
+    while (!pit_oneshot_done());
+
+    count = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+    return count;
+}
+
+/*
+ * lapic_timer_start
+ * DESCRIPTION: start the LAPIC timer of this processor, periodic at PIT_FREQ
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void lapic_timer_start()
+{
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_TIMER_PERIODIC | LAPIC_TIMER_VEC);
+    lapic_write(LAPIC_TIMER_INIT, lapic_ticks_per_tick);
+}
@@ -0,0 +1,145 @@
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "types.h"
+#include "x86_desc.h"
+
+/* Reference: https://wiki.osdev.org/APIC, https://wiki.osdev.org/IOAPIC, https://wiki.osdev.org/MADT */
+
+/* set to 0 (-DUSE_APIC=0) to always use the 8259 and the PIT */
+#ifndef USE_APIC
+#define USE_APIC                1
+#endif
+
+#define ISA_IRQ_NUM             16          /* legacy IRQs routed through the IOAPIC            */
+#define IRQ_VECTOR_BASE         0x20        /* IRQ n uses vector 0x20 + n on both controllers   */
+#define LAPIC_TIMER_VEC         0x30        /* scheduler tick from the LAPIC timer              */
+#define IPI_REMAP_VEC           0x31        /* redo the mappings of the process running here    */
+#define SPURIOUS_VEC            0xFF        /* LAPIC spurious interrupt, no EOI                 */
+
+/* ACPI tables */
+#define BDA_EBDA_SEG            0x40E       /* BIOS data area word holding the EBDA segment     */
+#define EBDA_SCAN_SIZE          1024        /* RSDP may be in the first 1kB of the EBDA         */
+#define BIOS_ROM_START          0xE0000     /* or in the BIOS ROM area                          */
+#define BIOS_ROM_END            0x100000
+#define RSDP_ALIGN              16
+#define RSDP_CHECKSUM_SIZE      20          /* ACPI 1.0 part of the RSDP                        */
+#define ACPI_SIG_LEN            4
+
+/* MADT entry types */
+#define MADT_LAPIC              0
+#define MADT_IOAPIC             1
+#define MADT_ISO                2           /* interrupt source override                        */
+#define MADT_LAPIC_ENABLED      0x1
+#define MADT_POLARITY_MASK      0x3
+#define MADT_POLARITY_LOW       0x3
+#define MADT_TRIGGER_MASK       0xC
+#define MADT_TRIGGER_LEVEL      0xC
+
+/* LAPIC registers, offset to the LAPIC base */
+#define LAPIC_DEFAULT_ADDR      0xFEE00000
+#define LAPIC_ID                0x020
+#define LAPIC_TPR               0x080
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+#define LAPIC_LVT_TIMER         0x320
+#define LAPIC_TIMER_INIT        0x380
+#define LAPIC_TIMER_CUR         0x390
+#define LAPIC_TIMER_DIV         0x3E0
+#define LAPIC_ID_SHIFT          24
+#define LAPIC_SVR_ENABLE        0x100
+#define LVT_MASKED              0x10000
+#define LVT_TIMER_PERIODIC      0x20000
+#define LAPIC_TIMER_DIV_16      0x3
+#define ICR_INIT                0x00000500
+#define ICR_STARTUP             0x00000600
+#define ICR_LEVEL_ASSERT        0x00004000
+#define ICR_PENDING             0x00001000  /* delivery status, the IPI is not accepted yet     */
+#define ICR_DEST_SHIFT          24
+
+/* IOAPIC registers */
+#define IOAPIC_REGSEL           0x00
+#define IOAPIC_WIN              0x10
+#define IOAPIC_VER              0x01
+#define IOAPIC_REDTBL(n)        (0x10 + 2 * (n))
+#define IOAPIC_MAX_RED_SHIFT    16
+#define IOAPIC_DEST_SHIFT       24
+#define RED_MASKED              0x10000
+#define RED_LEVEL               0x8000
+#define RED_ACTIVE_LOW          0x2000
+
+/* CPUID */
+#define CPUID_FEAT_EDX_APIC     0x200
+
+/* ACPI table header */
+typedef struct acpi_header_t {
+    int8_t   sig[ACPI_SIG_LEN];
+    uint32_t length;
+    uint8_t  revision;
+    uint8_t  checksum;
+    int8_t   oem_id[6];
+    int8_t   oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+/* root system description pointer, ACPI 1.0 part */
+typedef struct rsdp_t {
+    int8_t   sig[8];
+    uint8_t  checksum;
+    int8_t   oem_id[6];
+    uint8_t  revision;
+    uint32_t rsdt_addr;
+} __attribute__((packed)) rsdp_t;
+
+/* what the kernel keeps from the MADT */
+typedef struct madt_info_t {
+    uint32_t lapic_addr;                    /* physical LAPIC base                      */
+    uint32_t ncpus;                         /* enabled processors                       */
+    uint8_t  cpu_apic_id[MAX_CPUS];         /* LAPIC id of each processor, BSP included */
+    uint32_t ioapic_addr;                   /* physical base of the first IOAPIC, 0 if none */
+    uint32_t ioapic_id;
+    uint32_t ioapic_gsi_base;               /* first GSI of the IOAPIC                  */
+    uint32_t irq_gsi[ISA_IRQ_NUM];          /* GSI of each ISA IRQ                      */
+    uint32_t irq_flags[ISA_IRQ_NUM];        /* polarity and trigger of each ISA IRQ     */
+} madt_info_t;
+
+/* interrupt controller timing, in cycles */
+typedef struct intr_stats_t {
+    uint32_t count;         /* interrupts measured                          */
+    uint32_t eoi_cycles;    /* total cycles from handler entry to after EOI */
+    uint32_t eoi_max;       /* worst handler entry to after EOI             */
+} intr_stats_t;
+
+/* MADT content, valid if madt.lapic_addr is not 0 */
+madt_info_t madt;
+
+/* 1 if IRQs go through the IOAPIC and the LAPIC timer is the scheduler tick, 0 for 8259 and PIT */
+volatile uint32_t apic_mode;
+
+/* LAPIC timer counts in one scheduler tick, 0 until calibrated */
+uint32_t lapic_ticks_per_tick;
+
+/* detect and initialize the LAPIC and IOAPIC, switch to them if found */
+extern int32_t apic_init();
+/* switch IRQs and the scheduler tick back to the 8259 and the PIT */
+extern void apic_disable();
+/* switch IRQs and the scheduler tick to the IOAPIC and the LAPIC timer */
+extern int32_t apic_enable();
+/* acknowledge the current interrupt on the LAPIC */
+extern void lapic_eoi();
+/* id of the LAPIC of this processor */
+extern uint32_t lapic_id();
+/* enable the LAPIC of an application processor and start its scheduler tick */
+extern void lapic_init_ap();
+/* send an inter-processor interrupt, ICR_INIT or ICR_STARTUP | page */
+extern int32_t lapic_ipi(uint32_t apic_id, uint32_t icr);
+/* route an ISA IRQ through the IOAPIC to vector IRQ_VECTOR_BASE + irq */
+extern void ioapic_unmask(uint32_t irq);
+/* stop an ISA IRQ at the IOAPIC */
+extern void ioapic_mask(uint32_t irq);
+
+#endif /* _APIC_H */
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Compare a benchmark run with the stored baseline.
+
+usage: bench_compare.py LOG BASELINE [--tolerance PCT] [--update]
+
+LOG is the serial capture of a "make bench" run, holding the
+"BENCH <name> <value> <unit>" lines of the kernel and of the "bench" user
+program, lower values are better. a benchmark more than PCT percent (default
+10) above its baseline is a regression and the exit status is 1. --update
+stores the run as the new baseline instead.
+"""
+
+import argparse
+import re
+import sys
+
+BENCH_RE = re.compile(r"^BENCH (\w+) (\d+) (\S+)\s*$")
+END_RE = re.compile(r"^BENCH end (\d+)\s*$")
+
+
+def load(path):
+    """{name: (value, unit)} of a log or baseline, and the end status if any."""
+    results, status = {}, None
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.strip("\r\n")
+            m = END_RE.match(line)
+            if m:
+                status = int(m.group(1))
+                continue
+            m = BENCH_RE.match(line)
+            if m:
+                results[m.group(1)] = (int(m.group(2)), m.group(3))
+    return results, status
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log")
+    ap.add_argument("baseline")
+    ap.add_argument("--tolerance", type=float, default=10.0,
+                    help="allowed slowdown in percent")
+    ap.add_argument("--update", action="store_true",
+                    help="store the run as the baseline")
+    args = ap.parse_args()
+
+    run, status = load(args.log)
+    if status is None:
+        sys.exit("%s: the run did not finish" % args.log)
+    if status != 0:
+        sys.exit("%s: the bench program failed with status %d" % (args.log, status))
+    if not run:
+        sys.exit("%s: no results" % args.log)
+
+    if args.update:
+        with open(args.baseline, "w") as f:
+            for name in sorted(run):
+                f.write("BENCH %s %d %s\n" % (name, run[name][0], run[name][1]))
+        print("baseline %s updated, %d benchmarks" % (args.baseline, len(run)))
+        return
+
+    try:
+        base, _ = load(args.baseline)
+    except FileNotFoundError:
+        sys.exit("no baseline %s, store one with \"make bench-baseline\"" % args.baseline)
+
+    failed = 0
+    print("%-16s %12s %12s %8s" % ("benchmark", "baseline", "run", "change"))
+    for name in sorted(base):
+        value, unit = base[name]
+        if name not in run:
+            print("%-16s %12d %12s %8s  MISSING" % (name, value, "-", "-"))
+            failed += 1
+            continue
+        now = run[name][0]
+        change = 100.0 * (now - value) / value if value else 0.0
+        verdict = ""
+        if now > value * (1 + args.tolerance / 100.0):
+            verdict = "  REGRESSION"
+            failed += 1
+        print("%-16s %12d %12d %+7.1f%%%s  %s" % (name, value, now, change, verdict, unit))
+    for name in sorted(set(run) - set(base)):
+        print("%-16s %12s %12d %8s  new" % (name, "-", run[name][0], "-"))
+
+    if failed:
+        sys.exit("%d benchmark(s) regressed by more than %g%%" % (failed, args.tolerance))
+
+
+if __name__ == "__main__":
+    main()
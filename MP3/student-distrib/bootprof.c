@@ -0,0 +1,75 @@
+#include "bootprof.h"
+#include "lib.h"
+#include "klog.h"
+#include "clock.h"
+
+/* markers in boot order, the first is the entry into the C kernel */
+static boot_mark_t boot_marks[BOOT_MAX_MARKS];
+static uint32_t boot_nmarks;
+/* set once the boot has been reported */
+static uint32_t boot_done;
+
+/*
+ * boot_mark
+ * DESCRIPTION: record the end of a boot phase with the TSC
+ * INPUT: name -- phase name, a string literal
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: dropped if BOOT_MAX_MARKS are recorded
+ */
+void boot_mark(const int8_t* name)
+{
+    if (boot_nmarks >= BOOT_MAX_MARKS)
+        return;
+    boot_marks[boot_nmarks].name = name;
+    boot_marks[boot_nmarks].tsc = rdtsc();
+    boot_nmarks++;
+}
+
+/*
+ * boot_prompt
+ * DESCRIPTION: called by every terminal read, the first one is the first prompt of
+ *              the first shell, mark it and report the boot
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void boot_prompt()
+{
+    if (boot_done)
+        return;
+    boot_mark("first prompt");
+    boot_report(0);
+}
+
+/*
+ * boot_report
+ * DESCRIPTION: log each phase with its length and the time since entry, the first
+ *              marker also gives the time from reset to entry (firmware and boot
+ *              loader). only the first call reports
+ * INPUT: bench -- 1 to also print the whole boot as a BENCH line
+ * OUTPUT: BENCH line if bench
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void boot_report(uint32_t bench)
+{
+    uint64_t start;
+    uint32_t i;
+
+    if (boot_done || boot_nmarks == 0)
+        return;
+    boot_done = 1;
+
+    start = boot_marks[0].tsc;
+    klog(KLOG_INFO, "boot: %s at %u us since reset", boot_marks[0].name, clock_cycles_us(start));
+    for (i = 1; i < boot_nmarks; i++)
+    {
+        klog(KLOG_INFO, "boot: %s %u us, at %u us", boot_marks[i].name,
+             clock_cycles_us(boot_marks[i].tsc - boot_marks[i - 1].tsc), clock_cycles_us(boot_marks[i].tsc - start));
+    }
+
+    if (bench)
+        printf("BENCH boot_total %u us\n", clock_cycles_us(boot_marks[boot_nmarks - 1].tsc - start));
+}
@@ -0,0 +1,28 @@
+#ifndef _BOOTPROF_H
+#define _BOOTPROF_H
+
+#include "types.h"
+
+/*
+    boot phase markers, entry() stamps the TSC after each init step and the first
+    terminal read stamps the first prompt. the phases are reported then, in the kernel
+    log (dmesg) and as BENCH lines in benchmark mode, in microseconds once the clock is
+    calibrated
+*/
+
+/* most markers kept, later ones are dropped */
+#define BOOT_MAX_MARKS      40
+
+typedef struct boot_mark_t {
+    const int8_t* name;     /* phase that ended here, a string literal  */
+    uint64_t tsc;
+} boot_mark_t;
+
+/* record the end of a boot phase */
+extern void boot_mark(const int8_t* name);
+/* called by every terminal read, the first one ends the boot and reports it */
+extern void boot_prompt();
+/* log the phases, and print them as BENCH lines if bench */
+extern void boot_report(uint32_t bench);
+
+#endif /* _BOOTPROF_H */
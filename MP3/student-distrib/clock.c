@@ -0,0 +1,227 @@
+#include "clock.h"
+#include "lib.h"
+#include "schedule.h"
+#include "syscall.h"
+#include "smp.h"
+#include "klog.h"
+#include "timer.h"
+
+/* nanoseconds of a scheduler tick, the resolution of the fallback clock and of sleeping */
+#define CLOCK_TICK_NS       (NS_PER_SEC / PIT_FREQ)
+#define CLOCK_CALIB_COUNT   (PIT_MAX_FREQ / MS_PER_SECOND * CLOCK_CALIB_MS)
+
+/* the clock page, a whole page since all of it is visible to user programs */
+static union {
+    clock_page_t clock;
+    uint8_t page[PAGE_4KB_SIZE];
+} clock_mem __attribute__((aligned(PAGE_4KB_SIZE)));
+
+/* (edx:eax) / d, the quotient MUST fit in 32 bits */
+static inline uint32_t div64_32(uint64_t n, uint32_t d) {
+    uint32_t q, r;
+    asm ("divl %4" : "=a"(q), "=d"(r) : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+    return q;
+}
+
+/* (delta * mult) >> shift without losing the high bits, shift at most 32 */
+static inline uint64_t clock_scale(uint64_t delta, uint32_t mult, uint32_t shift) {
+    return (((uint64_t)(uint32_t)delta * mult) >> shift) + (((uint64_t)(uint32_t)(delta >> 32) * mult) << (32 - shift));
+}
+
+static uint32_t clock_calibrate();
+
+/*
+ * clock_init
+ * DESCRIPTION: measure the TSC frequency with PIT channel 2 and fill in the clock page.
+ *              the clock keeps PIT tick resolution if the TSC does not count
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: PIT channel 2 reprogrammed, the clock starts at 0
+ */
+void clock_init()
+{
+    clock_page_t* clk = &clock_mem.clock;
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t khz = clock_calibrate();
+    uint32_t shift = 32;
+
+    clk->seq++;
+    clk->tsc_khz = 0;
+    if (khz != 0)
+    {
+        /* largest shift that keeps mult in 32 bits, 32 above 1GHz */
+        while (shift > 0 && ((uint64_t)NS_PER_MS << shift) >= ((uint64_t)khz << 32))
+            shift--;
+        clk->mult = div64_32((uint64_t)NS_PER_MS << shift, khz);
+        clk->shift = shift;
+        clk->tsc_base = rdtsc();
+        clk->tsc_khz = khz;
+    }
+    clk->seq++;
+
+    if (khz == 0)
+    {
+        klog(KLOG_WARN, "clock: TSC does not count, %u ns resolution", CLOCK_TICK_NS);
+        return;
+    }
+
+    /* the clock is only monotonic across frequency changes with an invariant TSC */
+    eax = CPUID_EXT_MAX;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if (eax >= CPUID_EXT_POWER)
+    {
+        eax = CPUID_EXT_POWER;
+        asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    }
+    else
+        edx = 0;
+    klog(KLOG_INFO, "clock: TSC %u kHz, invariant %u", khz, (edx & CPUID_EDX_INVARIANT_TSC) != 0);
+}
+
+/*
+ * clock_calibrate
+ * DESCRIPTION: count TSC cycles during CLOCK_CALIB_MS one-shots of PIT channel 2,
+ *              polled so no interrupt is needed. the shortest run has the least
+ *              interference (SMIs, emulator exits)
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: TSC frequency in kHz, 0 if the TSC did not count
+ * SIDE AFFECTS: PIT channel 2 reprogrammed
+ */
+static uint32_t clock_calibrate()
+{
+    uint64_t start;
+    uint32_t cycles, best = 0xFFFFFFFF;
+    uint32_t i;
+
+    for (i = 0; i < CLOCK_CALIB_RUNS; i++)
+    {
+        pit_oneshot_start(CLOCK_CALIB_COUNT);
+        start = rdtsc();
+        while (!pit_oneshot_done());
+        cycles = (uint32_t)(rdtsc() - start);
+        if (cycles < best)
+            best = cycles;
+    }
+    if (best == 0)
+        return 0;
+    return div64_32((uint64_t)best * PIT_MAX_FREQ, CLOCK_CALIB_COUNT * MS_PER_SECOND);
+}
+
+/*
+ * clock_ns
+ * DESCRIPTION: read the clock
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: nanoseconds since clock_init
+ * SIDE AFFECTS: none
+ */
+uint64_t clock_ns()
+{
+    clock_page_t* clk = &clock_mem.clock;
+
+    if (clk->tsc_khz == 0)
+        return (uint64_t)pit_ticks * CLOCK_TICK_NS;
+    return clock_scale(rdtsc() - clk->tsc_base, clk->mult, clk->shift);
+}
+
+/*
+ * clock_cycles_us
+ * DESCRIPTION: convert TSC cycles to microseconds with the calibrated frequency
+ * INPUT: cycles -- TSC cycles
+ * OUTPUT: none
+ * RETURN: microseconds, 0 if the TSC is not calibrated, 0xFFFFFFFF if too many
+ * SIDE AFFECTS: none
+ */
+uint32_t clock_cycles_us(uint64_t cycles)
+{
+    clock_page_t* clk = &clock_mem.clock;
+    uint64_t ns;
+
+    if (clk->tsc_khz == 0)
+        return 0;
+    ns = clock_scale(cycles, clk->mult, clk->shift);
+    if ((ns >> 32) >= NS_PER_US)
+        return 0xFFFFFFFF;
+    return div64_32(ns, NS_PER_US);
+}
+
+/*
+ * clock_map
+ * DESCRIPTION: map the clock page read-only at CLOCK_VIRTUAL_ADDR in the process being
+ *              switched in, the caller is in charge of flushing TLB
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: the 140MB page directory entry of this processor made present
+ */
+void clock_map()
+{
+    page_directory[VIDMAP_OFFSET].p           = 1;    // present
+    page_directory[VIDMAP_OFFSET].r_w         = 1;    // enable r/w, each page table entry decides
+    page_directory[VIDMAP_OFFSET].u_s         = 1;    // user mode
+    page_directory[VIDMAP_OFFSET].base_addr   = (unsigned int)vid_page_table >> MEM_OFFSET_BITS;
+    vid_page_table[CLOCK_VID_PT].p = 1;     // present
+    vid_page_table[CLOCK_VID_PT].r_w = 0;   // read only
+    vid_page_table[CLOCK_VID_PT].u_s = 1;   // user mode
+    vid_page_table[CLOCK_VID_PT].base_addr = (uint32_t)clock_mem.page >> MEM_OFFSET_BITS;
+}
+
+/*
+ * gettime
+ * DESCRIPTION: system call gettime, the clock for programs that do not read the clock page
+ * INPUT: ns -- where to output the time, in user space
+ * OUTPUT: nanoseconds since boot
+ * RETURN: 0 for success, -1 for fail
+ * SIDE AFFECTS: none
+ */
+int32_t gettime(uint64_t* ns)
+{
+    if ((uint32_t)ns < ADDR_128MB || (uint32_t)(ns + 1) > ADDR_132MB)
+        return -1;
+
+    *ns = clock_ns();
+    return 0;
+}
+
+/*
+ * nanosleep
+ * DESCRIPTION: system call nanosleep, block on the sleep timer for the whole ticks but
+ *              the last, sleep until the next interrupt through the last, then spin the
+ *              rest with the kernel lock released so the wake up is not rounded to a tick.
+ *              a clock of PIT ticks only blocks
+ * INPUT: ns -- nanoseconds to sleep, in user space
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 for fail
+ * SIDE AFFECTS: none
+ */
+int32_t nanosleep(const uint64_t* ns)
+{
+    uint64_t deadline;
+    int64_t left;
+    uint32_t ticks;
+
+    if ((uint32_t)ns < ADDR_128MB || (uint32_t)(ns + 1) > ADDR_132MB)
+        return -1;
+
+    deadline = clock_ns() + *ns;
+    while ((left = (int64_t)(deadline - clock_ns())) > 0)
+    {
+        /* at most a second at a time keeps the division 32-bit */
+        ticks = (left > NS_PER_SEC) ? PIT_FREQ : (uint32_t)left / CLOCK_TICK_NS;
+        if (clock_mem.clock.tsc_khz == 0)
+            timer_sleep(ticks + 1);
+        else if (ticks >= 2)
+            timer_sleep(ticks - 1);
+        else if (ticks == 1)
+        {
+            cli();
+            kernel_wait();
+            sti();
+        }
+        else
+            kernel_relax();
+    }
+    return 0;
+}
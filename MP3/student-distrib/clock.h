@@ -0,0 +1,54 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include "types.h"
+#include "paging.h"
+
+/*
+    monotonic nanosecond clock from the TSC, calibrated against PIT channel 2 at boot.
+    the conversion is kept in a page mapped read-only at CLOCK_VIRTUAL_ADDR in every
+    process, so user programs read time with rdtsc and no system call
+*/
+
+#define NS_PER_SEC              1000000000
+#define NS_PER_MS               1000000
+#define NS_PER_US               1000
+
+/* calibration, the fewest TSC cycles of CLOCK_CALIB_RUNS one-shots of CLOCK_CALIB_MS each */
+#define CLOCK_CALIB_RUNS        3
+#define CLOCK_CALIB_MS          50          /* at most 54, the PIT count is 16 bits     */
+
+/* last entry of the vid page table, the entries before are left to vidmap and shm */
+#define CLOCK_VID_PT            (NUM_PT_ENTRY - 1)
+#define CLOCK_VIRTUAL_ADDR      (VID_VIRTUAL_ADDR + CLOCK_VID_PT * PAGE_4KB_SIZE)
+
+#define CPUID_EXT_MAX           0x80000000
+#define CPUID_EXT_POWER         0x80000007
+#define CPUID_EDX_INVARIANT_TSC 0x00000100
+
+/*
+    conversion of the clock page, ns = ((tsc - tsc_base) * mult) >> shift. the layout
+    is ece391_clock_t of the user library, keep them the same
+*/
+typedef struct clock_page_t {
+    volatile uint32_t seq;      /* odd while the kernel changes the fields below        */
+    uint32_t tsc_khz;           /* TSC frequency, 0 if the clock runs from PIT ticks    */
+    uint32_t mult;
+    uint32_t shift;
+    uint64_t tsc_base;          /* TSC at clock 0                                       */
+} clock_page_t;
+
+/* calibrate the TSC and start the clock */
+extern void clock_init();
+/* nanoseconds since clock_init */
+extern uint64_t clock_ns();
+/* TSC cycles in microseconds, 0 before clock_init or without a TSC */
+extern uint32_t clock_cycles_us(uint64_t cycles);
+/* map the clock page read-only in the current process' address space */
+extern void clock_map();
+
+/* system calls, the current clock and a sleep of at least *ns nanoseconds */
+extern int32_t gettime(uint64_t* ns);
+extern int32_t nanosleep(const uint64_t* ns);
+
+#endif /* _CLOCK_H */
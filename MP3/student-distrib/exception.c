@@ -1,6 +1,8 @@
 #include "lib.h"
 #include "exception.h"
 #include "syscall.h"
+#include "klog.h"
+#include "fpu.h"
 
 void exc_handler(unsigned int vec);
 
@@ -40,6 +42,9 @@ void exc_handler(unsigned int vec){
     if(vec >= EXC_NUM)
         return;
     cli();
+    /* nests if the exception comes from kernel code */
+    kernel_lock();
+    klog(KLOG_ERR, "exception %d: %s, pid %d", vec, exception_info[vec], curr_pid);
     printf("EXCEPTION %d:\n", vec);
     printf("%s\n", exception_info[vec]);
     /* halt the current program if there is */
@@ -58,7 +63,7 @@ void exc_breakpoint()                {exc_handler(0x03);}
 void exc_overflow()                  {exc_handler(0x04);}
 void exc_bounds()                    {exc_handler(0x05);}
 void exc_invalid_opcode()            {exc_handler(0x06);}
-void exc_coprocessor_not_avaliable() {exc_handler(0x07);}
+void exc_coprocessor_not_avaliable() {if (fpu_handler() != 0) exc_handler(0x07);}
 void exc_double_fault()              {exc_handler(0x08);}
 void exc_coprocessor_segment_fault() {exc_handler(0x09);}
 void exc_invalid_tss()               {exc_handler(0x0A);}
@@ -12,6 +12,7 @@ extern void exc_breakpoint();
 extern void exc_overflow();
 extern void exc_bounds();
 extern void exc_invalid_opcode();
+/* lazy FPU load, returns to the faulting instruction unless it is a real fault */
 extern void exc_coprocessor_not_avaliable();
 extern void exc_double_fault();
 extern void exc_coprocessor_segment_fault();
@@ -26,6 +26,40 @@ void filesys_init(void* filesys){
     cur_dentry_idx = -1;
 }
 
+/*
+ * filesys_check
+ * DESCRIPTION: check that an image is consistent enough for the readers below, the boot
+ *              block counts fit in the image, the dentries name existing inodes and no
+ *              file is longer than an inode can map. data block indices are checked as
+ *              they are read
+ * INPUT: filesys -- the address of the start of the filesystem img
+ *        size -- size of the image in bytes
+ * OUTPUT: none
+ * RETURN: 0 if the image can be used, -1 otherwise
+ * SIDE AFFECTS: none
+ */
+int32_t filesys_check(const void* filesys, uint32_t size){
+    const boot_block_t* boot = filesys;
+    const inode_t* inodes = &((const inode_t*)filesys)[1];
+    uint32_t i;
+    uint32_t blocks = size / BLOCK_SIZE_BYTE;   /* whole blocks in the image */
+
+    if(filesys == NULL || blocks == 0)
+        return -1;
+    /* boot block, then the inodes, then the data blocks */
+    if(boot->dir_num > MAX_DENTRY_NUM || boot->inode_num >= blocks || boot->data_block_num > blocks - 1 - boot->inode_num)
+        return -1;
+    for(i = 0; i < boot->dir_num; i++){
+        if(boot->dentry_arr[i].file_type == FILE_TYPE && boot->dentry_arr[i].inode_idx >= boot->inode_num)
+            return -1;
+    }
+    for(i = 0; i < boot->inode_num; i++){
+        if(inodes[i].file_size > MAX_INODE_DATA_BLOCK_NUM * BLOCK_SIZE_BYTE)
+            return -1;
+    }
+    return 0;
+}
+
 /*
  * read_dentry_by_name
  * DESCRIPTION: Find dentry with the corresponding filename and copy data through input dentry pointer
@@ -104,6 +138,7 @@ int32_t read_dentry_by_index(uint32_t idx, dentry_t* dentry){
  */
 int32_t read_data(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t nbytes){
     int read_bytes;             /* already read bytes                       */
+    int chunk;                  /* bytes copied from the current block      */
     int cur_block_num;          /* number of block that has been read       */
     int cur_block_idx;          /* index of the current read block          */
     int cur_block_offset;       /* byte offset in the current block         */
@@ -113,6 +148,12 @@ int32_t read_data(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t nb
     /* sanity check */
     if(buf == NULL || inode_idx >= boot_block->inode_num)
         return -1;
+    /* nothing to read at or past the end, the block index there may be garbage */
+    if(offset >= cur_inode->file_size)
+        return 0;
+    /* stop at the end of file, before looking at the next block */
+    if(nbytes > cur_inode->file_size - offset)
+        nbytes = cur_inode->file_size - offset;
 
     /* calculate info of current read block */
     cur_block_num = offset/BLOCK_SIZE_BYTE;
@@ -122,8 +163,8 @@ int32_t read_data(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t nb
     cur_block = &(data_block_arr[cur_block_idx]);
     cur_block_offset = offset%BLOCK_SIZE_BYTE;
 
-    /* copy data */
-    for(read_bytes = 0; read_bytes < nbytes; read_bytes++){
+    /* copy data, the rest of a block at a time */
+    for(read_bytes = 0; read_bytes < nbytes; read_bytes += chunk){
         /* if data is in different block, read from different block */
         if(cur_block_offset >= BLOCK_SIZE_BYTE){
             /* calculate info of current read block */
@@ -133,11 +174,12 @@ int32_t read_data(uint32_t inode_idx, uint32_t offset, uint8_t* buf, uint32_t nb
             cur_block = &(data_block_arr[cur_block_idx]);
             cur_block_offset = 0;
         }
-        /* if at the end of file, stop reading */
-        if(offset++ >= cur_inode->file_size)
-            break;
-        /* copy a byte */
-        *(buf++) = cur_block->data[cur_block_offset++];
+        chunk = BLOCK_SIZE_BYTE - cur_block_offset;
+        if(chunk > nbytes - read_bytes)
+            chunk = nbytes - read_bytes;
+        memcpy(buf, &cur_block->data[cur_block_offset], chunk);
+        buf += chunk;
+        cur_block_offset += chunk;
     }
     /* return the number of bytes read */
     return read_bytes;
@@ -213,6 +255,21 @@ int32_t file_write(int32_t fd, void* buf, int32_t nbytes){
     return -1;
 }
 
+/*
+ * file_poll
+ * DESCRIPTION: readiness hook of a file, data in the file system image never blocks
+ * INPUT: fd -- file descriptor. Not used.
+ *        stamp -- filled in with current TSC if not NULL
+ * OUTPUT: none
+ * RETURN: 1, always ready
+ * SIDE AFFECTS: none
+ */
+int32_t file_poll(int32_t fd, uint32_t* stamp){
+    if(stamp != NULL)
+        *stamp = (uint32_t)rdtsc();
+    return 1;
+}
+
 
 /*
  * dir_open
@@ -290,6 +347,21 @@ int32_t dir_write(int32_t fd, void* buf, int32_t nbytes){
     return -1;
 }
 
+/*
+ * dir_poll
+ * DESCRIPTION: readiness hook of a directory, reading a directory never blocks
+ * INPUT: fd -- file descriptor. Not used.
+ *        stamp -- filled in with current TSC if not NULL
+ * OUTPUT: none
+ * RETURN: 1, always ready
+ * SIDE AFFECTS: none
+ */
+int32_t dir_poll(int32_t fd, uint32_t* stamp){
+    if(stamp != NULL)
+        *stamp = (uint32_t)rdtsc();
+    return 1;
+}
+
 /*
  * get_file_size
  * DESCRIPTION: Get the file size in byte of the given dentry.
@@ -10,11 +10,14 @@
 #define MAX_DENTRY_NUM              (BLOCK_SIZE_BYTE-64)/64
 #define MAX_INODE_DATA_BLOCK_NUM    (BLOCK_SIZE_BYTE-4)/4
 
-#define FILE_TYPE_NUM   4
+#define FILE_TYPE_NUM   7
 #define RTC_TYPE        0
 #define DIR_TYPE        1
 #define FILE_TYPE       2
 #define STD_TYPE        3
+#define KLOG_TYPE       4   /* kernel log device, not in the file system image */
+#define PROF_TYPE       5   /* profiler samples, not in the file system image   */
+#define TRACE_TYPE      6   /* event trace, not in the file system image        */
 
 typedef struct dentry_t{
     char        file_name[MAX_FILE_NAME_LEN];
@@ -42,6 +45,8 @@ typedef struct data_block_t{
 
 /* initialize the file system */
 extern void filesys_init(void* filesys);
+/* check that an image of size bytes is consistent, 0 if it is */
+extern int32_t filesys_check(const void* filesys, uint32_t size);
 /* read dentry with the corresponding filename */
 extern int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
 /* read entry with the corresponding index in boot block */
@@ -57,6 +62,8 @@ extern int32_t file_close(int32_t fd);
 extern int32_t file_read(int32_t fd, void* buf, int32_t nbytes);
 /* Write bytes into the current opened file. Not used. */
 extern int32_t file_write(int32_t fd, void* buf, int32_t nbytes);
+/* Readiness of a file, always ready. */
+extern int32_t file_poll(int32_t fd, uint32_t* stamp);
 
 /* Open a directory. Initialize the global index of dentry. */
 extern int32_t dir_open(const char* filename);
@@ -66,6 +73,8 @@ extern int32_t dir_close(int32_t fd);
 extern int32_t dir_read(int32_t fd, void* buf, int32_t nbytes);
 /* Not used. */
 extern int32_t dir_write(int32_t fd, void* buf, int32_t nbytes);
+/* Readiness of a directory, always ready. */
+extern int32_t dir_poll(int32_t fd, uint32_t* stamp);
 
 /* Get the file size in byte of the given dentry. */
 extern uint32_t get_file_size(dentry_t* dentry);
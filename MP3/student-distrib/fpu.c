@@ -0,0 +1,219 @@
+#include "fpu.h"
+#include "lib.h"
+#include "smp.h"
+#include "syscall.h"
+#include "klog.h"
+
+/* state after fninit with the default MXCSR, loaded on the first FPU use of a process */
+static uint8_t fpu_clean[FXSAVE_SIZE] __attribute__((aligned(FXSAVE_ALIGN)));
+
+static inline uint32_t read_cr0(void) {
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+/* set CR0.TS, the next FPU instruction traps */
+static inline void stts(void) {
+    asm volatile ("movl %%cr0, %%eax; orl %0, %%eax; movl %%eax, %%cr0"
+            :
+            : "i"(CR0_TS)
+            : "eax"
+    );
+}
+
+static inline void clts(void) {
+    asm volatile ("clts");
+}
+
+static inline void fxsave(uint8_t* area) {
+    asm volatile ("fxsave (%0)" : : "r"(area) : "memory");
+}
+
+static inline void fxrstor(uint8_t* area) {
+    asm volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+}
+
+/*
+ * fpu_init
+ * DESCRIPTION: enable the FPU and SSE on this processor. CR0.TS is left set so
+ *              the first use of each process traps to fpu_handler
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 if the processor has no FXSAVE (FPU use is not switched)
+ * SIDE AFFECTS: CR0 and CR4 changed, fpu_mode and fpu_sse2 set by the boot processor
+ */
+int32_t fpu_init()
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if (!(edx & CPUID_FEAT_EDX_FXSR))
+    {
+        fpu_mode = 0;
+        klog(KLOG_WARN, "fpu: no fxsave, fpu state not switched");
+        return -1;
+    }
+
+    /* FPU present, WAIT and native errors, then FXSAVE and SSE exceptions */
+    asm volatile ("                         \n\
+        movl    %%cr0, %%eax                \n\
+        andl    %0, %%eax                   \n\
+        orl     %1, %%eax                   \n\
+        movl    %%eax, %%cr0                \n\
+        movl    %%cr4, %%eax                \n\
+        orl     %2, %%eax                   \n\
+        movl    %%eax, %%cr4                \n\
+        fninit                              \n\
+        "
+        :
+        : "i"(~(CR0_EM | CR0_TS)), "i"(CR0_MP | CR0_NE), "i"(CR4_OSFXSR | CR4_OSXMMEXCPT)
+        : "eax"
+    );
+
+    /* the clean image is the same on every processor, the boot processor takes it */
+    if (this_cpu()->id == 0)
+    {
+        fxsave(fpu_clean);
+        fpu_mode = 1;
+        fpu_sse2 = (edx & CPUID_FEAT_EDX_SSE2) != 0;
+        klog(KLOG_INFO, "fpu: lazy switching on, sse2 %u", fpu_sse2);
+    }
+
+    this_cpu()->fpu_owner = -1;
+    stts();
+    return 0;
+}
+
+/*
+ * fpu_handler
+ * DESCRIPTION: device not available (vector 7), the current process used the FPU
+ *              for the first time since it was switched in. its state is loaded
+ *              unless this processor's registers still hold it
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 0 if the instruction can be restarted, -1 if it is a real fault
+ * SIDE AFFECTS: CR0.TS cleared
+ */
+int32_t fpu_handler()
+{
+    cpu_t* cpu = this_cpu();
+    fpu_state_t* st;
+    uint32_t start = (uint32_t)rdtsc();
+
+    /* the kernel only uses the FPU between kernel_fpu_begin and kernel_fpu_end */
+    if (!fpu_mode || curr_pid == -1 || !(read_cr0() & CR0_TS))
+        return -1;
+
+    clts();
+    st = &get_pcb_ptr(curr_pid)->fpu;
+    /* the previous owner was saved when it was switched out, nothing to save here */
+    if (cpu->fpu_owner != curr_pid || st->cpu != cpu->id)
+    {
+        fxrstor(st->used ? st->fxsave : fpu_clean);
+        st->used = 1;
+        st->cpu = cpu->id;
+        cpu->fpu_owner = curr_pid;
+    }
+
+    cpu->fpu_traps++;
+    cpu->fpu_trap_cycles += (uint32_t)rdtsc() - start;
+    return 0;
+}
+
+/*
+ * fpu_switch_out
+ * DESCRIPTION: the context running on this processor is being switched out. if it
+ *              used the FPU since it was switched in (CR0.TS clear), its state is
+ *              saved now, so it can be loaded on any processor later
+ * INPUT: st -- state of the process, NULL for the idle loop
+ * OUTPUT: none
+ * RETURN: 1 if the state was saved, 0 otherwise
+ * SIDE AFFECTS: CR0.TS set
+ */
+uint32_t fpu_switch_out(fpu_state_t* st)
+{
+    if (!fpu_mode || (read_cr0() & CR0_TS))
+        return 0;
+
+    if (st != NULL)
+        fxsave(st->fxsave);
+    stts();
+    return st != NULL;
+}
+
+/*
+ * fpu_state_init
+ * DESCRIPTION: reset the FPU state of a new process, it is loaded from the clean
+ *              image on first use
+ * INPUT: st -- state in the new pcb
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void fpu_state_init(fpu_state_t* st)
+{
+    st->used = 0;
+    st->cpu = NO_CPU;
+}
+
+/*
+ * fpu_drop
+ * DESCRIPTION: a process halts on this processor, its state in the registers is not
+ *              saved and the registers are no longer its
+ * INPUT: pid -- the halting process
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: CR0.TS set
+ */
+void fpu_drop(uint32_t pid)
+{
+    cpu_t* cpu = this_cpu();
+
+    if (!fpu_mode)
+        return;
+    if (cpu->fpu_owner == pid)
+        cpu->fpu_owner = -1;
+    stts();
+}
+
+/*
+ * kernel_fpu_begin
+ * DESCRIPTION: let the kernel use the FPU and SSE registers until kernel_fpu_end.
+ *              interrupts are off in between so no switch or other kernel user
+ *              comes in, keep the section short
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: flags to give to kernel_fpu_end
+ * SIDE AFFECTS: CR0.TS cleared, the registers are no longer the current process'
+ */
+uint32_t kernel_fpu_begin()
+{
+    cpu_t* cpu;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    cpu = this_cpu();
+    if (read_cr0() & CR0_TS)
+        clts();
+    else if (curr_pid != -1 && cpu->fpu_owner == curr_pid)
+        /* the process used the FPU in this run, its registers are live */
+        fxsave(get_pcb_ptr(curr_pid)->fpu.fxsave);
+    cpu->fpu_owner = -1;
+    return flags;
+}
+
+/*
+ * kernel_fpu_end
+ * DESCRIPTION: end a kernel_fpu_begin section, the next FPU use of the process traps
+ *              and loads its state back
+ * INPUT: flags -- returned by kernel_fpu_begin
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: CR0.TS set
+ */
+void kernel_fpu_end(uint32_t flags)
+{
+    stts();
+    restore_flags(flags);
+}
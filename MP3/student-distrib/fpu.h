@@ -0,0 +1,59 @@
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "types.h"
+
+/* Reference: https://wiki.osdev.org/FPU and https://wiki.osdev.org/SSE */
+
+#define FXSAVE_SIZE             512         /* size of an FXSAVE area       */
+#define FXSAVE_ALIGN            16          /* FXSAVE needs 16 byte aligned */
+
+#define CR0_MP                  0x00000002  /* WAIT traps on TS too         */
+#define CR0_EM                  0x00000004  /* no FPU, emulate              */
+#define CR0_TS                  0x00000008  /* task switched, FPU use traps */
+#define CR0_NE                  0x00000020  /* native FPU error reporting   */
+#define CR4_OSFXSR              0x00000200  /* FXSAVE/FXRSTOR and SSE       */
+#define CR4_OSXMMEXCPT          0x00000400  /* SIMD exceptions on vector 19 */
+
+#define CPUID_FEAT_EDX_FXSR     0x01000000
+#define CPUID_FEAT_EDX_SSE      0x02000000
+#define CPUID_FEAT_EDX_SSE2     0x04000000
+
+/* fpu_state_t.cpu of a state that is in no processor's registers */
+#define NO_CPU                  ((uint32_t)-1)
+
+/*
+    FPU/SSE state of a process, kept in its pcb. the registers are loaded only
+    when the process uses the FPU after a switch (vector 7 with CR0.TS set),
+    and saved on switch out only if it used them during that run
+*/
+typedef struct fpu_state_t {
+    uint8_t fxsave[FXSAVE_SIZE] __attribute__((aligned(FXSAVE_ALIGN)));
+    uint32_t used;      /* 1 once the process touched the FPU, fxsave is valid      */
+    uint32_t cpu;       /* processor whose registers were last loaded from fxsave   */
+} fpu_state_t;
+
+/* 1 if FXSAVE is available and lazy switching is on */
+uint32_t fpu_mode;
+/* 1 if SSE2 can be used by the kernel between kernel_fpu_begin and kernel_fpu_end */
+uint32_t fpu_sse2;
+
+/* enable the FPU and SSE on this processor, with CR0.TS set */
+extern int32_t fpu_init();
+/* vector 7, load the current process' state, returns -1 if it is a real fault */
+extern int32_t fpu_handler();
+/* a process' context is being switched out, save its state if it used the FPU */
+extern uint32_t fpu_switch_out(fpu_state_t* st);
+/* a new process starts with a clean state */
+extern void fpu_state_init(fpu_state_t* st);
+/* a process ends, its state in the registers is dropped */
+extern void fpu_drop(uint32_t pid);
+/*
+ * the kernel may use SSE between these two, with interrupts off. the state of the
+ * current process is saved first if it is in the registers, and loaded again on
+ * its next FPU use. returns the flags for kernel_fpu_end
+ */
+extern uint32_t kernel_fpu_begin();
+extern void kernel_fpu_end(uint32_t flags);
+
+#endif /* _FPU_H */
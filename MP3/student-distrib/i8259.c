@@ -4,6 +4,7 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "apic.h"
 
 /* Reference: https://wiki.osdev.org/PIC & Lectures*/
 
@@ -11,6 +12,9 @@
 uint8_t master_mask; /* IRQs 0-7  */
 uint8_t slave_mask;  /* IRQs 8-15 */
 
+/* IRQs enabled by drivers, bit n for IRQ n, kept whichever controller is used */
+static uint16_t irq_enabled_mask = 0;
+
 /*
  * i8259_init
  * DECRIPTION: Initialize the 8259 PIC. Notice It cannot implement the function of reset.
@@ -59,6 +63,13 @@ void enable_irq(uint32_t irq_num) {
     /* range judge. If it is out of range, immediately return*/
     if (irq_num > MAX_IRQ_NUM || irq_num <0)
         return;
+    irq_enabled_mask |= 1 << irq_num;
+    /* the 8259 stays masked while the IOAPIC is used */
+    if (apic_mode)
+    {
+        ioapic_unmask(irq_num);
+        return;
+    }
     /* check whether it is master IRQ_num, i.e. 0-7*/
     if (irq_num < MAX_MASTER_IRQ_NUM)
     {
@@ -87,6 +98,12 @@ void disable_irq(uint32_t irq_num) {
     /* range judge. If it is out of range, immediately return*/
     if (irq_num > MAX_IRQ_NUM || irq_num < 0)
         return;
+    irq_enabled_mask &= ~(1 << irq_num);
+    if (apic_mode)
+    {
+        ioapic_mask(irq_num);
+        return;
+    }
     /* check whether it is master IRQ_num, i.e. 0-7*/
     if (irq_num < MAX_MASTER_IRQ_NUM)
     {
@@ -115,6 +132,12 @@ void send_eoi(uint32_t irq_num) {
     /* range judge. If it is out of range, immediately return*/
     if (irq_num > MAX_IRQ_NUM || irq_num < 0)
         return;
+    /* the LAPIC takes one EOI for whatever is in service */
+    if (apic_mode)
+    {
+        lapic_eoi();
+        return;
+    }
     /* check whether it is master IRQ_num, i.e. 0-7*/
     if (irq_num < MAX_MASTER_IRQ_NUM)
     {
@@ -126,3 +149,49 @@ void send_eoi(uint32_t irq_num) {
     outb(EOI | (irq_num - MAX_MASTER_IRQ_NUM), SLAVE_8259_PORT);
     outb(EOI | SLAVE_PORT, MASTER_8259_PORT);
 }
+
+/*
+ * irq_enabled
+ * DESCRIPTION: check whether a driver enabled an IRQ, whichever controller is used
+ * INPUT: irq_num: the number of irq
+ * OUTPUT: none
+ * RETURN: 1 if enabled, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+uint32_t irq_enabled(uint32_t irq_num) {
+    if (irq_num > MAX_IRQ_NUM)
+        return 0;
+    return (irq_enabled_mask >> irq_num) & 1;
+}
+
+/*
+ * i8259_mask_all
+ * DESCRIPTION: mask every IRQ on the PICs without forgetting which are enabled,
+ *              used when the IOAPIC takes over
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: modify the status of PICs
+ */
+void i8259_mask_all(void) {
+    master_mask = INIT_MASK;
+    slave_mask = INIT_MASK;
+    outb(master_mask, MASTER_8259_DATA);
+    outb(slave_mask, SLAVE_8259_DATA);
+}
+
+/*
+ * i8259_restore
+ * DESCRIPTION: unmask the IRQs enabled by drivers on the PICs, used when the
+ *              IOAPIC gives them back
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: modify the status of PICs
+ */
+void i8259_restore(void) {
+    master_mask = ~(irq_enabled_mask & INIT_MASK);
+    slave_mask = ~(irq_enabled_mask >> MAX_MASTER_IRQ_NUM);
+    outb(master_mask, MASTER_8259_DATA);
+    outb(slave_mask, SLAVE_8259_DATA);
+}
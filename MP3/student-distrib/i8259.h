@@ -49,5 +49,11 @@ void enable_irq(uint32_t irq_num);
 void disable_irq(uint32_t irq_num);
 /* Send end-of-interrupt signal for the specified IRQ */
 void send_eoi(uint32_t irq_num);
+/* Check whether a driver enabled the specified IRQ */
+uint32_t irq_enabled(uint32_t irq_num);
+/* Mask every IRQ, the enabled IRQs are remembered */
+void i8259_mask_all(void);
+/* Unmask the IRQs enabled by drivers */
+void i8259_restore(void);
 
 #endif /* _I8259_H */
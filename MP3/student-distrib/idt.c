@@ -3,6 +3,7 @@
 #include "idt.h"
 #include "exception.h"
 #include "interrupt_linkage.h"
+#include "apic.h"
 
 // just for check point 3.1
 void system_call();
@@ -11,8 +12,14 @@ void system_call();
  * idt_init
  *   DESCRIPTION: Initialize IDT (interrupt descriptor table)
  *                0x00-0x13 are exceptions
+ *                0x20 PIT interrupt
  *                0x21 keyboard interrupt
+ *                0x24 serial (COM1) interrupt
  *                0x28 RTC interrupt
+ *                0x20-0x2F are the same IRQs when routed by the IOAPIC
+ *                0x30 LAPIC timer interrupt
+ *                0x31 remap IPI
+ *                0xFF LAPIC spurious interrupt
  *                0x80 reserved for system call
  *   INPUTS: none
  *   OUTPUTS: none
@@ -28,7 +35,7 @@ void idt_init(){
     set_intr_gate(0x04, exc_overflow);
     set_intr_gate(0x05, exc_bounds);
     set_intr_gate(0x06, exc_invalid_opcode);
-    set_intr_gate(0x07, exc_coprocessor_not_avaliable);
+    set_intr_gate(0x07, int_coprocessor);
     set_intr_gate(0x08, exc_double_fault);
     set_intr_gate(0x09, exc_coprocessor_segment_fault);
     set_intr_gate(0x0A, exc_invalid_tss);
@@ -44,7 +51,11 @@ void idt_init(){
     // Interrupt
     set_intr_gate(0x20, int_pit);
     set_intr_gate(0x21, int_keyboard);
+    set_intr_gate(0x24, int_serial);
     set_intr_gate(0x28, int_rtc);
+    set_intr_gate(LAPIC_TIMER_VEC, int_apic_timer);
+    set_intr_gate(IPI_REMAP_VEC, int_ipi_remap);
+    set_intr_gate(SPURIOUS_VEC, int_spurious);
     // System Call
     set_trap_gate(0x80, system_call);
     return;
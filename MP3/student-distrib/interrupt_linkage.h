@@ -1,13 +1,52 @@
 #ifndef _INTERRUPT_LINKAGE_H
 #define _INTERRUPT_LINKAGE_H
+
+/* line passed to irq_enter/irq_exit by each linkage, the LAPIC timer has none */
+#define LINKAGE_IRQ_PIT         0
+#define LINKAGE_IRQ_KEYBOARD    1
+#define LINKAGE_IRQ_SERIAL      4
+#define LINKAGE_IRQ_RTC         8
+#define LINKAGE_IRQ_LAPIC_TIMER 16
+
 #ifndef ASM
 
+#include "types.h"
+
+/* registers saved by the linkage (pushall), then the frame pushed by the processor */
+typedef struct irq_frame_t {
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t ebp;
+    uint32_t eax;
+    uint32_t ds;
+    uint32_t es;
+    uint32_t fs;
+    uint32_t eip;           /* interrupted instruction                              */
+    uint32_t cs;            /* its privilege level in the low 2 bits                */
+    uint32_t eflags;
+    uint32_t esp;           /* user stack, only if the interrupt came from user mode */
+    uint32_t ss;
+} irq_frame_t;
+
 /* RTC interrupt linkage code */
 extern void int_rtc();
 /* keyboard interrupt linkage code */
 extern void int_keyboard();
 /* PIT interrupt linkage code */
 extern void int_pit();
+/* serial (COM1) interrupt linkage code */
+extern void int_serial();
+/* LAPIC timer interrupt linkage code */
+extern void int_apic_timer();
+/* device not available (vector 7) linkage code */
+extern void int_coprocessor();
+/* LAPIC spurious interrupt linkage code */
+extern void int_spurious();
+/* remap IPI linkage code */
+extern void int_ipi_remap();
 
 #endif
 #endif
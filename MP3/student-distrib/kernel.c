@@ -16,6 +16,20 @@
 #include "syscall.h"
 #include "terminal.h"
 #include "schedule.h"
+#include "shm.h"
+#include "serial.h"
+#include "klog.h"
+#include "apic.h"
+#include "smp.h"
+#include "fpu.h"
+#include "softirq.h"
+#include "kheap.h"
+#include "clock.h"
+#include "trace.h"
+#include "timer.h"
+#include "vbe.h"
+#include "bootprof.h"
+#include "uheap.h"
 
 /* If it is set to 1, run test for CP1&2 (but tests may not be compatible with the code after CP3) */
 #define RUN_TESTS   0
@@ -30,8 +44,16 @@ void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
 
-    /* start addr of the file system image */
+    /* start addr and size of the file system image */
     uint32_t filesys_start_addr;
+    uint32_t filesys_size = 0;
+    /* end of the boot modules, the kernel heap starts above */
+    uint32_t boot_mem_end = 0;
+    /* end of physical memory, 0 if the boot loader did not tell */
+    uint32_t mem_end = 0;
+
+    /* boot phases are stamped from here, reported at the first prompt */
+    boot_mark("entry");
 
     /* Clear the screen. */
     clear();
@@ -49,8 +71,11 @@ void entry(unsigned long magic, unsigned long addr) {
     printf("flags = 0x%#x\n", (unsigned)mbi->flags);
 
     /* Are mem_* valid? */
-    if (CHECK_FLAG(mbi->flags, 0))
+    if (CHECK_FLAG(mbi->flags, 0)) {
         printf("mem_lower = %uKB, mem_upper = %uKB\n", (unsigned)mbi->mem_lower, (unsigned)mbi->mem_upper);
+        /* upper memory starts at 1MB */
+        mem_end = (1024 + mbi->mem_upper) * 1024;
+    }
 
     /* Is boot_device valid? */
     if (CHECK_FLAG(mbi->flags, 1))
@@ -66,6 +91,7 @@ void entry(unsigned long magic, unsigned long addr) {
         module_t* mod = (module_t*)mbi->mods_addr;
         /* get the start of the filesys */
         filesys_start_addr = mod->mod_start;
+        filesys_size = mod->mod_end - mod->mod_start;
 
         while (mod_count < mbi->mods_count) {
             printf("Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
@@ -75,6 +101,8 @@ void entry(unsigned long magic, unsigned long addr) {
                 printf("0x%x ", *((char*)(mod->mod_start+i)));
             }
             printf("\n");
+            if (mod->mod_end > boot_mem_end)
+                boot_mem_end = mod->mod_end;
             mod_count++;
             mod++;
         }
@@ -110,6 +138,8 @@ void entry(unsigned long magic, unsigned long addr) {
                     (unsigned)mmap->length_low);
     }
 
+    boot_mark("multiboot info");
+
     /* Construct an LDT entry in the GDT */
     {
         seg_desc_t the_ldt_desc;
@@ -127,9 +157,10 @@ void entry(unsigned long magic, unsigned long addr) {
         lldt(KERNEL_LDT);
     }
 
-    /* Construct a TSS entry in the GDT */
+    /* Construct a TSS entry in the GDT for each processor */
     {
         seg_desc_t the_tss_desc;
+        int i;
         the_tss_desc.granularity   = 0x0;
         the_tss_desc.opsize        = 0x0;
         the_tss_desc.reserved      = 0x0;
@@ -141,44 +172,101 @@ void entry(unsigned long magic, unsigned long addr) {
         the_tss_desc.type          = 0x9;
         the_tss_desc.seg_lim_15_00 = TSS_SIZE & 0x0000FFFF;
 
-        SET_TSS_PARAMS(the_tss_desc, &tss, tss_size);
+        for (i = 0; i < MAX_CPUS; i++) {
+            SET_TSS_PARAMS(the_tss_desc, &tss[i], tss_size);
 
-        tss_desc_ptr = the_tss_desc;
+            tss_desc_ptr[i] = the_tss_desc;
 
-        tss.ldt_segment_selector = KERNEL_LDT;
-        tss.ss0 = KERNEL_DS;
-        tss.esp0 = 0x800000;
+            tss[i].ldt_segment_selector = KERNEL_LDT;
+            tss[i].ss0 = KERNEL_DS;
+        }
+        /* the boot processor, APs get their esp0 in smp_init */
+        tss[0].esp0 = 0x800000;
         ltr(KERNEL_TSS);
     }
+    boot_mark("descriptors");
 
     /* prevent scheduling when first shell has not been executed */
     curr_pid = -1;
 
+    /* boot runs in the kernel like any other entry, execute releases the lock on the first iret */
+    kernel_lock();
+
+    /* init kernel log first, every handler may log */
+    klog_init();
+    boot_mark("klog");
     /* init IDT */
     idt_init();
+    boot_mark("idt");
+    /* enable the FPU and SSE, their state is switched lazily */
+    fpu_init();
+    boot_mark("fpu");
     /* init paging */
     paging_init();
+    boot_mark("paging");
+    /* give the rest of the kernel page to the heap */
+    kheap_init(boot_mem_end);
+    boot_mark("kheap");
+    /* init shared memory segments */
+    shm_init();
+    boot_mark("shm");
+    /* init bottom halves before any handler raises them */
+    softirq_init();
+    boot_mark("softirq");
     /* Init the PIC */
     i8259_init();
+    boot_mark("pic");
+    /* switch to the IOAPIC and LAPIC timer if the MADT has them, IRQs enabled below follow */
+    apic_init();
+    boot_mark("apic");
+    /* find the Bochs VBE display, vidmap_ex switches it to graphics */
+    vbe_init(mem_end);
+    boot_mark("vbe");
+    /* user heaps above the back buffer */
+    uheap_init(mem_end);
+    boot_mark("uheap");
 
     /* Initialize devices, memory, filesystem, enable device interrupts on the
      * PIC, any other initialization stuff... */
 
     /* init RTC */
     rtc_init();
+    boot_mark("rtc");
     /* init keyboard */
     keyboard_init();
+    boot_mark("keyboard");
     /* init PIT */
     pit_init();
+    boot_mark("pit");
+    /* kernel timers, driven by the PIT tick */
+    timer_init();
+    boot_mark("timers");
+    /* calibrate the TSC against the PIT, the nanosecond clock starts here */
+    clock_init();
+    boot_mark("clock");
+    /* init serial port, kernel printf is mirrored to COM1 from here on */
+    serial_init();
+    boot_mark("serial");
+    /* start the other processors, they take ticks once interrupts are enabled */
+    smp_init();
+    boot_mark("smp");
+    /* a trace ring for every processor that came up */
+    trace_init();
+    boot_mark("trace");
 
     /* init file system */
+    if (filesys_check((void*)filesys_start_addr, filesys_size) != 0)
+        klog(KLOG_WARN, "file system image is inconsistent");
     filesys_init((void*)filesys_start_addr);
+    boot_mark("filesys");
 
     /* init file operation table */
     file_op_table_init();
+    boot_mark("file ops");
 
     /* init multi-terminals */
     terminal_init();
+    boot_mark("terminals");
 
     /* Enable interrupts */
     /* Do not enable the following until after you have set up your
@@ -189,11 +277,16 @@ void entry(unsigned long magic, unsigned long addr) {
 
     /* clear the screen */
     clear();
+    boot_mark("interrupts on");
 
 #if RUN_TESTS
     /* Run tests */
     launch_tests();
 #else
+#if RUN_BENCH
+    /* kernel benchmarks, the first terminal runs the user ones */
+    launch_bench();
+#endif
     /* launch the first terminal */
     if(launch_first_terminal() == -1)
         printf("\n fail to launch first terminal.\n");
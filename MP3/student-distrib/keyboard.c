@@ -3,12 +3,36 @@
 #include "i8259.h"
 #include "terminal.h"
 #include "syscall.h"
+#include "serial.h"
+#include "klog.h"
+#include "smp.h"
+#include "softirq.h"
+#include "kheap.h"
 
 static unsigned char caps_state = 0;
 static unsigned char shift_state = 0;
 static unsigned char ctrl_state = 0;
 static unsigned char alt_state = 0;
 
+/* 
+    scancode ring between the IRQ handler (single producer, only moves kbd_head)
+    and the line discipline (single consumer, only moves kbd_tail, never runs concurrently)
+*/
+static kbd_event_t kbd_ring[KBD_RING_SIZE];
+static volatile uint32_t kbd_head = 0;
+static volatile uint32_t kbd_tail = 0;
+
+/* keyboard timing statistics */
+static kbd_stats_t kbd_stats;
+
+static int32_t ldisc_accept(unsigned char scancode);
+static int32_t ldisc_queues(unsigned char scancode);
+static int32_t ldisc_command_waits();
+static void ldisc_input(unsigned char scancode, uint32_t tsc);
+static void ldisc_queue(terminal_t* term, uint8_t c, uint32_t tsc);
+static void echo_key(terminal_t* term, uint8_t key, uint32_t tsc);
+static uint32_t avg64(uint64_t sum, uint32_t count);
+
 // array for basic key inputs
 unsigned char key_table[4][KEY_NUM] = {
 	// default
@@ -41,35 +65,147 @@ unsigned char key_table[4][KEY_NUM] = {
 *	effects:	enables line for keyboard on the master PIC
 */
 void keyboard_init(){
+    softirq_register(SOFTIRQ_TTY, keyboard_process);
     enable_irq(KEYBOARD_IRQ);
 }
 
 /*
 *	keyboard_handler
-*	Description: If a valid key is pressed, the function echo it onto screen (foreground terminal regardless of scheduler).
+*	Description: Read the scancode and put it in the scancode ring, the line discipline
+*	             handles it later in the TTY softirq (keyboard_process).
 *	inputs:	 nothing
 *	outputs: nothing
-*	side effects: echo current pressed key to screen
+*	side effects: scancode queued, dropped if the ring is full
 */
 void keyboard_handler(){
-    unsigned char scancode = 0;     /* scanned code */
-    int i;                          /* loop index for tab */
+    uint32_t start = (uint32_t)rdtsc();     /* TSC at entry, also the keypress time */
+    uint32_t head = kbd_head;               /* producer index                       */
+    uint32_t cycles;                        /* cycles spent in the handler          */
+    unsigned char scancode;                 /* scanned code                         */
 
     /* enable pic interrupt */
     send_eoi(KEYBOARD_IRQ);
 
-    /* get current foreground terminal and its buffer */
-    terminal_t* curr_term = &terminals[curr_term_id];
-    volatile uint8_t* read_buffer = curr_term->term_buf;
+    /* the controller raises the IRQ once a scancode is ready, read it once */
+    scancode = inb(KEYBOARD_PORT);
 
-    /* wait for interrupt */
-    while(1){
-        if (inb(KEYBOARD_PORT)){
-            scancode = inb(KEYBOARD_PORT);
-            break;
+    if (head - kbd_tail < KBD_RING_SIZE){
+        kbd_ring[head & KBD_RING_MASK].scancode = scancode;
+        kbd_ring[head & KBD_RING_MASK].tsc = start;
+        /* publish the entry only after it is written */
+        asm volatile ("" : : : "memory");
+        kbd_head = head + 1;
+    }
+    else{
+        kbd_stats.dropped++;
+        klog(KLOG_WARN, "kbd: ring full, scancode %x dropped", scancode);
+    }
+    softirq_raise(SOFTIRQ_TTY);
+
+    klog(KLOG_DEBUG, "kbd: scancode %x", scancode);
+
+    cycles = (uint32_t)rdtsc() - start;
+    kbd_stats.irq_count++;
+    kbd_stats.irq_cycles += cycles;
+    if (cycles > kbd_stats.irq_max)
+        kbd_stats.irq_max = cycles;
+}
+
+/*
+*	keyboard_process
+*	Description: Consumer of the scancode ring, run the line discipline for every queued scancode.
+*	             Called by terminal read/poll with IF = 0 and as the TTY softirq, never
+*	             concurrently with itself.
+*	inputs:	 nothing
+*	outputs: nothing
+*	side effects: keys echoed, lines queued, terminal may be switched
+*/
+void keyboard_process(){
+    kbd_event_t ev;     /* current scancode */
+
+    while (kbd_tail != kbd_head){
+        ev = kbd_ring[kbd_tail & KBD_RING_MASK];
+        /* input that does not fit in the input queue waits for the reader, nothing is lost,
+           unless a modifier, ALT+Fn or CTRL key is behind it, then it is dropped */
+        if (ldisc_queues(ev.scancode) && !ldisc_accept(ev.scancode)){
+            if (!ldisc_command_waits())
+                break;
+            kbd_stats.dropped++;
+            kbd_tail++;
+            continue;
         }
+        /* consume before handling, a terminal switch may execute a shell and come back much later */
+        kbd_tail++;
+        ldisc_input(ev.scancode, ev.tsc);
+    }
+}
+
+/*
+*	keyboard_stats
+*	Description: Print IRQ handler cost and keystroke-to-echo latency to the screen (CTRL+T).
+*	inputs:	 nothing
+*	outputs: nothing
+*	side effects: none
+*/
+void keyboard_stats(){
+    printf("\nkbd irq: %u, avg %u cycles, max %u cycles, dropped %u\n", kbd_stats.irq_count,
+           kbd_stats.irq_count ? kbd_stats.irq_cycles / kbd_stats.irq_count : 0, kbd_stats.irq_max, kbd_stats.dropped);
+    printf("kbd echo: %u, avg %u cycles, max %u cycles\n", kbd_stats.echo_count,
+           avg64(kbd_stats.echo_cycles, kbd_stats.echo_count), kbd_stats.echo_max);
+}
+
+/*
+*	ldisc_accept
+*	Description: Check whether the foreground terminal's input queue has room for what a scancode may queue.
+*	inputs:	 a scancode from keyboard.
+*	outputs: 1 if it can be handled now, 0 otherwise
+*	side effects: none
+*/
+static int32_t ldisc_accept(unsigned char scancode){
+    return tty_room(&terminals[curr_term_id], (scancode == ENTER) ? '\n' : '\0');
+}
+
+/*
+*	ldisc_queues
+*	Description: Check whether a scancode would queue input to the foreground terminal with
+*	             the current modifiers, modifiers, releases and CTRL keys do not.
+*	inputs:	 a scancode from keyboard.
+*	outputs: 1 if it queues input, 0 otherwise
+*	side effects: none
+*/
+static int32_t ldisc_queues(unsigned char scancode){
+    if (scancode == ENTER || scancode == BACKSPACE || scancode == TAB)
+        return 1;
+    if (scancode >= KEY_NUM || ctrl_state)
+        return 0;
+    return key_table[0][scancode] != '\0';
+}
+
+/*
+*	ldisc_command_waits
+*	Description: Check whether a scancode that queues no input is in the ring behind the first one.
+*	inputs:	 nothing
+*	outputs: 1 if there is one, 0 otherwise
+*	side effects: none
+*/
+static int32_t ldisc_command_waits(){
+    uint32_t i;
+
+    for (i = kbd_tail + 1; i != kbd_head; i++){
+        if (!ldisc_queues(kbd_ring[i & KBD_RING_MASK].scancode))
+            return 1;
     }
+    return 0;
+}
 
+/*
+*	ldisc_input
+*	Description: Handle a scancode for the foreground terminal regardless of scheduler.
+*	inputs:	 a scancode from keyboard, and the TSC when it is pressed
+*	outputs: nothing
+*	side effects: keys echoed, lines queued
+*/
+static void ldisc_input(unsigned char scancode, uint32_t tsc){
     switch (scancode){
         case CAPS_LOCK:
             caps_state = ~caps_state;
@@ -98,58 +234,45 @@ void keyboard_handler(){
         case ALT_UP:
             alt_state = 0;
             break;
+        case PAGE_UP:
+            /* show the previous page of the scrollback, keep one row of context */
+            scroll_view(NUM_ROWS - 1);
+            break;
+        case PAGE_DOWN:
+            scroll_view(-(NUM_ROWS - 1));
+            break;
         case ENTER:
-            read_buffer[curr_term->term_buf_offset] = '\n';
-            curr_term->term_buf_offset += 1;
-            /* if enter is pressed, set flag is_enter to tell the foreground terminal ready to read */
-            terminals[curr_term_id].is_enter = 1;
-            newline();
+            tty_input(&terminals[curr_term_id], '\n', tsc);
             break;
         case BACKSPACE:
-            /* handle backspace */
-            if (curr_term->term_buf_offset>0){
-                curr_term->term_buf_offset -= 1;
-                read_buffer[curr_term->term_buf_offset] = '\0';
-                delc();
-            }
+            tty_input(&terminals[curr_term_id], '\b', tsc);
             break;
         case TAB:
-            /* one table is equal to 4 space */
-            for (i=0; i<4; i++){
-                read_buffer[curr_term->term_buf_offset] = ' ';
-                curr_term->term_buf_offset += 1;
-                putc(' '); 
-            }
+            tty_input(&terminals[curr_term_id], '\t', tsc);
             break;
         default:
             /* print scancode */
-            print_key(scancode);
+            print_key(scancode, tsc);
             break;
     }
 }
 
 /*
 *	print_key
-*	Description: If a valid scancode needs to be printed, show it to screen (foreground terminal regardless of scheduler).
-*	inputs:	 a scancode from keyboard.
+*	Description: If a valid scancode needs to be printed, hand its key to the foreground terminal
+*	             (regardless of scheduler).
+*	inputs:	 a scancode from keyboard, and the TSC when it is pressed
 *	outputs: nothing
 *	side effects: echo character corresponds to scancode to screen.
 */
-void print_key(unsigned char scancode){
+void print_key(unsigned char scancode, uint32_t tsc){
     unsigned char key;  /* corresponding key value */
-    
-    /* get current foreground terminal and its buffer */
-    terminal_t* curr_term = &terminals[curr_term_id];
-    volatile uint8_t* read_buffer = curr_term->term_buf;
 
     /* for alt+Fkeys, switch the terminal */
     if(alt_state){
-        if (scancode == F1)
-            terminal_switch(0);
-        else if (scancode == F2)
-            terminal_switch(1);
-        else if (scancode == F3)
-            terminal_switch(2);
+        /* F1 to F10 scancodes are consecutive */
+        if (scancode >= F1 && scancode < F1 + TERMINAL_NUM)
+            terminal_switch(scancode - F1);
     }
 
     /* select different key modes based on shift and cpas state */
@@ -179,38 +302,159 @@ void print_key(unsigned char scancode){
             update_cursor(0,0);
             return;
         }
+        /* for ctrl+T, report keyboard timing */
+        else if (key == 't' || key == 'T'){
+            keyboard_stats();
+            return;
+        }
+        /* for ctrl+P, report the load of each processor */
+        else if (key == 'p' || key == 'P'){
+            smp_stats();
+            return;
+        }
+        /* for ctrl+K, report the kernel heap */
+        else if (key == 'k' || key == 'K'){
+            kheap_stats();
+            return;
+        }
         else if (key == 'c')
             return;
     }
     /* print the correct key to the foreground */
-    else if (curr_term->term_buf_offset < READ_BUFFER_SIZE){
-        read_buffer[curr_term->term_buf_offset] = key;
-        curr_term->term_buf_offset += 1;
-        putc(key);
-    }
+    else
+        tty_input(&terminals[curr_term_id], key, tsc);
     return;
 }
 
 /*
-*	clr_read_buffer
-*	Description: Clear current running process' terminal's buffer and reset its pointer.
-*	inputs:	 nothing
+*	tty_room
+*	Description: Check whether a terminal's input queue has room for what a char may queue.
+*	inputs:	 term -- terminal, c -- char from the keyboard or serial line
+*	outputs: 1 if it can be handled now, 0 otherwise
+*	side effects: none
+*/
+int32_t tty_room(terminal_t* term, uint8_t c){
+    uint32_t need;
+
+    if (term->mode & TTY_ICANON)
+        need = (c == '\n') ? term->term_buf_offset + 1 : 0;
+    else
+        need = 1;
+    return TERMINAL_QUEUE_SIZE - (term->in_head - term->in_tail) >= need;
+}
+
+/*
+*	tty_input
+*	Description: Line discipline, edit the line or queue the char according to the terminal's mode,
+*	             tty_room has made sure there is room.
+*	inputs:	 term -- terminal, c -- char, '\n' ends a line and '\b' erases, tsc -- TSC when it arrives
 *	outputs: nothing
-*	side effects: the read buffer is resetted.
+*	side effects: keys echoed, lines queued
 */
-void clr_read_buffer(){
-    int i;                                                      /* loop index for clearing read buffer          */
-    int curr_process_term_id = get_pcb_ptr(curr_pid)->term_id;  /* current running process' terminal id         */
-    terminal_t* curr_term = &terminals[curr_process_term_id];   /* current running process' terminal pointer    */
-    volatile uint8_t* read_buffer = curr_term->term_buf;        /* current running process' terminal buffer     */
-
-    /* clear the buffer */
-    for (i=0; i<READ_BUFFER_SIZE; i++)
-        read_buffer[i] = 0;
-    curr_term->term_buf_offset = 0;
-
-    /* clear is_ready, clear is_enter flag */
-    terminals[curr_process_term_id].is_enter = 0;
-    return;
+void tty_input(terminal_t* term, uint8_t c, uint32_t tsc){
+    int i;  /* loop index for tab and line */
+
+    /* in raw mode, the key goes to the reader at once */
+    if (!(term->mode & TTY_ICANON)){
+        ldisc_queue(term, c, tsc);
+        echo_key(term, (c == '\t') ? ' ' : c, tsc);
+        return;
+    }
+
+    switch (c){
+        case '\n':
+            /* move the whole line to the input queue, tell the terminal a line is ready to read */
+            for (i = 0; i < term->term_buf_offset; i++)
+                ldisc_queue(term, term->term_buf[i], tsc);
+            ldisc_queue(term, '\n', tsc);
+            term->term_buf_offset = 0;
+            echo_key(term, '\n', tsc);
+            break;
+        case '\b':
+            /* handle backspace */
+            if (term->term_buf_offset > 0){
+                term->term_buf_offset -= 1;
+                echo_key(term, '\b', tsc);
+            }
+            break;
+        case '\t':
+            /* one table is equal to 4 space, as long as the line has room */
+            for (i = 0; i < TAB_SPACES && term->term_buf_offset < READ_BUFFER_SIZE; i++){
+                term->term_buf[term->term_buf_offset] = ' ';
+                term->term_buf_offset += 1;
+                echo_key(term, ' ', tsc);
+            }
+            break;
+        default:
+            if (term->term_buf_offset < READ_BUFFER_SIZE){
+                term->term_buf[term->term_buf_offset] = c;
+                term->term_buf_offset += 1;
+                echo_key(term, c, tsc);
+            }
+            break;
+    }
+}
+
+/*
+*	ldisc_queue
+*	Description: Append a char to a terminal's input queue, tty_room has made sure there is room.
+*	inputs:	 term -- terminal, c -- char, tsc -- TSC of the keypress
+*	outputs: nothing
+*	side effects: input queue changed, line count and ready time updated
+*/
+static void ldisc_queue(terminal_t* term, uint8_t c, uint32_t tsc){
+    uint32_t flags;
+
+    spin_lock_irqsave(&term->in_lock, flags);
+    term->in_buf[term->in_head & TERMINAL_QUEUE_MASK] = c;
+    term->in_head++;
+    if (c == '\n')
+        term->lines++;
+    /* the input becomes readable by this key */
+    if (c == '\n' || !(term->mode & TTY_ICANON))
+        term->enter_tsc = tsc;
+    spin_unlock_irqrestore(&term->in_lock, flags);
 }
 
+/*
+*	echo_key
+*	Description: Echo a key on the terminal's screen and on the serial line if it is the serial
+*	             console, when the terminal echoes, and record the latency from the keypress.
+*	inputs:	 term -- terminal, key -- char to echo, '\b' erases, tsc -- TSC of the keypress
+*	outputs: nothing
+*	side effects: screen changed
+*/
+static void echo_key(terminal_t* term, uint8_t key, uint32_t tsc){
+    uint32_t latency;
+
+    if (!(term->mode & TTY_ECHO))
+        return;
+    console_echo(&term->con, key);
+    if (term->mode & TTY_SERIAL){
+        if (key == '\b')
+            serial_write((uint8_t*)"\b \b", 3);
+        else
+            serial_putc(key);
+    }
+
+    latency = (uint32_t)rdtsc() - tsc;
+    kbd_stats.echo_count++;
+    kbd_stats.echo_cycles += latency;
+    if (latency > kbd_stats.echo_max)
+        kbd_stats.echo_max = latency;
+}
+
+/*
+*	avg64
+*	Description: Average of a 64-bit sum without 64-bit division, which the kernel has no support for.
+*	inputs:	 sum, count
+*	outputs: sum / count, precise to 1024 if the sum needs more than 32 bits
+*	side effects: none
+*/
+static uint32_t avg64(uint64_t sum, uint32_t count){
+    if (count == 0)
+        return 0;
+    if ((sum >> 32) == 0)
+        return (uint32_t)sum / count;
+    return ((uint32_t)(sum >> 10) / count) << 10;
+}
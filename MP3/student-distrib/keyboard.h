@@ -1,10 +1,15 @@
 #ifndef _KEYBOARD_H
 #define _KEYBOARD_H
 
+#include "types.h"
+
 #define KEY_NUM             60
 #define KEYBOARD_PORT       0x60
 #define KEYBOARD_IRQ        1
 #define READ_BUFFER_SIZE    127
+#define KBD_RING_SIZE       256     /* scancodes buffered for the line discipline, power of 2 */
+#define KBD_RING_MASK       (KBD_RING_SIZE - 1)
+#define TAB_SPACES          4
 #define BACKSPACE	        0x0E
 #define TAB			        0x0F
 #define ENTER		        0x1C
@@ -20,15 +25,42 @@
 #define F1          		0x3B
 #define F2          		0x3C
 #define F3          		0x3D
+#define PAGE_UP             0x49
+#define PAGE_DOWN           0x51
+
+/* scancode ring entry */
+typedef struct kbd_event_t {
+    uint8_t scancode;       /* scancode read by the IRQ handler */
+    uint32_t tsc;           /* low 32 bits of TSC at the IRQ    */
+} kbd_event_t;
+
+/* keyboard timing statistics, in cycles */
+typedef struct kbd_stats_t {
+    uint32_t irq_count;     /* keyboard interrupts                  */
+    uint32_t irq_cycles;    /* total cycles in the IRQ handler      */
+    uint32_t irq_max;       /* worst IRQ handler cycles             */
+    uint32_t echo_count;    /* keys echoed                          */
+    uint64_t echo_cycles;   /* total keypress to echo cycles        */
+    uint32_t echo_max;      /* worst keypress to echo cycles        */
+    uint32_t dropped;       /* scancodes lost to a full ring/queue  */
+} kbd_stats_t;
 
 /* init the keyboard by enabling the corresponding irq line */
 extern void keyboard_init();
 /* keyboard interrupt handler */
 extern void keyboard_handler();
-/* echo a pressed key to screen */
-extern void print_key(unsigned char scancode);
-/* clear the keyboard read buffer */
-extern void clr_read_buffer();
+/* run the line discipline for queued scancodes */
+extern void keyboard_process();
+/* print keyboard timing statistics */
+extern void keyboard_stats();
+/* add a pressed key to the line and echo it to screen */
+extern void print_key(unsigned char scancode, uint32_t tsc);
+
+struct terminal_t;
+/* check whether a terminal can take a char from the keyboard or serial line now */
+extern int32_t tty_room(struct terminal_t* term, uint8_t c);
+/* line discipline, edit the line or queue a char of a terminal */
+extern void tty_input(struct terminal_t* term, uint8_t c, uint32_t tsc);
 
 
 #endif
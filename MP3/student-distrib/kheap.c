@@ -0,0 +1,491 @@
+#include "kheap.h"
+#include "lib.h"
+#include "syscall.h"
+#include "klog.h"
+#include "spinlock.h"
+
+/* the kernel image and stacks share the 4MB page at PAGE_4MB_SIZE */
+#define KPAGE_BASE          PAGE_4MB_SIZE
+#define KHEAP_END           (KS_BASE_ADDR - KS_SIZE * NUM_PROCESS)
+#define FRAME_IDX(addr)     (((uint32_t)(addr) - KPAGE_BASE) >> MEM_OFFSET_BITS)
+#define FRAME_ADDR(idx)     (KPAGE_BASE + ((idx) << MEM_OFFSET_BITS))
+#define FRAME_MASK          (PAGE_4KB_SIZE - 1)
+#define BITS_PER_WORD       32
+
+/* end of the kernel image, from the linker */
+extern uint8_t _end[];
+
+/* 1 bit per frame of the kernel page, frames outside the heap stay used */
+static uint32_t frame_map[KHEAP_MAX_FRAMES / BITS_PER_WORD];
+/* length of a kmalloc allocation of whole frames, at its first frame */
+static uint16_t frame_run[KHEAP_MAX_FRAMES];
+/* frame range of the heap */
+static uint32_t heap_first, heap_last;
+static uint32_t frames_free;
+/* frame map lock, a cache's lock is taken first when a slab needs a frame */
+static spinlock_t frame_lock = SPINLOCK_INIT;
+
+/* all caches, then the kmalloc caches among them */
+static kmem_cache_t kmem_caches[KMEM_MAX_CACHES];
+static uint32_t kmem_ncaches = 0;
+static kmem_cache_t* kmalloc_caches[KMALLOC_CLASSES];
+
+static inline uint32_t frame_used(uint32_t idx) {
+    return (frame_map[idx / BITS_PER_WORD] >> (idx % BITS_PER_WORD)) & 1;
+}
+
+static inline void frame_set(uint32_t idx, uint32_t used) {
+    if (used)
+        frame_map[idx / BITS_PER_WORD] |= 1 << (idx % BITS_PER_WORD);
+    else
+        frame_map[idx / BITS_PER_WORD] &= ~(1 << (idx % BITS_PER_WORD));
+}
+
+static slab_t** slab_list(kmem_cache_t* cache, slab_t* slab);
+static void slab_unlink(slab_t** list, slab_t* slab);
+static void slab_push(slab_t** list, slab_t* slab);
+
+/*
+ * kheap_init
+ * DESCRIPTION: give the frames from start, or the end of the kernel image if it is
+ *              higher, up to the lowest kernel stack to the heap, and create the
+ *              kmalloc caches
+ * INPUT: start -- first free address after the boot modules
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void kheap_init(uint32_t start)
+{
+    char name[KMEM_NAME_LEN];
+    uint32_t i;
+
+    if (start < (uint32_t)_end)
+        start = (uint32_t)_end;
+    start = (start + FRAME_MASK) & ~FRAME_MASK;
+
+    for (i = 0; i < KHEAP_MAX_FRAMES / BITS_PER_WORD; i++)
+        frame_map[i] = ~0;
+    heap_first = FRAME_IDX(start);
+    heap_last = FRAME_IDX(KHEAP_END);
+    frames_free = 0;
+    for (i = heap_first; i < heap_last; i++)
+    {
+        frame_set(i, 0);
+        frames_free++;
+    }
+
+    for (i = 0; i < KMALLOC_CLASSES; i++)
+    {
+        strcpy((int8_t*)name, (int8_t*)"kmalloc-");
+        itoa(1 << (KMALLOC_MIN_SHIFT + i), (int8_t*)name + strlen((int8_t*)name), 10);
+        kmalloc_caches[i] = kmem_cache_create(name, 1 << (KMALLOC_MIN_SHIFT + i), 0);
+    }
+    klog(KLOG_INFO, "kheap: %u frames from %x", frames_free, start);
+}
+
+/*
+ * frame_alloc
+ * DESCRIPTION: take the first run of n free frames
+ * INPUT: n -- number of frames
+ * OUTPUT: none
+ * RETURN: address of the first frame, NULL if there is no such run
+ * SIDE AFFECTS: none
+ */
+void* frame_alloc(uint32_t n)
+{
+    uint32_t flags;
+    uint32_t i, run = 0;
+
+    if (n == 0)
+        return NULL;
+
+    spin_lock_irqsave(&frame_lock, flags);
+    for (i = heap_first; i < heap_last; i++)
+    {
+        run = frame_used(i) ? 0 : run + 1;
+        if (run == n)
+            break;
+    }
+    if (run != n)
+    {
+        spin_unlock_irqrestore(&frame_lock, flags);
+        return NULL;
+    }
+    for (i = i + 1 - n, run = 0; run < n; run++)
+        frame_set(i + run, 1);
+    frames_free -= n;
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return (void*)FRAME_ADDR(i);
+}
+
+/*
+ * frame_free
+ * DESCRIPTION: give back n frames from frame_alloc
+ * INPUT: addr -- first frame
+ *        n -- number of frames
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void frame_free(void* addr, uint32_t n)
+{
+    uint32_t idx = FRAME_IDX(addr);
+    uint32_t flags;
+    uint32_t i;
+
+    if (((uint32_t)addr & FRAME_MASK) || idx < heap_first || idx + n > heap_last)
+        return;
+
+    spin_lock_irqsave(&frame_lock, flags);
+    for (i = idx; i < idx + n; i++)
+    {
+        if (frame_used(i))
+        {
+            frame_set(i, 0);
+            frames_free++;
+        }
+    }
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+/*
+ * frame_free_count
+ * DESCRIPTION: number of free frames
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: free frames
+ * SIDE AFFECTS: none
+ */
+uint32_t frame_free_count()
+{
+    return frames_free;
+}
+
+/*
+ * frame_largest_run
+ * DESCRIPTION: longest run of free frames, frames_free minus it is a measure of
+ *              external fragmentation
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: frames in the longest run
+ * SIDE AFFECTS: none
+ */
+uint32_t frame_largest_run()
+{
+    uint32_t i, run = 0, best = 0;
+
+    for (i = heap_first; i < heap_last; i++)
+    {
+        run = frame_used(i) ? 0 : run + 1;
+        if (run > best)
+            best = run;
+    }
+    return best;
+}
+
+/*
+ * kmem_cache_create
+ * DESCRIPTION: create a cache of objects of one size, its slabs are single frames
+ * INPUT: name -- name shown by kheap_stats
+ *        size -- object size
+ *        align -- object alignment, a power of two, 0 for KMEM_MIN_ALIGN
+ * OUTPUT: none
+ * RETURN: the cache, NULL if there are too many or the object does not fit a frame
+ * SIDE AFFECTS: none
+ */
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, uint32_t align)
+{
+    kmem_cache_t* cache;
+
+    if (align < KMEM_MIN_ALIGN)
+        align = KMEM_MIN_ALIGN;
+    /* a free object holds the free list link */
+    if (size < sizeof(void*))
+        size = sizeof(void*);
+    if (kmem_ncaches >= KMEM_MAX_CACHES)
+        return NULL;
+
+    cache = &kmem_caches[kmem_ncaches];
+    cache->obj_size = (size + align - 1) & ~(align - 1);
+    cache->first = (sizeof(slab_t) + align - 1) & ~(align - 1);
+    if (cache->first + cache->obj_size > PAGE_4KB_SIZE)
+        return NULL;
+    cache->per_slab = (PAGE_4KB_SIZE - cache->first) / cache->obj_size;
+    strncpy((int8_t*)cache->name, (int8_t*)name, KMEM_NAME_LEN - 1);
+    cache->name[KMEM_NAME_LEN - 1] = '\0';
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty = NULL;
+    cache->nempty = 0;
+    cache->allocs = 0;
+    cache->frees = 0;
+    cache->failures = 0;
+    cache->active = 0;
+    cache->max_active = 0;
+    cache->slabs = 0;
+    spin_init(&cache->lock);
+    kmem_ncaches++;
+    return cache;
+}
+
+/*
+ * slab_new
+ * DESCRIPTION: take a frame for a new slab of a cache and thread its objects on the
+ *              free list, in address order
+ * INPUT: cache -- the cache
+ * OUTPUT: none
+ * RETURN: the slab, on the empty list, NULL if there is no free frame
+ * SIDE AFFECTS: none
+ */
+static slab_t* slab_new(kmem_cache_t* cache)
+{
+    slab_t* slab = (slab_t*)frame_alloc(1);
+    uint8_t* obj;
+    uint32_t i;
+
+    if (slab == NULL)
+        return NULL;
+
+    slab->cache = cache;
+    slab->inuse = 0;
+    obj = (uint8_t*)slab + cache->first;
+    slab->free = obj;
+    for (i = 0; i + 1 < cache->per_slab; i++, obj += cache->obj_size)
+        *(void**)obj = obj + cache->obj_size;
+    *(void**)obj = NULL;
+
+    slab_push(&cache->empty, slab);
+    cache->nempty++;
+    cache->slabs++;
+    return slab;
+}
+
+/*
+ * kmem_cache_alloc
+ * DESCRIPTION: take an object, from a partly used slab first to keep slabs full
+ * INPUT: cache -- the cache
+ * OUTPUT: none
+ * RETURN: the object, not cleared, NULL if there is no memory
+ * SIDE AFFECTS: none
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache)
+{
+    slab_t* slab;
+    void* obj;
+    uint32_t flags;
+
+    if (cache == NULL)
+        return NULL;
+
+    spin_lock_irqsave(&cache->lock, flags);
+    if ((slab = cache->partial) == NULL && (slab = cache->empty) == NULL && (slab = slab_new(cache)) == NULL)
+    {
+        cache->failures++;
+        spin_unlock_irqrestore(&cache->lock, flags);
+        return NULL;
+    }
+
+    slab_unlink(slab_list(cache, slab), slab);
+    if (slab->inuse == 0)
+        cache->nempty--;
+    obj = slab->free;
+    slab->free = *(void**)obj;
+    slab->inuse++;
+    slab_push(slab_list(cache, slab), slab);
+
+    cache->allocs++;
+    if (++cache->active > cache->max_active)
+        cache->max_active = cache->active;
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return obj;
+}
+
+/*
+ * kmem_cache_free
+ * DESCRIPTION: give an object back to its slab, a slab left empty goes back to the
+ *              frames unless the cache keeps fewer than KMEM_KEEP_EMPTY empty slabs
+ * INPUT: cache -- the cache
+ *        obj -- object from kmem_cache_alloc on this cache
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj)
+{
+    slab_t* slab = (slab_t*)((uint32_t)obj & ~FRAME_MASK);
+    uint32_t flags;
+
+    if (obj == NULL)
+        return;
+    if (slab->cache != cache)
+    {
+        klog(KLOG_WARN, "kheap: %x freed to the wrong cache %s", obj, cache->name);
+        return;
+    }
+
+    spin_lock_irqsave(&cache->lock, flags);
+    slab_unlink(slab_list(cache, slab), slab);
+    *(void**)obj = slab->free;
+    slab->free = obj;
+    slab->inuse--;
+    cache->frees++;
+    cache->active--;
+
+    if (slab->inuse == 0 && cache->nempty >= KMEM_KEEP_EMPTY)
+    {
+        cache->slabs--;
+        slab->cache = NULL;
+        frame_free(slab, 1);
+    }
+    else
+    {
+        if (slab->inuse == 0)
+            cache->nempty++;
+        slab_push(slab_list(cache, slab), slab);
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * kmalloc
+ * DESCRIPTION: allocate from the smallest kmalloc cache that fits, or whole frames
+ *              above KMALLOC_MAX
+ * INPUT: size -- bytes needed
+ * OUTPUT: none
+ * RETURN: the memory, 8 byte aligned (page aligned above KMALLOC_MAX), NULL if there is none
+ * SIDE AFFECTS: none
+ */
+void* kmalloc(uint32_t size)
+{
+    uint32_t shift = KMALLOC_MIN_SHIFT;
+    uint32_t n;
+    void* ptr;
+
+    if (size == 0)
+        return NULL;
+
+    if (size <= KMALLOC_MAX)
+    {
+        while ((1U << shift) < size)
+            shift++;
+        return kmem_cache_alloc(kmalloc_caches[shift - KMALLOC_MIN_SHIFT]);
+    }
+
+    n = (size + FRAME_MASK) >> MEM_OFFSET_BITS;
+    if ((ptr = frame_alloc(n)) != NULL)
+        frame_run[FRAME_IDX(ptr)] = n;
+    return ptr;
+}
+
+/*
+ * kfree
+ * DESCRIPTION: free memory from kmalloc, page aligned pointers are frame runs, the
+ *              others are objects whose slab header is at the start of their frame
+ * INPUT: ptr -- memory from kmalloc, or NULL
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void kfree(void* ptr)
+{
+    uint32_t idx;
+
+    if (ptr == NULL)
+        return;
+
+    if (((uint32_t)ptr & FRAME_MASK) == 0)
+    {
+        idx = FRAME_IDX(ptr);
+        if (idx < KHEAP_MAX_FRAMES && frame_run[idx] != 0)
+        {
+            frame_free(ptr, frame_run[idx]);
+            frame_run[idx] = 0;
+        }
+        return;
+    }
+    kmem_cache_free(((slab_t*)((uint32_t)ptr & ~FRAME_MASK))->cache, ptr);
+}
+
+/*
+ * kheap_stats
+ * DESCRIPTION: print the frame usage, and for each cache its objects in use, frames,
+ *              the share of those frames holding live objects and its call counts
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void kheap_stats()
+{
+    kmem_cache_t* cache;
+    uint32_t i;
+
+    printf("\nheap: %u/%u frames free, largest run %u\n", frames_free, heap_last - heap_first,
+           frame_largest_run());
+    for (i = 0; i < kmem_ncaches; i++)
+    {
+        cache = &kmem_caches[i];
+        if (cache->allocs == 0)
+            continue;
+        printf("%s: %u/%u objs, %u slabs, %u%% used, %u allocs, %u frees, %u failed\n",
+               cache->name, cache->active, cache->max_active, cache->slabs,
+               cache->slabs ? cache->active * cache->obj_size * 100 / (cache->slabs * PAGE_4KB_SIZE) : 0,
+               cache->allocs, cache->frees, cache->failures);
+    }
+}
+
+/*
+ * slab_list
+ * DESCRIPTION: list a slab belongs on, from its use
+ * INPUT: cache -- its cache
+ *        slab -- the slab
+ * OUTPUT: none
+ * RETURN: pointer to the head of the list
+ * SIDE AFFECTS: none
+ */
+static slab_t** slab_list(kmem_cache_t* cache, slab_t* slab)
+{
+    if (slab->inuse == 0)
+        return &cache->empty;
+    if (slab->free == NULL)
+        return &cache->full;
+    return &cache->partial;
+}
+
+/*
+ * slab_unlink
+ * DESCRIPTION: remove a slab from a list
+ * INPUT: list -- head of the list
+ *        slab -- a slab on it
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void slab_unlink(slab_t** list, slab_t* slab)
+{
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        *list = slab->next;
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+}
+
+/*
+ * slab_push
+ * DESCRIPTION: put a slab at the head of a list
+ * INPUT: list -- head of the list
+ *        slab -- a slab on no list
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void slab_push(slab_t** list, slab_t* slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL)
+        (*list)->prev = slab;
+    *list = slab;
+}
@@ -0,0 +1,76 @@
+#ifndef _KHEAP_H
+#define _KHEAP_H
+
+#include "types.h"
+#include "paging.h"
+#include "spinlock.h"
+
+/*
+    kernel heap, the free part of the kernel 4MB page between the kernel image (and
+    the boot modules) and the kernel stacks, handed out as 4kB page frames. slab caches
+    cut frames into objects of one size, kmalloc uses power of two caches up to
+    KMALLOC_MAX and whole frames above
+*/
+
+#define KHEAP_MAX_FRAMES    (PAGE_4MB_SIZE / PAGE_4KB_SIZE)     /* frames in the kernel page        */
+#define KMEM_MAX_CACHES     24                                  /* kmalloc classes included         */
+#define KMEM_NAME_LEN       16
+#define KMEM_MIN_ALIGN      8
+#define KMEM_KEEP_EMPTY     1       /* empty slabs a cache keeps before giving frames back      */
+#define KMALLOC_MIN_SHIFT   4       /* smallest class, 16 bytes                                 */
+#define KMALLOC_MAX_SHIFT   11      /* largest class, 2kB, larger requests take whole frames    */
+#define KMALLOC_CLASSES     (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+#define KMALLOC_MAX         (1 << KMALLOC_MAX_SHIFT)
+
+/* header at the start of each slab frame, objects follow */
+typedef struct slab_t {
+    struct slab_t* next;
+    struct slab_t* prev;
+    struct kmem_cache_t* cache;
+    void* free;                 /* first free object, each free object points to the next  */
+    uint32_t inuse;             /* objects handed out                                       */
+} slab_t;
+
+/* cache of objects of one size */
+typedef struct kmem_cache_t {
+    char name[KMEM_NAME_LEN];
+    uint32_t obj_size;          /* object size rounded up to the alignment                  */
+    uint32_t first;             /* offset of the first object in a slab                     */
+    uint32_t per_slab;          /* objects in one slab                                      */
+    slab_t* partial;            /* slabs with free and used objects, allocated from first   */
+    slab_t* full;               /* slabs with no free object                                */
+    slab_t* empty;              /* slabs with no used object                                */
+    uint32_t nempty;
+    spinlock_t lock;            /* slab lists and statistics, IRQ safe                     */
+    /* statistics */
+    uint32_t allocs;            /* successful allocations                                   */
+    uint32_t frees;
+    uint32_t failures;          /* allocations failed for lack of frames                    */
+    uint32_t active;            /* objects in use                                           */
+    uint32_t max_active;
+    uint32_t slabs;             /* frames held                                              */
+} kmem_cache_t;
+
+/* init the heap on the frames from start to the kernel stacks */
+extern void kheap_init(uint32_t start);
+
+/* contiguous page frames, not zeroed */
+extern void* frame_alloc(uint32_t n);
+extern void frame_free(void* addr, uint32_t n);
+/* free frames and length of the longest free run */
+extern uint32_t frame_free_count();
+extern uint32_t frame_largest_run();
+
+/* create a cache, align is a power of two, 0 for KMEM_MIN_ALIGN */
+extern kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, uint32_t align);
+extern void* kmem_cache_alloc(kmem_cache_t* cache);
+extern void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/* general purpose allocation, NULL if there is no memory */
+extern void* kmalloc(uint32_t size);
+extern void kfree(void* ptr);
+
+/* print the frame usage and the statistics of every cache (CTRL+K) */
+extern void kheap_stats();
+
+#endif /* _KHEAP_H */
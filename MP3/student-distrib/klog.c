@@ -0,0 +1,298 @@
+#include "klog.h"
+#include "types.h"
+#include "lib.h"
+#include "syscall.h"
+
+/*
+    kernel log ring, writers reserve a slot by an atomic add on klog_head and publish it
+    by writing its seq last, so handlers never wait for each other or for a reader.
+    a reader only trusts a record whose seq is the same before and after copying it.
+*/
+static klog_entry_t klog_ring[KLOG_SIZE];
+static volatile uint32_t klog_head = 0;
+
+/* level letters shown in front of each line */
+static const int8_t klog_level_char[] = "EWID";
+
+/* format a record into a line */
+static int32_t klog_format(int8_t* dst, int32_t size, const klog_entry_t* e);
+
+/*
+ * klog_init
+ * DESCRIPTION: initialize the kernel log, nothing is kept from before
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void klog_init()
+{
+    int i;
+
+    for (i = 0; i < KLOG_SIZE; i++)
+        klog_ring[i].seq = 0;
+    klog_head = 0;
+    klog_level = KLOG_DEFAULT_LEVEL;
+}
+
+/*
+ * klog
+ * DESCRIPTION: log a record with a TSC stamp, the format and up to KLOG_ARGS argument
+ *              words are saved as they are, formatting is left to the reader.
+ *              safe from interrupt, exception and system call context, never blocks
+ * INPUT: level -- KLOG_ERR to KLOG_DEBUG
+ *        fmt -- printf style format (%d %u %x %#x %c %s), a string literal
+ *        ... -- arguments, strings MUST be string literals
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: the oldest record is overwritten if the log is full
+ */
+void klog(uint32_t level, const int8_t* fmt, ...)
+{
+    /* arguments follow the format on the stack, as in printf */
+    uint32_t* args = (uint32_t*)&fmt + 1;
+    uint32_t seq = 1;
+    klog_entry_t* e;
+    int i;
+
+    /* cheap enough for handlers that log every tick at KLOG_DEBUG */
+    if (level > klog_level)
+        return;
+
+    /* reserve a slot */
+    asm volatile ("lock xaddl %0, %1" : "+r"(seq), "+m"(klog_head) : : "memory");
+    e = &klog_ring[seq & KLOG_MASK];
+
+    /* the old record in the slot is no longer valid */
+    e->seq = 0;
+    asm volatile ("" : : : "memory");
+    e->level = level;
+    e->tsc = rdtsc();
+    e->fmt = fmt;
+    for (i = 0; i < KLOG_ARGS; i++)
+        e->args[i] = args[i];
+    /* publish the record only after it is written */
+    asm volatile ("" : : : "memory");
+    e->seq = seq + 1;
+}
+
+/*
+ * klog_open
+ * DESCRIPTION: open the dmesg device, reading starts from the oldest record kept
+ * INPUT: filename -- not used
+ * OUTPUT: none
+ * RETURN: 0
+ * SIDE AFFECTS: none
+ */
+int32_t klog_open(const char* filename)
+{
+    return 0;
+}
+
+/*
+ * klog_close
+ * DESCRIPTION: close the dmesg device
+ * INPUT: fd -- not used
+ * OUTPUT: none
+ * RETURN: 0
+ * SIDE AFFECTS: none
+ */
+int32_t klog_close(int32_t fd)
+{
+    return 0;
+}
+
+/*
+ * klog_read
+ * DESCRIPTION: read formatted records as lines "<level>[kcycles] message\n", only whole
+ *              lines are returned. the file offset is the sequence number of the next
+ *              record, records overwritten before they are read are skipped
+ * INPUT: fd -- file descriptor
+ *        buf -- buffer for the lines
+ *        nbytes -- size of the buffer
+ * OUTPUT: none
+ * RETURN: number of bytes read, 0 once every record is read, -1 for fail
+ * SIDE AFFECTS: file offset advanced
+ */
+int32_t klog_read(int32_t fd, void* buf, int32_t nbytes)
+{
+    int8_t line[KLOG_LINE_SIZE];
+    klog_entry_t e;
+    uint32_t pos = cur_fd_array[fd].file_offset;
+    uint32_t head = klog_head;
+    int32_t ret = 0;
+    int32_t len;
+
+    if (buf == NULL || nbytes <= 0)
+        return -1;
+
+    /* the reader fell behind, start from the oldest record kept */
+    if (head - pos > KLOG_SIZE)
+        pos = head - KLOG_SIZE;
+
+    while (pos != head)
+    {
+        e = klog_ring[pos & KLOG_MASK];
+        if (e.seq != pos + 1 || klog_ring[pos & KLOG_MASK].seq != pos + 1)
+        {
+            /* still being written, wait for the next read */
+            if ((int32_t)(klog_ring[pos & KLOG_MASK].seq - (pos + 1)) < 0)
+                break;
+            /* overwritten by a newer record */
+            pos++;
+            continue;
+        }
+        len = klog_format(line, KLOG_LINE_SIZE, &e);
+        /* only whole lines, unless the buffer cannot hold even one */
+        if (ret + len > nbytes)
+        {
+            if (ret != 0)
+                break;
+            len = nbytes;
+        }
+        memcpy((uint8_t*)buf + ret, line, len);
+        ret += len;
+        pos++;
+    }
+
+    cur_fd_array[fd].file_offset = pos;
+    return ret;
+}
+
+/*
+ * klog_write
+ * DESCRIPTION: set the log level, records more verbose than it are dropped
+ * INPUT: fd -- not used
+ *        buf -- an int32 level
+ *        nbytes -- 4
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 for fail
+ * SIDE AFFECTS: klog_level changed
+ */
+int32_t klog_write(int32_t fd, void* buf, int32_t nbytes)
+{
+    int32_t level;
+
+    if (buf == NULL || nbytes != 4)
+        return -1;
+    level = *(int32_t*)buf;
+    if (level < KLOG_ERR || level > KLOG_DEBUG)
+        return -1;
+    klog_level = level;
+    return 0;
+}
+
+/*
+ * klog_poll
+ * DESCRIPTION: check whether there are records not read yet
+ * INPUT: fd -- file descriptor
+ *        stamp -- filled in with the TSC of the newest record if not NULL
+ * OUTPUT: none
+ * RETURN: 1 if ready, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+int32_t klog_poll(int32_t fd, uint32_t* stamp)
+{
+    uint32_t head = klog_head;
+
+    if (head == cur_fd_array[fd].file_offset)
+        return 0;
+    if (stamp != NULL)
+        *stamp = (uint32_t)klog_ring[(head - 1) & KLOG_MASK].tsc;
+    return 1;
+}
+
+/*
+ * klog_format
+ * DESCRIPTION: format a record into "<level>[kcycles] message\n", the TSC is shown
+ *              in units of 1024 cycles, the kernel has no 64-bit division
+ * INPUT: dst -- line buffer
+ *        size -- size of the line buffer
+ *        e -- record
+ * OUTPUT: none
+ * RETURN: length of the line, cut to fit with the \n kept
+ * SIDE AFFECTS: none
+ */
+static int32_t klog_format(int8_t* dst, int32_t size, const klog_entry_t* e)
+{
+    int8_t conv_buf[36];        /* number conversion                */
+    const int8_t* fmt = e->fmt; /* format being walked              */
+    const int8_t* s;            /* string to append                 */
+    int32_t len = 0;            /* length of the line so far        */
+    int32_t arg = 0;            /* next argument word               */
+    int32_t i;
+
+    /* leave room for the \n */
+    size--;
+
+    dst[len++] = '<';
+    dst[len++] = klog_level_char[e->level];
+    dst[len++] = '>';
+    dst[len++] = '[';
+    itoa((uint32_t)(e->tsc >> 10), conv_buf, 10);
+    for (s = conv_buf; *s != '\0' && len < size; s++)
+        dst[len++] = *s;
+    if (len < size)
+        dst[len++] = ']';
+    if (len < size)
+        dst[len++] = ' ';
+
+    while (*fmt != '\0' && len < size)
+    {
+        if (*fmt != '%')
+        {
+            dst[len++] = *fmt++;
+            continue;
+        }
+        fmt++;
+        s = conv_buf;
+        switch (*fmt)
+        {
+            case '%':
+                s = (int8_t*)"%";
+                break;
+            case '#':
+                /* 8 digit zero padded hex, only %#x */
+                fmt++;
+                itoa(arg < KLOG_ARGS ? e->args[arg++] : 0, &conv_buf[8], 16);
+                i = strlen(&conv_buf[8]);
+                s = &conv_buf[i];
+                while (i < 8)
+                    conv_buf[i++] = '0';
+                break;
+            case 'x':
+                itoa(arg < KLOG_ARGS ? e->args[arg++] : 0, conv_buf, 16);
+                break;
+            case 'u':
+                itoa(arg < KLOG_ARGS ? e->args[arg++] : 0, conv_buf, 10);
+                break;
+            case 'd':
+                i = (arg < KLOG_ARGS) ? (int32_t)e->args[arg++] : 0;
+                if (i < 0)
+                {
+                    conv_buf[0] = '-';
+                    itoa(-i, &conv_buf[1], 10);
+                }
+                else
+                    itoa(i, conv_buf, 10);
+                break;
+            case 'c':
+                conv_buf[0] = (arg < KLOG_ARGS) ? (int8_t)e->args[arg++] : ' ';
+                conv_buf[1] = '\0';
+                break;
+            case 's':
+                s = (arg < KLOG_ARGS) ? (const int8_t*)e->args[arg++] : (int8_t*)"";
+                break;
+            default:
+                conv_buf[0] = '\0';
+                break;
+        }
+        if (*fmt != '\0')
+            fmt++;
+        while (*s != '\0' && len < size)
+            dst[len++] = *s++;
+    }
+
+    dst[len++] = '\n';
+    return len;
+}
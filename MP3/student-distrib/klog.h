@@ -0,0 +1,48 @@
+#ifndef _KLOG_H
+#define _KLOG_H
+
+#include "types.h"
+
+/* name of the kernel log device, it has no dentry in the file system image */
+#define KLOG_DEV_NAME       "dmesg"
+
+/* records kept, the oldest is overwritten when full, power of 2 */
+#define KLOG_SIZE           256
+#define KLOG_MASK           (KLOG_SIZE - 1)
+/* argument words saved with a record, formatted when it is read */
+#define KLOG_ARGS           4
+/* longest line read out of the log */
+#define KLOG_LINE_SIZE      128
+
+/* severity levels, lower is more severe */
+#define KLOG_ERR            0
+#define KLOG_WARN           1
+#define KLOG_INFO           2
+#define KLOG_DEBUG          3
+#define KLOG_DEFAULT_LEVEL  KLOG_INFO
+
+/* kernel log record, the format is kept and formatted only when the record is read */
+typedef struct klog_entry_t {
+    volatile uint32_t seq;      /* sequence number + 1, written last to publish the record */
+    uint32_t level;             /* severity                                               */
+    uint64_t tsc;               /* TSC when logged                                        */
+    const int8_t* fmt;          /* printf style format, MUST be a string literal          */
+    uint32_t args[KLOG_ARGS];   /* argument words, %s arguments MUST be string literals   */
+} klog_entry_t;
+
+/* records more verbose than this level are dropped */
+uint32_t klog_level;
+
+/* init the kernel log */
+extern void klog_init();
+/* log a record, safe from any context, never blocks */
+extern void klog(uint32_t level, const int8_t* fmt, ...);
+
+/* dmesg device, reads formatted records, a write of an int32 sets the level */
+extern int32_t klog_open(const char* filename);
+extern int32_t klog_close(int32_t fd);
+extern int32_t klog_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t klog_write(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t klog_poll(int32_t fd, uint32_t* stamp);
+
+#endif /* _KLOG_H */
@@ -4,20 +4,35 @@
 #include "lib.h"
 #include "terminal.h"
 #include "syscall.h"
+#include "serial.h"
+#include "fpu.h"
 
-static int screen_x;
-static int screen_y;
-static char* video_mem = (char *)VIDEO;
+#define VID_CELL(c)     ((uint16_t)(c) | (ATTRIB << 8))   /* character cell with the default attribute */
+
+/* console used before terminals are initialized, a plain screen without scrollback */
+static console_t boot_con = {(uint8_t *)VIDEO, NUM_ROWS, 0, NULL, 0, 0, 0, 0, 0};
+/* console shown on screen, putc and the hardware cursor work on it */
+static console_t* fg = &boot_con;
+
+static uint16_t* vid_row(console_t* con, int row);
+static uint16_t* ring_row(console_t* con, int row);
+static void console_scroll(console_t* con, int rows);
+static void console_render(console_t* con);
+static void console_live(console_t* con);
+static void console_delc(console_t* con);
+static void console_set_start(console_t* con);
 
 /* void clear(void);
  * Inputs: void
  * Return Value: none
- * Function: Clears video memory */
+ * Function: Clears the screen */
 void clear(void) {
     int32_t i;
-    for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
-        *(uint8_t *)(video_mem + (i << 1)) = ' ';
-        *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;
+    fg->view = 0;
+    for (i = 0; i < NUM_ROWS; i++) {
+        memset_word(vid_row(fg, i), VID_CELL(' '), NUM_COLS);
+        if (fg->ring != NULL)
+            memset_word(ring_row(fg, i), VID_CELL(' '), NUM_COLS);
     }
 }
 
@@ -26,8 +41,8 @@ void clear(void) {
  * Return Value: none
  * Function: Reset input position on the screen */
 void reset_screen_xy(){
-    screen_x = 0;
-    screen_y = 0;
+    fg->x = 0;
+    fg->y = 0;
     return;
 }
 
@@ -175,20 +190,10 @@ int32_t puts(int8_t* s) {
  * Return Value: void
  *  Function: Output a character to the console */
 void putc(uint8_t c) {
-    if(c == '\n' || c == '\r') {
-        newline();
-        return;
-    } 
-
-    *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
-    *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
-    screen_x++;
-    // screen_x %= NUM_COLS;
-    // screen_y = (screen_y + (screen_x / NUM_COLS)) % NUM_ROWS;
-    
-    if(screen_x == NUM_COLS)
-        newline();
-    update_cursor(screen_x, screen_y);
+    if (serial_mirror)
+        serial_putc(c);
+    console_write(fg, &c, 1);
+    update_cursor(fg->x, fg->y);
 }
 
 /* void delc();
@@ -196,17 +201,8 @@ void putc(uint8_t c) {
  * Return Value: void
  *  Function: Perform backspaces */
 void delc() {
-    if (screen_x == 0){
-        screen_y--;
-        screen_x = NUM_COLS-1;
-    }
-	else
-		screen_x--;
-    
-    *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';
-    *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
-
-    update_cursor(screen_x, screen_y);
+    console_delc(fg);
+    update_cursor(fg->x, fg->y);
 }
 
 /* void newline();
@@ -214,10 +210,9 @@ void delc() {
  * Return Value: void
  *  Function: Perform newline */
 void newline() {
-    screen_y ++;
-    scroll_up();
-    screen_x = 0;
-    update_cursor(screen_x, screen_y);
+    uint8_t c = '\n';
+    console_write(fg, &c, 1);
+    update_cursor(fg->x, fg->y);
 }
 
 /* void scroll_up();
@@ -225,21 +220,269 @@ void newline() {
  * Return Value: void
  *  Function: shift up the content in screen */
 void scroll_up() {
-	int x;
-	int y;
-
-    // shift existing content up, and fill last row with spaces
-    while (screen_y>=NUM_ROWS){
-	    for (x = 0; x < NUM_COLS; x++) {
-	    	for (y = 0; y < NUM_ROWS-1; y++) {
-	    		*(uint8_t *)(video_mem + ((NUM_COLS*y + x) << 1)) = *(uint8_t *)(video_mem + ((NUM_COLS*(y+1) + x) << 1));
-	    	}
-	    }
-        screen_y --;
+    if (fg->y >= NUM_ROWS) {
+        console_scroll(fg, fg->y - (NUM_ROWS-1));
+        fg->y = NUM_ROWS-1;
+    }
+}
+
+/* int32_t putbuf(const uint8_t* buf, int32_t n);
+ * Inputs: const uint8_t* buf = characters to print
+ *         int32_t n = number of characters in buf
+ * Return Value: number of characters printed, \0 is skipped
+ *  Function: Output a whole buffer to the console, with one scroll and one cursor update */
+int32_t putbuf(const uint8_t* buf, int32_t n) {
+    int32_t ret = console_write(fg, buf, n);
+    update_cursor(fg->x, fg->y);
+    return ret;
+}
+
+/* void console_init(console_t* con, uint8_t* vid, uint32_t vid_rows, uint16_t* ring);
+ * Inputs: console_t* con = console to initialize
+ *         uint8_t* vid = start of its pan region in VGA text memory
+ *         uint32_t vid_rows = rows in the pan region, at least NUM_ROWS
+ *         uint16_t* ring = SCROLLBACK_ROWS rows for scrollback, NULL for none
+ * Return Value: void
+ *  Function: set up a blank console with the cursor at the top left corner */
+void console_init(console_t* con, uint8_t* vid, uint32_t vid_rows, uint16_t* ring) {
+    con->vid = vid;
+    con->vid_rows = vid_rows;
+    con->vid_top = 0;
+    con->ring = ring;
+    con->head = 0;
+    con->history = 0;
+    con->view = 0;
+    con->x = 0;
+    con->y = 0;
+    memset_word(vid, VID_CELL(' '), NUM_COLS*vid_rows);
+    if (ring != NULL)
+        memset_word(ring, VID_CELL(' '), NUM_COLS*SCROLLBACK_ROWS);
+}
+
+/* void console_show(console_t* con);
+ * Inputs: console_t* con = console to show
+ * Return Value: void
+ *  Function: show a console by reprogramming the CRTC start address to its screen,
+ *            and direct putc and the cursor to it, nothing is copied */
+void console_show(console_t* con) {
+    fg = con;
+    console_set_start(con);
+    update_cursor(con->x, con->y);
+}
+
+/* void console_echo(console_t* con, uint8_t c);
+ * Inputs: console_t* con = console to echo on
+ *         uint8_t c = typed character, '\b' erases the previous one
+ * Return Value: void
+ *  Function: echo a typed key on a console, the cursor follows if the console is shown */
+void console_echo(console_t* con, uint8_t c) {
+    if (c == '\b')
+        console_delc(con);
+    else
+        console_write(con, &c, 1);
+    if (con == fg)
+        update_cursor(fg->x, fg->y);
+}
+
+/* void console_home(console_t* con);
+ * Inputs: console_t* con = console
+ * Return Value: void
+ *  Function: move the screen back to the top of the pan region, so that the screen
+ *            starts at the region's first page, as vidmap users expect */
+void console_home(console_t* con) {
+    console_live(con);
+    if (con->vid_top == 0)
+        return;
+    memmove(con->vid, vid_row(con, 0), (NUM_COLS*NUM_ROWS) << 1);
+    con->vid_top = 0;
+    if (con == fg) {
+        console_set_start(con);
+        update_cursor(con->x, con->y);
+    }
+}
+
+/* void scroll_view(int32_t rows);
+ * Inputs: int32_t rows = rows to scroll back, negative to scroll forward
+ * Return Value: void
+ *  Function: show older rows of the screen's scrollback, the live screen is at view 0 */
+void scroll_view(int32_t rows) {
+    int32_t view;
+
+    if (fg->ring == NULL)
+        return;
+    view = (int32_t)fg->view + rows;
+    if (view < 0)
+        view = 0;
+    if (view > (int32_t)fg->history)
+        view = fg->history;
+    if (view == (int32_t)fg->view)
+        return;
+    fg->view = view;
+    console_render(fg);
+    update_cursor(fg->x, fg->y);
+}
+
+/* uint16_t* vid_row(console_t* con, int row);
+ * Inputs: console_t* con = console
+ *         int row = screen row
+ * Return Value: the screen row in VGA text memory */
+static uint16_t* vid_row(console_t* con, int row) {
+    return (uint16_t *)con->vid + (con->vid_top + row) * NUM_COLS;
+}
+
+/* uint16_t* ring_row(console_t* con, int row);
+ * Inputs: console_t* con = console
+ *         int row = screen row, negative for rows above the screen
+ * Return Value: the screen row in the scrollback ring */
+static uint16_t* ring_row(console_t* con, int row) {
+    return con->ring + ((con->head + row) & SCROLLBACK_MASK) * NUM_COLS;
+}
+
+/* void console_scroll(console_t* con, int rows);
+ * Inputs: console_t* con = console
+ *         int rows = number of rows to shift up
+ * Return Value: void
+ *  Function: shift up the screen. The ring only advances its head, and the screen pans
+ *            down the VGA region by the CRTC start address; only when the region is used
+ *            up, the rows kept are moved back to its top with one bulk move. The rows
+ *            entering at the bottom are filled with spaces */
+static void console_scroll(console_t* con, int rows) {
+    int i;
+    int keep;
+
+    if (rows <= 0)
+        return;
+
+    if (con->ring != NULL) {
+        con->head = (con->head + rows) & SCROLLBACK_MASK;
+        for (i = (rows < SCROLLBACK_ROWS) ? NUM_ROWS - rows : NUM_ROWS - SCROLLBACK_ROWS; i < NUM_ROWS; i++)
+            memset_word(ring_row(con, i), VID_CELL(' '), NUM_COLS);
+        con->history += rows;
+        if (con->history > SCROLLBACK_ROWS - NUM_ROWS)
+            con->history = SCROLLBACK_ROWS - NUM_ROWS;
+    }
+
+    keep = (rows < NUM_ROWS) ? NUM_ROWS - rows : 0;
+    if (con->vid_top + rows + NUM_ROWS <= con->vid_rows) {
+        con->vid_top += rows;
+    } else {
+        if (keep > 0)
+            memmove(con->vid, vid_row(con, rows), (NUM_COLS*keep) << 1);
+        con->vid_top = 0;
+    }
+    memset_word(vid_row(con, keep), VID_CELL(' '), NUM_COLS*(NUM_ROWS-keep));
+
+    if (con == fg)
+        console_set_start(con);
+}
+
+/* void console_render(console_t* con);
+ * Inputs: console_t* con = console
+ * Return Value: void
+ *  Function: copy the rows in view from the ring to the screen */
+static void console_render(console_t* con) {
+    int i;
+    for (i = 0; i < NUM_ROWS; i++)
+        memcpy(vid_row(con, i), ring_row(con, i - (int)con->view), NUM_COLS << 1);
+}
+
+/* void console_live(console_t* con);
+ * Inputs: console_t* con = console
+ * Return Value: void
+ *  Function: go back to the live screen if scrolled back, output always lands there */
+static void console_live(console_t* con) {
+    if (con->view == 0)
+        return;
+    con->view = 0;
+    console_render(con);
+}
+
+/* void console_delc(console_t* con);
+ * Inputs: console_t* con = console
+ * Return Value: void
+ *  Function: erase the character before the cursor */
+static void console_delc(console_t* con) {
+    console_live(con);
+    if (con->x == 0) {
+        if (con->y == 0)
+            return;
+        con->y--;
+        con->x = NUM_COLS-1;
+    }
+    else
+        con->x--;
+
+    vid_row(con, con->y)[con->x] = VID_CELL(' ');
+    if (con->ring != NULL)
+        ring_row(con, con->y)[con->x] = VID_CELL(' ');
+}
+
+/* void console_set_start(console_t* con);
+ * Inputs: console_t* con = console shown
+ * Return Value: void
+ *  Function: point the CRTC start address at the console's screen */
+static void console_set_start(console_t* con) {
+    uint16_t start = ((uint32_t)(con->vid - (uint8_t *)VIDEO) >> 1) + con->vid_top * NUM_COLS;
+	outw(0x000C | (start & 0xFF00), 0x03D4);
+	outw(0x000D | ((start << 8) & 0xFF00), 0x03D4);
+}
+
+/* int32_t console_write(console_t* con, const uint8_t* buf, int32_t n);
+ * Inputs: console_t* con = console to write to
+ *         const uint8_t* buf = characters to print
+ *         int32_t n = number of characters in buf
+ * Return Value: number of characters printed, \0 is skipped
+ *  Function: lay out a whole buffer in one pass. The final cursor row is computed first,
+ *            so the console is scrolled once for the whole block. Rows that scroll off
+ *            the screen again are only written to the ring, and never drawn */
+int32_t console_write(console_t* con, const uint8_t* buf, int32_t n) {
+    int32_t i;
+    int32_t ret = 0;
+    int cx = con->x;
+    int cy = con->y;
+    int rows;
+    uint8_t c;
+
+    console_live(con);
+
+    // find out how many rows the block scrolls
+    for (i = 0; i < n; i++) {
+        c = buf[i];
+        if (c == '\0')
+            continue;
+        if (c == '\n' || c == '\r' || ++cx == NUM_COLS) {
+            cx = 0;
+            cy++;
+        }
     }
-	for (x = 0; x < NUM_COLS; x++) {
-		*(uint8_t *)(video_mem + ((NUM_COLS*(NUM_ROWS-1) + x) << 1)) = ' ';
-	}
+    rows = cy - (NUM_ROWS-1);
+    console_scroll(con, rows);
+
+    // rows above the screen (cy < 0) belong to lines already scrolled off
+    cx = con->x;
+    cy = (rows > 0) ? con->y - rows : con->y;
+    for (i = 0; i < n; i++) {
+        c = buf[i];
+        if (c == '\0')
+            continue;
+        ret++;
+        if (c == '\n' || c == '\r') {
+            cx = 0;
+            cy++;
+            continue;
+        }
+        if (cy >= 0)
+            vid_row(con, cy)[cx] = VID_CELL(c);
+        if (con->ring != NULL && cy >= NUM_ROWS - SCROLLBACK_ROWS)
+            ring_row(con, cy)[cx] = VID_CELL(c);
+        if (++cx == NUM_COLS) {
+            cx = 0;
+            cy++;
+        }
+    }
+    con->x = cx;
+    con->y = cy;
+    return ret;
 }
 
 /* int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
@@ -310,13 +553,14 @@ uint32_t strlen(const int8_t* s) {
     return len;
 }
 
-/* void* memset(void* s, int32_t c, uint32_t n);
+/* void* memset_stos(void* s, int32_t c, uint32_t n);
+ * Description: memset with rep stosl, used by memset for small sizes
  * Inputs:    void* s = pointer to memory
  *          int32_t c = value to set memory to
  *         uint32_t n = number of bytes to set
  * Return Value: new string
  * Function: set n consecutive bytes of pointer s to value c */
-void* memset(void* s, int32_t c, uint32_t n) {
+void* memset_stos(void* s, int32_t c, uint32_t n) {
     c &= 0xFF;
     asm volatile ("                 \n\
             .memset_top:            \n\
@@ -393,13 +637,14 @@ void* memset_dword(void* s, int32_t c, uint32_t n) {
     return s;
 }
 
-/* void* memcpy(void* dest, const void* src, uint32_t n);
+/* void* memcpy_movs(void* dest, const void* src, uint32_t n);
+ * Description: memcpy with rep movsl, used by memcpy for small sizes
  * Inputs:      void* dest = destination of copy
  *         const void* src = source of copy
  *              uint32_t n = number of byets to copy
  * Return Value: pointer to dest
  * Function: copy n bytes of src to dest */
-void* memcpy(void* dest, const void* src, uint32_t n) {
+void* memcpy_movs(void* dest, const void* src, uint32_t n) {
     asm volatile ("                 \n\
             .memcpy_top:            \n\
             testl   %%ecx, %%ecx    \n\
@@ -438,14 +683,14 @@ void* memcpy(void* dest, const void* src, uint32_t n) {
     return dest;
 }
 
-/* void* memmove(void* dest, const void* src, uint32_t n);
- * Description: Optimized memmove (used for overlapping memory areas)
+/* void* memmove_movsb(void* dest, const void* src, uint32_t n);
+ * Description: memmove with rep movsb, kept as the baseline of the memory benchmark
  * Inputs:      void* dest = destination of move
  *         const void* src = source of move
  *              uint32_t n = number of byets to move
  * Return Value: pointer to dest
  * Function: move n bytes of src to dest */
-void* memmove(void* dest, const void* src, uint32_t n) {
+void* memmove_movsb(void* dest, const void* src, uint32_t n) {
     asm volatile ("                             \n\
             movw    %%ds, %%dx                  \n\
             movw    %%dx, %%es                  \n\
@@ -457,6 +702,7 @@ void* memmove(void* dest, const void* src, uint32_t n) {
             std                                 \n\
             .memmove_go:                        \n\
             rep     movsb                       \n\
+            cld                                 \n\
             "
             :
             : "D"(dest), "S"(src), "c"(n)
@@ -465,6 +711,215 @@ void* memmove(void* dest, const void* src, uint32_t n) {
     return dest;
 }
 
+/* void sse_copy_blocks(void* dest, const void* src, uint32_t blocks, uint32_t nt);
+ * Inputs:      void* dest = destination of copy, 16 byte aligned
+ *         const void* src = source of copy, any alignment
+ *         uint32_t blocks = number of MEM_SSE_BLOCK byte blocks to copy
+ *             uint32_t nt = 1 for non-temporal stores, that do not fill the cache
+ * Return Value: none
+ * Function: copy with SSE2 registers, MUST run between kernel_fpu_begin and kernel_fpu_end */
+static void sse_copy_blocks(void* dest, const void* src, uint32_t blocks, uint32_t nt) {
+    if (nt) {
+        asm volatile ("                         \n\
+            1:                                  \n\
+            movdqu  (%%esi), %%xmm0             \n\
+            movdqu  16(%%esi), %%xmm1           \n\
+            movdqu  32(%%esi), %%xmm2           \n\
+            movdqu  48(%%esi), %%xmm3           \n\
+            movntdq %%xmm0, (%%edi)             \n\
+            movntdq %%xmm1, 16(%%edi)           \n\
+            movntdq %%xmm2, 32(%%edi)           \n\
+            movntdq %%xmm3, 48(%%edi)           \n\
+            addl    $64, %%esi                  \n\
+            addl    $64, %%edi                  \n\
+            decl    %%ecx                       \n\
+            jnz     1b                          \n\
+            sfence                              \n\
+            "
+            : "+S"(src), "+D"(dest), "+c"(blocks)
+            :
+            : "memory", "cc"
+        );
+    } else {
+        asm volatile ("                         \n\
+            1:                                  \n\
+            movdqu  (%%esi), %%xmm0             \n\
+            movdqu  16(%%esi), %%xmm1           \n\
+            movdqu  32(%%esi), %%xmm2           \n\
+            movdqu  48(%%esi), %%xmm3           \n\
+            movdqa  %%xmm0, (%%edi)             \n\
+            movdqa  %%xmm1, 16(%%edi)           \n\
+            movdqa  %%xmm2, 32(%%edi)           \n\
+            movdqa  %%xmm3, 48(%%edi)           \n\
+            addl    $64, %%esi                  \n\
+            addl    $64, %%edi                  \n\
+            decl    %%ecx                       \n\
+            jnz     1b                          \n\
+            "
+            : "+S"(src), "+D"(dest), "+c"(blocks)
+            :
+            : "memory", "cc"
+        );
+    }
+}
+
+/* void sse_fill_blocks(void* s, uint32_t c, uint32_t blocks, uint32_t nt);
+ * Inputs:         void* s = pointer to memory, 16 byte aligned
+ *              uint32_t c = byte value repeated in the 4 bytes
+ *         uint32_t blocks = number of MEM_SSE_BLOCK byte blocks to set
+ *             uint32_t nt = 1 for non-temporal stores, that do not fill the cache
+ * Return Value: none
+ * Function: fill with SSE2 registers, MUST run between kernel_fpu_begin and kernel_fpu_end */
+static void sse_fill_blocks(void* s, uint32_t c, uint32_t blocks, uint32_t nt) {
+    if (nt) {
+        asm volatile ("                         \n\
+            movd    %%eax, %%xmm0               \n\
+            pshufd  $0, %%xmm0, %%xmm0          \n\
+            1:                                  \n\
+            movntdq %%xmm0, (%%edi)             \n\
+            movntdq %%xmm0, 16(%%edi)           \n\
+            movntdq %%xmm0, 32(%%edi)           \n\
+            movntdq %%xmm0, 48(%%edi)           \n\
+            addl    $64, %%edi                  \n\
+            decl    %%ecx                       \n\
+            jnz     1b                          \n\
+            sfence                              \n\
+            "
+            : "+D"(s), "+c"(blocks)
+            : "a"(c)
+            : "memory", "cc"
+        );
+    } else {
+        asm volatile ("                         \n\
+            movd    %%eax, %%xmm0               \n\
+            pshufd  $0, %%xmm0, %%xmm0          \n\
+            1:                                  \n\
+            movdqa  %%xmm0, (%%edi)             \n\
+            movdqa  %%xmm0, 16(%%edi)           \n\
+            movdqa  %%xmm0, 32(%%edi)           \n\
+            movdqa  %%xmm0, 48(%%edi)           \n\
+            addl    $64, %%edi                  \n\
+            decl    %%ecx                       \n\
+            jnz     1b                          \n\
+            "
+            : "+D"(s), "+c"(blocks)
+            : "a"(c)
+            : "memory", "cc"
+        );
+    }
+}
+
+/* void* memcpy(void* dest, const void* src, uint32_t n);
+ * Description: size dispatched memcpy, rep movsl below MEM_SSE_MIN bytes, SSE2 above,
+ *              with non-temporal stores from MEM_NT_MIN bytes. SSE2 is used only once
+ *              fpu_init has found it, inside kernel_fpu_begin/end sections of at most
+ *              MEM_SSE_CHUNK bytes so interrupts are not off for long
+ * Inputs:      void* dest = destination of copy
+ *         const void* src = source of copy
+ *              uint32_t n = number of byets to copy
+ * Return Value: pointer to dest
+ * Function: copy n bytes of src to dest */
+void* memcpy(void* dest, const void* src, uint32_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    uint32_t head, chunk, nt, flags;
+
+    if (n < MEM_SSE_MIN || !fpu_sse2)
+        return memcpy_movs(dest, src, n);
+
+    /* align the stores, loads stay unaligned */
+    head = -(uint32_t)d & (MEM_SSE_ALIGN - 1);
+    memcpy_movs(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    nt = (n >= MEM_NT_MIN);
+    while (n >= MEM_SSE_BLOCK) {
+        chunk = ((n < MEM_SSE_CHUNK) ? n : MEM_SSE_CHUNK) & ~(MEM_SSE_BLOCK - 1);
+        flags = kernel_fpu_begin();
+        sse_copy_blocks(d, s, chunk / MEM_SSE_BLOCK, nt);
+        kernel_fpu_end(flags);
+        d += chunk;
+        s += chunk;
+        n -= chunk;
+    }
+    memcpy_movs(d, s, n);
+    return dest;
+}
+
+/* void* memset(void* s, int32_t c, uint32_t n);
+ * Description: size dispatched memset, same thresholds as memcpy
+ * Inputs:    void* s = pointer to memory
+ *          int32_t c = value to set memory to
+ *         uint32_t n = number of bytes to set
+ * Return Value: new string
+ * Function: set n consecutive bytes of pointer s to value c */
+void* memset(void* s, int32_t c, uint32_t n) {
+    uint8_t* d = (uint8_t*)s;
+    uint32_t head, chunk, nt, flags;
+
+    if (n < MEM_SSE_MIN || !fpu_sse2)
+        return memset_stos(s, c, n);
+
+    head = -(uint32_t)d & (MEM_SSE_ALIGN - 1);
+    memset_stos(d, c, head);
+    d += head;
+    n -= head;
+
+    c &= 0xFF;
+    nt = (n >= MEM_NT_MIN);
+    while (n >= MEM_SSE_BLOCK) {
+        chunk = ((n < MEM_SSE_CHUNK) ? n : MEM_SSE_CHUNK) & ~(MEM_SSE_BLOCK - 1);
+        flags = kernel_fpu_begin();
+        sse_fill_blocks(d, c << 24 | c << 16 | c << 8 | c, chunk / MEM_SSE_BLOCK, nt);
+        kernel_fpu_end(flags);
+        d += chunk;
+        n -= chunk;
+    }
+    memset_stos(d, c, n);
+    return s;
+}
+
+/* void* memmove(void* dest, const void* src, uint32_t n);
+ * Description: Optimized memmove (used for overlapping memory areas). a forward copy is
+ *              safe unless dest overlaps the end of src, memcpy does it, the other case
+ *              is copied backwards a dword at a time
+ * Inputs:      void* dest = destination of move
+ *         const void* src = source of move
+ *              uint32_t n = number of byets to move
+ * Return Value: pointer to dest
+ * Function: move n bytes of src to dest */
+void* memmove(void* dest, const void* src, uint32_t n) {
+    void* d = dest;
+
+    if ((uint8_t*)dest <= (const uint8_t*)src || (uint8_t*)dest >= (const uint8_t*)src + n)
+        return memcpy(dest, src, n);
+
+    /* the n & 3 top bytes, then dwords down to the start */
+    asm volatile ("                             \n\
+            movw    %%ds, %%dx                  \n\
+            movw    %%dx, %%es                  \n\
+            leal    -1(%%esi, %%ecx), %%esi     \n\
+            leal    -1(%%edi, %%ecx), %%edi     \n\
+            movl    %%ecx, %%edx                \n\
+            andl    $0x3, %%ecx                 \n\
+            shrl    $2, %%edx                   \n\
+            std                                 \n\
+            rep     movsb                       \n\
+            subl    $3, %%esi                   \n\
+            subl    $3, %%edi                   \n\
+            movl    %%edx, %%ecx                \n\
+            rep     movsl                       \n\
+            cld                                 \n\
+            "
+            : "+D"(d), "+S"(src), "+c"(n)
+            :
+            : "edx", "memory", "cc"
+    );
+    return dest;
+}
+
 /* int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n)
  * Inputs: const int8_t* s1 = first string to compare
  *         const int8_t* s2 = second string to compare
@@ -532,8 +987,9 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
  * Function: increments video memory. To be used to test rtc */
 void test_interrupts(void) {
     int32_t i;
+    uint8_t* screen = (uint8_t *)vid_row(fg, 0);
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
-        video_mem[i << 1]++;
+        screen[i << 1]++;
     }
 }
 
@@ -564,15 +1020,21 @@ void disable_cursor()
 /* void update_cursor(int x, int y)
  * Inputs: x, y
  * Return Value: void
- * Function: moves cursor */
+ * Function: moves cursor, it follows its row when the screen is scrolled back */
 void update_cursor(int x, int y)
 {
     if (x==NUM_COLS){
         x = 0;
         y ++;
     }
+    y += fg->view;
+    /* hide the cursor below the screen if its row is out of view */
+    if (y >= NUM_ROWS){
+        x = 0;
+        y = NUM_ROWS;
+    }
         
-	uint16_t position = NUM_COLS*y + x;
+	uint16_t position = ((uint32_t)(fg->vid - (uint8_t *)VIDEO) >> 1) + (fg->vid_top + y) * NUM_COLS + x;
 	outw(0x000E | (position & 0xFF00), 0x03D4);
 	outw(0x000F | ((position << 8) & 0xFF00), 0x03D4);
 }
@@ -597,7 +1059,7 @@ uint16_t get_cursor_position(void)
  * Function: get cursor x position */
 int get_screen_x()
 {
-    return screen_x;
+    return fg->x;
 }
 
 /* get_screen_y
@@ -606,7 +1068,7 @@ int get_screen_x()
  * Function: get cursor y position */
 int get_screen_y()
 {
-    return screen_y;
+    return fg->y;
 }
 
 /* set_screen_xy
@@ -615,14 +1077,14 @@ int get_screen_y()
  * Function: set cursor's x,y position */
 void set_screen_xy(int x, int y)
 {
-    screen_x = x;
-    screen_y = y;
-    update_cursor(screen_x, screen_y);
+    fg->x = x;
+    fg->y = y;
+    update_cursor(fg->x, fg->y);
 }
 
-/* The following functions operates in terminal video buffer */
+/* The following functions operates in current process' terminal's console */
 
-/* Terminal printf(). Print string in current running process' terminal's video buffer
+/* Terminal printf(). Print string in current running process' terminal's console
  * Only supports the following format strings:
  * %%  - print a literal '%' character
  * %x  - print a number in hexadecimal
@@ -764,23 +1226,10 @@ int32_t terminal_puts(int8_t* s) {
 /* void terminal_putc(uint8_t c);
  * Inputs: uint_8* c = character to print
  * Return Value: void
- *  Function: Output a character to current process' terminal's video buffer */
+ *  Function: Output a character to current process' terminal's console */
 void terminal_putc(uint8_t c) {
     uint32_t id = get_pcb_ptr(curr_pid)->term_id;
-
-    if(c == '\n' || c == '\r') {
-        terminal_newline();
-        return;
-    } 
-
-    *(uint8_t *)(terminals[id].vid_buf + ((NUM_COLS * terminals[id].cursor_y + terminals[id].cursor_x) << 1)) = c;
-    *(uint8_t *)(terminals[id].vid_buf + ((NUM_COLS * terminals[id].cursor_y + terminals[id].cursor_x) << 1) + 1) = ATTRIB;
-    terminals[id].cursor_x++;
-    // screen_x %= NUM_COLS;
-    // screen_y = (screen_y + (screen_x / NUM_COLS)) % NUM_ROWS;
-    
-    if(terminals[id].cursor_x == NUM_COLS)
-        terminal_newline();
+    console_write(&terminals[id].con, &c, 1);
 }
 
 /* void delc();
@@ -789,16 +1238,7 @@ void terminal_putc(uint8_t c) {
  *  Function: Perform backspaces */
 void terminal_delc() {
     uint32_t id = get_pcb_ptr(curr_pid)->term_id;
-
-    if (terminals[id].cursor_x == 0){
-        terminals[id].cursor_y--;
-        terminals[id].cursor_x = NUM_COLS-1;
-    }
-	else
-		terminals[id].cursor_x--;
-    
-    *(uint8_t *)(terminals[id].vid_buf + ((NUM_COLS * terminals[id].cursor_y + terminals[id].cursor_x) << 1)) = ' ';
-    *(uint8_t *)(terminals[id].vid_buf + ((NUM_COLS * terminals[id].cursor_y + terminals[id].cursor_x) << 1) + 1) = ATTRIB;
+    console_delc(&terminals[id].con);
 }
 
 /* void newline();
@@ -807,9 +1247,8 @@ void terminal_delc() {
  *  Function: Perform newline */
 void terminal_newline() {
     uint32_t id = get_pcb_ptr(curr_pid)->term_id;
-    terminals[id].cursor_y ++;
-    terminal_scroll_up();
-    terminals[id].cursor_x = 0;
+    uint8_t c = '\n';
+    console_write(&terminals[id].con, &c, 1);
 }
 
 /* void scroll_up();
@@ -817,19 +1256,19 @@ void terminal_newline() {
  * Return Value: void
  *  Function: shift up the content in screen */
 void terminal_scroll_up() {
-	int x;
-	int y;
-    uint32_t id = get_pcb_ptr(curr_pid)->term_id;
-    // shift existing content up, and fill last row with spaces
-    while (terminals[id].cursor_y>=NUM_ROWS){
-	    for (x = 0; x < NUM_COLS; x++) {
-	    	for (y = 0; y < NUM_ROWS-1; y++) {
-	    		*(uint8_t *)(terminals[id].vid_buf + ((NUM_COLS*y + x) << 1)) = *(uint8_t *)(terminals[id].vid_buf + ((NUM_COLS*(y+1) + x) << 1));
-	    	}
-	    }
-        terminals[id].cursor_y --;
+    console_t* con = &terminals[get_pcb_ptr(curr_pid)->term_id].con;
+    if (con->y >= NUM_ROWS) {
+        console_scroll(con, con->y - (NUM_ROWS-1));
+        con->y = NUM_ROWS-1;
     }
-	for (x = 0; x < NUM_COLS; x++) {
-		*(uint8_t *)(terminals[id].vid_buf + ((NUM_COLS*(NUM_ROWS-1) + x) << 1)) = ' ';
-	}
+}
+
+/* int32_t terminal_putbuf(const uint8_t* buf, int32_t n);
+ * Inputs: const uint8_t* buf = characters to print
+ *         int32_t n = number of characters in buf
+ * Return Value: number of characters printed, \0 is skipped
+ *  Function: Output a whole buffer to current process' terminal's console, with one scroll */
+int32_t terminal_putbuf(const uint8_t* buf, int32_t n) {
+    uint32_t id = get_pcb_ptr(curr_pid)->term_id;
+    return console_write(&terminals[id].con, buf, n);
 }
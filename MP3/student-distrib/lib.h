@@ -12,12 +12,31 @@
 #define NUM_ROWS    25
 #define ATTRIB      0x7
 #define VIDBUF_SIZE 2*NUM_COLS*NUM_ROWS
+#define VID_PAGE_SIZE   0x1000  /* one hardware text page, enough for a screen  */
+#define VID_PAGE_NUM    8       /* text pages in the 32kB window at VIDEO       */
+#define SCROLLBACK_ROWS 256     /* rows in a console's scrollback ring, power of 2 */
+#define SCROLLBACK_MASK (SCROLLBACK_ROWS - 1)
+
+/* text console, the screen is a window of NUM_ROWS rows panned down a region of
+ * VGA text memory by the CRTC start address, and every row is also kept in a ring */
+typedef struct console_t {
+    uint8_t* vid;           /* start of the pan region in VGA text memory           */
+    uint32_t vid_rows;      /* rows in the pan region, at least NUM_ROWS            */
+    uint32_t vid_top;       /* region row shown as screen row 0                     */
+    uint16_t* ring;         /* scrollback ring of SCROLLBACK_ROWS rows, or NULL     */
+    uint32_t head;          /* ring row of screen row 0                             */
+    uint32_t history;       /* rows above the screen kept in the ring               */
+    uint32_t view;          /* rows scrolled back, 0 for the live screen            */
+    int x;                  /* cursor x position                                    */
+    int y;                  /* cursor y position                                    */
+} console_t;
 
 int32_t printf(int8_t *format, ...);
 void putc(uint8_t c);
 void delc();
 void newline();
 void scroll_up();
+int32_t putbuf(const uint8_t* buf, int32_t n);
 int32_t puts(int8_t *s);
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
 int8_t *strrev(int8_t* s);
@@ -33,11 +52,28 @@ int get_screen_x();
 int get_screen_y();
 void set_screen_xy(int x, int y);
 
+void console_init(console_t* con, uint8_t* vid, uint32_t vid_rows, uint16_t* ring);
+void console_show(console_t* con);
+void console_home(console_t* con);
+void console_echo(console_t* con, uint8_t c);
+int32_t console_write(console_t* con, const uint8_t* buf, int32_t n);
+void scroll_view(int32_t rows);
+
+/* memcpy and memset use SSE2 from MEM_SSE_MIN bytes, non-temporal stores from MEM_NT_MIN */
+#define MEM_SSE_MIN     512
+#define MEM_NT_MIN      0x10000
+#define MEM_SSE_CHUNK   0x4000      /* bytes copied per kernel_fpu_begin, interrupts are off */
+#define MEM_SSE_BLOCK   64          /* bytes per iteration, four xmm registers */
+#define MEM_SSE_ALIGN   16
+
 void* memset(void* s, int32_t c, uint32_t n);
+void* memset_stos(void* s, int32_t c, uint32_t n);
 void* memset_word(void* s, int32_t c, uint32_t n);
 void* memset_dword(void* s, int32_t c, uint32_t n);
 void* memcpy(void* dest, const void* src, uint32_t n);
+void* memcpy_movs(void* dest, const void* src, uint32_t n);
 void* memmove(void* dest, const void* src, uint32_t n);
+void* memmove_movsb(void* dest, const void* src, uint32_t n);
 int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
@@ -48,6 +84,7 @@ void terminal_putc(uint8_t c);
 void terminal_delc();
 void terminal_newline();
 void terminal_scroll_up();
+int32_t terminal_putbuf(const uint8_t* buf, int32_t n);
 
 /* Userspace address-check functions */
 int32_t bad_userspace_addr(const void* addr, int32_t len);
@@ -100,6 +137,17 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the time stamp counter, i.e. cycles since the processor reset */
+static inline uint64_t rdtsc(void) {
+    uint64_t val;
+    asm volatile ("rdtsc"
+            : "=A"(val)
+            :
+            : "memory"
+    );
+    return val;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -123,7 +171,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
@@ -140,6 +188,9 @@ do {                                    \
     );                                  \
 } while (0)
 
+/* interrupt enable bit of EFLAGS, tells whether flags saved by cli_and_save had interrupts on */
+#define EFLAGS_IF                       0x200
+
 /* Save flags and then clear interrupt flag
  * Saves the EFLAGS register into the variable "flags", and then
  * disables interrupts on this processor */
@@ -4,6 +4,10 @@
 
 #include "paging.h"
 #include "lib.h"
+#include "shm.h"
+#include "clock.h"
+#include "vbe.h"
+#include "uheap.h"
 
 /*
 *	paging_init
@@ -94,6 +98,33 @@ void page_table_init()
     }
 }
 
+/*
+*	paging_init_ap
+*	Description:    init the page directory and video page table of an application processor,
+*	                the kernel entries point to the same pages as the boot processor's, the
+*	                user entries are set when a process is switched in there
+*	inputs:		    cpu -- index of the processor
+*	outputs:	    nothing
+*	effects:	    the processor's page directory and video page table are initialized
+*/
+void paging_init_ap(uint32_t cpu)
+{
+    /* loop index */
+    int i;
+
+    for (i = 0; i < NUM_PD_ENTRY; i++)
+    {
+        cpu_page_directory[cpu][i] = cpu_page_directory[0][i];
+        if (cpu_page_directory[cpu][i].u_s)
+            cpu_page_directory[cpu][i].p = 0;
+    }
+    for (i = 0; i < NUM_PT_ENTRY; i++)
+    {
+        cpu_vid_page_table[cpu][i] = cpu_vid_page_table[0][i];
+        cpu_vid_page_table[cpu][i].p = 0;
+    }
+}
+
 /*
 *	enable_paging
 *	Description:    several hardware registers' values are set to enable paging 
@@ -104,23 +135,26 @@ void page_table_init()
 void enable_paging()
 {   
     asm volatile(
-        /* load cr3 base addr */
-        "movl $page_directory, %eax;"
+        /* load cr3 base addr, the boot processor's page directory */
+        "movl %0, %%eax;"
         /* mask unnecessary bits, the last 10 bits would come from virtual memory addr as index */
-        "andl $0xFFFFFC00, %eax;"   
-        "movl %eax, %cr3;"
+        "andl $0xFFFFFC00, %%eax;"   
+        "movl %%eax, %%cr3;"
 
         /* Enable Mixture of 4kb and 4mb access */
-        "movl %cr4, %eax;"
+        "movl %%cr4, %%eax;"
         /* set the bit 4 to be 1 */
-        "orl $0x00000010, %eax;"
-        "movl %eax, %cr4;"
+        "orl $0x00000010, %%eax;"
+        "movl %%eax, %%cr4;"
 
         /* MSE: enable paging */
-        "movl %cr0, %eax;"
+        "movl %%cr0, %%eax;"
         /* set the bit 31 to be 1 */
-        "orl $0x80000000, %eax;"
-        "movl %eax, %cr0;"
+        "orl $0x80000000, %%eax;"
+        "movl %%eax, %%cr0;"
+        :
+        : "r"(page_directory)
+        : "eax", "memory"
     );
 }
 
@@ -142,7 +176,7 @@ void activate_video()
 *	Description:    set a page for according process
 *	inputs:		    process id
 *	outputs:	    nothing
-*	effects:	    page directory entry in 128MB/4MB is changed
+*	effects:	    page directory entry in 128MB/4MB, shared pages, the clock page and the framebuffer are changed
 */
 void set_paging(uint32_t pid)
 {
@@ -163,6 +197,15 @@ void set_paging(uint32_t pid)
     page_directory[index].avail       = 0;
     page_directory[index].base_addr   = physical_addr >> MEM_OFFSET_BITS;
 
+    /* map the shared memory segments this process attaches */
+    shm_remap(pid);
+    /* map the clock page, read only */
+    clock_map();
+    /* map the framebuffer if this process owns the display */
+    vbe_remap(pid);
+    /* and its heap */
+    uheap_remap(pid);
+
     /* flush TLB */
     flush_TLB();
 }
@@ -181,3 +224,79 @@ void flush_TLB()
         "movl %eax, %cr3;"
     );
 }
+
+/*
+*	map_phys_4mb
+*	Description:    map the 4mB region holding a physical address at the same virtual address
+*	                for the kernel on every processor, used for ACPI tables and device registers
+*	inputs:		    phys -- physical address in the region
+*	                uncached -- 1 to disable caching, for device registers
+*	outputs:	    0 if it is mapped now, 1 if it was already mapped there, -1 if the virtual range is in use
+*	effects:	    page directory entry changed, TLB flushed
+*/
+int32_t map_phys_4mb(uint32_t phys, uint32_t uncached)
+{
+    uint32_t index = phys / PAGE_4MB_SIZE;
+    int i;
+
+    if (page_directory[index].p)
+    {
+        /* the same identity 4mB page, e.g. the kernel page or a device mapped before */
+        if (page_directory[index].ps && page_directory[index].base_addr == (index * PAGE_4MB_SIZE) >> MEM_OFFSET_BITS)
+            return 1;
+        return -1;
+    }
+
+    page_directory[index].r_w         = 1;
+    page_directory[index].u_s         = 0;    // kernel only
+    page_directory[index].pwt         = uncached;
+    page_directory[index].pcd         = uncached;
+    page_directory[index].a           = 0;
+    page_directory[index].reserved    = 0;
+    page_directory[index].ps          = 1;    // 4mB page
+    page_directory[index].g           = 0;
+    page_directory[index].avail       = 0;
+    page_directory[index].base_addr   = (index * PAGE_4MB_SIZE) >> MEM_OFFSET_BITS;
+    page_directory[index].p           = 1;    // present
+
+    /* kernel entries are the same on every processor */
+    for (i = 0; i < MAX_CPUS; i++)
+        cpu_page_directory[i][index] = page_directory[index];
+
+    flush_TLB();
+    return 0;
+}
+
+/*
+*	unmap_phys_4mb
+*	Description:    remove a mapping made by map_phys_4mb
+*	inputs:		    phys -- physical address in the region
+*	outputs:	    nothing
+*	effects:	    page directory entry changed, TLB flushed
+*/
+void unmap_phys_4mb(uint32_t phys)
+{
+    int i;
+
+    for (i = 0; i < MAX_CPUS; i++)
+        cpu_page_directory[i][phys / PAGE_4MB_SIZE].p = 0;
+    flush_TLB();
+}
+
+/*
+*	set_low_pages
+*	Description:    make the 4kB pages of the first 4mB in a range present or not, used to
+*	                read the BIOS data area and ROM, the video pages MUST NOT be in the range
+*	inputs:		    start, end -- physical range [start, end)
+*	                present -- 1 to map, 0 to unmap
+*	outputs:	    nothing
+*	effects:	    page table changed, TLB flushed
+*/
+void set_low_pages(uint32_t start, uint32_t end, uint32_t present)
+{
+    uint32_t i;
+
+    for (i = start >> MEM_OFFSET_BITS; i < ((end + PAGE_4KB_SIZE - 1) >> MEM_OFFSET_BITS) && i < NUM_PT_ENTRY; i++)
+        page_table[i].p = present;
+    flush_TLB();
+}
@@ -6,6 +6,7 @@
 #define _PAGING_H
 
 #include "types.h"
+#include "x86_desc.h"
 
 /* the number of paging directory entries */
 #define NUM_PD_ENTRY        1024
@@ -55,12 +56,16 @@ typedef struct page_table_entry
     uint32_t base_addr      : 20;
 } page_table_entry_t;
 
-/* page directory, 4096 aligned */
-page_dir_entry_t page_directory[NUM_PD_ENTRY] __attribute__((aligned(PAGE_4KB_SIZE)));
+/* page directory of each processor, 4096 aligned, the kernel entries are the same in all */
+page_dir_entry_t cpu_page_directory[MAX_CPUS][NUM_PD_ENTRY] __attribute__((aligned(PAGE_4KB_SIZE)));
 /* page table, 4096 aligned */
 page_table_entry_t page_table[NUM_PT_ENTRY] __attribute__((aligned(PAGE_4KB_SIZE)));
-/* page table for virtual video memory */
-page_table_entry_t vid_page_table[NUM_PT_ENTRY] __attribute__((aligned(PAGE_4KB_SIZE)));
+/* page table for virtual video memory of each processor */
+page_table_entry_t cpu_vid_page_table[MAX_CPUS][NUM_PT_ENTRY] __attribute__((aligned(PAGE_4KB_SIZE)));
+
+/* page directory and video page table of the processor running this, they map its process */
+#define page_directory      (cpu_page_directory[cpu_id()])
+#define vid_page_table      (cpu_vid_page_table[cpu_id()])
 
 /* init paging */
 void paging_init();
@@ -68,6 +73,8 @@ void paging_init();
 void page_directory_init();
 /* init page table */
 void page_table_init(); 
+/* init the page directory of an application processor from the boot processor's */
+void paging_init_ap(uint32_t cpu);
 /* set hardware registers to enable mixed paging */
 void enable_paging();
 /* activate video memory page to be valid */
@@ -76,5 +83,11 @@ void activate_video();
 void set_paging(uint32_t pid);
 /* flush TLB */
 void flush_TLB();
+/* map a 4MB physical region at the same virtual address for the kernel */
+int32_t map_phys_4mb(uint32_t phys, uint32_t uncached);
+/* remove a mapping made by map_phys_4mb */
+void unmap_phys_4mb(uint32_t phys);
+/* make the 4kB pages of the first 4MB in a range present or not */
+void set_low_pages(uint32_t start, uint32_t end, uint32_t present);
 
 #endif
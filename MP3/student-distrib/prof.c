@@ -0,0 +1,185 @@
+#include "prof.h"
+#include "lib.h"
+#include "syscall.h"
+#include "smp.h"
+#include "kheap.h"
+#include "klog.h"
+
+/* 1 while sampling */
+static volatile uint32_t prof_on = 0;
+/* sample buffer of each processor, from the kernel heap on the first start */
+static prof_sample_t* prof_buf[MAX_CPUS];
+/* samples kept and samples lost to a full buffer, per processor */
+static uint32_t prof_count[MAX_CPUS];
+static uint32_t prof_dropped[MAX_CPUS];
+
+/*
+ * prof_sample
+ * DESCRIPTION: record where the tick interrupted this processor, if sampling is on.
+ *              runs under the kernel lock like profctl, so no other lock is needed
+ * INPUT: frame -- registers of the interrupted code
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void prof_sample(irq_frame_t* frame)
+{
+    uint32_t id = cpu_id();
+    prof_sample_t* s;
+
+    if (!prof_on || prof_buf[id] == NULL)
+        return;
+    if (prof_count[id] >= PROF_SAMPLES)
+    {
+        prof_dropped[id]++;
+        return;
+    }
+
+    s = &prof_buf[id][prof_count[id]++];
+    s->eip = frame->eip;
+    s->pid = (int16_t)curr_pid;
+    s->cpu = id;
+    s->user = (frame->cs & 3) != 0;
+}
+
+/*
+ * profctl
+ * DESCRIPTION: system call profctl, start or stop the profiler
+ * INPUT: cmd -- PROF_START or PROF_STOP
+ * OUTPUT: none
+ * RETURN: 0 for PROF_START, number of samples kept for PROF_STOP, -1 for fail
+ * SIDE AFFECTS: PROF_START discards the samples taken before
+ */
+int32_t profctl(int32_t cmd)
+{
+    uint32_t i, total = 0, dropped = 0;
+
+    switch (cmd)
+    {
+        case PROF_START:
+            prof_on = 0;
+            for (i = 0; i < ncpus_online; i++)
+            {
+                if (prof_buf[i] == NULL &&
+                    (prof_buf[i] = (prof_sample_t*)kmalloc(PROF_SAMPLES * sizeof(prof_sample_t))) == NULL)
+                    return -1;
+                prof_count[i] = 0;
+                prof_dropped[i] = 0;
+            }
+            prof_on = 1;
+            return 0;
+        case PROF_STOP:
+            prof_on = 0;
+            for (i = 0; i < MAX_CPUS; i++)
+            {
+                total += prof_count[i];
+                dropped += prof_dropped[i];
+            }
+            klog(KLOG_INFO, "prof: %u samples, %u dropped", total, dropped);
+            return total;
+        default:
+            return -1;
+    }
+}
+
+/*
+ * prof_open
+ * DESCRIPTION: open the prof device, reading starts from the first sample
+ * INPUT: filename -- not used
+ * OUTPUT: none
+ * RETURN: 0
+ * SIDE AFFECTS: none
+ */
+int32_t prof_open(const char* filename)
+{
+    return 0;
+}
+
+/*
+ * prof_close
+ * DESCRIPTION: close the prof device
+ * INPUT: fd -- not used
+ * OUTPUT: none
+ * RETURN: 0
+ * SIDE AFFECTS: none
+ */
+int32_t prof_close(int32_t fd)
+{
+    return 0;
+}
+
+/*
+ * prof_read
+ * DESCRIPTION: read whole samples, those of processor 0 first. the file offset counts
+ *              the samples read
+ * INPUT: fd -- file descriptor
+ *        buf -- buffer for prof_sample_t records
+ *        nbytes -- size of the buffer
+ * OUTPUT: none
+ * RETURN: number of bytes read, 0 once every sample is read, -1 for fail
+ * SIDE AFFECTS: file offset advanced
+ */
+int32_t prof_read(int32_t fd, void* buf, int32_t nbytes)
+{
+    prof_sample_t* dst = (prof_sample_t*)buf;
+    uint32_t pos = cur_fd_array[fd].file_offset;
+    uint32_t want, idx, cpu, n;
+    int32_t ret = 0;
+
+    if (buf == NULL || nbytes < (int32_t)sizeof(prof_sample_t))
+        return -1;
+    want = nbytes / sizeof(prof_sample_t);
+
+    /* skip the processors whose samples were read */
+    idx = pos;
+    for (cpu = 0; cpu < MAX_CPUS && idx >= prof_count[cpu]; cpu++)
+        idx -= prof_count[cpu];
+
+    for (; cpu < MAX_CPUS && want > 0; cpu++, idx = 0)
+    {
+        n = prof_count[cpu] - idx;
+        if (n > want)
+            n = want;
+        if (n == 0)
+            continue;
+        memcpy(dst, &prof_buf[cpu][idx], n * sizeof(prof_sample_t));
+        dst += n;
+        want -= n;
+        pos += n;
+        ret += n * sizeof(prof_sample_t);
+    }
+
+    cur_fd_array[fd].file_offset = pos;
+    return ret;
+}
+
+/*
+ * prof_write
+ * DESCRIPTION: nothing can be written to the prof device, profctl controls it
+ * INPUT: fd, buf, nbytes -- not used
+ * OUTPUT: none
+ * RETURN: -1
+ * SIDE AFFECTS: none
+ */
+int32_t prof_write(int32_t fd, void* buf, int32_t nbytes)
+{
+    return -1;
+}
+
+/*
+ * prof_poll
+ * DESCRIPTION: check whether there are samples not read yet
+ * INPUT: fd -- file descriptor
+ *        stamp -- not filled in, samples have no time
+ * OUTPUT: none
+ * RETURN: 1 if ready, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+int32_t prof_poll(int32_t fd, uint32_t* stamp)
+{
+    uint32_t i, total = 0;
+
+    for (i = 0; i < MAX_CPUS; i++)
+        total += prof_count[i];
+    return total != cur_fd_array[fd].file_offset;
+}
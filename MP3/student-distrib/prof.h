@@ -0,0 +1,42 @@
+#ifndef _PROF_H
+#define _PROF_H
+
+#include "types.h"
+#include "interrupt_linkage.h"
+
+/*
+    sampling profiler. while it is on, every scheduler tick (PIT or LAPIC timer) records
+    the interrupted EIP and pid in a buffer of its processor. the "prof" device returns
+    the samples, profile.py in this directory turns them into a symbolized flat profile.
+    code running with IF = 0 is charged to the instruction that enables interrupts
+*/
+
+#define PROF_DEV_NAME       "prof"
+#define PROF_SAMPLES        4096        /* samples kept per processor, later ones are dropped */
+
+/* profctl commands */
+#define PROF_START          1           /* clear the samples and start sampling  */
+#define PROF_STOP           2           /* stop sampling, the samples are kept   */
+
+/* one sample, as read from the device */
+typedef struct prof_sample_t {
+    uint32_t eip;
+    int16_t pid;            /* -1 for the idle loop                 */
+    uint8_t cpu;
+    uint8_t user;           /* 1 if the tick came from user mode    */
+} prof_sample_t;
+
+/* take a sample, called on every scheduler tick */
+extern void prof_sample(irq_frame_t* frame);
+
+/* system call, start or stop sampling */
+extern int32_t profctl(int32_t cmd);
+
+/* prof device, reads whole samples of every processor in turn */
+extern int32_t prof_open(const char* filename);
+extern int32_t prof_close(int32_t fd);
+extern int32_t prof_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t prof_write(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t prof_poll(int32_t fd, uint32_t* stamp);
+
+#endif /* _PROF_H */
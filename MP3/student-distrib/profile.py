@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Flat profile from the samples dumped by the "prof" user program.
+
+usage: profile.py bootimg LOG [--user PROG.exe] [--pid]
+
+LOG is a capture of the serial line (or of the screen) holding the
+"P <cpu> <pid> <user> <eip>" lines printed by "prof dump". kernel samples are
+symbolized with the symbols of bootimg, user samples with those of PROG.exe
+(syscalls/*.exe, before elfconvert) if given, else counted as [user].
+"""
+
+import argparse
+import bisect
+import collections
+import re
+import subprocess
+import sys
+
+SAMPLE_RE = re.compile(r"^P (\d+) (-?\d+) ([01]) ([0-9A-Fa-f]+)\s*$")
+
+
+def load_symbols(elf):
+    """Sorted (address, name) of the text symbols of an ELF file."""
+    out = subprocess.run(["nm", "-n", "--defined-only", elf], check=True,
+                         capture_output=True, text=True).stdout
+    syms = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            syms.append((int(parts[0], 16), parts[2]))
+    return syms
+
+
+def symbolize(syms, addrs, eip):
+    i = bisect.bisect_right(addrs, eip) - 1
+    return syms[i][1] if i >= 0 else "[unknown %#x]" % eip
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("bootimg")
+    ap.add_argument("log")
+    ap.add_argument("--user", help="user program ELF for user mode samples")
+    ap.add_argument("--pid", action="store_true", help="split the profile by pid")
+    args = ap.parse_args()
+
+    ksyms = load_symbols(args.bootimg)
+    kaddrs = [a for a, _ in ksyms]
+    usyms = load_symbols(args.user) if args.user else []
+    uaddrs = [a for a, _ in usyms]
+
+    counts = collections.Counter()
+    total = 0
+    with open(args.log, errors="replace") as f:
+        for line in f:
+            m = SAMPLE_RE.match(line.strip("\r\n"))
+            if not m:
+                continue
+            pid, user, eip = int(m.group(2)), m.group(3) == "1", int(m.group(4), 16)
+            if pid < 0:
+                name = "[idle] " + symbolize(ksyms, kaddrs, eip)
+            elif user:
+                name = symbolize(usyms, uaddrs, eip) if usyms else "[user]"
+            else:
+                name = symbolize(ksyms, kaddrs, eip)
+            counts[(pid if args.pid else None, name)] += 1
+            total += 1
+
+    if total == 0:
+        sys.exit("no samples in %s" % args.log)
+    print("%8s %6s  %s" % ("samples", "%", "function"))
+    for (pid, name), n in counts.most_common():
+        where = name if pid is None else "%s (pid %d)" % (name, pid)
+        print("%8d %5.1f%%  %s" % (n, 100.0 * n / total, where))
+    print("%8d total" % total)
+
+
+if __name__ == "__main__":
+    main()
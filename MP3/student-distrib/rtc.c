@@ -4,6 +4,8 @@
 #include "i8259.h"
 #include "tests.h"
 #include "terminal.h"
+#include "klog.h"
+#include "smp.h"
 
 /* Reference: https://wiki.osdev.org/RTC */
 
@@ -11,7 +13,16 @@
 
 /* count rtc interrupt, would overflow, but doesn't matter */
 /* used for indicate whether a new interrupt happen or for virtualization */
-static uint32_t rtc_counter;
+static volatile uint32_t rtc_counter;
+/* low 32 bits of TSC at the last rtc interrupt, reported by rtc_poll */
+static volatile uint32_t rtc_tsc;
+/* rtc_counter at each process' last rtc_read, a virtual tick is pending once the counter passes a multiple of its period */
+static uint32_t virt_rtc_last[NUM_PROCESS];
+
+/* get the wait period of a process' virtualized rtc */
+static int32_t rtc_wait_period(uint32_t pid);
+/* check whether a virtual tick of a process is pending */
+static int32_t rtc_ready(uint32_t pid);
 
 /*
  * rtc_init
@@ -49,8 +60,10 @@ int32_t rtc_init()
     rtc_counter = 0;
 
     /* init virtual rtc ratio array */
-    for(i = 0; i < NUM_PROCESS; i++)
+    for(i = 0; i < NUM_PROCESS; i++){
         virt_rtc_ratio[i] = RTC_MAX_FRE/RTC_MAX_FRE;
+        virt_rtc_last[i] = 0;
+    }
 
     /* enable NMI*/
     prev = inb(RTC_PORT) & 0X7F; //0x7F is used to set the first bit to 0
@@ -119,6 +132,8 @@ void rtc_handler() {
     inb(RTC_DATA); // throw the contents in register C to reset status bits in register C
 
     rtc_counter++; // update counter
+    rtc_tsc = (uint32_t)rdtsc(); // stamp the tick for poll
+    klog(KLOG_DEBUG, "rtc: tick %u", rtc_counter);
 
     /* send EOI to indicate the handler finishes the work*/
     send_eoi(RTC_IRQ);
@@ -136,6 +151,8 @@ int32_t rtc_open(const char* filename)
 {
     /* set default frequency*/
     rtc_set_fre(RTC_MAX_FRE);
+    /* no virtual tick pending for a newly opened rtc */
+    virt_rtc_last[curr_pid] = rtc_counter;
     /* return 0 for success*/
     return 0;
 }
@@ -163,7 +180,8 @@ int32_t rtc_close(int32_t fd)
 
 /*
  * rtc_read
- * DESCRIPTION: a virtualized rtc read, wait several periods cooresponding to current process' rtc frequency
+ * DESCRIPTION: a virtualized rtc read, wait until a tick of current process' rtc frequency,
+ *              i.e. several periods of the real rtc, has passed since last read
  * INPUT: fd, buf, nbytes: unused variable
  * OUTPUT: none
  * RETURN: return 0 for success
@@ -171,22 +189,66 @@ int32_t rtc_close(int32_t fd)
  */
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes)
 {
-    /* record the current rtc_interrupt_status */
-    int32_t current_status = rtc_counter;
+    /* if next virtual tick doesn't come, wait */
+    while(!rtc_ready(curr_pid))
+        kernel_relax();
+    /* consume the tick */
+    virt_rtc_last[curr_pid] = rtc_counter;
+
+    /* return 0 for success*/
+    return 0;
+}
+
+/*
+ * rtc_poll
+ * DESCRIPTION: readiness hook of the virtualized rtc, used by poll
+ * INPUT: fd: unused variable
+ *        stamp: filled in with the TSC of the last rtc interrupt if not NULL
+ * OUTPUT: none
+ * RETURN: 1 if rtc_read would not wait, 0 otherwise
+ * SIDEAFFECTS: none
+ */
+int32_t rtc_poll(int32_t fd, uint32_t* stamp)
+{
+    if(!rtc_ready(curr_pid))
+        return 0;
+    if(stamp != NULL)
+        *stamp = rtc_tsc;
+    return 1;
+}
+
+/*
+ * rtc_wait_period
+ * DESCRIPTION: get the wait period of a process' virtualized rtc, in real rtc periods
+ * INPUT: pid: process id
+ * OUTPUT: none
+ * RETURN: wait period, at least 1
+ * SIDEAFFECTS: none
+ */
+static int32_t rtc_wait_period(uint32_t pid)
+{
     /* calculate wait period, because there is scheduling, divide it by the number of running terminals */
-    int32_t wait_period = virt_rtc_ratio[curr_pid] / running_term_num;
+    int32_t wait_period = virt_rtc_ratio[pid] / running_term_num;
 
     /* if wait period is too short, set it to 1 */
     if(wait_period == 0)
         wait_period = 1;
+    return wait_period;
+}
 
-    /* if next rtc interrupt doesn't come, wait */
-    while(current_status == rtc_counter);
-    /* wait for several period */
-    while(rtc_counter % wait_period);
-
-    /* return 0 for success*/
-    return 0;
+/*
+ * rtc_ready
+ * DESCRIPTION: check whether the real rtc has passed a multiple of the process' wait period
+ *              since its last read, i.e. a virtual tick is pending
+ * INPUT: pid: process id
+ * OUTPUT: none
+ * RETURN: 1 if pending, 0 otherwise
+ * SIDEAFFECTS: none
+ */
+static int32_t rtc_ready(uint32_t pid)
+{
+    int32_t wait_period = rtc_wait_period(pid);
+    return (rtc_counter / wait_period) != (virt_rtc_last[pid] / wait_period);
 }
 
 /*
@@ -34,6 +34,8 @@ extern int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes);
 extern int32_t rtc_write(int32_t fd, void* buf, int32_t nbytes);
 /*  close the RTC driver and reset some variable */
 extern int32_t rtc_close(int32_t fd);
+/* RTC readiness hook. Virtualized. ready if a tick of current process' rtc frequency passed since last read */
+extern int32_t rtc_poll(int32_t fd, uint32_t* stamp);
 
 /* Old virtualized RTC read wrote in check point 2 */
 // extern int32_t rtc_virtread(int32_t fd, void* buf, int32_t nbytes);
@@ -1,11 +1,29 @@
 #include "schedule.h"
+#include "apic.h"
 #include "terminal.h"
+#include "klog.h"
 #include "syscall.h"
 #include "x86_desc.h"
+#include "smp.h"
+#include "fpu.h"
 #include "lib.h"
+#include "prof.h"
+#include "trace.h"
+#include "thread.h"
+#include "timer.h"
 
 /* Reference: https://wiki.osdev.org/Programmable_Interval_Timer */
 
+/* one run queue per processor */
+static run_queue_t run_queues[MAX_CPUS];
+
+static void intr_stats_add(intr_stats_t* st, uint32_t start);
+static void sched_tick(irq_frame_t* frame);
+static uint32_t rq_pop_head(run_queue_t* rq);
+static uint32_t rq_steal(uint32_t cpu);
+static void sched_finish_switch();
+static uint32_t sched_on_cpu(uint32_t pid);
+
 /*
  * pit_init
  * DESCRIPTION: initialize the PIT, see schedule.h file for command details
@@ -16,27 +34,39 @@
  */
 void pit_init()
 {
+    int i;
+
     /* sent command to pit */
     outb(PIT_CMD, PIT_CMD_PORT);
     /* sent least significant bits of period */
-    outb(PIT_LATCH && PIT_BITMASK, PIT_CHANNEL_0);
+    outb(PIT_LATCH & PIT_BITMASK, PIT_CHANNEL_0);
     /* sent most significant bits of period */
     outb(PIT_LATCH >> PIT_MSB_OFFSET, PIT_CHANNEL_0);
-    /* enable interrupt */
+    /* reset the coarse clock */
+    pit_ticks = 0;
+    /* empty run queues */
+    for (i = 0; i < MAX_CPUS; i++)
+    {
+        spin_init(&run_queues[i].lock);
+        run_queues[i].head = run_queues[i].tail = 0;
+    }
+    /* enable interrupt, it stays masked while the LAPIC timer is the tick */
     enable_irq(PIT_IRQ);
     return;
 }
 
 /*
  * pit_handler
- * DESCRIPTION: PIT handler, call scheduler to do scheduling
- * INPUT: none
+ * DESCRIPTION: PIT handler, the scheduler tick when IRQs go through the 8259
+ * INPUT: frame -- registers of the interrupted code
  * OUTPUT: none
  * RETURN: none
  * SIDE AFFECTS: none
  */
-void pit_handler()
+void pit_handler(irq_frame_t* frame)
 {
+    uint32_t start = (uint32_t)rdtsc();
+
     /* 
      * this send eoi CANNOT be put after scheduler because when the new executed 
      * shell (excute by terminal switch) comes back to terminal switch 
@@ -44,13 +74,89 @@ void pit_handler()
      * fail because PIT has the highest priority.
      */
     send_eoi(PIT_IRQ);
-    /* call scheduler */
-    scheduler();
+    intr_stats_add(&pit_stats, start);
+    sched_tick(frame);
+}
+
+/*
+ * apic_timer_handler
+ * DESCRIPTION: LAPIC timer handler, the scheduler tick when IRQs go through the IOAPIC.
+ *              the EOI is sent first for the same reason as in pit_handler
+ * INPUT: frame -- registers of the interrupted code
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void apic_timer_handler(irq_frame_t* frame)
+{
+    uint32_t start = (uint32_t)rdtsc();
+
+    lapic_eoi();
+    intr_stats_add(&lapic_stats, start);
+    sched_tick(frame);
+}
+
+/*
+ * intr_stats_add
+ * DESCRIPTION: record the cycles from handler entry to after the EOI
+ * INPUT: st -- statistics of the interrupt controller
+ *        start -- TSC at handler entry
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void intr_stats_add(intr_stats_t* st, uint32_t start)
+{
+    uint32_t cycles = (uint32_t)rdtsc() - start;
+
+    st->count++;
+    st->eoi_cycles += cycles;
+    if (cycles > st->eoi_max)
+        st->eoi_max = cycles;
+}
+
+/*
+ * sched_tick
+ * DESCRIPTION: work done on every scheduler tick, whichever timer drives it, the
+ *              profiler samples the interrupted code first
+ * INPUT: frame -- registers of the interrupted code
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void sched_tick(irq_frame_t* frame)
+{
+    cpu_t* cpu = this_cpu();
+
+    prof_sample(frame);
+
+    /* every processor ticks, time is kept by the boot processor */
+    cpu->ticks++;
+    if (cpu->idle)
+        cpu->idle_ticks++;
+    if (cpu->id == 0)
+    {
+        /* update the coarse clock */
+        pit_ticks++;
+        klog(KLOG_DEBUG, "pit: tick %u, pid %d", pit_ticks, curr_pid);
+        /* expired timers run in the timer softirq */
+        timer_tick();
+    }
+    /* softirqs are not preempted, the next tick switches */
+    if (!cpu->in_softirq)
+        scheduler();
+
+    /* a killed thread exits when it would go back to user mode, see thread.h */
+    if ((frame->cs & 3) && curr_pid != -1 && get_pcb_ptr(curr_pid)->killed)
+        thread_exit();
 }
 
 /*
  * scheduler
- * DESCRIPTION: do scheduling, switch between current running processes in different terminals
+ * DESCRIPTION: do scheduling, switch between current running processes in different terminals.
+ *              the next process comes from this processor's run queue, or is stolen from the
+ *              longest other queue; the current one goes back to the run queue once its
+ *              context is saved. an idle processor leaves its idle loop the same way
  * INPUT: none
  * OUTPUT: none
  * RETURN: none
@@ -58,63 +164,87 @@ void pit_handler()
  */
 void scheduler()
 {
-    int i;                          /* loop index for finding new process' terminal */
+    cpu_t* cpu;                     /* this processor                               */
     pcb_t* curr_pcb;                /* current running process' pcb                 */
     pcb_t* next_pcb;                /* next process' pcb                            */
-    uint32_t curr_process_term_id;  /* current running process' terminal id         */
     uint32_t next_term_id;          /* next process' terminal id                    */
     uint32_t next_pid;              /* next process id                              */
+    uint32_t* save_ctx;             /* where the current ebp, esp, lock depth go    */
+    uint32_t fpu_saved;             /* 1 if the current run used the FPU            */
+    uint32_t start;                 /* TSC at the start of the switch               */
 
-    /* if curr_pid is -1, which means the first process has not executed, just return */
-    /* this cannot be removed because if it is removed, scheduler would switch to an inexistent */
-    /* place and mess every thing up when the first shell hasn't been executed                  */
-    if(curr_pid == -1)
-        return;
-
-    /* get current process ralevent info */
-    curr_pcb = get_pcb_ptr(curr_pid);
-    curr_process_term_id = curr_pcb->term_id;
-    next_term_id = (curr_process_term_id + 1)%TERMINAL_NUM;
-
-    /* get next process's terminal's id */
-    for(i = 0; i < TERMINAL_NUM && !terminals[next_term_id].is_running; i++)
-        next_term_id = (next_term_id + 1)%TERMINAL_NUM;
-    
-    /* if process does not change, which means there is only one process running, just return */
-    if(next_term_id == curr_process_term_id)
-        return;
-
-    /* get next process's id */
-    next_pid = terminals[next_term_id].curr_pid;
+    cpu = this_cpu();
 
-    /* set paging */
-    set_paging(next_pid);
+    /* get next process's id, nothing waiting means the current process keeps running */
+    if ((next_pid = rq_pop_head(&run_queues[cpu->id])) == NO_PID)
+    {
+        if ((next_pid = rq_steal(cpu->id)) == NO_PID)
+            return;
+        cpu->steals++;
+    }
 
-    /* remap video memory */
-    if(next_term_id == curr_term_id)
-        vid_remap((uint8_t *)VIDEO);
+    /* the current process is queued after the switch, the idle loop is never queued */
+    start = (uint32_t)rdtsc();
+    cpu->prev_pid = curr_pid;
+    if (curr_pid == -1)
+    {
+        save_ctx = &cpu->idle_ebp;
+        cpu->idle_depth = cpu->lock_depth;
+        fpu_saved = fpu_switch_out(NULL);
+    }
     else
-        vid_remap(terminals[next_term_id].vid_buf);
+    {
+        curr_pcb = get_pcb_ptr(curr_pid);
+        save_ctx = &curr_pcb->ebp;
+        curr_pcb->lock_depth = cpu->lock_depth;
+        curr_pcb->in_softirq = cpu->in_softirq;
+        fpu_saved = fpu_switch_out(&curr_pcb->fpu);
+    }
 
-    /* get next process's pcb */
+    /* get next process's pcb and terminal */
     next_pcb = get_pcb_ptr(next_pid);
+    next_term_id = next_pcb->term_id;
 
-    /* set current fd array */
-    cur_fd_array = next_pcb->fd_array;
+    /* set paging, threads use their process' page */
+    set_paging(next_pcb->mm_pid);
+
+    /* remap video memory to next process's terminal's VGA region */
+    vid_remap(terminals[next_term_id].con.vid);
+
+    /* set current fd array, shared by the threads of a process */
+    cur_fd_array = get_pcb_ptr(next_pcb->mm_pid)->fd_array;
 
     /* set kernel stack pointer */
-    tss.esp0 = KS_BASE_ADDR - KS_SIZE * next_pid - sizeof(int32_t);
+    tss[cpu->id].esp0 = KS_BASE_ADDR - KS_SIZE * next_pid - sizeof(int32_t);
 
-    /* update current pid */
+    /* update current pid, the kernel lock nesting follows the context */
+    trace(TRACE_SWITCH, curr_pid, TRACE_SWITCH_ARG(next_pid, next_term_id, TRACE_SW_TICK));
     curr_pid = next_pid;
+    cpu->lock_depth = next_pcb->lock_depth;
+    cpu->in_softirq = next_pcb->in_softirq;
+    cpu->idle = 0;
+    cpu->switches++;
+
+    /* the FPU state of the next process is loaded when it uses it, see fpu_handler */
+    if (fpu_saved)
+    {
+        cpu->fpu_switches++;
+        cpu->fpu_switch_cycles += (uint32_t)rdtsc() - start;
+    }
+    else
+    {
+        cpu->plain_switches++;
+        cpu->plain_switch_cycles += (uint32_t)rdtsc() - start;
+    }
 
-    /* store current's esp, ebp */
+    /* store current's ebp, esp, they are next to each other in pcb_t and cpu_t */
     asm volatile("                                \n\
-        movl %%ebp, %0                            \n\
-        movl %%esp, %1                            \n\
+        movl %%ebp, (%0)                          \n\
+        movl %%esp, 4(%0)                         \n\
         "
-        : "=r"(curr_pcb->ebp), "=r"(curr_pcb->esp)
         :
+        : "r"(save_ctx)
+        : "memory"
     );
 
     /* get next process's esp, ebp */
@@ -125,5 +255,237 @@ void scheduler()
         :
         : "r"(next_pcb->ebp), "r"(next_pcb->esp)
     );
+
+    /* running on the next context now, locals are not valid */
+    sched_finish_switch();
 }
 
+/*
+ * sched_finish_switch
+ * DESCRIPTION: queue the process switched out by scheduler, now that its context is
+ *              saved and another processor may pick it up. a blocked thread is not
+ *              queued, an exited one gives its pid back. a thread switched in for the
+ *              first time goes to user mode from here
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void sched_finish_switch()
+{
+    cpu_t* cpu = this_cpu();
+    uint32_t prev = cpu->prev_pid;
+
+    cpu->prev_pid = -1;
+    if (prev != -1)
+    {
+        if (get_pcb_ptr(prev)->exited)
+            free_pid(prev);
+        else if (!get_pcb_ptr(prev)->blocked)
+            sched_enqueue(prev);
+    }
+
+    if (get_pcb_ptr(cpu->pid)->start_eip != 0)
+        thread_start();
+}
+
+/*
+ * sched_enqueue
+ * DESCRIPTION: put a process that is ready but not running at the tail of this
+ *              processor's run queue
+ * INPUT: pid -- process id, its context MUST be saved
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void sched_enqueue(uint32_t pid)
+{
+    run_queue_t* rq = &run_queues[cpu_id()];
+    uint32_t flags;
+
+    spin_lock_irqsave(&rq->lock, flags);
+    /* there are never more ready processes than slots */
+    rq->pids[rq->tail++ & RUN_QUEUE_MASK] = pid;
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/*
+ * sched_block
+ * DESCRIPTION: wait until the current process or thread is woken by sched_wake. it is
+ *              in no run queue meanwhile, the processor runs something else or halts
+ *              if nothing is ready. a killed thread returns at once
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: the blocked flag of the current PCB MUST be set, under the kernel lock
+ *               and with IF = 0 if an interrupt handler may wake it
+ */
+void sched_block()
+{
+    pcb_t* pcb = get_pcb_ptr(curr_pid);
+
+    while (pcb->blocked && !pcb->killed)
+    {
+        /* back here once woken and switched in, or right away if nothing else is ready */
+        cli();
+        scheduler();
+        if (pcb->blocked && !pcb->killed)
+            kernel_wait();
+        sti();
+    }
+}
+
+/*
+ * sched_wake
+ * DESCRIPTION: make a blocked process or thread ready. one still current on some
+ *              processor, in the kernel_wait of sched_block, sees it at its next
+ *              interrupt, any other is queued here. switches hold the kernel lock, so
+ *              whether it is current cannot change meanwhile
+ * INPUT: pid -- process or thread, nothing is done if it is not blocked or exited
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void sched_wake(uint32_t pid)
+{
+    pcb_t* pcb = get_pcb_ptr(pid);
+
+    if (!pcb->blocked || pcb->exited)
+        return;
+    pcb->blocked = 0;
+    if (!sched_on_cpu(pid))
+        sched_enqueue(pid);
+}
+
+/*
+ * sched_on_cpu
+ * DESCRIPTION: check whether a process is the current one of some processor
+ * INPUT: pid -- process id
+ * OUTPUT: none
+ * RETURN: 1 if current somewhere, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+static uint32_t sched_on_cpu(uint32_t pid)
+{
+    uint32_t i;
+
+    for (i = 0; i < ncpus_online; i++)
+    {
+        if (cpus[i].pid == pid)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * rq_pop_head
+ * DESCRIPTION: take the process that waited longest from a run queue
+ * INPUT: rq -- run queue
+ * OUTPUT: none
+ * RETURN: process id, NO_PID if the queue is empty
+ * SIDE AFFECTS: none
+ */
+static uint32_t rq_pop_head(run_queue_t* rq)
+{
+    uint32_t pid = NO_PID;
+    uint32_t flags;
+
+    spin_lock_irqsave(&rq->lock, flags);
+    if (rq->head != rq->tail)
+        pid = rq->pids[rq->head++ & RUN_QUEUE_MASK];
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return pid;
+}
+
+/*
+ * rq_steal
+ * DESCRIPTION: take a process from the tail of the longest run queue of another
+ *              processor, the one that would wait there longest
+ * INPUT: cpu -- index of this processor
+ * OUTPUT: none
+ * RETURN: process id, NO_PID if every other queue is empty
+ * SIDE AFFECTS: none
+ */
+static uint32_t rq_steal(uint32_t cpu)
+{
+    run_queue_t* victim = NULL;
+    uint32_t pid = NO_PID;
+    uint32_t len, max_len = 0;
+    uint32_t flags;
+    uint32_t i;
+
+    /* lengths are only a hint, the victim is checked again under its lock */
+    for (i = 0; i < ncpus_online; i++)
+    {
+        len = run_queues[i].tail - run_queues[i].head;
+        if (i != cpu && len > max_len)
+        {
+            max_len = len;
+            victim = &run_queues[i];
+        }
+    }
+    if (victim == NULL)
+        return NO_PID;
+
+    spin_lock_irqsave(&victim->lock, flags);
+    if (victim->head != victim->tail)
+        pid = victim->pids[--victim->tail & RUN_QUEUE_MASK];
+    spin_unlock_irqrestore(&victim->lock, flags);
+    return pid;
+}
+
+/*
+ * pit_oneshot_start
+ * DESCRIPTION: start PIT channel 2 counting down once, its output goes high at 0.
+ *              channel 2 raises no interrupt, so this works with IF = 0
+ * INPUT: count -- PIT input clocks to count, PIT_MAX_FREQ per second
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: speaker kept off
+ */
+void pit_oneshot_start(uint16_t count)
+{
+    /* gate channel 2 off, speaker off */
+    uint8_t gate = inb(PIT_GATE_PORT) & ~(PIT_GATE_CH2 | PIT_SPEAKER);
+    outb(gate, PIT_GATE_PORT);
+
+    outb(PIT_CMD_CH2_ONESHOT, PIT_CMD_PORT);
+    outb(count & PIT_BITMASK, PIT_CHANNEL_2);
+    outb(count >> PIT_MSB_OFFSET, PIT_CHANNEL_2);
+
+    /* the count starts with a rising gate */
+    outb(gate | PIT_GATE_CH2, PIT_GATE_PORT);
+}
+
+/*
+ * pit_oneshot_done
+ * DESCRIPTION: check the output of PIT channel 2
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 1 once the count started by pit_oneshot_start has run out, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+int32_t pit_oneshot_done()
+{
+    return (inb(PIT_GATE_PORT) & PIT_OUT_CH2) != 0;
+}
+
+/*
+ * pit_delay_us
+ * DESCRIPTION: busy wait, used before interrupts and the TSC can be trusted
+ * INPUT: us -- microseconds, at most 54ms
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: PIT channel 2 reprogrammed
+ */
+void pit_delay_us(uint32_t us)
+{
+    uint32_t count = us * (PIT_MAX_FREQ / MS_PER_SECOND) / MS_PER_SECOND;
+
+    if (count == 0)
+        count = 1;
+    if (count > 0xFFFF)
+        count = 0xFFFF;
+    pit_oneshot_start(count);
+    while (!pit_oneshot_done());
+}
@@ -2,9 +2,18 @@
 #define _SCHEDULE_H
 
 #include "i8259.h"
+#include "apic.h"
+#include "spinlock.h"
+#include "interrupt_linkage.h"
 
 #define PIT_CMD_PORT        0x43
 #define PIT_CHANNEL_0       0x40
+#define PIT_CHANNEL_2       0x42        /* not wired to an IRQ, used to time calibrations */
+#define PIT_GATE_PORT       0x61        /* channel 2 gate and output, speaker enable      */
+#define PIT_GATE_CH2        0x01
+#define PIT_SPEAKER         0x02
+#define PIT_OUT_CH2         0x20
+#define PIT_CMD_CH2_ONESHOT 0xB0        /* channel 2, lobyte / hibyte, mode 0, binary     */
 #define PIT_BINARY_MODE     0           /* 0b0      16-bit binary                    */
 #define PIT_OP_MODE         3           /* 0b011    Mode 3 (square wave generator)   */
 #define PIT_AC_MODE         3           /* 0b11     lobyte / hibyte                  */
@@ -15,14 +24,60 @@
 #define PIT_LATCH           ((int)((PIT_MAX_FREQ + PIT_FREQ / 2) / PIT_FREQ))   /* number of periods to wait */
 #define PIT_BITMASK         0xff        /* mask most significant bits       */
 #define PIT_MSB_OFFSET      8
+#define MS_PER_SECOND       1000
+/* convert milliseconds to PIT ticks, rounded up */
+#define MS_TO_PIT_TICKS(ms) (((ms) * PIT_FREQ + MS_PER_SECOND - 1) / MS_PER_SECOND)
+
+/* run queue slots, power of 2, at least NUM_PROCESS */
+#define RUN_QUEUE_SIZE      8
+#define RUN_QUEUE_MASK      (RUN_QUEUE_SIZE - 1)
+/* no process */
+#define NO_PID              ((uint32_t)-1)
+
+/*
+ * processes waiting for a processor, the active process of each running terminal is
+ * either running on some processor or in one run queue. the owner takes from head,
+ * an idle processor steals from tail of the longest queue
+ */
+typedef struct run_queue_t {
+    spinlock_t lock;
+    uint32_t pids[RUN_QUEUE_SIZE];
+    uint32_t head;          /* next process to run      */
+    uint32_t tail;          /* next free slot           */
+} run_queue_t;
+
+/* number of scheduler ticks since boot, used as a coarse clock for timeouts */
+volatile uint32_t pit_ticks;
+
+/* handler entry to EOI cycles of the PIT on the 8259 and of the LAPIC timer */
+intr_stats_t pit_stats;
+intr_stats_t lapic_stats;
 
 /* initialize pit */
 extern void pit_init();
 
 /* pit handler */
-extern void pit_handler();
+extern void pit_handler(irq_frame_t* frame);
+
+/* LAPIC timer handler */
+extern void apic_timer_handler(irq_frame_t* frame);
 
 /* do scheduling, switch between current running processes in different terminals */
 void scheduler();
 
+/* queue a process that is ready but not running on this processor's run queue */
+extern void sched_enqueue(uint32_t pid);
+
+/* wait, out of the run queues, until sched_wake, the caller sets the blocked flag */
+extern void sched_block();
+/* make a blocked process or thread ready again */
+extern void sched_wake(uint32_t pid);
+
+/* start a PIT channel 2 one-shot count, polled with pit_oneshot_done */
+extern void pit_oneshot_start(uint16_t count);
+/* 1 once the one-shot count has run out */
+extern int32_t pit_oneshot_done();
+/* busy wait with PIT channel 2, at most 54ms */
+extern void pit_delay_us(uint32_t us);
+
 #endif
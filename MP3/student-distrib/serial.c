@@ -0,0 +1,303 @@
+#include "serial.h"
+#include "types.h"
+#include "lib.h"
+#include "i8259.h"
+#include "keyboard.h"
+#include "terminal.h"
+#include "klog.h"
+#include "smp.h"
+#include "softirq.h"
+
+/* Reference: https://wiki.osdev.org/Serial_Ports */
+
+/* DEL, sent by most terminal emulators for backspace */
+#define SERIAL_DEL  0x7F
+
+/*
+    TX ring, filled by writers and drained into the UART FIFO by the irq handler,
+    both ends only move with IF = 0
+*/
+static uint8_t tx_ring[SERIAL_TX_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+
+/*
+    RX ring between the irq handler (single producer, only moves rx_head)
+    and the line discipline (single consumer, only moves rx_tail, never runs concurrently)
+*/
+static uint8_t rx_ring[SERIAL_RX_SIZE];
+static uint32_t rx_tsc[SERIAL_RX_SIZE];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+/* bytes lost to a full RX ring */
+static uint32_t rx_dropped = 0;
+
+/* bottom half of the irq, feeds the RX ring to the line discipline */
+static void serial_rx_tasklet(uint32_t data);
+static tasklet_t rx_tasklet = TASKLET_INIT(serial_rx_tasklet, 0);
+
+/* move bytes from the TX ring into the FIFO, with IF = 0 */
+static void serial_tx_fill();
+/* append a byte to the TX ring, waiting for room if needed, with IF = 0 */
+static void serial_tx_push(uint8_t c, uint32_t flags);
+
+/*
+ * serial_init
+ * DESCRIPTION: initialize COM1 at 115200 8N1 with FIFOs, check the UART answers
+ *              in loopback mode, then enable the RX interrupt
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 if there is no UART
+ * SIDE AFFECTS: kernel console output is mirrored to COM1
+ */
+int32_t serial_init()
+{
+    serial_present = 0;
+    serial_mirror = 0;
+
+    /* no interrupts while programming */
+    outb(0x00, COM1_PORT + UART_IER);
+
+    /* set the baud rate divisor */
+    outb(LCR_DLAB, COM1_PORT + UART_LCR);
+    outb(SERIAL_BAUD_DIV & 0xFF, COM1_PORT + UART_DATA);
+    outb(SERIAL_BAUD_DIV >> 8, COM1_PORT + UART_IER);
+    outb(LCR_8N1, COM1_PORT + UART_LCR);
+    outb(FCR_ENABLE, COM1_PORT + UART_FCR);
+
+    /* send a byte to itself, nothing comes back if the UART is missing */
+    outb(MCR_LOOPBACK, COM1_PORT + UART_MCR);
+    outb(SERIAL_PROBE_BYTE, COM1_PORT + UART_DATA);
+    if (inb(COM1_PORT + UART_DATA) != SERIAL_PROBE_BYTE)
+    {
+        klog(KLOG_INFO, "serial: no UART on COM1");
+        return -1;
+    }
+
+    /* normal mode, with the irq routed to the PIC */
+    outb(MCR_IRQ, COM1_PORT + UART_MCR);
+    serial_present = 1;
+    serial_mirror = 1;
+
+    /* the TX interrupt is only enabled while the TX ring has bytes */
+    outb(IER_RX, COM1_PORT + UART_IER);
+    enable_irq(SERIAL_IRQ);
+    klog(KLOG_INFO, "serial: COM1 at %u baud", SERIAL_BAUD / SERIAL_BAUD_DIV);
+
+    return 0;
+}
+
+/*
+ * serial_handler
+ * DESCRIPTION: COM1 interrupt handler, move received bytes into the RX ring
+ *              and refill the TX FIFO, until the UART has nothing pending
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: bytes received are dropped if the RX ring is full
+ */
+void serial_handler()
+{
+    uint32_t tsc = (uint32_t)rdtsc();   /* arrival time of the bytes */
+    uint8_t c;
+
+    send_eoi(SERIAL_IRQ);
+
+    /* reading IIR acknowledges TX empty, reading the data acknowledges RX */
+    while (!(inb(COM1_PORT + UART_IIR) & IIR_NO_INT))
+    {
+        while (inb(COM1_PORT + UART_LSR) & LSR_DR)
+        {
+            c = inb(COM1_PORT + UART_DATA);
+            if (rx_head - rx_tail < SERIAL_RX_SIZE)
+            {
+                rx_ring[rx_head & SERIAL_RX_MASK] = c;
+                rx_tsc[rx_head & SERIAL_RX_MASK] = tsc;
+                /* publish the entry only after it is written */
+                asm volatile ("" : : : "memory");
+                rx_head++;
+            }
+            else
+            {
+                rx_dropped++;
+                klog(KLOG_WARN, "serial: RX ring full, %u bytes dropped", rx_dropped);
+            }
+        }
+        serial_tx_fill();
+    }
+    if (rx_head != rx_tail)
+        tasklet_schedule(&rx_tasklet);
+}
+
+/*
+ * serial_rx_tasklet
+ * DESCRIPTION: bottom half of serial_handler, runs with interrupts enabled
+ * INPUT: data -- unused
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: keys echoed, lines queued
+ */
+static void serial_rx_tasklet(uint32_t data)
+{
+    serial_process();
+}
+
+/*
+ * serial_write
+ * DESCRIPTION: queue bytes for transmission on COM1, \n is sent as \r\n.
+ *              when the TX ring is full, the caller sleeps until the irq makes
+ *              room, or polls the UART if interrupts are off
+ * INPUT: buf -- bytes to send
+ *        n -- number of bytes
+ * OUTPUT: none
+ * RETURN: n, or -1 for fail
+ * SIDE AFFECTS: none
+ */
+int32_t serial_write(const uint8_t* buf, int32_t n)
+{
+    uint32_t flags;
+    int32_t i;
+
+    if (!serial_present || buf == NULL || n < 0)
+        return -1;
+
+    cli_and_save(flags);
+    for (i = 0; i < n; i++)
+    {
+        if (buf[i] == '\n')
+            serial_tx_push('\r', flags);
+        serial_tx_push(buf[i], flags);
+    }
+    /* start the transmitter if it is idle */
+    serial_tx_fill();
+    restore_flags(flags);
+
+    return n;
+}
+
+/*
+ * serial_putc
+ * DESCRIPTION: queue one byte for transmission on COM1
+ * INPUT: c -- byte to send
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void serial_putc(uint8_t c)
+{
+    serial_write(&c, 1);
+}
+
+/*
+ * serial_flush
+ * DESCRIPTION: wait until every byte queued has left the UART
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void serial_flush()
+{
+    uint32_t flags;
+
+    if (!serial_present)
+        return;
+
+    cli_and_save(flags);
+    while (tx_tail != tx_head || !(inb(COM1_PORT + UART_LSR) & LSR_TEMT))
+    {
+        /* the TX interrupt wakes us while the ring has bytes, the last FIFO is polled */
+        if (tx_tail != tx_head && (flags & EFLAGS_IF))
+            kernel_wait();
+        else
+            serial_tx_fill();
+    }
+    restore_flags(flags);
+}
+
+/*
+ * serial_process
+ * DESCRIPTION: consumer of the RX ring, feed the bytes received to the line discipline
+ *              of the serial console terminal, or discard them if there is none.
+ *              called by terminal read/poll with IF = 0 and as the RX tasklet, never
+ *              concurrently with itself
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: keys echoed, lines queued
+ */
+void serial_process()
+{
+    terminal_t* term;
+    uint32_t tsc;
+    uint8_t c;
+
+    if (serial_term_id < 0)
+    {
+        rx_tail = rx_head;
+        return;
+    }
+    term = &terminals[serial_term_id];
+
+    while (rx_tail != rx_head)
+    {
+        c = rx_ring[rx_tail & SERIAL_RX_MASK];
+        tsc = rx_tsc[rx_tail & SERIAL_RX_MASK];
+        /* terminal emulators send \r for enter and DEL for backspace */
+        if (c == '\r')
+            c = '\n';
+        else if (c == SERIAL_DEL)
+            c = '\b';
+        /* a line that does not fit in the input queue waits for the reader */
+        if (!tty_room(term, c))
+            break;
+        rx_tail++;
+        tty_input(term, c, tsc);
+    }
+}
+
+/*
+ * serial_tx_fill
+ * DESCRIPTION: if the FIFO is empty, move up to a FIFO of bytes from the TX ring into it,
+ *              and keep the TX interrupt on only while the ring has more. IF MUST be 0
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void serial_tx_fill()
+{
+    int i;
+
+    if (inb(COM1_PORT + UART_LSR) & LSR_THRE)
+    {
+        for (i = 0; i < UART_FIFO_SIZE && tx_tail != tx_head; i++)
+        {
+            outb(tx_ring[tx_tail & SERIAL_TX_MASK], COM1_PORT + UART_DATA);
+            tx_tail++;
+        }
+    }
+    outb((tx_tail != tx_head) ? (IER_RX | IER_TX) : IER_RX, COM1_PORT + UART_IER);
+}
+
+/*
+ * serial_tx_push
+ * DESCRIPTION: append a byte to the TX ring. IF MUST be 0
+ * INPUT: c -- byte to send
+ *        flags -- EFLAGS of the caller, tells whether it may sleep
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: may sleep until the irq makes room
+ */
+static void serial_tx_push(uint8_t c, uint32_t flags)
+{
+    while (tx_head - tx_tail >= SERIAL_TX_SIZE)
+    {
+        serial_tx_fill();
+        /* sleep until the TX interrupt, or poll if interrupts were off */
+        if (flags & EFLAGS_IF)
+            kernel_wait();
+    }
+    tx_ring[tx_head & SERIAL_TX_MASK] = c;
+    tx_head++;
+}
@@ -0,0 +1,64 @@
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "types.h"
+
+/* Reference: https://wiki.osdev.org/Serial_Ports */
+
+/* COM1 port and irq line */
+#define COM1_PORT           0x3F8
+#define SERIAL_IRQ          4
+
+/* 16550 registers, offset to the port base */
+#define UART_DATA           0       /* RX/TX holding register, divisor low byte if DLAB */
+#define UART_IER            1       /* interrupt enable, divisor high byte if DLAB      */
+#define UART_IIR            2       /* interrupt identification (read)                  */
+#define UART_FCR            2       /* FIFO control (write)                             */
+#define UART_LCR            3       /* line control                                     */
+#define UART_MCR            4       /* modem control                                    */
+#define UART_LSR            5       /* line status                                      */
+
+/* register bits */
+#define LCR_DLAB            0x80    /* divisor latch access                             */
+#define LCR_8N1             0x03    /* 8 data bits, no parity, 1 stop bit               */
+#define IER_RX              0x01    /* interrupt on received data                       */
+#define IER_TX              0x02    /* interrupt on TX holding register empty           */
+#define FCR_ENABLE          0xC7    /* enable and clear FIFOs, RX trigger at 14 bytes   */
+#define MCR_IRQ             0x0B    /* DTR, RTS and OUT2 (routes the irq to the PIC)    */
+#define MCR_LOOPBACK        0x1E    /* loopback mode, used to check the UART exists     */
+#define LSR_DR              0x01    /* data ready                                       */
+#define LSR_THRE            0x20    /* TX holding register (and FIFO) empty             */
+#define LSR_TEMT            0x40    /* transmitter completely idle                      */
+#define IIR_NO_INT          0x01    /* no interrupt pending                             */
+
+#define UART_FIFO_SIZE      16      /* bytes the TX FIFO takes when THRE is set         */
+#define SERIAL_BAUD         115200  /* base clock of the baud rate divisor              */
+#define SERIAL_BAUD_DIV     1       /* 115200 / 1 baud                                  */
+#define SERIAL_PROBE_BYTE   0xAE    /* sent to itself in loopback mode                  */
+
+/* software rings, power of 2 */
+#define SERIAL_TX_SIZE      4096
+#define SERIAL_TX_MASK      (SERIAL_TX_SIZE - 1)
+#define SERIAL_RX_SIZE      256
+#define SERIAL_RX_MASK      (SERIAL_RX_SIZE - 1)
+
+/* 1 if a UART answered on COM1 */
+uint32_t serial_present;
+
+/* 1 to mirror kernel console output (printf) to COM1, on by default when the UART exists */
+uint32_t serial_mirror;
+
+/* init COM1, 115200 8N1 with FIFOs and interrupts */
+extern int32_t serial_init();
+/* COM1 interrupt handler */
+extern void serial_handler();
+/* queue bytes for transmission, \n is sent as \r\n */
+extern int32_t serial_write(const uint8_t* buf, int32_t n);
+/* queue one byte for transmission */
+extern void serial_putc(uint8_t c);
+/* wait until everything queued is on the wire */
+extern void serial_flush();
+/* feed received bytes to the line discipline of the serial console terminal */
+extern void serial_process();
+
+#endif /* _SERIAL_H */
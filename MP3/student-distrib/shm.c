@@ -0,0 +1,296 @@
+/*
+    shared memory segments
+    4kB kernel heap frames that can be mapped into several processes' user space,
+    right after the vidmap page at VID_VIRTUAL_ADDR. the system calls run without the
+    kernel lock, shm_lock covers the tables, and with IF = 0 the process stays on the
+    processor whose vid page table it changes. threads of the process on other
+    processors are sent the remap IPI
+*/
+
+#include "shm.h"
+#include "lib.h"
+#include "syscall.h"
+#include "kheap.h"
+#include "spinlock.h"
+#include "smp.h"
+
+/* segment info array */
+static shm_seg_t shm_segs[SHM_MAX_SEG];
+/* bitmap of attached (mapped) segments for each process, bit i for segment i */
+static uint32_t shm_attached[NUM_PROCESS];
+/* bitmap of segments each process holds a reference to, got or attached */
+static uint32_t shm_held[NUM_PROCESS];
+/* segments and bitmaps */
+static spinlock_t shm_lock = SPINLOCK_INIT;
+
+static void shm_free(int32_t shmid);
+static void shm_hold(uint32_t pid, int32_t shmid);
+
+/*
+ * shm_init
+ * DESCRIPTION: initialize shared memory segments, and prepare their page table entries
+ *              in the vid page table (not present until some process attaches them)
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: vid page table entries of segments initialized
+ */
+void shm_init()
+{
+    int i;  /* loop index */
+
+    for (i = 0; i < SHM_MAX_SEG; i++)
+    {
+        shm_segs[i].key = SHM_KEY_NONE;
+        shm_segs[i].refcnt = 0;
+        shm_segs[i].page = NULL;
+        vid_page_table[SHM_VID_PT_START + i].p = 0;     // not present until attached
+        vid_page_table[SHM_VID_PT_START + i].r_w = 1;   // enable r/w
+        vid_page_table[SHM_VID_PT_START + i].u_s = 1;   // user mode
+    }
+    for (i = 0; i < NUM_PROCESS; i++)
+    {
+        shm_attached[i] = 0;
+        shm_held[i] = 0;
+    }
+}
+
+/*
+ * shmget
+ * DESCRIPTION: find the segment with key, if there is not, allocate a new zeroed one
+ *              with a page frame from the kernel heap. the caller holds a reference
+ *              until it detaches the segment or halts, so a segment nobody attaches
+ *              is freed too
+ * INPUT: key -- user chosen key shared by processes who want to communicate
+ * OUTPUT: none
+ * RETURN: segment id for success, -1 for fail
+ * SIDE AFFECTS: a new segment may be allocated, a reference taken
+ */
+int32_t shmget(int32_t key)
+{
+    int i;              /* loop index */
+    int free_id = -1;   /* first unused segment */
+    uint32_t flags;
+
+    /* sanity check */
+    if (key == SHM_KEY_NONE)
+        return -1;
+
+    spin_lock_irqsave(&shm_lock, flags);
+
+    /* look for an existing segment with this key */
+    for (i = 0; i < SHM_MAX_SEG; i++)
+    {
+        if (shm_segs[i].key == key)
+        {
+            shm_hold(curr_mm_pid, i);
+            spin_unlock_irqrestore(&shm_lock, flags);
+            return i;
+        }
+        if (free_id == -1 && shm_segs[i].key == SHM_KEY_NONE)
+            free_id = i;
+    }
+
+    /* no segment left, or no frame for a new one */
+    if (free_id == -1 || (shm_segs[free_id].page = (uint8_t*)frame_alloc(1)) == NULL)
+    {
+        spin_unlock_irqrestore(&shm_lock, flags);
+        return -1;
+    }
+    shm_segs[free_id].key = key;
+    shm_segs[free_id].refcnt = 0;
+    memset(shm_segs[free_id].page, 0, PAGE_4KB_SIZE);
+    shm_hold(curr_mm_pid, free_id);
+
+    spin_unlock_irqrestore(&shm_lock, flags);
+    return free_id;
+}
+
+/*
+ * shmat
+ * DESCRIPTION: attach a segment to the current process' address space
+ * INPUT: shmid -- segment id returned by shmget
+ *        addr -- a pointer points to a place where to output the virtual address of the segment
+ * OUTPUT: virtual address of the segment
+ * RETURN: 0 for success, -1 for fail
+ * SIDE AFFECTS: segment's page becomes present, TLB flushed
+ */
+int32_t shmat(int32_t shmid, uint8_t** addr)
+{
+    uint32_t flags;
+    uint32_t mm_pid;
+
+    /* sanity check, the output pointer must be in user space */
+    if (shmid < 0 || shmid >= SHM_MAX_SEG)
+        return -1;
+    if ((uint32_t)addr < ADDR_128MB || (uint32_t)(addr + 1) > ADDR_132MB)
+        return -1;
+
+    spin_lock_irqsave(&shm_lock, flags);
+    if (shm_segs[shmid].key == SHM_KEY_NONE)
+    {
+        spin_unlock_irqrestore(&shm_lock, flags);
+        return -1;
+    }
+
+    /* count the reference only once for each process */
+    mm_pid = curr_mm_pid;
+    shm_hold(mm_pid, shmid);
+    shm_attached[mm_pid] |= 1 << shmid;
+
+    /* make sure the page table of the 140MB region is present */
+    page_directory[VIDMAP_OFFSET].p           = 1;    // present
+    page_directory[VIDMAP_OFFSET].r_w         = 1;    // enable r/w
+    page_directory[VIDMAP_OFFSET].u_s         = 1;    // user mode
+    page_directory[VIDMAP_OFFSET].base_addr   = (unsigned int)vid_page_table >> MEM_OFFSET_BITS;
+    vid_page_table[SHM_VID_PT_START + shmid].base_addr = (uint32_t)shm_segs[shmid].page >> MEM_OFFSET_BITS;
+    vid_page_table[SHM_VID_PT_START + shmid].p = 1;
+
+    /* flush TLB */
+    flush_TLB();
+    spin_unlock_irqrestore(&shm_lock, flags);
+
+    /* the other threads of the process may use the address once this returns */
+    smp_remap_others(mm_pid, 1);
+
+    /* output segment virtual address for user */
+    *addr = (uint8_t*)(SHM_VIRTUAL_ADDR + shmid * PAGE_4KB_SIZE);
+
+    return 0;
+}
+
+/*
+ * shmdt
+ * DESCRIPTION: detach a segment from the current process' address space,
+ *              the segment is freed when nobody attaches it
+ * INPUT: shmid -- segment id
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 for fail
+ * SIDE AFFECTS: segment's page becomes not present, TLB flushed
+ */
+int32_t shmdt(int32_t shmid)
+{
+    uint32_t flags;
+    uint32_t mm_pid;
+    uint8_t* page = NULL;
+
+    /* sanity check */
+    if (shmid < 0 || shmid >= SHM_MAX_SEG)
+        return -1;
+
+    spin_lock_irqsave(&shm_lock, flags);
+    mm_pid = curr_mm_pid;
+    if (!(shm_attached[mm_pid] & (1 << shmid)))
+    {
+        spin_unlock_irqrestore(&shm_lock, flags);
+        return -1;
+    }
+
+    shm_attached[mm_pid] &= ~(1 << shmid);
+    shm_held[mm_pid] &= ~(1 << shmid);
+    vid_page_table[SHM_VID_PT_START + shmid].p = 0;
+
+    /* the last reference frees the segment, its frame once no other processor maps it */
+    if (--shm_segs[shmid].refcnt == 0)
+    {
+        page = shm_segs[shmid].page;
+        shm_segs[shmid].key = SHM_KEY_NONE;
+        shm_segs[shmid].page = NULL;
+    }
+
+    /* flush TLB */
+    flush_TLB();
+    spin_unlock_irqrestore(&shm_lock, flags);
+
+    /* the other threads of the process drop the page too */
+    smp_remap_others(mm_pid, page != NULL);
+    if (page != NULL)
+        frame_free(page, 1);
+
+    return 0;
+}
+
+/*
+ * shm_detach_all
+ * DESCRIPTION: drop every segment reference held by a process, attached or only got,
+ *              used by halt
+ * INPUT: pid -- process id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: segments may be freed
+ */
+void shm_detach_all(uint32_t pid)
+{
+    int i;  /* loop index */
+    uint32_t flags;
+
+    spin_lock_irqsave(&shm_lock, flags);
+    for (i = 0; i < SHM_MAX_SEG; i++)
+    {
+        if (!(shm_held[pid] & (1 << i)))
+            continue;
+        if (--shm_segs[i].refcnt == 0)
+            shm_free(i);
+    }
+    shm_attached[pid] = 0;
+    shm_held[pid] = 0;
+    spin_unlock_irqrestore(&shm_lock, flags);
+}
+
+/*
+ * shm_remap
+ * DESCRIPTION: set the shared pages of a process present in the vid page table,
+ *              the caller is in charge of flushing TLB
+ * INPUT: pid -- process id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: vid page table changed
+ */
+void shm_remap(uint32_t pid)
+{
+    int i;  /* loop index */
+    uint32_t flags;
+
+    spin_lock_irqsave(&shm_lock, flags);
+    for (i = 0; i < SHM_MAX_SEG; i++)
+    {
+        vid_page_table[SHM_VID_PT_START + i].p = (shm_attached[pid] >> i) & 1;
+        if (shm_attached[pid] & (1 << i))
+            vid_page_table[SHM_VID_PT_START + i].base_addr = (uint32_t)shm_segs[i].page >> MEM_OFFSET_BITS;
+    }
+    spin_unlock_irqrestore(&shm_lock, flags);
+}
+
+/*
+ * shm_free
+ * DESCRIPTION: free a segment nobody attaches, its page goes back to the kernel heap,
+ *              with shm_lock held
+ * INPUT: shmid -- segment id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void shm_free(int32_t shmid)
+{
+    shm_segs[shmid].key = SHM_KEY_NONE;
+    frame_free(shm_segs[shmid].page, 1);
+    shm_segs[shmid].page = NULL;
+}
+
+/*
+ * shm_hold
+ * DESCRIPTION: take a reference to a segment for a process, once per process, with
+ *              shm_lock held
+ * INPUT: pid -- process id
+ *        shmid -- segment id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: segment's refcnt may increase
+ */
+static void shm_hold(uint32_t pid, int32_t shmid)
+{
+    if (shm_held[pid] & (1 << shmid))
+        return;
+    shm_held[pid] |= 1 << shmid;
+    shm_segs[shmid].refcnt++;
+}
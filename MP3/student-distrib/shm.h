@@ -0,0 +1,41 @@
+/*
+    shared memory header file
+*/
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "types.h"
+#include "paging.h"
+
+#define SHM_MAX_SEG         8                                       /* number of shared 4kB segments        */
+#define SHM_KEY_NONE        -1                                      /* key of an unused segment             */
+#define SHM_VID_PT_START    1                                       /* vid page table entry of segment 0    */
+#define SHM_VIRTUAL_ADDR    (VID_VIRTUAL_ADDR + SHM_VID_PT_START * PAGE_4KB_SIZE)   /* right after vidmap page  */
+
+/* shared memory segment info struct */
+typedef struct shm_seg_t {
+    int32_t key;            /* user chosen key, SHM_KEY_NONE if unused  */
+    uint32_t refcnt;        /* number of processes attaching it         */
+    uint8_t* page;          /* page frame from the kernel heap          */
+} shm_seg_t;
+
+/* initialize shared memory segments */
+void shm_init();
+
+/* find or create the segment with key, return its id */
+int32_t shmget(int32_t key);
+
+/* attach a segment to the current process' address space */
+int32_t shmat(int32_t shmid, uint8_t** addr);
+
+/* detach a segment from the current process' address space */
+int32_t shmdt(int32_t shmid);
+
+/* detach every segment attached by a process, used by halt */
+void shm_detach_all(uint32_t pid);
+
+/* set the shared pages of a process present in the vid page table */
+void shm_remap(uint32_t pid);
+
+#endif
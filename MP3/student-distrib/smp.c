@@ -0,0 +1,385 @@
+#include "smp.h"
+#include "types.h"
+#include "lib.h"
+#include "spinlock.h"
+#include "apic.h"
+#include "paging.h"
+#include "schedule.h"
+#include "syscall.h"
+#include "klog.h"
+#include "fpu.h"
+
+/* trampoline in ap_boot.S, and the data it takes from smp_init */
+extern uint8_t ap_trampoline[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_tramp_gdt[];
+extern uint8_t ap_tramp_cr3[];
+extern uint8_t ap_tramp_stack[];
+
+/* address of a trampoline label once it is copied */
+#define TRAMP(label)    ((uint8_t*)AP_TRAMPOLINE_ADDR + ((label) - ap_trampoline))
+
+/* size of the GDT descriptor loaded by lgdt */
+#define GDT_DESC_SIZE   6
+
+/* idle stacks of the APs, cpus[0] keeps the boot stack */
+static uint8_t ap_stacks[MAX_CPUS][AP_STACK_SIZE] __attribute__((aligned(AP_STACK_SIZE)));
+
+/* index given to the AP being started, read by ap_main */
+static volatile uint32_t ap_booting = 0;
+
+/* the kernel lock */
+static spinlock_t kernel_spinlock = SPINLOCK_INIT;
+
+static int32_t ap_start(uint32_t id, uint32_t apic_id);
+
+/*
+ * smp_init
+ * DESCRIPTION: start every enabled processor of the MADT with INIT and STARTUP IPIs,
+ *              one at a time, each comes up with its own TSS, page directory and idle
+ *              stack and waits in its idle loop for a process to run
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: number of processors online
+ * SIDE AFFECTS: cpus and ncpus_online filled in
+ */
+int32_t smp_init()
+{
+    uint32_t bsp_apic_id;
+    uint32_t i;
+
+    /* the boot processor */
+    cpus[0].id = 0;
+    cpus[0].apic_id = apic_mode ? lapic_id() : 0;
+    cpus[0].prev_pid = -1;
+    cpus[0].online = 1;
+    ncpus_online = 1;
+
+    /* the APs need the LAPIC timer as their tick */
+    if (!USE_SMP || !apic_mode || madt.ncpus <= 1)
+    {
+        klog(KLOG_INFO, "smp: 1 cpu online");
+        return ncpus_online;
+    }
+
+    /* the trampoline runs in real mode from a page below 1MB */
+    set_low_pages(AP_TRAMPOLINE_ADDR, AP_TRAMPOLINE_ADDR + PAGE_4KB_SIZE, 1);
+    memcpy((void*)AP_TRAMPOLINE_ADDR, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    memcpy(TRAMP(ap_tramp_gdt), (uint8_t*)&gdt_desc_ptr, GDT_DESC_SIZE);
+
+    bsp_apic_id = cpus[0].apic_id;
+    for (i = 0; i < madt.ncpus && ncpus_online < MAX_CPUS; i++)
+    {
+        if (madt.cpu_apic_id[i] == bsp_apic_id)
+            continue;
+        /* an AP that starts late would take the index of the next one, stop at the first failure */
+        if (ap_start(ncpus_online, madt.cpu_apic_id[i]) != 0)
+        {
+            klog(KLOG_WARN, "smp: cpu with apic id %u did not start", madt.cpu_apic_id[i]);
+            break;
+        }
+        ncpus_online++;
+    }
+
+    set_low_pages(AP_TRAMPOLINE_ADDR, AP_TRAMPOLINE_ADDR + PAGE_4KB_SIZE, 0);
+    klog(KLOG_INFO, "smp: %u cpus online", ncpus_online);
+    return ncpus_online;
+}
+
+/*
+ * ap_start
+ * DESCRIPTION: prepare the state of an AP and start it, INIT then up to two STARTUP
+ *              IPIs as in the MP specification
+ * INPUT: id -- index in cpus
+ *        apic_id -- its LAPIC id
+ * OUTPUT: none
+ * RETURN: 0 once it is online, -1 if it did not come up in AP_START_TIMEOUT_MS
+ * SIDE AFFECTS: page directory of the AP set up
+ */
+static int32_t ap_start(uint32_t id, uint32_t apic_id)
+{
+    cpu_t* cpu = &cpus[id];
+    uint32_t stack_top = (uint32_t)ap_stacks[id] + AP_STACK_SIZE;
+    uint32_t i;
+
+    cpu->id = id;
+    cpu->apic_id = apic_id;
+    cpu->online = 0;
+    cpu->pid = -1;
+    cpu->fd_array = NULL;
+    cpu->lock_depth = 0;
+    cpu->prev_pid = -1;
+
+    /* kernel entries shared with the boot processor, user entries set when a process runs there */
+    paging_init_ap(id);
+    tss[id].esp0 = stack_top;
+
+    *(uint32_t*)TRAMP(ap_tramp_cr3) = (uint32_t)cpu_page_directory[id];
+    *(uint32_t*)TRAMP(ap_tramp_stack) = stack_top;
+    ap_booting = id;
+
+    if (lapic_ipi(apic_id, ICR_INIT | ICR_LEVEL_ASSERT) != 0)
+        return -1;
+    pit_delay_us(AP_INIT_DELAY_US);
+    for (i = 0; i < 2 && !cpu->online; i++)
+    {
+        if (lapic_ipi(apic_id, ICR_STARTUP | (AP_TRAMPOLINE_ADDR >> MEM_OFFSET_BITS)) != 0)
+            return -1;
+        pit_delay_us(AP_SIPI_DELAY_US);
+    }
+    for (i = 0; i < AP_START_TIMEOUT_MS && !cpu->online; i++)
+        pit_delay_us(AP_POLL_US);
+
+    return cpu->online ? 0 : -1;
+}
+
+/*
+ * ap_main
+ * DESCRIPTION: C entry of an AP, in protected mode with paging and the IDT. load its TSS,
+ *              start its LAPIC timer and idle until the scheduler gives it a process
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: never
+ * SIDE AFFECTS: none
+ */
+void ap_main()
+{
+    uint32_t id = ap_booting;
+    cpu_t* cpu = &cpus[id];
+
+    ltr(CPU_TSS(id));
+    lldt(KERNEL_LDT);
+    lapic_init_ap();
+    fpu_init();
+
+    /* ticks come from now on, the first one takes the kernel lock */
+    cpu->online = 1;
+    klog(KLOG_INFO, "smp: cpu %u online, apic id %u", id, cpu->apic_id);
+
+    /* the idle loop, the scheduler saves this context in cpu_t and never queues it */
+    sti();
+    while (1)
+    {
+        cpu->idle = 1;
+        asm volatile ("hlt");
+    }
+}
+
+/*
+ * kernel_lock
+ * DESCRIPTION: take the kernel lock, or nest once more if this processor holds it
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: may spin until another processor leaves the kernel
+ */
+void kernel_lock()
+{
+    uint32_t flags;
+    cpu_t* cpu;
+
+    /* no interrupt, and so no switch to another process, between the check and the take */
+    cli_and_save(flags);
+    cpu = this_cpu();
+    if (cpu->lock_depth++ == 0)
+        spin_lock(&kernel_spinlock);
+    restore_flags(flags);
+}
+
+/*
+ * kernel_unlock
+ * DESCRIPTION: undo one kernel_lock, the lock is released when the nesting reaches 0
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void kernel_unlock()
+{
+    uint32_t flags;
+    cpu_t* cpu;
+
+    cli_and_save(flags);
+    cpu = this_cpu();
+    if (cpu->lock_depth > 0 && --cpu->lock_depth == 0)
+        spin_unlock(&kernel_spinlock);
+    restore_flags(flags);
+}
+
+/*
+ * kernel_lock_drop
+ * DESCRIPTION: release the kernel lock whatever the nesting, used before waiting and
+ *              before entering user mode from execute
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: nesting held before, 0 if the lock was not held
+ * SIDE AFFECTS: none
+ */
+uint32_t kernel_lock_drop()
+{
+    uint32_t flags;
+    uint32_t depth;
+    cpu_t* cpu;
+
+    cli_and_save(flags);
+    cpu = this_cpu();
+    depth = cpu->lock_depth;
+    if (depth > 0)
+    {
+        cpu->lock_depth = 0;
+        spin_unlock(&kernel_spinlock);
+    }
+    restore_flags(flags);
+    return depth;
+}
+
+/*
+ * kernel_lock_retake
+ * DESCRIPTION: take the kernel lock back after kernel_lock_drop, possibly on another
+ *              processor if the process was switched in between
+ * INPUT: depth -- nesting returned by kernel_lock_drop
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void kernel_lock_retake(uint32_t depth)
+{
+    uint32_t flags;
+
+    if (depth == 0)
+        return;
+    cli_and_save(flags);
+    spin_lock(&kernel_spinlock);
+    this_cpu()->lock_depth = depth;
+    restore_flags(flags);
+}
+
+/*
+ * kernel_wait
+ * DESCRIPTION: sleep until the next interrupt with the kernel lock released, the
+ *              replacement of sti; hlt; cli in kernel wait loops. an AP only wakes on
+ *              its own tick, device IRQs go to the boot processor
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: IF MUST be 0 and is 0 on return
+ */
+void kernel_wait()
+{
+    uint32_t depth = kernel_lock_drop();
+
+    this_cpu()->idle = 1;
+    /* sti takes effect after hlt starts, so no interrupt is missed */
+    asm volatile ("sti; hlt; cli");
+    this_cpu()->idle = 0;
+    kernel_lock_retake(depth);
+}
+
+/*
+ * kernel_relax
+ * DESCRIPTION: let other processors into the kernel once, for loops spinning on a
+ *              condition set by an interrupt handler that may run elsewhere
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void kernel_relax()
+{
+    uint32_t depth = kernel_lock_drop();
+
+    asm volatile ("pause");
+    kernel_lock_retake(depth);
+}
+
+/*
+ * smp_remap_others
+ * DESCRIPTION: a mapping change of a process only reaches the page tables and TLB of
+ *              this processor, send the remap IPI to every other processor running a
+ *              thread of the process. one switched to the process later maps it anew
+ * INPUT: mm_pid -- the process
+ *        wait -- 1 to return once they remapped, before a frame they mapped is freed.
+ *                the caller MUST have IF = 1 and hold no lock they may spin on with
+ *                IF = 0 (the kernel lock, shm_lock)
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void smp_remap_others(uint32_t mm_pid, uint32_t wait)
+{
+    uint32_t seen[MAX_CPUS];
+    uint32_t sent = 0;
+    uint32_t flags;
+    uint32_t i, pid;
+
+    if (ncpus_online < 2)
+        return;
+
+    /* no switch or migration while the targets are picked and the ICR is written */
+    cli_and_save(flags);
+    for (i = 0; i < ncpus_online; i++)
+    {
+        pid = cpus[i].pid;
+        if (i == cpu_id() || pid == -1 || get_pcb_ptr(pid)->mm_pid != mm_pid)
+            continue;
+        seen[i] = cpus[i].remaps;
+        if (lapic_ipi(cpus[i].apic_id, IPI_REMAP_VEC) == 0)
+            sent |= 1 << i;
+    }
+    restore_flags(flags);
+
+    for (i = 0; wait && i < ncpus_online; i++)
+    {
+        while ((sent & (1 << i)) && cpus[i].remaps == seen[i])
+            asm volatile ("pause");
+    }
+}
+
+/*
+ * ipi_remap_handler
+ * DESCRIPTION: remap IPI, map the process running here again from its current state
+ *              and flush TLB. runs with IF = 0 and without the kernel lock
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: page directory and vid page table of this processor changed
+ */
+void ipi_remap_handler()
+{
+    cpu_t* cpu = this_cpu();
+
+    lapic_eoi();
+    if (cpu->pid != -1)
+        set_paging(get_pcb_ptr(cpu->pid)->mm_pid);
+    cpu->remaps++;
+}
+
+/*
+ * smp_stats
+ * DESCRIPTION: print the scheduler statistics of each processor (CTRL+P), and the
+ *              average cost of a switch out of a run that used the FPU or not, and how
+ *              long interrupt handlers kept interrupts disabled
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void smp_stats()
+{
+    cpu_t* cpu;
+    uint32_t i;
+
+    printf("\n");
+    for (i = 0; i < ncpus_online; i++)
+    {
+        cpu = &cpus[i];
+        printf("cpu %u: pid %d, ticks %u, busy %u%%, switches %u, steals %u\n", i, cpu->pid, cpu->ticks,
+               cpu->ticks ? 100 - cpu->idle_ticks * 100 / cpu->ticks : 0, cpu->switches, cpu->steals);
+        printf("  switch cycles: fpu %u (%u), no fpu %u (%u), fpu load %u (%u)\n",
+               cpu->fpu_switches ? cpu->fpu_switch_cycles / cpu->fpu_switches : 0, cpu->fpu_switches,
+               cpu->plain_switches ? cpu->plain_switch_cycles / cpu->plain_switches : 0, cpu->plain_switches,
+               cpu->fpu_traps ? cpu->fpu_trap_cycles / cpu->fpu_traps : 0, cpu->fpu_traps);
+        printf("  irq off cycles: avg %u, max %u (%u)\n",
+               cpu->irqoff_count ? cpu->irqoff_cycles / cpu->irqoff_count : 0, cpu->irqoff_max, cpu->irqoff_count);
+    }
+}
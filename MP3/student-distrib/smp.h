@@ -0,0 +1,108 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+#include "types.h"
+#include "x86_desc.h"
+
+/* Reference: https://wiki.osdev.org/Symmetric_Multiprocessing */
+
+/* set to 0 (-DUSE_SMP=0) to leave the application processors halted */
+#ifndef USE_SMP
+#define USE_SMP                 1
+#endif
+
+#define AP_TRAMPOLINE_ADDR      0x8000      /* real mode entry of the APs, page aligned below 1MB */
+#define AP_STACK_SIZE           4096        /* stack of the idle loop of each AP                  */
+#define AP_INIT_DELAY_US        10000       /* wait after INIT                                    */
+#define AP_SIPI_DELAY_US        200         /* wait after each STARTUP                            */
+#define AP_START_TIMEOUT_MS     100         /* give up on an AP not online after this             */
+#define AP_POLL_US              1000        /* one poll of the online flag per ms                 */
+
+#ifndef ASM
+
+struct file_desc_t;
+struct tasklet_t;
+
+/* state of one processor, only touched by that processor unless noted */
+typedef struct cpu_t {
+    uint32_t id;                        /* index in cpus, CPU_TSS(id) is its TSS            */
+    uint32_t apic_id;                   /* LAPIC id                                         */
+    volatile uint32_t online;           /* set by the processor once it can take ticks      */
+    uint32_t pid;                       /* process running here, -1 if idle                 */
+    struct file_desc_t* fd_array;       /* fd array of that process                         */
+    uint32_t lock_depth;                /* kernel lock nesting, held if not 0               */
+    uint32_t prev_pid;                  /* process switched out, queued after the switch    */
+    uint32_t idle_ebp;                  /* context of the idle loop, ebp then esp           */
+    uint32_t idle_esp;
+    uint32_t idle_depth;
+    volatile uint32_t idle;             /* 1 while halted with nothing to do                */
+    uint32_t fpu_owner;                 /* process whose FPU state is in the registers, -1  */
+    volatile uint32_t softirq_pending;  /* raised softirqs, bit n for softirq n             */
+    uint32_t in_softirq;                /* 1 while softirqs run, follows the context        */
+    struct tasklet_t* tasklet_head;     /* tasklets to run, in order                        */
+    struct tasklet_t* tasklet_tail;
+    uint32_t irqoff_start;              /* TSC when interrupts were last turned off         */
+    /* statistics, read by smp_stats */
+    uint32_t ticks;                     /* scheduler ticks taken                            */
+    uint32_t idle_ticks;                /* ticks that found it halted                       */
+    uint32_t switches;                  /* processes switched in                            */
+    uint32_t steals;                    /* processes taken from another run queue           */
+    uint32_t irqs;                      /* device interrupts taken                          */
+    volatile uint32_t remaps;           /* remap IPIs handled, read by their senders        */
+    uint32_t fpu_switches;              /* switches out of a run that used the FPU ...      */
+    uint32_t fpu_switch_cycles;         /* ... and their cycles, FXSAVE included            */
+    uint32_t plain_switches;            /* switches out of a run that did not ...           */
+    uint32_t plain_switch_cycles;       /* ... and their cycles                             */
+    uint32_t fpu_traps;                 /* vector 7 traps, lazy FPU loads ...               */
+    uint32_t fpu_trap_cycles;           /* ... and their cycles, FXRSTOR included           */
+    uint32_t irqoff_count;              /* interrupt-disabled stretches in handlers ...     */
+    uint32_t irqoff_cycles;             /* ... their cycles ...                             */
+    uint32_t irqoff_max;                /* ... and the longest                              */
+} cpu_t;
+
+/* per-processor state, cpus[0] is the boot processor */
+cpu_t cpus[MAX_CPUS];
+
+/* processors running, the first ncpus_online entries of cpus */
+uint32_t ncpus_online;
+
+/* state of the processor running this */
+static inline cpu_t* this_cpu(void) {
+    return &cpus[cpu_id()];
+}
+
+/* start the application processors listed in the MADT */
+extern int32_t smp_init();
+/* C entry of an application processor, called by the trampoline */
+extern void ap_main();
+
+/*
+ * the kernel lock, taken at every kernel entry (system call, interrupt, exception)
+ * and released on the way out, so kernel code runs on one processor at a time while
+ * user code runs on all of them. it nests on the processor that holds it, and the
+ * nesting is saved and restored with each process context. the run queues, pid table,
+ * shm tables, kernel heap, timer wheel and terminal input queues have spinlocks of
+ * their own, taken with spin_lock_irqsave, so the system calls that only touch them
+ * (see syscall_unlocked) run without the kernel lock
+ */
+extern void kernel_lock();
+extern void kernel_unlock();
+/* release the lock whatever the nesting, returns the nesting for kernel_lock_retake */
+extern uint32_t kernel_lock_drop();
+extern void kernel_lock_retake(uint32_t depth);
+/* sti; hlt; cli without holding the kernel lock, IF MUST be 0 */
+extern void kernel_wait();
+/* let other processors into the kernel while spinning on a condition */
+extern void kernel_relax();
+
+/* make the other processors running threads of a process redo its mappings */
+extern void smp_remap_others(uint32_t mm_pid, uint32_t wait);
+/* remap IPI handler */
+extern void ipi_remap_handler();
+
+/* print ticks, idle time, switches, steals, switch costs and irq-off time of each processor */
+extern void smp_stats();
+
+#endif /* ASM */
+
+#endif /* _SMP_H */
@@ -0,0 +1,237 @@
+#include "softirq.h"
+#include "lib.h"
+#include "smp.h"
+#include "syscall.h"
+#include "trace.h"
+
+/* handler of each softirq */
+static softirq_fn softirq_vec[NUM_SOFTIRQS];
+
+static void tasklet_action();
+static void do_softirq();
+static void irqoff_stop(cpu_t* cpu);
+
+/*
+ * softirq_init
+ * DESCRIPTION: init the softirq table, the tasklet softirq runs the tasklet queues
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: bottom halves deferred from now on
+ */
+void softirq_init()
+{
+    softirq_register(SOFTIRQ_TASKLET, tasklet_action);
+    softirq_defer = 1;
+}
+
+/*
+ * softirq_register
+ * DESCRIPTION: set the handler of a softirq
+ * INPUT: nr -- softirq number
+ *        fn -- handler, runs with IF = 1 and the kernel lock held
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void softirq_register(uint32_t nr, softirq_fn fn)
+{
+    if (nr < NUM_SOFTIRQS)
+        softirq_vec[nr] = fn;
+}
+
+/*
+ * softirq_raise
+ * DESCRIPTION: mark a softirq pending on this processor, it runs at the next irq_exit
+ * INPUT: nr -- softirq number
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void softirq_raise(uint32_t nr)
+{
+    uint32_t flags;
+
+    cli_and_save(flags);
+    this_cpu()->softirq_pending |= 1 << nr;
+    restore_flags(flags);
+}
+
+/*
+ * tasklet_schedule
+ * DESCRIPTION: queue a tasklet at the tail of this processor's tasklet queue
+ * INPUT: t -- tasklet, nothing is done if it is already queued
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: SOFTIRQ_TASKLET raised
+ */
+void tasklet_schedule(tasklet_t* t)
+{
+    cpu_t* cpu;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (!t->scheduled)
+    {
+        cpu = this_cpu();
+        t->scheduled = 1;
+        t->next = NULL;
+        if (cpu->tasklet_head == NULL)
+            cpu->tasklet_head = t;
+        else
+            cpu->tasklet_tail->next = t;
+        cpu->tasklet_tail = t;
+        cpu->softirq_pending |= 1 << SOFTIRQ_TASKLET;
+    }
+    restore_flags(flags);
+}
+
+/*
+ * tasklet_action
+ * DESCRIPTION: the tasklet softirq, run every tasklet queued so far in order. a tasklet
+ *              may schedule itself again, it then runs on the next pass
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void tasklet_action()
+{
+    cpu_t* cpu;
+    tasklet_t* list;
+    tasklet_t* t;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    cpu = this_cpu();
+    list = cpu->tasklet_head;
+    cpu->tasklet_head = NULL;
+    cpu->tasklet_tail = NULL;
+    restore_flags(flags);
+
+    while (list != NULL)
+    {
+        t = list;
+        list = t->next;
+        t->scheduled = 0;
+        t->func(t->data);
+    }
+}
+
+/*
+ * irq_enter
+ * DESCRIPTION: start of an interrupt handler, interrupts are off from here
+ * INPUT: irq -- line of the interrupt, LINKAGE_IRQ_*
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void irq_enter(uint32_t irq)
+{
+    cpu_t* cpu = this_cpu();
+
+    cpu->irqs++;
+    cpu->irqoff_start = (uint32_t)rdtsc();
+    trace(TRACE_IRQ_ENTER, curr_pid, irq);
+}
+
+/*
+ * irq_exit
+ * DESCRIPTION: end of an interrupt handler, run the pending softirqs unless this
+ *              interrupt came in while they were running
+ * INPUT: irq -- line of the interrupt, LINKAGE_IRQ_*
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: IF = 0 on return
+ */
+void irq_exit(uint32_t irq)
+{
+    cpu_t* cpu = this_cpu();
+
+    trace(TRACE_IRQ_EXIT, curr_pid, irq);
+    if (cpu->softirq_pending && !cpu->in_softirq)
+        do_softirq();
+    irqoff_stop(this_cpu());
+}
+
+/*
+ * do_softirq
+ * DESCRIPTION: run the pending softirqs, with interrupts enabled if softirq_defer is
+ *              set. interrupts taken meanwhile may raise more, they are run in up to
+ *              SOFTIRQ_MAX_RESTART passes
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: IF MUST be 0 and is 0 on return
+ */
+static void do_softirq()
+{
+    cpu_t* cpu = this_cpu();
+    uint32_t restart = SOFTIRQ_MAX_RESTART;
+    uint32_t pending;
+    uint32_t nr;
+
+    cpu->in_softirq = 1;
+    while ((pending = cpu->softirq_pending) != 0 && restart-- > 0)
+    {
+        cpu->softirq_pending = 0;
+        if (softirq_defer)
+        {
+            irqoff_stop(cpu);
+            sti();
+        }
+        for (nr = 0; pending != 0; nr++, pending >>= 1)
+        {
+            if ((pending & 1) && softirq_vec[nr] != NULL)
+                softirq_vec[nr]();
+        }
+        cli();
+        /* a handler may execute a shell and come back here much later, maybe elsewhere */
+        cpu = this_cpu();
+        if (softirq_defer)
+            cpu->irqoff_start = (uint32_t)rdtsc();
+    }
+    cpu->in_softirq = 0;
+}
+
+/*
+ * irqoff_stop
+ * DESCRIPTION: interrupts are about to be enabled, record how long they were off
+ *              since irq_enter or the last cli of do_softirq
+ * INPUT: cpu -- this processor
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void irqoff_stop(cpu_t* cpu)
+{
+    uint32_t cycles = (uint32_t)rdtsc() - cpu->irqoff_start;
+
+    cpu->irqoff_count++;
+    cpu->irqoff_cycles += cycles;
+    if (cycles > cpu->irqoff_max)
+        cpu->irqoff_max = cycles;
+}
+
+/*
+ * irqoff_reset
+ * DESCRIPTION: clear the interrupt-disabled time statistics of every processor
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void irqoff_reset()
+{
+    uint32_t flags;
+    uint32_t i;
+
+    cli_and_save(flags);
+    for (i = 0; i < MAX_CPUS; i++)
+    {
+        cpus[i].irqoff_count = 0;
+        cpus[i].irqoff_cycles = 0;
+        cpus[i].irqoff_max = 0;
+    }
+    restore_flags(flags);
+}
@@ -0,0 +1,52 @@
+#ifndef _SOFTIRQ_H
+#define _SOFTIRQ_H
+
+#include "types.h"
+
+/*
+    bottom halves of interrupt handlers. a handler (top half) acknowledges the device,
+    queues what it read and raises a softirq or schedules a tasklet; irq_exit runs the
+    pending ones with interrupts enabled before the linkage returns. softirqs of one
+    processor never nest and are never preempted by the scheduler
+*/
+
+#define SOFTIRQ_TTY             0   /* line discipline of queued scancodes      */
+#define SOFTIRQ_TASKLET         1   /* tasklets scheduled on this processor     */
+#define SOFTIRQ_TIMER           2   /* expired kernel timers, boot processor    */
+#define NUM_SOFTIRQS            3
+
+/* passes over newly raised softirqs before irq_exit returns, the rest waits for the next irq */
+#define SOFTIRQ_MAX_RESTART     4
+
+typedef void (*softirq_fn)();
+
+/* deferred function, scheduled at most once until it runs */
+typedef struct tasklet_t {
+    struct tasklet_t* next;
+    void (*func)(uint32_t data);
+    uint32_t data;
+    volatile uint32_t scheduled;
+} tasklet_t;
+
+#define TASKLET_INIT(func, data)    { NULL, (func), (data), 0 }
+
+/* 1 to run bottom halves with interrupts enabled, 0 to run them inline with IF = 0 */
+uint32_t softirq_defer;
+
+/* init the softirq table */
+extern void softirq_init();
+/* set the handler of a softirq */
+extern void softirq_register(uint32_t nr, softirq_fn fn);
+/* mark a softirq pending on this processor */
+extern void softirq_raise(uint32_t nr);
+/* queue a tasklet on this processor, nothing if it is already queued */
+extern void tasklet_schedule(tasklet_t* t);
+
+/* called by the interrupt linkage around each handler, with IF = 0 */
+extern void irq_enter(uint32_t irq);
+extern void irq_exit(uint32_t irq);
+
+/* clear the interrupt-disabled time statistics of every processor */
+extern void irqoff_reset();
+
+#endif /* _SOFTIRQ_H */
@@ -0,0 +1,62 @@
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "types.h"
+#include "lib.h"
+
+/*
+    ticket spinlock, processors get the lock in the order they asked for it.
+    a lock also taken by interrupt handlers MUST be taken with spin_lock_irqsave,
+    or a handler on the same processor would spin forever on it
+*/
+typedef struct spinlock_t {
+    volatile uint16_t next;     /* ticket of the next processor to ask  */
+    volatile uint16_t owner;    /* ticket holding the lock              */
+} spinlock_t;
+
+#define SPINLOCK_INIT       { 0, 0 }
+
+/* init a lock, unlocked */
+static inline void spin_init(spinlock_t* lock) {
+    lock->next = 0;
+    lock->owner = 0;
+}
+
+/* take a ticket and wait for it to be served */
+static inline void spin_lock(spinlock_t* lock) {
+    uint16_t ticket = 1;
+    asm volatile ("lock xaddw %0, %1"
+            : "+r"(ticket), "+m"(lock->next)
+            :
+            : "memory", "cc"
+    );
+    while (lock->owner != ticket)
+        asm volatile ("pause" : : : "memory");
+}
+
+/* serve the next ticket, only the holder writes owner */
+static inline void spin_unlock(spinlock_t* lock) {
+    asm volatile ("" : : : "memory");
+    lock->owner++;
+}
+
+/* 1 if some processor holds the lock */
+static inline int32_t spin_is_locked(spinlock_t* lock) {
+    return lock->next != lock->owner;
+}
+
+/* disable interrupts on this processor, then take the lock */
+#define spin_lock_irqsave(lock, flags)      \
+do {                                        \
+    cli_and_save(flags);                    \
+    spin_lock(lock);                        \
+} while (0)
+
+/* release the lock, then restore the interrupt flag */
+#define spin_unlock_irqrestore(lock, flags) \
+do {                                        \
+    spin_unlock(lock);                      \
+    restore_flags(flags);                   \
+} while (0)
+
+#endif /* _SPINLOCK_H */
@@ -5,11 +5,35 @@
 #include "rtc.h"
 #include "filesys.h"
 #include "terminal.h"
+#include "shm.h"
+#include "schedule.h"
+#include "klog.h"
+#include "prof.h"
+#include "trace.h"
+#include "thread.h"
+#include "vbe.h"
+#include "uheap.h"
+#include "kheap.h"
+#include "spinlock.h"
+#include "tests.h"
 
 /* file operation table array */
 static file_op_table_t file_op_table_arr[FILE_TYPE_NUM];
 /* process id array */
 static uint32_t pid_array[NUM_PROCESS] = {0};
+/* pid_array, a thread's pid is freed by the scheduler of any processor */
+static spinlock_t pid_lock = SPINLOCK_INIT;
+/* fd array of a new process, stdin and stdout open, see file_op_table_init */
+static file_desc_t fd_array_init[MAX_FILE_NUM];
+/* fd arrays of the processes */
+static kmem_cache_t* fd_array_cache;
+/* executables execute has checked, the file system image does not change */
+static exec_cache_t exec_cache[EXEC_CACHE_SIZE];
+/* next entry replaced */
+static uint32_t exec_cache_next;
+
+static exec_cache_t* exec_lookup(const uint8_t* name);
+static void execute_undo(uint32_t pid);
 
 /*
  * halt
@@ -32,11 +56,25 @@ int32_t halt(uint8_t status)
     /* get current process' pcb pointer */
     curr_pcb = get_pcb_ptr(curr_pid);
 
+    /* a thread ends alone, the memory and fds stay with its process */
+    if (curr_pcb->mm_pid != curr_pcb->pid)
+        thread_exit();
+
+    /* the other threads of the process go first, they use its memory */
+    if (curr_pcb->threads > 0)
+        thread_kill_all(curr_pcb);
+
     /* get current process' terminal id */
     curr_process_term_id = curr_pcb->term_id;
 
     /* clear pid */
-    pid_array[curr_pcb->pid] = 0;
+    free_pid(curr_pcb->pid);
+
+    /* its FPU state is not needed anymore */
+    fpu_drop(curr_pcb->pid);
+
+    /* nor its timers */
+    timer_proc_exit(curr_pcb->pid);
 
     /* get parent pcb, if current process is the base shell, just load itsself as its parent for re-executing */
     parent_pcb = get_pcb_ptr((curr_pcb->parent_pid == NO_PARENT_PID) ? curr_pid : curr_pcb->parent_pid);
@@ -46,6 +84,13 @@ int32_t halt(uint8_t status)
         if(cur_fd_array[fd].flags)
             close(fd);
     }
+    /* drop shared memory references */
+    shm_detach_all(curr_pcb->pid);
+    /* and the display, back to text */
+    vbe_release(curr_pcb->pid);
+    /* and the heap */
+    uheap_release(curr_pcb->pid);
+
     /* clear stdin fd */
     cur_fd_array[0].op = NULL;
     cur_fd_array[0].flags = FD_FLAG_FREE;
@@ -53,30 +98,41 @@ int32_t halt(uint8_t status)
     cur_fd_array[1].op = NULL;
     cur_fd_array[1].flags = FD_FLAG_FREE;
 
-    /* restore parent fd array */
-    cur_fd_array = parent_pcb->fd_array;
+    /* the fd array goes back to its cache, a base shell has none until execute */
+    kmem_cache_free(fd_array_cache, curr_pcb->fd_array);
+    curr_pcb->fd_array = NULL;
+
+    /* restore parent fd array, a thread's are its process' */
+    cur_fd_array = get_pcb_ptr(parent_pcb->mm_pid)->fd_array;
 
     /* restore parent paging */
-    set_paging(parent_pcb->pid);
+    set_paging(parent_pcb->mm_pid);
 
     /* restore tss data, i.e. kernel stack pointer */
-    tss.esp0 = KS_BASE_ADDR - KS_SIZE*parent_pcb->pid - sizeof(int32_t);
+    tss[cpu_id()].esp0 = KS_BASE_ADDR - KS_SIZE*parent_pcb->pid - sizeof(int32_t);
 
     /* update terminal info */
     terminals[curr_process_term_id].pnum--;
 
     /* if it is the base shell, restart it */
     if(curr_pcb->parent_pid == NO_PARENT_PID){
+#if RUN_BENCH
+        /* the benchmark program ran in place of the first shell, its status ends the run */
+        if (curr_process_term_id == FIRST_TERMINAL_ID)
+            bench_exit(status);
+#endif
         clear();
         sti();
         execute((uint8_t*)"shell");
     }
 
     /* update pid */
+    trace(TRACE_HALT, curr_pid, status);
+    trace(TRACE_SWITCH, curr_pid, TRACE_SWITCH_ARG(parent_pcb->pid, parent_pcb->term_id, TRACE_SW_HALT));
     curr_pid = parent_pcb->pid;
 
     /* update terminal info */
-    terminals[curr_process_term_id].curr_pid = curr_pid;
+    terminals[curr_process_term_id].active_pid = curr_pid;
 
     /* decide return value according to the halt status */
     retval = (status == HALT_EXCEPTION) ? HALT_EXCEPTION_RETVAL : (uint16_t)status;
@@ -87,6 +143,10 @@ int32_t halt(uint8_t status)
     else
         terminal_putc('\n');
 
+    /* the parent's context comes back with the kernel lock nesting it was saved with */
+    this_cpu()->lock_depth = parent_pcb->lock_depth;
+    this_cpu()->in_softirq = parent_pcb->in_softirq;
+
     /* halt and enable interrupt */
     asm volatile("              \n\
         movl    %0, %%esp       \n\
@@ -120,20 +180,20 @@ int32_t execute(const uint8_t *cmd)
     /* parsed command and argument */
     uint8_t command[MAX_CMD_LEN];
     uint8_t argument[MAX_ARG_LEN];
-    /* file excitability check buffer */
-    uint8_t check_buffer[CHECK_BUFFER_SIZE];
     /* loop index */
     int i;
     /* start, end of the cmd and arg, used in parser */
     int start, end;
-    /* check dentry in executable check */  
-    dentry_t check_dentry;
+    /* checked executable */
+    exec_cache_t* exe;
     /* new process id */
     uint32_t new_pid;
     /* pcb pointer */
     pcb_t *curr_pcb, *new_pcb;
     /* EIP and ESP setting */
     uint32_t new_eip, new_esp;
+    /* 1 if the current process keeps running in its terminal and goes to the run queue */
+    uint32_t queue_curr;
 
     /* forbid interrupt */
     cli();
@@ -146,8 +206,8 @@ int32_t execute(const uint8_t *cmd)
     start = 0;
     /* until a non-space char appears */
     while (' ' == cmd[start])   start++;
-    /* parse the commands */
-    for (i = start; i < strlen((int8_t*)cmd); i++)
+    /* parse the commands, one pass up to the first space */
+    for (i = start; cmd[i] != '\0' && cmd[i] != ' '; i++)
     {
         /* if the commands is too long, report an error */
         if(i - start > MAX_CMD_LEN - 1)
@@ -155,8 +215,6 @@ int32_t execute(const uint8_t *cmd)
             sti();
             return -1;
         }
-        /* commands ends if meet a empty char */
-        if(cmd[i] == ' ')   break;
         /* store the parsed cmd into a buffer */
         command[i-start] = cmd[i];
     }
@@ -165,9 +223,9 @@ int32_t execute(const uint8_t *cmd)
     /* skip all the empty char between command and argument */
     start = i;
     while (' ' == cmd[start]) start++;
-    /* get the length of argument */
+    /* get the length of argument, the rest is cut off if it does not fit */
     end = start;
-    while (cmd[end] != '\0' && cmd[end] != ' ' && cmd[end] != '\n') end++;
+    while (cmd[end] != '\0' && cmd[end] != ' ' && cmd[end] != '\n' && end - start < MAX_ARG_LEN - 1) end++;
     /* also stores the argument into a buffer */
     for (i = start; i < end; i++)
         argument[i-start] = cmd[i];
@@ -178,22 +236,8 @@ int32_t execute(const uint8_t *cmd)
      * 2. check file executability *
      * =========================== */
 
-    /* is a file in the fs? */
-    if(0 != read_dentry_by_name(command, &check_dentry)){
-        sti();
-        return -1;
-    }
-
-    /* is valid exectuable? */
-    /* check file type */
-    if(check_dentry.file_type != FILE_TYPE){
-        sti();
-        return -1;
-    }
-    /* read magic number of the excutable file */
-    read_data(check_dentry.inode_idx, 0, check_buffer, CHECK_BUFFER_SIZE);
-    /* check the magic number of the excutable file: 0x7F, E, L, F */
-    if(check_buffer[0]!=0x7f && check_buffer[1]!='E' && check_buffer[2]!='L' && check_buffer[3]!= 'F')
+    /* a valid executable in the fs, checked once */
+    if ((exe = exec_lookup(command)) == NULL)
     {
         sti();
         return -1;
@@ -204,20 +248,46 @@ int32_t execute(const uint8_t *cmd)
      * 3. set paging *
      * ============= */
 
+    /* a base shell of another terminal leaves the current process ready, a halting base shell
+     * is not, nor one blocked in a wait, its wake up queues it */
+    queue_curr = (curr_pid != -1 && pid_used(curr_pid) && terminals[curr_term_id].pnum == 0 &&
+                  !get_pcb_ptr(curr_pid)->blocked);
+
     /* get new process id */
-    if ((new_pid = get_new_pid()) != -1)
+    if ((new_pid = get_new_pid()) == -1)
     {
-        set_paging(new_pid);
-    }else{
         /* Current number of running process exceeds */
         sti();
         return HALT_SPECIAL;
     }
 
+    /* its fd array and timers come from their caches */
+    new_pcb = get_pcb_ptr(new_pid);
+    if (fd_array_cache == NULL || (new_pcb->fd_array = kmem_cache_alloc(fd_array_cache)) == NULL)
+    {
+        free_pid(new_pid);
+        sti();
+        return -1;
+    }
+    if (timer_proc_init(new_pid) == -1)
+    {
+        kmem_cache_free(fd_array_cache, new_pcb->fd_array);
+        new_pcb->fd_array = NULL;
+        free_pid(new_pid);
+        sti();
+        return -1;
+    }
+
+    set_paging(new_pid);
+
     /* ==================== *
      * 4. load user program *
      * ==================== */
-    if(read_data(check_dentry.inode_idx, 0, (uint8_t*)PROGRAM_VIRTUAL_ADDR, get_file_size(&check_dentry)) == -1){
+    if(read_data(exe->inode_idx, 0, (uint8_t*)PROGRAM_VIRTUAL_ADDR, exe->size) == -1){
+        /* back to the current address space, if there is one */
+        if (curr_pid != -1)
+            set_paging(curr_mm_pid);
+        execute_undo(new_pid);
         sti();
         return -1;
     }
@@ -229,7 +299,7 @@ int32_t execute(const uint8_t *cmd)
     /*
      *  pcb struct reference:
      *      typedef struct pcb_t {
-     *          file_desc_t fd_array[MAX_FILE_NUM];
+     *          file_desc_t* fd_array;
      *          uint32_t pid;
      *          uint32_t parent_pid;
      *          uint8_t arg[MAX_ARG_LEN];
@@ -241,8 +311,6 @@ int32_t execute(const uint8_t *cmd)
      *      } pcb_t; 
      */
 
-    /* get curr and new pcb address */
-    new_pcb = get_pcb_ptr(new_pid);
     /* set process id */
     new_pcb->pid = new_pid;
     /* set parent process id and terminal id */
@@ -255,32 +323,31 @@ int32_t execute(const uint8_t *cmd)
         new_pcb->term_id = get_pcb_ptr(curr_pid)->term_id;
     }
     
-    /* initialize the fd_array */
-    /* init all file descriptor */
-    for (i = 0; i < MAX_FILE_NUM; i++)
-    {
-        new_pcb->fd_array[i].op = NULL;
-        new_pcb->fd_array[i].inode_idx = -1;
-        new_pcb->fd_array[i].file_offset = 0;
-        new_pcb->fd_array[i].flags = FD_FLAG_FREE;
-    }
-
-    /* init stdin */
-    new_pcb->fd_array[0].op = &file_op_table_arr[STD_TYPE];
-    new_pcb->fd_array[0].flags = FD_FLAG_BUSY;
-
-    /* init stdout */
-    new_pcb->fd_array[1].op = &file_op_table_arr[STD_TYPE];
-    new_pcb->fd_array[1].flags = FD_FLAG_BUSY;
+    /* initialize the fd_array, stdin and stdout open and the rest free, in one copy */
+    memcpy(new_pcb->fd_array, fd_array_init, sizeof(fd_array_init));
 
     /* set current fd array */
     cur_fd_array = new_pcb->fd_array;
 
+    /* the FPU state is loaded on first use */
+    fpu_state_init(&new_pcb->fpu);
+
+    /* a process owns its address space and starts with no other thread */
+    new_pcb->mm_pid = new_pid;
+    new_pcb->threads = 0;
+    new_pcb->blocked = 0;
+    new_pcb->exited = 0;
+    new_pcb->killed = 0;
+    new_pcb->futex_addr = 0;
+    new_pcb->exit_word = 0;
+    new_pcb->start_eip = 0;
+    new_pcb->start_esp = 0;
+
     /* set argument */
     strncpy((int8_t*)new_pcb->arg,(int8_t*)argument, MAX_ARG_LEN);
 
     /* set kernel stack pointer */
-    tss.esp0 = KS_BASE_ADDR - KS_SIZE * new_pid - sizeof(int32_t);
+    tss[cpu_id()].esp0 = KS_BASE_ADDR - KS_SIZE * new_pid - sizeof(int32_t);
 
     /* store esp and ebp if it is not the first shell of first kernel */
     /* this esp & ebp can be used for halt when system want to restore parent stack info */
@@ -303,23 +370,35 @@ int32_t execute(const uint8_t *cmd)
             "
             : "=r"(curr_pcb->ebp), "=r"(curr_pcb->esp)
         );
+        curr_pcb->lock_depth = this_cpu()->lock_depth;
+        curr_pcb->in_softirq = this_cpu()->in_softirq;
+        fpu_switch_out(&curr_pcb->fpu);
+        /* its context is saved, any processor may switch it in from now on */
+        if (queue_curr)
+            sched_enqueue(curr_pid);
     }
 
     /* update current pid */
+    trace(TRACE_EXECUTE, new_pid, curr_pid);
+    trace(TRACE_SWITCH, curr_pid, TRACE_SWITCH_ARG(new_pid, new_pcb->term_id, TRACE_SW_EXECUTE));
     curr_pid = new_pid;
 
     /* update terminal info */
-    terminals[curr_term_id].curr_pid = curr_pid;
+    terminals[curr_term_id].active_pid = curr_pid;
     terminals[curr_term_id].pnum++;
 
     /* ================================ *
      * 6.context switch to user program *
      * ================================ */
 
-    /* set the address of the first instruction */
-    new_eip = *(int32_t*)PROGRAM_START_ADDR;
+    /* set the address of the first instruction, read when the header was checked */
+    new_eip = exe->eip;
     new_esp = USER_STACK_ADDR;
 
+    /* the new process starts in user mode, outside the kernel and any softirq */
+    this_cpu()->in_softirq = 0;
+    kernel_lock_drop();
+
     /* set infomation for IRET to user program space, enable interrupt */
     asm volatile ("                                                \n\
         movw    %%cx, %%ds                                         \n\
@@ -366,8 +445,18 @@ int32_t open(const char *fname)
             break;
     }
 
-    /* fail if reach the max file number or could not find the file */
-    if (fd >= MAX_FILE_NUM || read_dentry_by_name((uint8_t*)fname, &dentry) != 0)
+    /* fail if reach the max file number */
+    if (fd >= MAX_FILE_NUM)
+        return -1;
+
+    /* the kernel log, profiler and trace devices have no dentry, otherwise fail if could not find the file */
+    if (strncmp((int8_t*)fname, (int8_t*)KLOG_DEV_NAME, sizeof(KLOG_DEV_NAME)) == 0)
+        dentry.file_type = KLOG_TYPE;
+    else if (strncmp((int8_t*)fname, (int8_t*)PROF_DEV_NAME, sizeof(PROF_DEV_NAME)) == 0)
+        dentry.file_type = PROF_TYPE;
+    else if (strncmp((int8_t*)fname, (int8_t*)TRACE_DEV_NAME, sizeof(TRACE_DEV_NAME)) == 0)
+        dentry.file_type = TRACE_TYPE;
+    else if (read_dentry_by_name((uint8_t*)fname, &dentry) != 0)
         return -1;
 
     /* set the file operator table pointer */
@@ -480,9 +569,111 @@ int32_t getargs(uint8_t *buf, int32_t nbytes)
     return 0;
 }
 
+/*
+ * poll
+ * DESCRIPTION: system call poll, wait until any of the file descriptors is ready
+ *              (asked by each device's poll hook) or the timeout timer expires
+ * INPUT: fds -- array of file descriptors to wait for, revents and stamp are filled in
+ *        nfds -- number of entries in fds
+ *        timeout -- timeout in ms, 0 for not waiting, -1 for waiting forever
+ * OUTPUT: revents and stamp of each entry
+ * RETURN: number of ready entries, 0 for timeout, -1 for fail
+ * SIDE AFFECTS: the processor halts until next interrupt while nothing is ready
+ */
+int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout)
+{
+    int i;              /* loop index for fds */
+    int32_t ready;      /* number of ready entries */
+    pollfd_t* pfd;      /* current entry */
+    pcb_t* pcb;         /* current process, owner of the timeout timer */
+
+    /* sanity check, the array must be in user space */
+    if (fds == NULL || nfds <= 0 || nfds > MAX_FILE_NUM || cur_fd_array == NULL)
+        return -1;
+    if ((unsigned int)fds < ADDR_128MB || (unsigned int)(fds + nfds) > ADDR_132MB)
+        return -1;
+
+    /* a positive timeout arms the sleep timer, its expiry sets timed_out */
+    pcb = get_pcb_ptr(curr_pid);
+    pcb->timed_out = 0;
+    if (timeout > 0)
+        timer_add(pcb->sleep_timer, MS_TO_PIT_TICKS(timeout), 0);
+
+    while (1)
+    {
+        ready = 0;
+        for (i = 0; i < nfds; i++)
+        {
+            pfd = &fds[i];
+            pfd->revents = 0;
+            /* unopened or not pollable fd is reported instead of waited for */
+            if (pfd->fd < 0 || pfd->fd >= MAX_FILE_NUM || cur_fd_array[pfd->fd].flags == FD_FLAG_FREE ||
+                cur_fd_array[pfd->fd].op == NULL || cur_fd_array[pfd->fd].op->poll == NULL)
+            {
+                pfd->revents = POLLNVAL;
+                ready++;
+                continue;
+            }
+            if ((pfd->events & POLLIN) && cur_fd_array[pfd->fd].op->poll(pfd->fd, &pfd->stamp))
+            {
+                pfd->revents = POLLIN;
+                ready++;
+            }
+        }
+
+        if (ready || timeout == 0 || (timeout > 0 && pcb->timed_out))
+        {
+            timer_cancel(pcb->sleep_timer);
+            return ready;
+        }
+
+        /* readiness only changes in interrupts, sleep until the next one */
+        cli();
+        kernel_wait();
+        sti();
+    }
+}
+
+/*
+ * fcntl
+ * DESCRIPTION: system call fcntl, get or set file descriptor flags,
+ *              only FD_FLAG_NONBLOCK can be changed, or the mode of a terminal
+ * INPUT: fd -- file descriptor array index
+ *        cmd -- F_GETFL, F_SETFL, F_GETTTY or F_SETTTY
+ *        arg -- new flags for F_SETFL, new mode for F_SETTTY
+ * OUTPUT: none
+ * RETURN: flags or mode for F_GET*, 0 for F_SET*, -1 for fail
+ * SIDE AFFECTS: file descriptor flags or terminal mode changed
+ */
+int32_t fcntl(int32_t fd, int32_t cmd, int32_t arg)
+{
+    /* sanity check */
+    if (fd < 0 || fd >= MAX_FILE_NUM || cur_fd_array == NULL || cur_fd_array[fd].flags == FD_FLAG_FREE)
+        return -1;
+
+    switch (cmd)
+    {
+        case F_GETFL:
+            return cur_fd_array[fd].flags & FD_FLAG_NONBLOCK;
+        case F_SETFL:
+            cur_fd_array[fd].flags = FD_FLAG_BUSY | (arg & FD_FLAG_NONBLOCK);
+            return 0;
+        case F_GETTTY:
+            if (cur_fd_array[fd].op->read != terminal_read)
+                return -1;
+            return terminal_get_mode();
+        case F_SETTTY:
+            if (cur_fd_array[fd].op->read != terminal_read)
+                return -1;
+            return terminal_set_mode(arg);
+        default:
+            return -1;
+    }
+}
+
 /* 
  *  vidmap
- *  Description: maps user space virtual vidmem to physical video memory 
+ *  Description: maps user space virtual vidmem to the screen of current process' terminal
  *               and return virtual vidmem address to user
  *  Input:  screen_start -- a pointer points to a place where to output virtual video memory addr for user
  *  Output: 0 for success, -1 for failure, virtual vidmem address
@@ -496,6 +687,9 @@ int32_t vidmap(uint8_t** screen_start)
     /* output vidmem virtual address for user */
     *screen_start = (uint8_t*)VID_VIRTUAL_ADDR;
 
+    /* the screen must start at the first page of the terminal's VGA region */
+    console_home(&terminals[get_pcb_ptr(curr_pid)->term_id].con);
+
     /* initialize the VIDMAP page */
     page_directory[VIDMAP_OFFSET].p           = 1;    // present
     page_directory[VIDMAP_OFFSET].r_w         = 1;    // enable r/w
@@ -504,7 +698,7 @@ int32_t vidmap(uint8_t** screen_start)
     vid_page_table[0].p = 1;    // present
     vid_page_table[0].r_w = 1;  // enable r/w
     vid_page_table[0].u_s = 1;  // user mode
-    vid_page_table[0].base_addr = VID_PHYS_ADDR >> MEM_OFFSET_BITS;
+    vid_page_table[0].base_addr = (uint32_t)terminals[get_pcb_ptr(curr_pid)->term_id].con.vid >> MEM_OFFSET_BITS;
 
     /* flush TLB */
     flush_TLB();
@@ -528,7 +722,7 @@ int32_t sigreturn()
 /* 
  *  vidmap
  *  Description: remaps user space virtual vidmem to a physical address
- *               (basically terminal vid buffer or physical vidmem)
+ *               (basically the start of a terminal's VGA region)
  *  Input:  phys_addr -- a pointer points to the start of physical memory to map to
  *  Output: 0 for success, -1 for failure
  */
@@ -566,6 +760,9 @@ int32_t vid_remap(uint8_t* phys_addr)
 uint32_t get_new_pid()
 {
     int i;  /* loop index */
+    uint32_t flags;
+
+    spin_lock_irqsave(&pid_lock, flags);
     /* traverse pid array to find unoccupied position */
     for (i = 0; i < NUM_PROCESS; i++)
     {
@@ -573,14 +770,48 @@ uint32_t get_new_pid()
         {
             /* find a empty position, set entry to busy (1) */
             pid_array[i] = 1;
+            spin_unlock_irqrestore(&pid_lock, flags);
             return i;
         }
     }
+    spin_unlock_irqrestore(&pid_lock, flags);
     /* Current number of running process exceeds */
     printf("Current number of running process exceeds!\n");
     return -1;
 }
 
+/*
+ * pid_used
+ * DESCRIPTION: check whether a process id is taken by a process or a thread
+ * INPUT: pid -- process id
+ * OUTPUT: none
+ * RETURN: 1 if taken, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+uint32_t pid_used(uint32_t pid)
+{
+    return pid < NUM_PROCESS && pid_array[pid];
+}
+
+/*
+ * free_pid
+ * DESCRIPTION: give back a process id taken by get_new_pid
+ * INPUT: pid -- process id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: pid_array entry cleared
+ */
+void free_pid(uint32_t pid)
+{
+    uint32_t flags;
+
+    if (pid >= NUM_PROCESS)
+        return;
+    spin_lock_irqsave(&pid_lock, flags);
+    pid_array[pid] = 0;
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
 /*
  * get_pcb_ptr
  * DESCRIPTION: get process's PCB pointer
@@ -596,7 +827,8 @@ inline pcb_t* get_pcb_ptr(uint32_t pid)
 
 /*
  * file_op_table_init
- * DESCRIPTION: initialize file operation table array
+ * DESCRIPTION: initialize file operation table array, the fd array execute copies
+ *              into a new process and the cache the copies come from
  * INPUT: none
  * OUTPUT: none
  * RETURN: none
@@ -604,27 +836,132 @@ inline pcb_t* get_pcb_ptr(uint32_t pid)
  */
 void file_op_table_init()
 {
+    int i;  /* loop index */
+
     /* init rtc operation table */
     file_op_table_arr[RTC_TYPE].open  = rtc_open;
     file_op_table_arr[RTC_TYPE].close = rtc_close;
     file_op_table_arr[RTC_TYPE].read  = rtc_read;
     file_op_table_arr[RTC_TYPE].write = rtc_write;
+    file_op_table_arr[RTC_TYPE].poll  = rtc_poll;
 
     /* init dir operation table */
     file_op_table_arr[DIR_TYPE].open  = dir_open ;
     file_op_table_arr[DIR_TYPE].close = dir_close;
     file_op_table_arr[DIR_TYPE].read  = dir_read ;
     file_op_table_arr[DIR_TYPE].write = dir_write;
+    file_op_table_arr[DIR_TYPE].poll  = dir_poll ;
 
     /* init file operation table */
     file_op_table_arr[FILE_TYPE].open  = file_open;
     file_op_table_arr[FILE_TYPE].close = file_close;
     file_op_table_arr[FILE_TYPE].read  = file_read;
     file_op_table_arr[FILE_TYPE].write = file_write;
+    file_op_table_arr[FILE_TYPE].poll  = file_poll;
 
     /* init stdin/out (terminal) operation table */
     file_op_table_arr[STD_TYPE].open  = terminal_open;
     file_op_table_arr[STD_TYPE].close = terminal_close;
     file_op_table_arr[STD_TYPE].read  = terminal_read;
     file_op_table_arr[STD_TYPE].write = terminal_write;
+    file_op_table_arr[STD_TYPE].poll  = terminal_poll;
+
+    /* init kernel log (dmesg) operation table */
+    file_op_table_arr[KLOG_TYPE].open  = klog_open;
+    file_op_table_arr[KLOG_TYPE].close = klog_close;
+    file_op_table_arr[KLOG_TYPE].read  = klog_read;
+    file_op_table_arr[KLOG_TYPE].write = klog_write;
+    file_op_table_arr[KLOG_TYPE].poll  = klog_poll;
+
+    /* init profiler samples operation table */
+    file_op_table_arr[PROF_TYPE].open  = prof_open;
+    file_op_table_arr[PROF_TYPE].close = prof_close;
+    file_op_table_arr[PROF_TYPE].read  = prof_read;
+    file_op_table_arr[PROF_TYPE].write = prof_write;
+    file_op_table_arr[PROF_TYPE].poll  = prof_poll;
+
+    file_op_table_arr[TRACE_TYPE].open  = trace_open;
+    file_op_table_arr[TRACE_TYPE].close = trace_close;
+    file_op_table_arr[TRACE_TYPE].read  = trace_read;
+    file_op_table_arr[TRACE_TYPE].write = trace_write;
+    file_op_table_arr[TRACE_TYPE].poll  = trace_poll;
+
+    /* fd array of a new process, every file descriptor free but stdin and stdout */
+    for (i = 0; i < MAX_FILE_NUM; i++)
+    {
+        fd_array_init[i].op = NULL;
+        fd_array_init[i].inode_idx = -1;
+        fd_array_init[i].file_offset = 0;
+        fd_array_init[i].flags = FD_FLAG_FREE;
+    }
+    fd_array_init[FD_STDIN_IDX].op = &file_op_table_arr[STD_TYPE];
+    fd_array_init[FD_STDIN_IDX].flags = FD_FLAG_BUSY;
+    fd_array_init[FD_STDOUT_IDX].op = &file_op_table_arr[STD_TYPE];
+    fd_array_init[FD_STDOUT_IDX].flags = FD_FLAG_BUSY;
+
+    fd_array_cache = kmem_cache_create("fd_array", sizeof(fd_array_init), 0);
+}
+
+/*
+ * exec_lookup
+ * DESCRIPTION: find an executable for execute. a name seen before is found in the exec
+ *              cache, otherwise its dentry is looked up and its ELF header checked and
+ *              the result cached. the file system image is read only, entries stay valid
+ * INPUT: name -- file name
+ * OUTPUT: none
+ * RETURN: cache entry of the executable, NULL if it is not a valid one
+ * SIDE AFFECTS: a cache entry may be replaced
+ */
+static exec_cache_t* exec_lookup(const uint8_t* name)
+{
+    uint8_t header[EXEC_HEADER_SIZE];   /* ELF identification up to the entry point */
+    dentry_t dentry;
+    exec_cache_t* exe;
+    uint32_t i;
+
+    /* the same rule as read_dentry_by_name, a longer name must not hit a 32 char entry */
+    if (strlen((int8_t*)name) > MAX_FILE_NAME_LEN)
+        return NULL;
+
+    for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    {
+        if (exec_cache[i].valid && !strncmp((int8_t*)exec_cache[i].name, (int8_t*)name, MAX_FILE_NAME_LEN))
+            return &exec_cache[i];
+    }
+
+    /* is a regular file in the fs? */
+    if (read_dentry_by_name(name, &dentry) != 0 || dentry.file_type != FILE_TYPE)
+        return NULL;
+    /* check the magic number of the excutable file: 0x7F, E, L, F */
+    if (read_data(dentry.inode_idx, 0, header, EXEC_HEADER_SIZE) != EXEC_HEADER_SIZE)
+        return NULL;
+    if (header[0] != ELF_MAGIC_0 || header[1] != 'E' || header[2] != 'L' || header[3] != 'F')
+        return NULL;
+
+    exe = &exec_cache[exec_cache_next];
+    exec_cache_next = (exec_cache_next + 1) % EXEC_CACHE_SIZE;
+    strncpy((int8_t*)exe->name, (int8_t*)dentry.file_name, MAX_FILE_NAME_LEN);
+    exe->inode_idx = dentry.inode_idx;
+    exe->size = get_file_size(&dentry);
+    exe->eip = *(uint32_t*)(header + PROGRAM_START_OFFSET);
+    exe->valid = 1;
+    return exe;
+}
+
+/*
+ * execute_undo
+ * DESCRIPTION: give back what execute took for a process whose program did not load
+ * INPUT: pid -- process id with its fd array and timers
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: pid freed
+ */
+static void execute_undo(uint32_t pid)
+{
+    pcb_t* pcb = get_pcb_ptr(pid);
+
+    kmem_cache_free(fd_array_cache, pcb->fd_array);
+    pcb->fd_array = NULL;
+    timer_proc_exit(pid);
+    free_pid(pid);
 }
@@ -4,11 +4,16 @@
 #include "types.h"
 #include "filesys.h"
 #include "paging.h"
+#include "smp.h"
+#include "fpu.h"
+#include "timer.h"
 
 #define MAX_CMD_LEN             128
 #define MAX_ARG_LEN             128
 #define NUM_PROCESS             6
-#define CHECK_BUFFER_SIZE       4
+#define EXEC_HEADER_SIZE        (PROGRAM_START_OFFSET + sizeof(uint32_t))  /* up to the entry point */
+#define ELF_MAGIC_0             0x7F
+#define EXEC_CACHE_SIZE         8
 #define NO_PARENT_PID           NUM_PROCESS
 /* file descriptor related */
 #define MAX_FILE_NUM            8
@@ -17,6 +22,16 @@
 #define FD_STDOUT_IDX           1
 #define FD_FLAG_FREE            0
 #define FD_FLAG_BUSY            1
+#define FD_FLAG_NONBLOCK        2   /* read returns at once if nothing is ready */
+/* fcntl commands */
+#define F_GETFL                 1
+#define F_SETFL                 2
+#define F_GETTTY                3   /* terminal fds only, get TTY_ICANON | TTY_ECHO mode */
+#define F_SETTTY                4   /* terminal fds only, set TTY_ICANON | TTY_ECHO mode */
+/* poll related */
+#define POLLIN                  1   /* data ready to be read */
+#define POLLNVAL                32  /* invalid file descriptor */
+#define POLL_NO_TIMEOUT         -1  /* wait until some fd is ready */
 /* paging & address related */
 #define KS_SIZE                 8192
 #define KS_BASE_ADDR            0x800000
@@ -37,8 +52,18 @@ typedef struct file_op_table_t {
     int32_t (*close) (int32_t fd);
     int32_t (*read)  (int32_t fd, void* buf, int32_t nbytes);
     int32_t (*write) (int32_t fd, void* buf, int32_t nbytes);
+    int32_t (*poll)  (int32_t fd, uint32_t* stamp);  /* readiness hook, nonzero if read would not block */
 } file_op_table_t;
 
+/* executable checked by execute, see exec_lookup */
+typedef struct exec_cache_t {
+    uint8_t name[MAX_FILE_NAME_LEN];    /* file name, not terminated if 32 chars    */
+    uint32_t inode_idx;
+    uint32_t size;                      /* bytes loaded                             */
+    uint32_t eip;                       /* entry point from the ELF header          */
+    uint32_t valid;
+} exec_cache_t;
+
 typedef struct file_desc_t {
     file_op_table_t* op;    /* file operator table */
     uint32_t inode_idx;     /* inode index */
@@ -46,9 +71,16 @@ typedef struct file_desc_t {
     uint32_t flags;         /* whether this file descriptor is used */
 } file_desc_t;
 
+typedef struct pollfd_t {
+    int32_t fd;             /* file descriptor to wait for                      */
+    uint16_t events;        /* requested events                                 */
+    uint16_t revents;       /* returned events                                  */
+    uint32_t stamp;         /* low 32 bits of TSC when the fd became ready      */
+} pollfd_t;
+
 typedef struct pcb_t {
-    /* file descriptor array */
-    file_desc_t fd_array[MAX_FILE_NUM];
+    /* file descriptor array, from the fd_array cache, NULL for a thread */
+    file_desc_t* fd_array;
     /* process id */
     uint32_t pid;
     uint32_t parent_pid;
@@ -56,16 +88,44 @@ typedef struct pcb_t {
     uint32_t term_id;
     /* arguments for this process */
     uint8_t arg[MAX_ARG_LEN];
-    /* used for context switch */
+    /* used for context switch, ebp MUST be right before esp */
     uint32_t ebp;
     uint32_t esp;
+    /* kernel lock nesting saved with the context */
+    uint32_t lock_depth;
+    /* 1 if the context was saved while running softirqs */
+    uint32_t in_softirq;
+    /* FPU/SSE registers, loaded lazily */
+    fpu_state_t fpu;
+    /* owner of the address space and fd array, the pid itself for a process */
+    uint32_t mm_pid;
+    /* live threads besides the first, kept by the owner */
+    uint32_t threads;
+    /* thread state, see thread.h */
+    volatile uint32_t blocked;      /* waiting in futex_wait or exited, not queued  */
+    volatile uint32_t exited;       /* the pid is freed once switched out           */
+    volatile uint32_t killed;       /* the owner halts, exit at the next chance     */
+    uint32_t futex_addr;            /* user address waited for while blocked        */
+    uint32_t exit_word;             /* user word cleared and woken at exit, 0 if none */
+    /* user entry and stack of a thread not started yet, 0 once started */
+    uint32_t start_eip;
+    uint32_t start_esp;
+    /* sleep and poll timeout, and the periodic alarm, from the ktimer cache, see timer.h */
+    ktimer_t* sleep_timer;
+    ktimer_t* alarm_timer;
+    volatile uint32_t timed_out;    /* set when sleep_timer expires             */
+    volatile uint32_t alarms;       /* alarm expiries not collected yet         */
+    volatile uint32_t alarm_waiting;/* blocked in alarm(ALARM_WAIT)             */
 } pcb_t;
 
-/* current process id */
-uint32_t curr_pid;
+/* current process id of this processor, -1 if none */
+#define curr_pid        (this_cpu()->pid)
 
-/* pointer pointing to current fd array */
-file_desc_t* cur_fd_array;
+/* owner of the address space of the current process or thread */
+#define curr_mm_pid     (get_pcb_ptr(curr_pid)->mm_pid)
+
+/* pointer pointing to current fd array of this processor */
+#define cur_fd_array    (this_cpu()->fd_array)
 
 /* system call execute, attempts to load and execute a new program, */
 /* handing off the processor to the new program until it terminates.*/
@@ -86,6 +146,12 @@ int32_t read(int32_t fd, void* buf, int32_t nbytes);
 /* system call write, would call particular device's write function according to the file type */
 int32_t write(int32_t fd, void* buf, int32_t nbytes);
 
+/* wait until any of the file descriptors is ready or timeout (in ms) expires */
+int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout);
+
+/* get or set file descriptor flags */
+int32_t fcntl(int32_t fd, int32_t cmd, int32_t arg);
+
 /* get args from command and copy it to buffer */
 int32_t getargs(uint8_t *buf, int32_t nbytes);
 
@@ -98,6 +164,12 @@ int32_t vid_remap(uint8_t* phys_addr);
 /* get new process id by finding unoccupied position of pid_array */
 uint32_t get_new_pid();
 
+/* 1 if the process id is taken */
+uint32_t pid_used(uint32_t pid);
+
+/* give back a process id taken by get_new_pid */
+void free_pid(uint32_t pid);
+
 /* remaps user space virtual vidmem to a physical address */
 inline pcb_t* get_pcb_ptr(uint32_t pid);
 
@@ -7,6 +7,11 @@
 #include "keyboard.h"
 #include "syscall.h"
 #include "lib.h"
+#include "serial.h"
+#include "smp.h"
+#include "kheap.h"
+#include "tests.h"
+#include "bootprof.h"
 
 /* MACRO for the sake of briefness */
 #define CHECK_FAIL_RETURN(value) \
@@ -15,57 +20,91 @@
         return -1;               \
     }
 
+/* check whether a terminal's input queue has something to read */
+static int32_t terminal_ready(terminal_t *term);
+/* set up the console and buffers of a terminal the first time it is used */
+static void terminal_setup(uint32_t term_id);
+
 /*
  * terminal_init
- * DESCRIPTION: initialize all terminals structures
+ * DESCRIPTION: initialize all terminals structures, the first terminal and the serial
+ *              console are set up now, the others on their first switch
  * INPUT: none
  * OUTPUT: 0
  * RETURN: 0 if success, 1 if fail
- * SIDE AFFECTS: vid buffers' pages setted
+ * SIDE AFFECTS: VGA pan regions mapped and cleared, scrollback rings taken from the
+ *               kernel heap (a terminal has none if it is out of memory)
  */
 int32_t terminal_init()
 {
-    int i;  /* loop index for different terminals               */
-    int j;  /* loop index for terminal buffer and video buffer  */
+    int i;  /* loop index for different terminals   */
     /* init every terminal structures */
     for (i = 0; i < TERMINAL_NUM; i++)
     {
         /* set basic attribute */
         terminals[i].id = i;
         terminals[i].is_running = 0;
-        terminals[i].curr_pid = -1;
+        terminals[i].ready = 0;
+        terminals[i].active_pid = -1;
         terminals[i].pnum = 0;
-        terminals[i].cursor_x = 0;
-        terminals[i].cursor_y = 0;
-        terminals[i].is_enter = 0;
+        terminals[i].mode = TTY_DEFAULT_MODE;
+        if (i == SERIAL_CONSOLE_TERM && serial_present)
+            terminals[i].mode |= TTY_SERIAL;
+        terminals[i].lines = 0;
+        terminals[i].enter_tsc = 0;
         terminals[i].term_buf_offset = 0;
-        terminals[i].vid_buf = (uint8_t *)(VIDEO+(i+1)*PAGE_4KB_SIZE);
-        /* init page for video buffer */
-        set_vid_buf_page(i);
-        /* init terminal buffer */
-        for (j = 0; j < MAX_TERMINAL_BUF_SIZE; j++)
-            terminals[i].term_buf[j] = '\0';
-        /* init video buffer */
-        for (j = 0; j < VIDBUF_SIZE/2; j++)
-        {
-            *(uint8_t *)(terminals[i].vid_buf + (j << 1)) = ' ';
-            *(uint8_t *)(terminals[i].vid_buf + (j << 1) + 1) = ATTRIB;
-        }
+        terminals[i].in_head = 0;
+        terminals[i].in_tail = 0;
+        spin_init(&terminals[i].in_lock);
     }
+    /* init serial console terminal */
+    serial_term_id = (SERIAL_CONSOLE_TERM < TERMINAL_NUM && serial_present) ? SERIAL_CONSOLE_TERM : -1;
+    /* the first terminal is shown at boot, the serial console takes input before anyone switches to it */
+    terminal_setup(FIRST_TERMINAL_ID);
+    if (serial_term_id != -1)
+        terminal_setup(serial_term_id);
     /* init current running terminal number */
     running_term_num = 0;
     return 0;
 }
 
+/*
+ * terminal_setup
+ * DESCRIPTION: map and clear the VGA pan region of a terminal, take its scrollback ring
+ *              and clear its line buffer, once
+ * INPUT: term_id -- terminal id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: terminal ready
+ */
+static void terminal_setup(uint32_t term_id)
+{
+    int j;  /* loop index for terminal buffer */
+
+    if (terminals[term_id].ready)
+        return;
+
+    /* init pages for this terminal's pan region, and the console in it */
+    set_vid_buf_page(term_id);
+    console_init(&terminals[term_id].con, (uint8_t *)TERM_VID_ADDR(term_id), TERM_VID_ROWS,
+                 (uint16_t *)kmalloc(SCROLLBACK_ROWS * NUM_COLS * sizeof(uint16_t)));
+    /* init terminal buffer */
+    for (j = 0; j < MAX_TERMINAL_BUF_SIZE; j++)
+        terminals[term_id].term_buf[j] = '\0';
+    terminals[term_id].ready = 1;
+}
+
 /*
  * terminal_switch
  * DESCRIPTION: switch to terminal with term_id, if the terminal is running, just switch;
  *              if not, run a shell for this new terminal
+ *              every terminal has its own VGA region, so a switch only moves the CRTC start address,
+ *              and the virtual vidmem of running processes needs no remap
  *              ATTENTION: this program must be called from a program who has disable the interrupt
  * INPUT: term_id -- terminal id
  * OUTPUT: none
  * RETURN: 0 if success, 1 if fail
- * SIDE AFFECTS: virtual video memory for user remapped
+ * SIDE AFFECTS: displayed text page changed
  */
 int32_t terminal_switch(uint32_t term_id)
 {
@@ -73,29 +112,11 @@ int32_t terminal_switch(uint32_t term_id)
     if (curr_term_id == term_id)
         return 0;
 
-    /* save terminal info */
-    CHECK_FAIL_RETURN(terminal_save(curr_term_id));
-
-    /* restore terminal info */
+    /* restore terminal info, flip to its screen */
     CHECK_FAIL_RETURN(terminal_restore(term_id));
 
     /* check whether the terminal is runnning */
-    if (terminals[curr_term_id].is_running)
-    {
-        /* remap the virtual video memory because terminal changes */
-        uint32_t curr_process_term_id = get_pcb_ptr(curr_pid)->term_id;
-        if (curr_process_term_id != curr_term_id)
-        {
-            /* if the current process is executed by current terminal, remap virtual vidmem to physical vidmem */
-            CHECK_FAIL_RETURN(vid_remap((uint8_t *)VIDEO));
-        }
-        else
-        {
-            /* if not, remap virtual vidmem to current process's terminal's video buffer */
-            CHECK_FAIL_RETURN(vid_remap(terminals[curr_process_term_id].vid_buf));
-        }
-    }
-    else
+    if (!terminals[curr_term_id].is_running)
     {
         /* if it is the new terminal, run shell for this terminal */
         /* switch current process to the shell belongs to new terminal regardless of scheduler */
@@ -103,7 +124,7 @@ int32_t terminal_switch(uint32_t term_id)
         /* update new terminal info, remap vidmem */
         terminals[curr_term_id].is_running = 1;
         running_term_num++;
-        CHECK_FAIL_RETURN(vid_remap((uint8_t *)VIDEO));
+        CHECK_FAIL_RETURN(vid_remap(terminals[curr_term_id].con.vid));
 
         /* execute new shell for this new terminal */
         execute((uint8_t *)"shell");
@@ -113,39 +134,13 @@ int32_t terminal_switch(uint32_t term_id)
     return 0;
 }
 
-
-/*
- * terminal_save
- * DESCRIPTION: save terminal info
- * INPUT: term_id -- terminal id
- * OUTPUT: none
- * RETURN: 0 if success, 1 if fail
- * SIDE AFFECTS: terminal vidbuffer changed
- */
-int32_t terminal_save(uint32_t term_id)
-{
-    /* sanity check */
-    if (term_id >= TERMINAL_NUM)
-        return -1;
-
-    /* save current cursor position */
-    terminals[term_id].cursor_x = get_screen_x();
-    terminals[term_id].cursor_y = get_screen_y();
-
-    /* save video memory */
-    memcpy((uint8_t *)terminals[term_id].vid_buf, (uint8_t *)VIDEO, VIDBUF_SIZE);
-
-    /* success, return 0 */
-    return 0;
-}
-
 /*
  * terminal_restore
  * DESCRIPTION: restore terminal info
  * INPUT: term_id -- terminal id
  * OUTPUT: none
  * RETURN: 0 if success, 1 if fail
- * SIDE AFFECTS: physical vidmem changed
+ * SIDE AFFECTS: displayed text page and cursor changed, the terminal set up on first use
  */
 int32_t terminal_restore(uint32_t term_id)
 {
@@ -153,14 +148,14 @@ int32_t terminal_restore(uint32_t term_id)
     if (term_id >= TERMINAL_NUM)
         return -1;
 
+    /* a terminal shown for the first time is set up now */
+    terminal_setup(term_id);
+
     /* set current terminal id */
     curr_term_id = term_id;
 
-    /* restore current cursor position */
-    set_screen_xy(terminals[term_id].cursor_x, terminals[term_id].cursor_y);
-
-    /* restore video memory */
-    memcpy((uint8_t *)VIDEO, (uint8_t *)terminals[term_id].vid_buf, VIDBUF_SIZE);
+    /* show the terminal's screen and cursor, nothing is copied */
+    console_show(&terminals[term_id].con);
 
     /* success, return 0 */
     return 0;
@@ -183,8 +178,12 @@ int32_t launch_first_terminal(){
     running_term_num = 1;
     terminals[FIRST_TERMINAL_ID].is_running = 1;
 
-    /* launch the first shell */
+    /* launch the first shell, or the benchmarks in benchmark mode */
+#if RUN_BENCH
+    CHECK_FAIL_RETURN(execute((uint8_t*)"bench"));
+#else
     CHECK_FAIL_RETURN(execute((uint8_t*)"shell"));
+#endif
 
     /* never reach here */
     return -1;
@@ -216,8 +215,10 @@ int32_t terminal_close(int32_t fd)
 
 /*
  * terminal_read
- * Description:    read the terminal input and store to 
- *                 the CURRENT RUNNING PROCESS' terminal's buffer
+ * Description:    read the terminal input queue of the CURRENT RUNNING PROCESS' terminal
+ *                 in canonical mode, read one line, the \n is not returned and the rest of
+ *                 a line longer than the buffer is discarded
+ *                 in raw mode, read the keys queued, at least one
  * inputs:         fd      -- file descriptor
  *                 buf     -- a buffer that holds the terminal input
  *                 nbytes  -- the number of bytes to read from keyboard buffer
@@ -227,74 +228,169 @@ int32_t terminal_close(int32_t fd)
 int32_t terminal_read(int32_t fd, void *buf, int32_t nbytes)
 {
     /* sanity check to see whether the read operation is valid */
-    if (NULL == buf || 0 == nbytes)
+    if (NULL == buf || 0 >= nbytes)
         return -1;
 
-    /* loop index*/
-    int i = 0;
-    /* a flag to show whether the a \n is met in keyboard read buffer */
-    int is_over = 0;
     /* return value, the number of bytes read, init to 0 */
     int ret = 0;
+    /* current char */
+    uint8_t c;
+    /* current running process' terminal */
+    terminal_t *term = &terminals[get_pcb_ptr(curr_pid)->term_id];
+    uint32_t flags;
 
-    /* current running process' terminal id */
-    int curr_process_term_id;
-    volatile uint8_t* read_buffer;
+    /* the first read is the first prompt, the end of the boot */
+    boot_prompt();
 
     /* 
-        an infinite loop to wait
-        until the foreground terminal program take an enter and is scheduled
-        then the loop breaks
+        wait until the input is ready, the line discipline runs here
+        and in the PIT tick, sleep until next interrupt in between
     */
     while (1)
     {
-        /* get current running process' terminal id */
-        curr_process_term_id = get_pcb_ptr(curr_pid)->term_id;
-        if (terminals[curr_process_term_id].is_enter == 1)
+        /* disable interrupt, the TTY softirq cannot come in while the input queue is touched */
+        cli();
+        keyboard_process();
+        serial_process();
+        /* the check and the copy below are one step for readers on other processors */
+        spin_lock_irqsave(&term->in_lock, flags);
+        if (terminal_ready(term))
             break;
+        spin_unlock_irqrestore(&term->in_lock, flags);
+        /* nonblocking fd, return at once if no line is ready */
+        if (cur_fd_array[fd].flags & FD_FLAG_NONBLOCK)
+        {
+            sti();
+            return 0;
+        }
+        /* sleep until the next interrupt, other processors may enter the kernel meanwhile */
+        kernel_wait();
     }
 
-    /* disable interrupt, avoid shcduling causing some page fault */
-    cli();
-
-    /* get current running process' terminal buffer */
-    read_buffer = terminals[curr_process_term_id].term_buf;
-
-    /* 
-        iterate through the keyboard read buffer
-        (i < 127) handles buffer overflow, at most 127 chars are legal to read
-    */
-    for (i = 0; (i < nbytes) && (i < MAX_TERMINAL_BUF_SIZE - 1); i++)
+    if (term->mode & TTY_ICANON)
     {
-        /* fill the buf with terminal input */
-        ((char *)buf)[i] = read_buffer[i];
-
-        /* if current char is enter, the input is over */
-        if (read_buffer[i] == '\n')
+        /* copy the first line, at most 127 chars are legal to read */
+        while ((c = term->in_buf[term->in_tail++ & TERMINAL_QUEUE_MASK]) != '\n')
         {
-            /* set is_over and change the current, last char in buffer to be \0 */
-            is_over = 1;
-            ((char *)buf)[i] = '\0';
+            if (ret < nbytes && ret < MAX_TERMINAL_BUF_SIZE - 1)
+                ((uint8_t *)buf)[ret++] = c;
+        }
+        term->lines--;
+        /* terminate the string if there is room */
+        if (ret < nbytes)
+            ((uint8_t *)buf)[ret] = '\0';
+    }
+    else
+    {
+        /* copy what is queued */
+        while (ret < nbytes && term->in_tail != term->in_head)
+        {
+            c = term->in_buf[term->in_tail++ & TERMINAL_QUEUE_MASK];
+            if (c == '\n')
+                term->lines--;
+            ((uint8_t *)buf)[ret++] = c;
         }
-        /* if the input hasn't over, increment return value */
-        if (is_over == 0)
-            ret++;
     }
 
-    /* clear read buffer for current process' terminal */
-    clr_read_buffer();
-
+    spin_unlock_irqrestore(&term->in_lock, flags);
     /* enable interrupt */
     sti();
 
     return ret;
 }
 
+/*
+ * terminal_poll
+ * Description:    check whether input is ready to read from
+ *                 the CURRENT RUNNING PROCESS' terminal, used by poll
+ * inputs:         fd      -- file descriptor, not used
+ *                 stamp   -- filled in with the TSC of the key making input ready if not NULL
+ * returns:        1 if terminal_read would not wait, 0 otherwise
+ * effects:        queued keys are handled
+ */
+int32_t terminal_poll(int32_t fd, uint32_t *stamp)
+{
+    terminal_t *term = &terminals[get_pcb_ptr(curr_pid)->term_id];
+    uint32_t flags;
+    int32_t ready;
+
+    cli_and_save(flags);
+    keyboard_process();
+    serial_process();
+    spin_lock(&term->in_lock);
+    ready = terminal_ready(term);
+    if (ready && stamp != NULL)
+        *stamp = term->enter_tsc;
+    spin_unlock(&term->in_lock);
+    restore_flags(flags);
+    return ready;
+}
+
+/*
+ * terminal_get_mode
+ * Description:    get the mode of current process' terminal
+ * inputs:         none
+ * returns:        TTY_ICANON | TTY_ECHO | TTY_SERIAL flags
+ * effects:        none
+ */
+int32_t terminal_get_mode()
+{
+    return terminals[get_pcb_ptr(curr_pid)->term_id].mode;
+}
+
+/*
+ * terminal_set_mode
+ * Description:    set the mode of current process' terminal, TTY_SERIAL makes it
+ *                 the serial console, taking it from any other terminal
+ * inputs:         mode    -- TTY_ICANON | TTY_ECHO | TTY_SERIAL flags
+ * returns:        0 for success, -1 for fail
+ * effects:        following keys are handled in the new mode
+ */
+int32_t terminal_set_mode(uint32_t mode)
+{
+    uint32_t id = get_pcb_ptr(curr_pid)->term_id;
+    uint32_t flags;
+
+    if (mode & ~(TTY_DEFAULT_MODE | TTY_SERIAL))
+        return -1;
+    if ((mode & TTY_SERIAL) && !serial_present)
+        return -1;
+
+    /* the serial line input goes to one terminal only, serial_process reads it with IF = 0 */
+    cli_and_save(flags);
+    if (mode & TTY_SERIAL)
+    {
+        if (serial_term_id >= 0)
+            terminals[serial_term_id].mode &= ~TTY_SERIAL;
+        serial_term_id = id;
+    }
+    else if (serial_term_id == id)
+        serial_term_id = -1;
+    terminals[id].mode = mode;
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * terminal_ready
+ * Description:    check whether a terminal's input queue has something to read, with IF = 0
+ * inputs:         term    -- terminal
+ * returns:        1 if ready, 0 otherwise
+ * effects:        none
+ */
+static int32_t terminal_ready(terminal_t *term)
+{
+    if (term->mode & TTY_ICANON)
+        return term->lines != 0;
+    return term->in_tail != term->in_head;
+}
+
 /*
  *  terminal_write
  *  Description:    write the corresponding number of bytes of a buffer of the terminal
  *                  if the current process' terminal is foreground terminal, write chars into video mem
  *                  if not, write to this terminal's video buffer
+ *                  the serial console terminal also sends them to COM1
  *  inputs:         fd      -- file descriptor
  *                  buf     -- a buffer that holds the chars to write to terminal
  *                  nbytes  -- the number of bytes to write from the input buffer
@@ -308,55 +404,37 @@ int32_t terminal_write(int32_t fd, void *buf, int32_t nbytes)
     if (NULL == buf || 0 == nbytes)
         return -1;
 
-    /* loop index */
-    int i = 0;
-    /* return value, the number of bytes written, init to 0 */
-    int ret = 0;
+    /* return value, the number of bytes written */
+    int ret;
 
     /* disable interrupt, avoid scheduling problem */
     cli();
 
-    /* check whether current process' terminal is the foreground terminal */
+    /* 
+        lay out the whole buffer at once, we only write none \0 char to terminal
+        if current process' terminal is the foreground terminal, write into video mem
+        if not, write into this terminal's video buffer
+    */
     if (get_pcb_ptr(curr_pid)->term_id == curr_term_id)
-    {
-        /* iterate through the input buffer */
-        for (i = 0; i < nbytes; i++)
-        {
-            if (((char *)buf)[i] != '\0')
-            {
-                /* we only write none \0 char to terminal */
-                putc(((char *)buf)[i]);
-                /* increment ret */
-                ret++;
-            }
-        }
-    }
+        ret = putbuf((uint8_t *)buf, nbytes);
     else
-    {
-        /* if it is not the foreground terminal, write into this terminal's video buffer */
-        for (i = 0; i < nbytes; i++)
-        {
-            if (((char *)buf)[i] != '\0')
-            {
-                /* we only write none \0 char to terminal */
-                terminal_putc(((char *)buf)[i]);
-                /* increment ret */
-                ret++;
-            }
-        }
-    }
+        ret = terminal_putbuf((uint8_t *)buf, nbytes);
 
     /* enable interrupt */
     sti();
 
+    /* the serial console may sleep until the UART has room, so it is fed with interrupts on */
+    if (terminals[get_pcb_ptr(curr_pid)->term_id].mode & TTY_SERIAL)
+        serial_write((uint8_t *)buf, nbytes);
+
     /* return the number of bytes written */
     return ret;
 }
 
 /*
  * set_vid_buf_page
- * DESCRIPTION: set terminal's video buffer page according to the terminal id
- *              no need to set page directory because vid buffer's address is in 0-3MB, which has enabled
+ * DESCRIPTION: set terminal's VGA pan region mapping according to the terminal id
+ *              no need to set page directory because VGA memory is in 0-4MB, which has enabled
  * INPUT: none
  * OUTPUT: none
  * RETURN: never return, 1 if fail
@@ -364,21 +442,26 @@ int32_t terminal_write(int32_t fd, void *buf, int32_t nbytes)
  */
 void set_vid_buf_page(int term_id){
 
-    /* get page table index */
-    uint32_t index = (uint32_t)(terminals[term_id].vid_buf) >> MEM_OFFSET_BITS;
-
-    /* set paging */
-    page_table[index].p = 1;        // Present
-    page_table[index].r_w = 1;      // Read/write permission, always 1
-    page_table[index].u_s = 0;      // User/supervisor, 0 means supervisor mode
-    page_table[index].pwt = 0;      // Page write-through, always 0
-    page_table[index].pcd = 0;      // Page cache disabled
-    page_table[index].a = 0;        // Accessed, won't use, does not matter
-    page_table[index].d = 0;        // Dirty, set to 0
-    page_table[index].pat = 0;      // Page Attribute Table index, set to 0
-    page_table[index].g = 1;        // Global bit, 1 means page is global and would not be clear in TLB when flush TLB
-    page_table[index].avail = 0;    // Available for our use, won't use, does not matter
-    page_table[index].base_addr = index;// Page-Table Base Address
+    int i;  /* loop index for pages in the region */
+
+    for (i = 0; i < TERM_VID_PAGES; i++)
+    {
+        /* get page table index */
+        uint32_t index = (TERM_VID_ADDR(term_id) >> MEM_OFFSET_BITS) + i;
+
+        /* set paging */
+        page_table[index].p = 1;        // Present
+        page_table[index].r_w = 1;      // Read/write permission, always 1
+        page_table[index].u_s = 0;      // User/supervisor, 0 means supervisor mode
+        page_table[index].pwt = 0;      // Page write-through, always 0
+        page_table[index].pcd = 0;      // Page cache disabled
+        page_table[index].a = 0;        // Accessed, won't use, does not matter
+        page_table[index].d = 0;        // Dirty, set to 0
+        page_table[index].pat = 0;      // Page Attribute Table index, set to 0
+        page_table[index].g = 1;        // Global bit, 1 means page is global and would not be clear in TLB when flush TLB
+        page_table[index].avail = 0;    // Available for our use, won't use, does not matter
+        page_table[index].base_addr = index;// Page-Table Base Address
+    }
 
     /* flush TLB */
     flush_TLB();
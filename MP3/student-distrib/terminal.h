@@ -6,24 +6,58 @@
 #define _TERMINAL_H
 
 #include "types.h"
+#include "lib.h"
+#include "spinlock.h"
 
 #define MAX_TERMINAL_BUF_SIZE   128
-#define TERMINAL_NUM            3
+#define TERMINAL_QUEUE_SIZE     512     /* typed-ahead input of a terminal, power of 2 */
+#define TERMINAL_QUEUE_MASK     (TERMINAL_QUEUE_SIZE - 1)
+
+/* terminal modes */
+#define TTY_ICANON              1       /* canonical, input is edited and read by lines */
+#define TTY_ECHO                2       /* echo the keys typed                          */
+#define TTY_SERIAL              4       /* serial console, input from and output to COM1 */
+#define TTY_DEFAULT_MODE        (TTY_ICANON | TTY_ECHO)
+
 #define FIRST_TERMINAL_ID       0
 
+/* number of terminals, switched by ALT+F1, F2... can be overridden with -DTERMINAL_NUM=n */
+/* each terminal owns a hardware text page, and a base shell takes one of NUM_PROCESS processes */
+#ifndef TERMINAL_NUM
+#define TERMINAL_NUM            3
+#endif
+#if TERMINAL_NUM > VID_PAGE_NUM
+#error "TERMINAL_NUM exceeds the number of VGA text pages"
+#endif
+
+/* terminal that is the serial console at boot if COM1 exists, -DSERIAL_CONSOLE_TERM=n, -1 for none */
+#ifndef SERIAL_CONSOLE_TERM
+#define SERIAL_CONSOLE_TERM     -1
+#endif
+
+/* VGA text pages of each terminal's pan region, the screen pans when it spans more than one page */
+#define TERM_VID_PAGES          (VID_PAGE_NUM / TERMINAL_NUM)
+#define TERM_VID_ADDR(id)       (VIDEO + (id) * TERM_VID_PAGES * VID_PAGE_SIZE)
+#define TERM_VID_ROWS           (TERM_VID_PAGES * VID_PAGE_SIZE / (NUM_COLS * 2))
+
 /* terminal info struct */
 typedef struct terminal_t{
 
     uint32_t id;            /* terminal id                                  */
     uint32_t is_running;    /* indicate whether the terminal is running     */
-    uint32_t curr_pid;      /* current process id of THIS terminal          */
+    uint32_t ready;         /* console and buffers set up, see terminal_setup */
+    uint32_t active_pid;    /* current process id of THIS terminal          */
     uint32_t pnum;          /* number of process running in this terminal   */
-    uint32_t cursor_x;      /* cursor x position of this terminal           */
-    uint32_t cursor_y;      /* cursor y position of this terminal           */
-    volatile uint32_t is_enter;                         /* indicate whether enter is pressed for this terminal */
-    volatile uint8_t term_buf[MAX_TERMINAL_BUF_SIZE];   /* read buffer for this terminal                       */
-    volatile uint8_t term_buf_offset;                   /* offset of read buffer for this terminal             */
-    uint8_t *vid_buf;                                   /* pointer points to this terminal's video buffer      */
+    uint32_t mode;                                      /* TTY_ICANON | TTY_ECHO | TTY_SERIAL                  */
+    uint32_t lines;                                     /* complete lines in the input queue                   */
+    uint32_t enter_tsc;                                 /* low 32 bits of TSC when input became ready          */
+    uint8_t term_buf[MAX_TERMINAL_BUF_SIZE];            /* line being edited in this terminal                  */
+    uint32_t term_buf_offset;                           /* offset of the line being edited                     */
+    uint8_t in_buf[TERMINAL_QUEUE_SIZE];                /* input queue, typed-ahead lines wait here            */
+    uint32_t in_head;                                   /* input queue write index, moved by the keyboard      */
+    uint32_t in_tail;                                   /* input queue read index, moved by terminal_read      */
+    spinlock_t in_lock;                                 /* input queue and line count, IRQ safe                */
+    console_t con;                                      /* screen, VGA pan region and scrollback of this terminal */
 
 } terminal_t;
 
@@ -33,6 +67,9 @@ terminal_t terminals[TERMINAL_NUM];
 /* foreground terminal id */
 uint32_t curr_term_id;
 
+/* id of the serial console terminal, -1 for none */
+int32_t serial_term_id;
+
 /* current running terminal number */
 uint32_t running_term_num;
 
@@ -42,9 +79,6 @@ int32_t terminal_init();
 /* switch to terminal with term_id */
 int32_t terminal_switch(uint32_t term_id);
 
-/* save terminal info */
-int32_t terminal_save(uint32_t term_id);
-
 /* restore terminal info */
 int32_t terminal_restore();
 
@@ -63,7 +97,14 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes);
 /* write the corresponding number of bytes of a buffer to the terminal */
 int32_t terminal_write(int32_t fd, void* buf, int32_t nbytes);
 
-/* set terminal's video buffer page according to the terminal id */
+/* check whether a line is ready to read from the terminal, used by poll */
+int32_t terminal_poll(int32_t fd, uint32_t* stamp);
+
+/* get or set the mode of current process' terminal */
+int32_t terminal_get_mode();
+int32_t terminal_set_mode(uint32_t mode);
+
+/* set terminal's VGA pan region mapping according to the terminal id */
 void set_vid_buf_page(int i);
 
 #endif
@@ -6,6 +6,23 @@
 #include "rtc.h"
 #include "terminal.h"
 #include "filesys.h"
+#include "serial.h"
+#include "schedule.h"
+#include "apic.h"
+#include "fpu.h"
+#include "smp.h"
+#include "softirq.h"
+#include "kheap.h"
+#include "clock.h"
+#include "trace.h"
+#include "paging.h"
+#include "syscall.h"
+#include "thread.h"
+#include "timer.h"
+#include "vbe.h"
+#include "bootprof.h"
+#include "uheap.h"
+#include "shm.h"
 
 
 #define PASS 1
@@ -369,6 +386,727 @@ int test_rtc(){
 	return PASS;
 }
 
+/* test for serial port */
+
+/* bytes sent by the serial throughput test, a line is 64 chars with its \n */
+#define T_SERIAL_BYTES			(64 * 1024)
+#define T_SERIAL_LINE			64
+
+/*
+ *	test_serial
+ *	Description:    measure output throughput over COM1, lines are queued with serial_write
+ *	                and timed until the UART is idle, with the PIT as the clock
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    T_SERIAL_BYTES bytes are sent on COM1, interrupts MUST be enabled
+*/
+int test_serial(){
+	uint8_t line[T_SERIAL_LINE];	/* one line of the pattern	*/
+	uint32_t i;						/* loop index				*/
+	uint32_t ticks;					/* PIT ticks elapsed		*/
+	uint32_t cycles;				/* cycles elapsed, low 32	*/
+	uint32_t start_tsc;				/* TSC at start, low 32		*/
+
+	TEST_HEADER;
+	if (!serial_present){
+		printf("no UART on COM1\n");
+		return FAIL;
+	}
+
+	/* printable pattern, so the host side can check it */
+	for (i = 0; i < T_SERIAL_LINE - 1; i++)
+		line[i] = '!' + i;
+	line[T_SERIAL_LINE - 1] = '\n';
+
+	/* do not measure what printf has queued before */
+	serial_flush();
+	ticks = pit_ticks;
+	start_tsc = (uint32_t)rdtsc();
+	for (i = 0; i < T_SERIAL_BYTES; i += T_SERIAL_LINE){
+		if (serial_write(line, T_SERIAL_LINE) != T_SERIAL_LINE)
+			return FAIL;
+	}
+	serial_flush();
+	cycles = (uint32_t)rdtsc() - start_tsc;
+	ticks = pit_ticks - ticks;
+	if (ticks == 0)
+		ticks = 1;
+
+	/* \n goes out as \r\n, one more byte per line */
+	printf("serial: %u bytes in %u ticks, %u kcycles, %u bytes/s\n", T_SERIAL_BYTES,
+		   ticks, cycles >> 10, (T_SERIAL_BYTES + T_SERIAL_BYTES / T_SERIAL_LINE) * PIT_FREQ / ticks);
+	return PASS;
+}
+
+/* test for interrupt controllers */
+
+/* scheduler ticks measured on each controller */
+#define T_INTR_TICKS			200
+
+/*
+ *	t_intr_measure
+ *	Description:    clear the statistics of a tick source, halt for T_INTR_TICKS ticks
+ *	                and print the handler entry to EOI cycles
+ *	inputs:         name -- controller name to print
+ *	                st -- statistics of the tick source in use
+ *	outputs:	    nothing
+ *	effects:	    interrupts MUST be enabled
+*/
+static void t_intr_measure(const char* name, intr_stats_t* st){
+	uint32_t start;		/* tick at start */
+
+	st->count = 0;
+	st->eoi_cycles = 0;
+	st->eoi_max = 0;
+	start = pit_ticks;
+	while (pit_ticks - start < T_INTR_TICKS)
+		asm volatile ("hlt");
+	printf("%s: %u ticks, entry to EOI avg %u cycles, max %u cycles\n", name,
+		   st->count, st->eoi_cycles / st->count, st->eoi_max);
+}
+
+/*
+ *	test_intr_latency
+ *	Description:    compare the cost of taking and acknowledging the scheduler tick with
+ *	                the LAPIC timer and with the PIT on the 8259, the APICs are switched
+ *	                off for the second measurement and back on after
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    interrupts MUST be enabled
+*/
+int test_intr_latency(){
+	uint32_t was_apic = apic_mode;	/* APICs in use before the test */
+
+	TEST_HEADER;
+	if (was_apic){
+		t_intr_measure("lapic", &lapic_stats);
+		apic_disable();
+	}
+	else
+		printf("APICs not in use, 8259 only\n");
+	t_intr_measure("8259", &pit_stats);
+	if (was_apic && apic_enable() != 0)
+		return FAIL;
+	return PASS;
+}
+
+/* test for bottom halves */
+
+/* scheduler ticks measured in each mode, type or hold a key meanwhile */
+#define T_IRQOFF_TICKS		500
+
+/*
+ *	t_irqoff_measure
+ *	Description:    clear the irq-off statistics, halt for T_IRQOFF_TICKS ticks and print
+ *	                how long interrupt handlers kept interrupts disabled on this processor
+ *	inputs:         defer -- softirq_defer for the measurement
+ *	outputs:	    nothing
+ *	effects:	    interrupts MUST be enabled
+*/
+static void t_irqoff_measure(uint32_t defer){
+	uint32_t start;		/* tick at start */
+	cpu_t* cpu = this_cpu();
+
+	softirq_defer = defer;
+	irqoff_reset();
+	start = pit_ticks;
+	while (pit_ticks - start < T_IRQOFF_TICKS)
+		asm volatile ("hlt");
+	printf("bottom halves %s: %u irqs, irq off avg %u cycles, max %u cycles\n",
+		   defer ? "deferred" : "inline", cpu->irqoff_count,
+		   cpu->irqoff_count ? cpu->irqoff_cycles / cpu->irqoff_count : 0, cpu->irqoff_max);
+}
+
+/*
+ *	test_irqoff
+ *	Description:    compare the worst interrupt-disabled time of the handlers with the
+ *	                line discipline run inline in the keyboard irq, as before softirqs,
+ *	                and deferred to the TTY softirq. type, scroll or switch terminals
+ *	                during both measurements
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    interrupts MUST be enabled
+*/
+int test_irqoff(){
+	TEST_HEADER;
+	t_irqoff_measure(0);
+	t_irqoff_measure(1);
+	return PASS;
+}
+
+/* test for memory routines */
+
+/* largest size of the sweep, sizes go up by 4 from T_MEM_MIN */
+#define T_MEM_MIN		16
+#define T_MEM_MAX		0x40000
+#define T_MEM_STEP_SHIFT	2
+/* bytes moved per measurement, at least one call */
+#define T_MEM_BYTES		0x100000
+/* offsets of dest and src from a 64 byte boundary */
+#define T_MEM_ALIGNS	3
+/* overlap of the memmove measurement */
+#define T_MEM_OVERLAP	8
+
+static uint8_t t_mem_dst[T_MEM_MAX + 64] __attribute__((aligned(64)));
+static uint8_t t_mem_src[T_MEM_MAX + 64] __attribute__((aligned(64)));
+static const uint32_t t_mem_align[T_MEM_ALIGNS][2] = {{0, 0}, {1, 3}, {8, 0}};
+
+typedef void* (*t_copy_fn)(void*, const void*, uint32_t);
+typedef void* (*t_fill_fn)(void*, int32_t, uint32_t);
+
+/*
+ *	t_mem_copy_cycles
+ *	Description:    time copies of one size, repeated to move about T_MEM_BYTES
+ *	inputs:         fn -- copy routine
+ *	                dst, src -- buffers
+ *	                n -- size of one copy
+ *	outputs:	    nothing
+ *	effects:	    dst overwritten, returns cycles per copy
+*/
+static uint32_t t_mem_copy_cycles(t_copy_fn fn, uint8_t* dst, const uint8_t* src, uint32_t n){
+	uint32_t reps = (n < T_MEM_BYTES) ? T_MEM_BYTES / n : 1;
+	uint32_t i;
+	uint64_t start = rdtsc();
+
+	for (i = 0; i < reps; i++)
+		fn(dst, src, n);
+	return (uint32_t)(rdtsc() - start) / reps;
+}
+
+/*
+ *	t_mem_fill_cycles
+ *	Description:    time fills of one size, repeated to set about T_MEM_BYTES
+ *	inputs:         fn -- fill routine
+ *	                dst -- buffer
+ *	                n -- size of one fill
+ *	outputs:	    nothing
+ *	effects:	    dst overwritten, returns cycles per fill
+*/
+static uint32_t t_mem_fill_cycles(t_fill_fn fn, uint8_t* dst, uint32_t n){
+	uint32_t reps = (n < T_MEM_BYTES) ? T_MEM_BYTES / n : 1;
+	uint32_t i;
+	uint64_t start = rdtsc();
+
+	for (i = 0; i < reps; i++)
+		fn(dst, 0x5A, n);
+	return (uint32_t)(rdtsc() - start) / reps;
+}
+
+/*
+ *	t_mem_check
+ *	Description:    check a copy, fill or move of n bytes against a byte loop, with
+ *	                guard bytes around the destination
+ *	inputs:         dst_off, src_off -- offsets from the buffer starts
+ *	                n -- size
+ *	outputs:	    nothing
+ *	effects:	    buffers overwritten, returns 0 if every result is right
+*/
+static int t_mem_check(uint32_t dst_off, uint32_t src_off, uint32_t n){
+	uint8_t* dst = t_mem_dst + dst_off;
+	uint8_t* src = t_mem_src + src_off;
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		src[i] = (uint8_t)(i * 7 + 1);
+	/* copy, guard bytes around it stay 0 */
+	memset_stos(t_mem_dst, 0, sizeof(t_mem_dst));
+	memcpy(dst, src, n);
+	for (i = 0; i < n; i++)
+		if (dst[i] != (uint8_t)(i * 7 + 1))
+			return -1;
+	if ((dst_off && dst[-1] != 0) || dst[n] != 0)
+		return -1;
+	/* fill */
+	memset(dst, 0xA5, n);
+	for (i = 0; i < n; i++)
+		if (dst[i] != 0xA5)
+			return -1;
+	if ((dst_off && dst[-1] != 0) || dst[n] != 0)
+		return -1;
+	/* overlapping moves in both directions, within the source buffer */
+	if (n > T_MEM_OVERLAP && src_off + n + T_MEM_OVERLAP <= sizeof(t_mem_src)){
+		memmove(src + T_MEM_OVERLAP, src, n);
+		for (i = 0; i < n; i++)
+			if (src[i + T_MEM_OVERLAP] != (uint8_t)(i * 7 + 1))
+				return -1;
+		memmove(src, src + T_MEM_OVERLAP, n);
+		for (i = 0; i < n; i++)
+			if (src[i] != (uint8_t)(i * 7 + 1))
+				return -1;
+	}
+	return 0;
+}
+
+/*
+ *	test_mem_routines
+ *	Description:    check memcpy, memset and memmove over sizes and alignments, and
+ *	                compare their cycles with the rep movsl/stosl/movsb routines they
+ *	                replace. the sweep goes up to 256kB, where non-temporal stores
+ *	                are used
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    none
+*/
+int test_mem_routines(){
+	uint32_t n, a, dst_off, src_off;
+	uint8_t* dst;
+	uint8_t* src;
+
+	TEST_HEADER;
+	printf("sse2 %u, cycles per call old/new\n", fpu_sse2);
+	for (n = T_MEM_MIN; n <= T_MEM_MAX; n <<= T_MEM_STEP_SHIFT){
+		for (a = 0; a < T_MEM_ALIGNS; a++){
+			dst_off = t_mem_align[a][0];
+			src_off = t_mem_align[a][1];
+			if (t_mem_check(dst_off, src_off, n) != 0){
+				printf("wrong result: %u bytes, +%u/+%u\n", n, dst_off, src_off);
+				return FAIL;
+			}
+			dst = t_mem_dst + dst_off;
+			src = t_mem_src + src_off;
+			printf("%u +%u/+%u: cpy %u/%u set %u/%u", n, dst_off, src_off,
+				   t_mem_copy_cycles(memcpy_movs, dst, src, n), t_mem_copy_cycles(memcpy, dst, src, n),
+				   t_mem_fill_cycles(memset_stos, dst, n), t_mem_fill_cycles(memset, dst, n));
+			/* overlapping, dest above src is the backward case */
+			if (n + T_MEM_OVERLAP + src_off <= sizeof(t_mem_src))
+				printf(" mov %u/%u", t_mem_copy_cycles(memmove_movsb, src + T_MEM_OVERLAP, src, n),
+					   t_mem_copy_cycles(memmove, src + T_MEM_OVERLAP, src, n));
+			printf("\n");
+		}
+	}
+	return PASS;
+}
+
+/* test for the kernel heap */
+
+/* objects held at once by the throughput and fragmentation runs */
+#define T_KHEAP_OBJS		256
+/* alloc/free pairs timed for each size */
+#define T_KHEAP_PAIRS		4096
+/* random operations of the fragmentation run */
+#define T_KHEAP_OPS			8192
+/* sizes of the throughput run, the last takes whole frames */
+#define T_KHEAP_SIZES		6
+
+static void* t_kheap_obj[T_KHEAP_OBJS];
+static uint32_t t_kheap_len[T_KHEAP_OBJS];
+static const uint32_t t_kheap_size[T_KHEAP_SIZES] = {16, 64, 200, 1024, 2048, 6000};
+
+/*
+ *	t_kheap_fill
+ *	Description:    write a pattern over an allocation, from its slot number
+ *	inputs:         slot -- index in t_kheap_obj
+ *	outputs:	    nothing
+ *	effects:	    the allocation overwritten
+*/
+static void t_kheap_fill(uint32_t slot){
+	uint8_t* p = (uint8_t*)t_kheap_obj[slot];
+	uint32_t i;
+
+	for (i = 0; i < t_kheap_len[slot]; i++)
+		p[i] = (uint8_t)(slot * 13 + i);
+}
+
+/*
+ *	t_kheap_check
+ *	Description:    check the pattern of an allocation, a wrong byte means two live
+ *	                allocations overlap or the free lists were corrupted
+ *	inputs:         slot -- index in t_kheap_obj
+ *	outputs:	    nothing
+ *	effects:	    returns 0 if the pattern is intact
+*/
+static int t_kheap_check(uint32_t slot){
+	uint8_t* p = (uint8_t*)t_kheap_obj[slot];
+	uint32_t i;
+
+	for (i = 0; i < t_kheap_len[slot]; i++)
+		if (p[i] != (uint8_t)(slot * 13 + i))
+			return -1;
+	return 0;
+}
+
+/*
+ *	test_kheap
+ *	Description:    time kmalloc/kfree pairs and a cache of its own for several sizes,
+ *	                then run random allocations and frees of mixed sizes with the
+ *	                contents checked, and report the frames held against the bytes
+ *	                asked for and the largest free run left
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    all memory taken is given back
+*/
+int test_kheap(){
+	kmem_cache_t* cache;
+	uint32_t free_before = frame_free_count();
+	uint32_t seed = 1;		/* LCG state */
+	uint32_t i, s, slot, live = 0, bytes = 0, held;
+	uint64_t start;
+
+	TEST_HEADER;
+	printf("%u frames free, largest run %u\n", free_before, frame_largest_run());
+
+	/* throughput, T_KHEAP_OBJS live objects so slabs are filled and emptied */
+	for (s = 0; s < T_KHEAP_SIZES; s++){
+		start = rdtsc();
+		for (i = 0; i < T_KHEAP_PAIRS; i++){
+			slot = i % T_KHEAP_OBJS;
+			if (i >= T_KHEAP_OBJS)
+				kfree(t_kheap_obj[slot]);
+			if ((t_kheap_obj[slot] = kmalloc(t_kheap_size[s])) == NULL)
+				break;
+		}
+		for (slot = 0; slot < T_KHEAP_OBJS && slot < i; slot++)
+			kfree(t_kheap_obj[slot]);
+		if (i < T_KHEAP_PAIRS)
+			printf("kmalloc %u: out of memory after %u\n", t_kheap_size[s], i);
+		else
+			printf("kmalloc %u: %u cycles per pair\n", t_kheap_size[s],
+				   (uint32_t)(rdtsc() - start) / T_KHEAP_PAIRS);
+	}
+	if ((cache = kmem_cache_create("test-48", 48, 0)) == NULL)
+		return FAIL;
+	start = rdtsc();
+	for (i = 0; i < T_KHEAP_PAIRS; i++){
+		slot = i % T_KHEAP_OBJS;
+		if (i >= T_KHEAP_OBJS)
+			kmem_cache_free(cache, t_kheap_obj[slot]);
+		if ((t_kheap_obj[slot] = kmem_cache_alloc(cache)) == NULL)
+			return FAIL;
+	}
+	for (slot = 0; slot < T_KHEAP_OBJS; slot++)
+		kmem_cache_free(cache, t_kheap_obj[slot]);
+	printf("cache 48: %u cycles per pair\n", (uint32_t)(rdtsc() - start) / T_KHEAP_PAIRS);
+
+	/* fragmentation, sizes skewed small like kernel objects, one in 16 above a frame */
+	for (slot = 0; slot < T_KHEAP_OBJS; slot++)
+		t_kheap_obj[slot] = NULL;
+	for (i = 0; i < T_KHEAP_OPS; i++){
+		seed = seed * 1103515245 + 12345;
+		slot = (seed >> 8) % T_KHEAP_OBJS;
+		if (t_kheap_obj[slot] != NULL){
+			if (t_kheap_check(slot) != 0){
+				printf("slot %u corrupted\n", slot);
+				return FAIL;
+			}
+			kfree(t_kheap_obj[slot]);
+			t_kheap_obj[slot] = NULL;
+			live--;
+			bytes -= t_kheap_len[slot];
+			continue;
+		}
+		t_kheap_len[slot] = ((seed >> 20) & 0xF) == 0 ? 4096 + (seed >> 16) % 8192 : 8 + (seed >> 16) % 500;
+		if ((t_kheap_obj[slot] = kmalloc(t_kheap_len[slot])) == NULL)
+			continue;
+		t_kheap_fill(slot);
+		live++;
+		bytes += t_kheap_len[slot];
+	}
+	held = free_before - frame_free_count();
+	printf("%u live, %u bytes in %u frames (%u%% used), largest run %u of %u free\n", live, bytes,
+		   held, held ? bytes * 100 / (held * PAGE_4KB_SIZE) : 0, frame_largest_run(), frame_free_count());
+	kheap_stats();
+
+	for (slot = 0; slot < T_KHEAP_OBJS; slot++){
+		if (t_kheap_obj[slot] == NULL)
+			continue;
+		if (t_kheap_check(slot) != 0){
+			printf("slot %u corrupted\n", slot);
+			return FAIL;
+		}
+		kfree(t_kheap_obj[slot]);
+	}
+	/* each kmalloc class may keep KMEM_KEEP_EMPTY empty slabs */
+	held = free_before - frame_free_count();
+	printf("%u frames kept after freeing everything\n", held);
+	return (held <= (KMALLOC_CLASSES + 1) * KMEM_KEEP_EMPTY) ? PASS : FAIL;
+}
+
+/* test for the clock */
+
+/* scheduler ticks the clock is compared over, and clock reads timed */
+#define T_CLOCK_TICKS		100
+#define T_CLOCK_READS		10000
+
+/*
+ *	test_clock
+ *	Description:    compare the nanosecond clock with PIT ticks over T_CLOCK_TICKS
+ *	                ticks, the difference should stay within a tick, and time a read
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    interrupts MUST be enabled
+*/
+int test_clock(){
+	uint32_t start_tick, i;
+	uint64_t start_ns, prev, now, start;
+	uint32_t clock_ms, tick_ms;
+
+	TEST_HEADER;
+	/* start right after a tick */
+	start_tick = pit_ticks;
+	while (pit_ticks == start_tick)
+		asm volatile ("hlt");
+	start_tick = pit_ticks;
+	start_ns = clock_ns();
+	while (pit_ticks - start_tick < T_CLOCK_TICKS)
+		asm volatile ("hlt");
+	clock_ms = (uint32_t)(clock_ns() - start_ns) / NS_PER_MS;
+	tick_ms = (pit_ticks - start_tick) * MS_PER_SECOND / PIT_FREQ;
+	printf("clock %u ms over %u ms of ticks\n", clock_ms, tick_ms);
+
+	prev = clock_ns();
+	start = rdtsc();
+	for (i = 0; i < T_CLOCK_READS; i++){
+		now = clock_ns();
+		if (now < prev){
+			printf("clock went back\n");
+			return FAIL;
+		}
+		prev = now;
+	}
+	printf("%u cycles per read\n", (uint32_t)(rdtsc() - start) / T_CLOCK_READS);
+	return (clock_ms + MS_PER_SECOND / PIT_FREQ >= tick_ms && clock_ms <= tick_ms + MS_PER_SECOND / PIT_FREQ) ? PASS : FAIL;
+}
+
+/* test for the event trace */
+
+/* events recorded, and the cost one may take at most */
+#define T_TRACE_EVENTS		10000
+#define T_TRACE_MAX_CYCLES	200
+
+/*
+ *	test_trace
+ *	Description:    time trace() with recording on, the test events push every
+ *	                earlier event out of this processor's ring
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    recording left as it was
+*/
+int test_trace(){
+	uint32_t i, was_on, cycles;
+	uint64_t start;
+
+	TEST_HEADER;
+	was_on = trace_on;
+	trace_on = 1;
+	start = rdtsc();
+	for (i = 0; i < T_TRACE_EVENTS; i++)
+		trace(TRACE_EXECUTE, curr_pid, i);
+	cycles = (uint32_t)(rdtsc() - start) / T_TRACE_EVENTS;
+	trace_on = was_on;
+	printf("%u cycles per event\n", cycles);
+	return (cycles <= T_TRACE_MAX_CYCLES) ? PASS : FAIL;
+}
+
+/* test for threads */
+
+/*
+ *	test_thread_args
+ *	Description:    thread_create and futex must refuse kernel addresses, unaligned
+ *	                words and unknown operations before touching any process state
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    none
+*/
+int test_thread_args(){
+	uint32_t word = 0;
+
+	TEST_HEADER;
+	if (thread_create(KS_BASE_ADDR, USER_STACK_ADDR, NULL) != -1)
+		return FAIL;
+	if (thread_create(PROGRAM_START_ADDR, KS_BASE_ADDR, NULL) != -1)
+		return FAIL;
+	if (thread_create(PROGRAM_START_ADDR, USER_STACK_ADDR, &word) != -1)
+		return FAIL;
+	if (futex(&word, FUTEX_WAKE, 1) != -1)
+		return FAIL;
+	if (futex((uint32_t*)(ADDR_128MB + 1), FUTEX_WAKE, 1) != -1)
+		return FAIL;
+	if (futex((uint32_t*)ADDR_132MB, FUTEX_WAIT, 0) != -1)
+		return FAIL;
+	return PASS;
+}
+
+/* test for the timer wheel */
+
+/* timers armed, the ticks the kept ones expire within, and how far the cancelled go */
+#define T_TIMERS			4096
+#define T_TIMER_SPAN		300
+#define T_TIMER_FAR			5000
+/* ticks a timer may expire late, the softirq of a tick can wait for the next irq */
+#define T_TIMER_LATE		1
+
+static ktimer_t t_timers[T_TIMERS];
+static uint32_t t_timer_expires[T_TIMERS];
+static volatile uint32_t t_timer_fired[T_TIMERS];
+static volatile uint32_t t_timer_left;
+
+/* expiry of a test timer, records the tick */
+static void t_timer_fn(uint32_t i){
+	t_timer_fired[i] = pit_ticks;
+	t_timer_left--;
+}
+
+/*
+ *	test_timer_wheel
+ *	Description:    arm T_TIMERS timers, the kept ones within T_TIMER_SPAN ticks so
+ *	                levels 0 and 1 are used, every fourth up to T_TIMER_FAR ticks and
+ *	                cancelled. each kept timer must expire once at its tick, no
+ *	                cancelled one may. reports the cost of add, cancel and of the
+ *	                expiry softirq per tick
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    interrupts MUST be enabled, timer_stats.max_cycles reset
+*/
+int test_timer_wheel(){
+	uint32_t i, seed = 1, start, runs, cycles;
+	uint32_t add_cycles, cancel_cycles;
+	uint64_t t0;
+
+	TEST_HEADER;
+	t_timer_left = T_TIMERS - T_TIMERS / 4;
+	runs = timer_stats.runs;
+	cycles = timer_stats.cycles;
+	timer_stats.max_cycles = 0;
+
+	t0 = rdtsc();
+	for (i = 0; i < T_TIMERS; i++){
+		seed = seed * 1103515245 + 12345;
+		t_timer_fired[i] = 0;
+		timer_setup(&t_timers[i], t_timer_fn, i);
+		if (i % 4 == 3)
+			timer_add(&t_timers[i], T_TIMER_SPAN + (seed >> 16) % T_TIMER_FAR, 0);
+		else
+			timer_add(&t_timers[i], 1 + (seed >> 16) % T_TIMER_SPAN, 0);
+		t_timer_expires[i] = t_timers[i].expires;
+	}
+	add_cycles = (uint32_t)(rdtsc() - t0) / T_TIMERS;
+
+	t0 = rdtsc();
+	for (i = 3; i < T_TIMERS; i += 4){
+		if (!timer_cancel(&t_timers[i])){
+			printf("timer %u expired early\n", i);
+			return FAIL;
+		}
+	}
+	cancel_cycles = (uint32_t)(rdtsc() - t0) / (T_TIMERS / 4);
+
+	start = pit_ticks;
+	while (t_timer_left > 0 && pit_ticks - start < T_TIMER_SPAN + PIT_FREQ)
+		asm volatile ("hlt");
+
+	runs = timer_stats.runs - runs;
+	cycles = timer_stats.cycles - cycles;
+	printf("add %u, cancel %u cycles, %u softirq runs, avg %u max %u cycles\n", add_cycles,
+		cancel_cycles, runs, runs ? cycles / runs : 0, timer_stats.max_cycles);
+
+	for (i = 0; i < T_TIMERS; i++){
+		if (i % 4 == 3){
+			if (t_timer_fired[i] != 0){
+				printf("cancelled timer %u expired\n", i);
+				return FAIL;
+			}
+		}
+		else if (t_timer_fired[i] < t_timer_expires[i] || t_timer_fired[i] > t_timer_expires[i] + T_TIMER_LATE){
+			printf("timer %u expired at %u, due %u\n", i, t_timer_fired[i], t_timer_expires[i]);
+			return FAIL;
+		}
+	}
+	return (t_timer_left == 0) ? PASS : FAIL;
+}
+
+/* test for the graphics device */
+
+/*
+ *	test_vbe_args
+ *	Description:    vidmap_ex and present must refuse unknown targets, kernel pointers
+ *	                and bad rectangle counts before looking at the display
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    none
+*/
+int test_vbe_args(){
+	uint8_t* screen;
+	fbrect_t rect;
+
+	TEST_HEADER;
+	if (vidmap_ex(VIDMAP_BACK + 1, (uint8_t**)ADDR_128MB, NULL) != -1)
+		return FAIL;
+	if (vidmap_ex(VIDMAP_FB, &screen, NULL) != -1)
+		return FAIL;
+	if (vidmap_ex(VIDMAP_FB, (uint8_t**)ADDR_128MB, (fbinfo_t*)(ADDR_132MB - sizeof(uint32_t))) != -1)
+		return FAIL;
+	if (present(&rect, 1, 0) != -1)
+		return FAIL;
+	if (present((fbrect_t*)ADDR_128MB, VBE_MAX_RECTS + 1, 0) != -1)
+		return FAIL;
+	if (present((fbrect_t*)ADDR_128MB, -1, 0) != -1)
+		return FAIL;
+	return PASS;
+}
+
+/*
+ *	test_sbrk_args
+ *	Description:    sbrk must refuse to move the break by more than the heap region
+ *	                before looking at the current process
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    none
+*/
+int test_sbrk_args(){
+	TEST_HEADER;
+	if (sbrk(UHEAP_MAX_SIZE + 1) != -1)
+		return FAIL;
+	if (sbrk(-UHEAP_MAX_SIZE - 1) != -1)
+		return FAIL;
+	if (sbrk(0x7FFFFFFF) != -1)
+		return FAIL;
+	return PASS;
+}
+
+/* key base of the test segments, far from the keys of the user programs */
+#define T_SHM_KEY				0x5EED0000
+
+/*
+ *	test_shm_unattached
+ *	Description:    a process that gets every segment and attaches none, then halts,
+ *	                must give the segments and their frames back, then a new key gets
+ *	                a slot again
+ *	inputs:         nothing
+ *	outputs:	    PASS/FAIL
+ *	effects:	    runs as the last pid for a while, writes the mm pid of its PCB,
+ *	                no process may run
+*/
+int test_shm_unattached(){
+	uint32_t pid = NUM_PROCESS - 1, saved_pid = this_cpu()->pid;
+	uint32_t frames;
+	int i, ret = PASS;
+
+	TEST_HEADER;
+	this_cpu()->pid = pid;
+	get_pcb_ptr(pid)->mm_pid = pid;
+	frames = frame_free_count();
+
+	for (i = 0; i < SHM_MAX_SEG; i++)
+	{
+		if (shmget(T_SHM_KEY + i) != i)
+			ret = FAIL;
+	}
+	/* full, and getting a key twice takes no other slot */
+	if (shmget(T_SHM_KEY + SHM_MAX_SEG) != -1 || shmget(T_SHM_KEY) != 0)
+		ret = FAIL;
+
+	/* what halt does */
+	shm_detach_all(pid);
+	if (frame_free_count() != frames)
+		ret = FAIL;
+	if (shmget(T_SHM_KEY + SHM_MAX_SEG) != 0)
+		ret = FAIL;
+	shm_detach_all(pid);
+
+	this_cpu()->pid = saved_pid;
+	return ret;
+}
+
 /* test for file system */
 
 /* size of one data read from a file */
@@ -489,4 +1227,186 @@ void launch_tests(){
 	// test_terminal();
 	// test_rtc();
 	// test_cat(test_fname_list[T_EXE_NAME]);
+	// TEST_OUTPUT("test_serial", test_serial());
+	// TEST_OUTPUT("test_intr_latency", test_intr_latency());
+	// TEST_OUTPUT("test_mem_routines", test_mem_routines());
+	// TEST_OUTPUT("test_irqoff", test_irqoff());
+	// TEST_OUTPUT("test_kheap", test_kheap());
+	// TEST_OUTPUT("test_clock", test_clock());
+	// TEST_OUTPUT("test_trace", test_trace());
+	// TEST_OUTPUT("test_thread_args", test_thread_args());
+	// TEST_OUTPUT("test_timer_wheel", test_timer_wheel());
+	// TEST_OUTPUT("test_vbe_args", test_vbe_args());
+	// TEST_OUTPUT("test_sbrk_args", test_sbrk_args());
+	// TEST_OUTPUT("test_shm_unattached", test_shm_unattached());
+}
+
+
+/* Benchmarks */
+
+/*
+ * every benchmark prints one "BENCH <name> <value> <unit>" line, lower is better.
+ * a benchmark is repeated BENCH_RUNS times and the best run is reported, a run an
+ * interrupt landed in (the irqs count of the processor moved) does not count, and
+ * nothing is reported if every run was interrupted. the "bench" user program adds the syscall,
+ * terminal_write and execute/halt results, bench_compare.py compares a run with
+ * the stored baseline
+ */
+#define BENCH_RUNS			16
+#define BENCH_LOOKUPS		1000
+#define BENCH_SWITCHES		1000
+#define BENCH_KB			1024
+
+/* a block read by the read_data benchmark */
+static uint8_t bench_buf[BLOCK_SIZE_BYTE];
+
+/*
+ *	bench_report
+ *	Description:    print a benchmark result
+ *	inputs:         name -- benchmark name
+ *	                value -- best result
+ *	                unit -- unit of the value
+ *	outputs:	    a BENCH line, on COM1 too
+ *	effects:	    none
+*/
+static void bench_report(const char* name, uint32_t value, const char* unit){
+	printf("BENCH %s %u %s\n", name, value, unit);
+}
+
+/*
+ *	bench_read_data
+ *	Description:    read the largest file of the file system a block at a time
+ *	inputs:         nothing
+ *	outputs:	    cycles per KB
+ *	effects:	    none
+*/
+static void bench_read_data(){
+	dentry_t dentry;
+	uint32_t i, run, offset, irqs, size = 0, inode = 0;
+	uint32_t cycles, best = (uint32_t)-1;
+	uint64_t start;
+
+	for (i = 0; read_dentry_by_index(i, &dentry) == 0; i++){
+		if (dentry.file_type == FILE_TYPE && get_file_size(&dentry) > size){
+			size = get_file_size(&dentry);
+			inode = dentry.inode_idx;
+		}
+	}
+	if (size < BENCH_KB)
+		return;
+
+	for (run = 0; run < BENCH_RUNS; run++){
+		irqs = this_cpu()->irqs;
+		start = rdtsc();
+		for (offset = 0; offset < size; offset += BLOCK_SIZE_BYTE)
+			read_data(inode, offset, bench_buf, BLOCK_SIZE_BYTE);
+		cycles = (uint32_t)(rdtsc() - start);
+		if (this_cpu()->irqs == irqs && cycles < best)
+			best = cycles;
+	}
+	if (best == (uint32_t)-1)
+		return;
+	bench_report("read_data", best / (size / BENCH_KB), "cycles/KB");
+}
+
+/*
+ *	bench_dentry_lookup
+ *	Description:    look up the last file name of the directory, the longest scan
+ *	inputs:         nothing
+ *	outputs:	    cycles per lookup
+ *	effects:	    none
+*/
+static void bench_dentry_lookup(){
+	dentry_t dentry;
+	uint8_t name[MAX_FILE_NAME_LEN + 1];
+	uint32_t i, run, last, irqs;
+	uint32_t cycles, best = (uint32_t)-1;
+	uint64_t start;
+
+	for (last = 0; read_dentry_by_index(last + 1, &dentry) == 0; last++)
+		;
+	if (read_dentry_by_index(last, &dentry) != 0)
+		return;
+	strncpy((int8_t*)name, dentry.file_name, MAX_FILE_NAME_LEN);
+	name[MAX_FILE_NAME_LEN] = '\0';
+
+	for (run = 0; run < BENCH_RUNS; run++){
+		irqs = this_cpu()->irqs;
+		start = rdtsc();
+		for (i = 0; i < BENCH_LOOKUPS; i++)
+			read_dentry_by_name(name, &dentry);
+		cycles = (uint32_t)(rdtsc() - start);
+		if (this_cpu()->irqs == irqs && cycles < best)
+			best = cycles;
+	}
+	if (best == (uint32_t)-1)
+		return;
+	bench_report("dentry_lookup", best / BENCH_LOOKUPS, "cycles");
+}
+
+/*
+ *	bench_addr_space_switch
+ *	Description:    time the address space part of a context switch as the scheduler
+ *	                does it, paging, video memory and kernel stack, between two pids.
+ *	                no register context is saved or restored and the scheduler is not
+ *	                entered, the execute/halt round trip of the "bench" user program
+ *	                covers a whole switch
+ *	inputs:         nothing
+ *	outputs:	    cycles per address space switch
+ *	effects:	    leaves the user pages of pid 0 mapped, execute maps its own
+*/
+static void bench_addr_space_switch(){
+	uint32_t i, run, pid, irqs;
+	uint32_t cycles, best = (uint32_t)-1;
+	uint64_t start;
+
+	for (run = 0; run < BENCH_RUNS; run++){
+		irqs = this_cpu()->irqs;
+		start = rdtsc();
+		for (i = 0; i < BENCH_SWITCHES; i++){
+			pid = i & 1;
+			set_paging(pid);
+			vid_remap(terminals[FIRST_TERMINAL_ID].con.vid);
+			tss[cpu_id()].esp0 = KS_BASE_ADDR - KS_SIZE * pid - sizeof(int32_t);
+		}
+		cycles = (uint32_t)(rdtsc() - start);
+		if (this_cpu()->irqs == irqs && cycles < best)
+			best = cycles;
+	}
+	if (best == (uint32_t)-1)
+		return;
+	bench_report("addr_space_switch", best / BENCH_SWITCHES, "cycles");
+}
+
+/*
+ *	launch_bench
+ *	Description:    report the boot, run the kernel benchmarks, the first terminal then runs the
+ *	                "bench" user program, whose halt ends the run in bench_exit
+ *	inputs:         nothing
+ *	outputs:	    BENCH lines
+ *	effects:	    interrupts MUST be enabled
+*/
+void launch_bench(){
+	printf("BENCH begin\n");
+	boot_report(1);
+	bench_read_data();
+	bench_dentry_lookup();
+	bench_addr_space_switch();
+}
+
+/*
+ *	bench_exit
+ *	Description:    end a benchmark run, QEMU exits with (status << 1) | 1 through its
+ *	                isa-debug-exit device, on other machines this processor stops
+ *	inputs:         status -- exit status of the "bench" user program
+ *	outputs:	    the last BENCH line
+ *	effects:	    never returns
+*/
+void bench_exit(uint32_t status){
+	printf("BENCH end %u\n", status);
+	serial_flush();
+	outb(status, BENCH_EXIT_PORT);
+	cli();
+	while (1)
+		asm volatile ("hlt");
 }
@@ -1,9 +1,22 @@
 #ifndef TESTS_H
 #define TESTS_H
 
+#include "types.h"
+
 #define TEST_RTC    0
 
+/* benchmark mode, "make bench" builds the kernel with RUN_BENCH=1 */
+#ifndef RUN_BENCH
+#define RUN_BENCH   0
+#endif
+/* I/O port of QEMU's isa-debug-exit device, as given to -device in the Makefile */
+#define BENCH_EXIT_PORT 0xF4
+
 // test launcher
 void launch_tests();
 
+// benchmarks, and the end of a benchmark run
+void launch_bench();
+void bench_exit(uint32_t status);
+
 #endif /* TESTS_H */
@@ -0,0 +1,285 @@
+#include "thread.h"
+#include "lib.h"
+#include "paging.h"
+#include "x86_desc.h"
+#include "schedule.h"
+#include "smp.h"
+#include "fpu.h"
+#include "trace.h"
+#include "timer.h"
+
+static int32_t futex_wait(uint32_t* addr, uint32_t val);
+static int32_t futex_wake(uint32_t mm_pid, uint32_t addr, uint32_t n);
+static uint32_t user_word_ok(uint32_t* addr);
+
+/*
+ * thread_create
+ * DESCRIPTION: system call thread_create, start a thread of the current process. it
+ *              gets a pid and a kernel stack of its own and goes to the run queue, the
+ *              first switch to it enters user mode at entry with esp = stack
+ * INPUT: entry -- first user instruction
+ *        stack -- user stack pointer, the caller lays out the arguments there
+ *        exit_word -- user word set to THREAD_ALIVE now, cleared and woken at exit
+ *                     as with FUTEX_WAKE, NULL for none
+ * OUTPUT: none
+ * RETURN: pid of the thread for success, -1 for fail
+ * SIDE AFFECTS: a pid taken
+ */
+int32_t thread_create(uint32_t entry, uint32_t stack, uint32_t* exit_word)
+{
+    pcb_t *owner, *pcb;
+    uint32_t tid;
+
+    /* sanity check, everything must be in user space */
+    if (entry < ADDR_128MB || entry >= ADDR_132MB || stack <= ADDR_128MB || stack > ADDR_132MB)
+        return -1;
+    if (exit_word != NULL && !user_word_ok(exit_word))
+        return -1;
+
+    owner = get_pcb_ptr(curr_mm_pid);
+    if ((tid = get_new_pid()) == -1)
+        return -1;
+
+    pcb = get_pcb_ptr(tid);
+    if (timer_proc_init(tid) == -1)
+    {
+        free_pid(tid);
+        return -1;
+    }
+    pcb->pid = tid;
+    pcb->parent_pid = owner->pid;
+    pcb->term_id = owner->term_id;
+    memcpy(pcb->arg, owner->arg, MAX_ARG_LEN);
+    pcb->mm_pid = owner->pid;
+    pcb->threads = 0;
+    pcb->blocked = 0;
+    pcb->exited = 0;
+    pcb->killed = 0;
+    pcb->futex_addr = 0;
+    pcb->exit_word = (uint32_t)exit_word;
+    fpu_state_init(&pcb->fpu);
+    /* the fds are the process' */
+    pcb->fd_array = NULL;
+
+    /* the first switch lands on the empty kernel stack with the lock held, see thread_start */
+    pcb->ebp = KS_BASE_ADDR - KS_SIZE * tid - sizeof(int32_t);
+    pcb->esp = pcb->ebp;
+    pcb->lock_depth = 1;
+    pcb->in_softirq = 0;
+    pcb->start_eip = entry;
+    pcb->start_esp = stack;
+
+    if (exit_word != NULL)
+        *exit_word = THREAD_ALIVE;
+    owner->threads++;
+
+    trace(TRACE_EXECUTE, tid, curr_pid);
+    sched_enqueue(tid);
+    return tid;
+}
+
+/*
+ * futex
+ * DESCRIPTION: system call futex, FUTEX_WAIT sleeps while *addr == val until a
+ *              FUTEX_WAKE on the same address, FUTEX_WAKE wakes up to val of the
+ *              threads of this process waiting on addr. the compare and the sleep are
+ *              atomic with respect to FUTEX_WAKE, both run under the kernel lock
+ * INPUT: addr -- aligned user word
+ *        op -- FUTEX_WAIT or FUTEX_WAKE
+ *        val -- expected value or number of threads to wake
+ * OUTPUT: none
+ * RETURN: FUTEX_WAIT 0 once woken, -1 if *addr != val or fail.
+ *         FUTEX_WAKE the number of threads woken, -1 for fail
+ * SIDE AFFECTS: none
+ */
+int32_t futex(uint32_t* addr, int32_t op, uint32_t val)
+{
+    if (!user_word_ok(addr))
+        return -1;
+
+    switch (op)
+    {
+        case FUTEX_WAIT:
+            return futex_wait(addr, val);
+        case FUTEX_WAKE:
+            return futex_wake(curr_mm_pid, (uint32_t)addr, val);
+        default:
+            return -1;
+    }
+}
+
+/*
+ * futex_wait
+ * DESCRIPTION: block the current thread on addr until futex_wake
+ * INPUT: addr -- checked user word
+ *        val -- expected value
+ * OUTPUT: none
+ * RETURN: 0 once woken, -1 if *addr != val
+ * SIDE AFFECTS: a killed thread exits instead of returning
+ */
+static int32_t futex_wait(uint32_t* addr, uint32_t val)
+{
+    pcb_t* pcb = get_pcb_ptr(curr_pid);
+
+    if (*addr != val)
+        return -1;
+
+    pcb->futex_addr = (uint32_t)addr;
+    pcb->blocked = 1;
+    sched_block();
+    pcb->futex_addr = 0;
+
+    if (pcb->killed)
+        thread_exit();
+    return 0;
+}
+
+/*
+ * futex_wake
+ * DESCRIPTION: wake up threads of a process waiting on a user word, lowest pid first
+ * INPUT: mm_pid -- process the threads belong to
+ *        addr -- user word
+ *        n -- most threads to wake
+ * OUTPUT: none
+ * RETURN: number of threads woken
+ * SIDE AFFECTS: none
+ */
+static int32_t futex_wake(uint32_t mm_pid, uint32_t addr, uint32_t n)
+{
+    pcb_t* pcb;
+    uint32_t pid;
+    int32_t woken = 0;
+
+    for (pid = 0; pid < NUM_PROCESS && woken < n; pid++)
+    {
+        pcb = get_pcb_ptr(pid);
+        if (!pid_used(pid) || pcb->mm_pid != mm_pid || !pcb->blocked || pcb->exited || pcb->futex_addr != addr)
+            continue;
+        pcb->futex_addr = 0;
+        sched_wake(pid);
+        woken++;
+    }
+    return woken;
+}
+
+/*
+ * thread_exit
+ * DESCRIPTION: end the current thread. the exit word is cleared and woken while the
+ *              user stack is no longer used, the pid is freed by sched_finish_switch
+ *              once another context runs on this processor
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: never
+ * SIDE AFFECTS: the process' thread count dropped
+ */
+void thread_exit()
+{
+    pcb_t* pcb = get_pcb_ptr(curr_pid);
+    pcb_t* owner = get_pcb_ptr(pcb->mm_pid);
+
+    cli();
+    trace(TRACE_HALT, pcb->pid, 0);
+    fpu_drop(pcb->pid);
+    timer_proc_exit(pcb->pid);
+
+    if (pcb->exit_word != 0)
+    {
+        *(uint32_t*)pcb->exit_word = 0;
+        futex_wake(pcb->mm_pid, pcb->exit_word, NUM_PROCESS);
+    }
+
+    pcb->exited = 1;
+    pcb->blocked = 1;
+    owner->threads--;
+
+    while (1)
+    {
+        scheduler();
+        kernel_wait();
+    }
+}
+
+/*
+ * thread_kill_all
+ * DESCRIPTION: kill the other threads of a process and wait until they exited, called
+ *              by halt before the process' memory and fds go away
+ * INPUT: pcb -- process, the current one
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: IF MUST be 0
+ */
+void thread_kill_all(pcb_t* pcb)
+{
+    pcb_t* t;
+    uint32_t pid;
+
+    for (pid = 0; pid < NUM_PROCESS; pid++)
+    {
+        t = get_pcb_ptr(pid);
+        if (!pid_used(pid) || pid == pcb->pid || t->mm_pid != pcb->pid || t->exited)
+            continue;
+        t->killed = 1;
+        sched_wake(pid);
+    }
+
+    /* the process is queued while the threads get their turn */
+    while (pcb->threads > 0)
+    {
+        scheduler();
+        if (pcb->threads > 0)
+            kernel_wait();
+    }
+}
+
+/*
+ * thread_start
+ * DESCRIPTION: the first switch into a thread comes here on its empty kernel stack
+ *              instead of returning, go to user mode like execute does
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: never
+ * SIDE AFFECTS: kernel lock released
+ */
+void thread_start()
+{
+    pcb_t* pcb = get_pcb_ptr(curr_pid);
+    uint32_t eip = pcb->start_eip;
+    uint32_t esp = pcb->start_esp;
+
+    pcb->start_eip = 0;
+    pcb->start_esp = 0;
+
+    /* the thread starts in user mode, outside the kernel and any softirq */
+    this_cpu()->in_softirq = 0;
+    kernel_lock_drop();
+
+    asm volatile ("                                                \n\
+        movw    %%cx, %%ds                                         \n\
+        pushl   %%ecx                                              \n\
+        pushl   %%ebx                                              \n\
+        pushfl                                                     \n\
+        popl    %%ecx                                              \n\
+        orl     $0x0200, %%ecx                                     \n\
+        pushl   %%ecx                                              \n\
+        pushl   %%edx                                              \n\
+        pushl   %%eax                                              \n\
+        iret                                                       \n\
+        "
+        :
+        : "a"(eip), "b"(esp), "c"(USER_DS), "d"(USER_CS)
+        : "memory"
+    );
+}
+
+/*
+ * user_word_ok
+ * DESCRIPTION: check that a pointer is an aligned word in the user page
+ * INPUT: addr -- pointer from the user
+ * OUTPUT: none
+ * RETURN: 1 if usable, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+static uint32_t user_word_ok(uint32_t* addr)
+{
+    return (uint32_t)addr >= ADDR_128MB && (uint32_t)(addr + 1) <= ADDR_132MB && ((uint32_t)addr & (sizeof(uint32_t) - 1)) == 0;
+}
@@ -0,0 +1,45 @@
+#ifndef _THREAD_H
+#define _THREAD_H
+
+#include "types.h"
+#include "syscall.h"
+
+/*
+    threads, a pid and a PCB with its own kernel stack that shares the 4MB page, the fd
+    array and the shared memory of the process it was created in (its mm_pid). the user
+    passes its stack, see ece391_thread_create. futex_wait and futex_wake let user
+    mutexes and condition variables sleep in the kernel instead of spinning.
+
+    a thread is in one of these states
+        running or queued       blocked = 0
+        waiting                 blocked = 1, in no run queue, futex_addr set for a futex
+        exited                  blocked = exited = 1, its pid is freed by the next switch
+    the process (the first thread) halts only once every other thread has exited, they
+    are killed first. a killed thread exits when it leaves a futex wait or a sleep, or at the next
+    tick that finds it in user mode, one waiting elsewhere in the kernel (a terminal
+    read, an execute) holds up the halt until it gets back
+*/
+
+/* futex system call operations */
+#define FUTEX_WAIT          0       /* sleep while *addr == val                 */
+#define FUTEX_WAKE          1       /* wake up to val threads waiting on addr   */
+
+/* value of the exit word while the thread runs */
+#define THREAD_ALIVE        1
+
+/* create a thread of the current process starting at entry with stack */
+int32_t thread_create(uint32_t entry, uint32_t stack, uint32_t* exit_word);
+
+/* wait or wake on a user word */
+int32_t futex(uint32_t* addr, int32_t op, uint32_t val);
+
+/* end the current thread, never returns */
+extern void thread_exit();
+
+/* kill every other thread of a process and wait until they exited */
+extern void thread_kill_all(pcb_t* pcb);
+
+/* first switch into a thread, go to user mode, never returns */
+extern void thread_start();
+
+#endif /* _THREAD_H */
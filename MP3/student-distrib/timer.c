@@ -0,0 +1,500 @@
+#include "timer.h"
+#include "lib.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "syscall.h"
+#include "thread.h"
+#include "kheap.h"
+
+/* slots of every level, a NULL terminated list each */
+static ktimer_t* timer_wheel[TIMER_LEVELS][TIMER_SLOTS];
+/* next tick to expire, the wheel has handled every tick before it */
+static uint32_t timer_next;
+/* timers armed */
+static volatile uint32_t timer_count;
+static spinlock_t timer_lock;
+/* sleep and alarm timers of the processes and threads */
+static kmem_cache_t* ktimer_cache;
+
+static void timer_softirq();
+static void timer_run(uint32_t now);
+static uint32_t timer_cascade(uint32_t level);
+static void timer_place(ktimer_t* t);
+static void timer_unlink(ktimer_t* t);
+static void sleep_expire(uint32_t pid);
+static void alarm_expire(uint32_t pid);
+static uint32_t ms_to_ticks(uint32_t ms);
+
+/*
+ * timer_init
+ * DESCRIPTION: empty the wheel, register the expiry softirq and create the cache of
+ *              the process timers
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void timer_init()
+{
+    uint32_t level, slot;
+
+    spin_init(&timer_lock);
+    for (level = 0; level < TIMER_LEVELS; level++)
+        for (slot = 0; slot < TIMER_SLOTS; slot++)
+            timer_wheel[level][slot] = NULL;
+    timer_next = pit_ticks + 1;
+    timer_count = 0;
+    softirq_register(SOFTIRQ_TIMER, timer_softirq);
+    ktimer_cache = kmem_cache_create("ktimer", sizeof(ktimer_t), 0);
+}
+
+/*
+ * timer_setup
+ * DESCRIPTION: set the function called when a timer expires
+ * INPUT: t -- timer, MUST NOT be armed
+ *        func -- called with data at each expiry, in the timer softirq
+ *        data -- its argument
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void timer_setup(ktimer_t* t, void (*func)(uint32_t data), uint32_t data)
+{
+    t->next = NULL;
+    t->pprev = NULL;
+    t->period = 0;
+    t->func = func;
+    t->data = data;
+}
+
+/*
+ * timer_add
+ * DESCRIPTION: arm a timer, an armed one is moved to the new expiry
+ * INPUT: t -- timer set up by timer_setup
+ *        ticks -- scheduler ticks from now, at least 1, the current tick is partly over
+ *        period -- ticks between later expiries, 0 for a one-shot
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void timer_add(ktimer_t* t, uint32_t ticks, uint32_t period)
+{
+    uint32_t flags;
+
+    if (ticks == 0)
+        ticks = 1;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timer_pending(t))
+    {
+        timer_unlink(t);
+        timer_count--;
+    }
+    /* an empty wheel stops following the ticks, see timer_tick */
+    if (timer_count == 0)
+        timer_next = pit_ticks + 1;
+    t->expires = pit_ticks + ticks;
+    t->period = period;
+    timer_place(t);
+    timer_count++;
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * timer_cancel
+ * DESCRIPTION: disarm a timer, it may still be running if called from another processor
+ * INPUT: t -- timer set up by timer_setup
+ * OUTPUT: none
+ * RETURN: 1 if it was armed, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+int32_t timer_cancel(ktimer_t* t)
+{
+    uint32_t flags;
+    int32_t ret = 0;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    if (timer_pending(t))
+    {
+        timer_unlink(t);
+        timer_count--;
+        ret = 1;
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return ret;
+}
+
+/*
+ * timer_tick
+ * DESCRIPTION: called by the boot processor's scheduler tick after pit_ticks moved,
+ *              the expiry runs in the softirq, nothing is done while no timer is armed
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void timer_tick()
+{
+    if (timer_count > 0)
+        softirq_raise(SOFTIRQ_TIMER);
+}
+
+/*
+ * timer_softirq
+ * DESCRIPTION: the timer softirq, expire the timers up to the current tick and time it
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: timer_stats updated
+ */
+static void timer_softirq()
+{
+    uint32_t start = (uint32_t)rdtsc();
+    uint32_t cycles;
+
+    timer_run(pit_ticks);
+
+    cycles = (uint32_t)rdtsc() - start;
+    timer_stats.runs++;
+    timer_stats.cycles += cycles;
+    if (cycles > timer_stats.max_cycles)
+        timer_stats.max_cycles = cycles;
+}
+
+/*
+ * timer_run
+ * DESCRIPTION: handle every tick from timer_next to now. a tick wrapping level 0
+ *              cascades the next slot of level 1 down, and so on up while levels wrap,
+ *              then the timers of its level 0 slot expire. periodic ones are armed
+ *              again before their function runs, which may cancel them
+ * INPUT: now -- current tick
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: functions run without timer_lock
+ */
+static void timer_run(uint32_t now)
+{
+    ktimer_t* work;
+    ktimer_t* t;
+    uint32_t slot, level;
+    uint32_t flags;
+
+    spin_lock_irqsave(&timer_lock, flags);
+    while ((int32_t)(now - timer_next) >= 0)
+    {
+        slot = timer_next & TIMER_SLOT_MASK;
+        if (slot == 0)
+        {
+            for (level = 1; level < TIMER_LEVELS && timer_cascade(level) == 0; level++);
+        }
+
+        /* take the slot, a cancel from a function unlinks from the local list */
+        work = timer_wheel[0][slot];
+        timer_wheel[0][slot] = NULL;
+        if (work != NULL)
+            work->pprev = &work;
+        timer_next++;
+
+        while ((t = work) != NULL)
+        {
+            timer_unlink(t);
+            timer_count--;
+            if (t->period != 0)
+            {
+                t->expires += t->period;
+                timer_place(t);
+                timer_count++;
+            }
+            timer_stats.fired++;
+            spin_unlock_irqrestore(&timer_lock, flags);
+            t->func(t->data);
+            spin_lock_irqsave(&timer_lock, flags);
+        }
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * timer_cascade
+ * DESCRIPTION: move the timers of the current slot of a level to the levels below,
+ *              their distance now fits there
+ * INPUT: level -- 1 to TIMER_LEVELS - 1
+ * OUTPUT: none
+ * RETURN: index of the slot, 0 if the level wrapped too
+ * SIDE AFFECTS: timer_lock MUST be held
+ */
+static uint32_t timer_cascade(uint32_t level)
+{
+    uint32_t slot = (timer_next >> (TIMER_LEVEL_BITS * level)) & TIMER_SLOT_MASK;
+    ktimer_t* t = timer_wheel[level][slot];
+    ktimer_t* next;
+
+    timer_wheel[level][slot] = NULL;
+    while (t != NULL)
+    {
+        next = t->next;
+        timer_place(t);
+        t = next;
+    }
+    return slot;
+}
+
+/*
+ * timer_place
+ * DESCRIPTION: put a timer in the slot of the lowest level its distance fits. an
+ *              expiry already passed goes to the next tick, one too far is clamped
+ * INPUT: t -- timer not in any slot, expires set
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: timer_lock MUST be held
+ */
+static void timer_place(ktimer_t* t)
+{
+    uint32_t delta = t->expires - timer_next;
+    uint32_t level = 0;
+    ktimer_t** head;
+
+    if ((int32_t)delta < 0)
+    {
+        t->expires = timer_next;
+        delta = 0;
+    }
+    else if (delta > TIMER_MAX_TICKS)
+    {
+        t->expires = timer_next + TIMER_MAX_TICKS;
+        delta = TIMER_MAX_TICKS;
+    }
+    while (level < TIMER_LEVELS - 1 && delta >= (1 << (TIMER_LEVEL_BITS * (level + 1))))
+        level++;
+
+    head = &timer_wheel[level][(t->expires >> (TIMER_LEVEL_BITS * level)) & TIMER_SLOT_MASK];
+    t->next = *head;
+    if (*head != NULL)
+        (*head)->pprev = &t->next;
+    *head = t;
+    t->pprev = head;
+}
+
+/*
+ * timer_unlink
+ * DESCRIPTION: take a timer out of its list
+ * INPUT: t -- armed timer
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: timer_lock MUST be held
+ */
+static void timer_unlink(ktimer_t* t)
+{
+    *t->pprev = t->next;
+    if (t->next != NULL)
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/*
+ * timer_proc_init
+ * DESCRIPTION: allocate and set up the sleep and alarm timers of a new process or thread
+ * INPUT: pid -- its id
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 if the cache has no memory
+ * SIDE AFFECTS: none
+ */
+int32_t timer_proc_init(uint32_t pid)
+{
+    pcb_t* pcb = get_pcb_ptr(pid);
+
+    /* NULL until allocated, a failure leaves nothing for timer_proc_exit */
+    pcb->alarm_timer = NULL;
+    if (ktimer_cache == NULL || (pcb->sleep_timer = kmem_cache_alloc(ktimer_cache)) == NULL)
+    {
+        pcb->sleep_timer = NULL;
+        return -1;
+    }
+    if ((pcb->alarm_timer = kmem_cache_alloc(ktimer_cache)) == NULL)
+    {
+        kmem_cache_free(ktimer_cache, pcb->sleep_timer);
+        pcb->sleep_timer = NULL;
+        return -1;
+    }
+    timer_setup(pcb->sleep_timer, sleep_expire, pid);
+    timer_setup(pcb->alarm_timer, alarm_expire, pid);
+    pcb->timed_out = 0;
+    pcb->alarms = 0;
+    pcb->alarm_waiting = 0;
+    return 0;
+}
+
+/*
+ * timer_proc_exit
+ * DESCRIPTION: disarm the timers of an ending process or thread and free them
+ * INPUT: pid -- its id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void timer_proc_exit(uint32_t pid)
+{
+    pcb_t* pcb = get_pcb_ptr(pid);
+
+    if (pcb->sleep_timer != NULL)
+    {
+        timer_cancel(pcb->sleep_timer);
+        kmem_cache_free(ktimer_cache, pcb->sleep_timer);
+        pcb->sleep_timer = NULL;
+    }
+    if (pcb->alarm_timer != NULL)
+    {
+        timer_cancel(pcb->alarm_timer);
+        kmem_cache_free(ktimer_cache, pcb->alarm_timer);
+        pcb->alarm_timer = NULL;
+    }
+}
+
+/*
+ * timer_sleep
+ * DESCRIPTION: block the current process or thread for a number of ticks, the
+ *              processor runs others meanwhile
+ * INPUT: ticks -- ticks to sleep, the first one is partly over
+ * OUTPUT: none
+ * RETURN: 0
+ * SIDE AFFECTS: a killed thread exits instead of returning
+ */
+int32_t timer_sleep(uint32_t ticks)
+{
+    pcb_t* pcb = get_pcb_ptr(curr_pid);
+    uint32_t flags;
+
+    /* blocked before armed, the expiry may come from an interrupt on this processor */
+    cli_and_save(flags);
+    pcb->timed_out = 0;
+    pcb->blocked = 1;
+    timer_add(pcb->sleep_timer, ticks, 0);
+    restore_flags(flags);
+
+    sched_block();
+    timer_cancel(pcb->sleep_timer);
+
+    if (pcb->killed)
+        thread_exit();
+    return 0;
+}
+
+/*
+ * sleep
+ * DESCRIPTION: system call sleep, block for at least ms milliseconds
+ * INPUT: ms -- milliseconds, at most TIMER_MAX_MS
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 for fail
+ * SIDE AFFECTS: none
+ */
+int32_t sleep(uint32_t ms)
+{
+    if (ms > TIMER_MAX_MS)
+        return -1;
+    if (ms == 0)
+        return 0;
+    /* one tick more, the current one is partly over */
+    return timer_sleep(ms_to_ticks(ms) + 1);
+}
+
+/*
+ * alarm
+ * DESCRIPTION: system call alarm, a periodic timer of the current process or thread.
+ *              the expiries are counted, ALARM_WAIT blocks until there is one and
+ *              collects them, a late reader sees how many periods it missed
+ * INPUT: ms -- period in ms to start or restart the alarm, 0 to stop it, ALARM_WAIT
+ * OUTPUT: none
+ * RETURN: expiries since the last ALARM_WAIT for ALARM_WAIT, 0 otherwise,
+ *         -1 for fail or ALARM_WAIT with no alarm running
+ * SIDE AFFECTS: a killed thread exits instead of returning
+ */
+int32_t alarm(int32_t ms)
+{
+    pcb_t* pcb = get_pcb_ptr(curr_pid);
+    uint32_t period;
+    uint32_t flags;
+    int32_t n;
+
+    if (ms == ALARM_WAIT)
+    {
+        cli_and_save(flags);
+        if (pcb->alarms == 0)
+        {
+            if (!timer_pending(pcb->alarm_timer))
+            {
+                restore_flags(flags);
+                return -1;
+            }
+            pcb->alarm_waiting = 1;
+            pcb->blocked = 1;
+            restore_flags(flags);
+            sched_block();
+            if (pcb->killed)
+                thread_exit();
+            cli_and_save(flags);
+        }
+        n = pcb->alarms;
+        pcb->alarms = 0;
+        restore_flags(flags);
+        return n;
+    }
+
+    if (ms < 0 || ms > TIMER_MAX_MS)
+        return -1;
+    timer_cancel(pcb->alarm_timer);
+    pcb->alarms = 0;
+    if (ms > 0)
+    {
+        period = ms_to_ticks(ms);
+        timer_add(pcb->alarm_timer, period, period);
+    }
+    return 0;
+}
+
+/*
+ * sleep_expire
+ * DESCRIPTION: expiry of a sleep or poll timeout, poll checks timed_out itself
+ * INPUT: pid -- owner of the timer
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void sleep_expire(uint32_t pid)
+{
+    get_pcb_ptr(pid)->timed_out = 1;
+    sched_wake(pid);
+}
+
+/*
+ * alarm_expire
+ * DESCRIPTION: expiry of an alarm, count it and wake an ALARM_WAIT
+ * INPUT: pid -- owner of the timer
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void alarm_expire(uint32_t pid)
+{
+    pcb_t* pcb = get_pcb_ptr(pid);
+
+    pcb->alarms++;
+    if (pcb->alarm_waiting)
+    {
+        pcb->alarm_waiting = 0;
+        sched_wake(pid);
+    }
+}
+
+/*
+ * ms_to_ticks
+ * DESCRIPTION: convert milliseconds to scheduler ticks, rounded up
+ * INPUT: ms -- milliseconds, at most TIMER_MAX_MS
+ * OUTPUT: none
+ * RETURN: ticks
+ * SIDE AFFECTS: none
+ */
+static uint32_t ms_to_ticks(uint32_t ms)
+{
+    return (ms + TIMER_MS_PER_TICK - 1) / TIMER_MS_PER_TICK;
+}
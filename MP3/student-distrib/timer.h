@@ -0,0 +1,72 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "types.h"
+#include "schedule.h"
+
+/*
+    kernel timers on a hierarchical timer wheel counted in scheduler ticks (pit_ticks).
+    level 0 has a slot per tick for the next TIMER_SLOTS ticks, each level above a slot
+    per TIMER_SLOTS slots of the one below. a timer goes to the level its distance fits
+    and moves down a level each time the level below wraps, so adding and cancelling
+    are O(1) and a tick only looks at one level 0 slot. the boot processor's tick raises
+    SOFTIRQ_TIMER while timers are pending, expired timers run there with the kernel lock
+    held, they MUST NOT sleep
+*/
+
+#define TIMER_LEVELS        4
+#define TIMER_LEVEL_BITS    6
+#define TIMER_SLOTS         (1 << TIMER_LEVEL_BITS)
+#define TIMER_SLOT_MASK     (TIMER_SLOTS - 1)
+/* farthest expiry, about 46 hours at PIT_FREQ, later ones are clamped */
+#define TIMER_MAX_TICKS     ((1 << (TIMER_LEVEL_BITS * TIMER_LEVELS)) - 1)
+#define TIMER_MS_PER_TICK   (MS_PER_SECOND / PIT_FREQ)
+#define TIMER_MAX_MS        (TIMER_MAX_TICKS * TIMER_MS_PER_TICK)
+
+/* alarm(ALARM_WAIT) waits for the next expiry of the alarm */
+#define ALARM_WAIT          -1
+
+typedef struct ktimer_t {
+    struct ktimer_t* next;          /* next timer in the slot                       */
+    struct ktimer_t** pprev;        /* link pointing to this one, NULL if not armed */
+    uint32_t expires;               /* pit_ticks value it expires at                */
+    uint32_t period;                /* ticks between expiries, 0 for a one-shot     */
+    void (*func)(uint32_t data);    /* called at expiry                             */
+    uint32_t data;
+} ktimer_t;
+
+/* 1 while a timer is armed */
+#define timer_pending(t)    ((t)->pprev != NULL)
+
+/* wheel statistics, the cost of the expiry softirq */
+typedef struct timer_stats_t {
+    uint32_t runs;                  /* softirq runs                     */
+    uint32_t cycles;                /* their cycles ...                 */
+    uint32_t max_cycles;            /* ... and the longest              */
+    uint32_t fired;                 /* timers expired                   */
+} timer_stats_t;
+
+timer_stats_t timer_stats;
+
+/* empty the wheel and register the expiry softirq */
+extern void timer_init();
+/* set the function of a timer, it is not armed */
+extern void timer_setup(ktimer_t* t, void (*func)(uint32_t data), uint32_t data);
+/* arm a timer to expire in ticks, then every period ticks if not 0 */
+extern void timer_add(ktimer_t* t, uint32_t ticks, uint32_t period);
+/* disarm a timer, 1 if it was armed */
+extern int32_t timer_cancel(ktimer_t* t);
+/* called by the boot processor's scheduler tick */
+extern void timer_tick();
+/* allocate the sleep and alarm timers of a new process or thread, -1 if no memory */
+extern int32_t timer_proc_init(uint32_t pid);
+/* disarm and free them when it ends */
+extern void timer_proc_exit(uint32_t pid);
+/* block the current process or thread for ticks, 0 once they passed */
+extern int32_t timer_sleep(uint32_t ticks);
+
+/* system calls, sleep for ms and a periodic alarm */
+int32_t sleep(uint32_t ms);
+int32_t alarm(int32_t ms);
+
+#endif /* _TIMER_H */
@@ -0,0 +1,238 @@
+#include "trace.h"
+#include "lib.h"
+#include "syscall.h"
+#include "smp.h"
+#include "kheap.h"
+#include "klog.h"
+
+/* ring of each processor */
+static trace_ring_t trace_rings[MAX_CPUS];
+
+static uint32_t trace_count(uint32_t cpu);
+
+/*
+ * trace_init
+ * DESCRIPTION: take the rings of the online processors from the kernel heap and start
+ *              recording, a processor without a ring records nothing
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: trace_on set
+ */
+void trace_init()
+{
+    uint32_t i;
+
+    for (i = 0; i < ncpus_online; i++)
+    {
+        trace_rings[i].head = 0;
+        trace_rings[i].buf = (trace_event_t*)kmalloc(TRACE_SIZE * sizeof(trace_event_t));
+        if (trace_rings[i].buf == NULL)
+            klog(KLOG_WARN, "trace: no memory for cpu %u", i);
+    }
+    trace_on = 1;
+}
+
+/*
+ * trace
+ * DESCRIPTION: record an event in this processor's ring, overwriting the oldest. the
+ *              slot is taken by one xadd, which an interrupt on this processor cannot
+ *              split, other processors never write this ring
+ * INPUT: type -- TRACE_SWITCH to TRACE_HALT
+ *        pid -- process the event is about
+ *        arg -- depends on the type, see trace.h
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void trace(uint32_t type, uint32_t pid, uint32_t arg)
+{
+    uint32_t id = cpu_id();
+    trace_ring_t* ring = &trace_rings[id];
+    trace_event_t* e;
+    uint32_t slot = 1;
+
+    if (!trace_on || ring->buf == NULL)
+        return;
+
+    asm volatile ("xaddl %0, %1" : "+r"(slot), "+m"(ring->head));
+    e = &ring->buf[slot & TRACE_MASK];
+    e->tsc = rdtsc();
+    e->type = type;
+    e->cpu = id;
+    e->pid = (int16_t)pid;
+    e->arg = arg;
+}
+
+/*
+ * trace_syscall_enter
+ * DESCRIPTION: record a system call entry. an unlocked call may be preempted here, the
+ *              event is written with IF = 0 so it stays on this processor's ring
+ * INPUT: nr -- system call number
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void trace_syscall_enter(uint32_t nr)
+{
+    uint32_t flags;
+
+    cli_and_save(flags);
+    trace(TRACE_SYSCALL_ENTER, curr_pid, nr);
+    restore_flags(flags);
+}
+
+/*
+ * trace_syscall_exit
+ * DESCRIPTION: record a system call return, execute returns once the child halts
+ * INPUT: ret -- return value
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+void trace_syscall_exit(int32_t ret)
+{
+    uint32_t flags;
+
+    cli_and_save(flags);
+    trace(TRACE_SYSCALL_EXIT, curr_pid, ret);
+    restore_flags(flags);
+}
+
+/*
+ * trace_open
+ * DESCRIPTION: open the trace device, reading starts from the oldest event kept
+ * INPUT: filename -- not used
+ * OUTPUT: none
+ * RETURN: 0
+ * SIDE AFFECTS: none
+ */
+int32_t trace_open(const char* filename)
+{
+    return 0;
+}
+
+/*
+ * trace_close
+ * DESCRIPTION: close the trace device
+ * INPUT: fd -- not used
+ * OUTPUT: none
+ * RETURN: 0
+ * SIDE AFFECTS: none
+ */
+int32_t trace_close(int32_t fd)
+{
+    return 0;
+}
+
+/*
+ * trace_read
+ * DESCRIPTION: read whole events, the kept events of processor 0 oldest first, then
+ *              processor 1... the file offset counts the events read. turn recording off
+ *              first, events recorded meanwhile may be overwritten while read
+ * INPUT: fd -- file descriptor
+ *        buf -- buffer for trace_event_t records
+ *        nbytes -- size of the buffer
+ * OUTPUT: none
+ * RETURN: number of bytes read, 0 once every event is read, -1 for fail
+ * SIDE AFFECTS: file offset advanced
+ */
+int32_t trace_read(int32_t fd, void* buf, int32_t nbytes)
+{
+    trace_event_t* dst = (trace_event_t*)buf;
+    uint32_t pos = cur_fd_array[fd].file_offset;
+    uint32_t want, idx, cpu, cnt, first;
+    int32_t ret = 0;
+
+    if (buf == NULL || nbytes < (int32_t)sizeof(trace_event_t))
+        return -1;
+    want = nbytes / sizeof(trace_event_t);
+
+    /* skip the processors whose events were read */
+    idx = pos;
+    for (cpu = 0; cpu < MAX_CPUS && idx >= trace_count(cpu); cpu++)
+        idx -= trace_count(cpu);
+
+    for (; cpu < MAX_CPUS && want > 0; cpu++, idx = 0)
+    {
+        cnt = trace_count(cpu);
+        first = trace_rings[cpu].head - cnt;
+        for (; idx < cnt && want > 0; idx++, want--, pos++)
+        {
+            *dst++ = trace_rings[cpu].buf[(first + idx) & TRACE_MASK];
+            ret += sizeof(trace_event_t);
+        }
+    }
+
+    cur_fd_array[fd].file_offset = pos;
+    return ret;
+}
+
+/*
+ * trace_write
+ * DESCRIPTION: turn recording on or off, or clear every ring
+ * INPUT: fd -- not used
+ *        buf -- an int32, TRACE_OFF, TRACE_ON or TRACE_CLEAR
+ *        nbytes -- 4
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 for fail
+ * SIDE AFFECTS: trace_on changed, or the events dropped
+ */
+int32_t trace_write(int32_t fd, void* buf, int32_t nbytes)
+{
+    uint32_t flags;
+    uint32_t i;
+
+    if (buf == NULL || nbytes != 4)
+        return -1;
+    switch (*(int32_t*)buf)
+    {
+        case TRACE_OFF:
+            trace_on = 0;
+            return 0;
+        case TRACE_ON:
+            trace_on = 1;
+            return 0;
+        case TRACE_CLEAR:
+            cli_and_save(flags);
+            for (i = 0; i < MAX_CPUS; i++)
+                trace_rings[i].head = 0;
+            restore_flags(flags);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/*
+ * trace_poll
+ * DESCRIPTION: check whether there are events not read yet
+ * INPUT: fd -- file descriptor
+ *        stamp -- not filled in
+ * OUTPUT: none
+ * RETURN: 1 if ready, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+int32_t trace_poll(int32_t fd, uint32_t* stamp)
+{
+    uint32_t i, total = 0;
+
+    for (i = 0; i < MAX_CPUS; i++)
+        total += trace_count(i);
+    return total != cur_fd_array[fd].file_offset;
+}
+
+/*
+ * trace_count
+ * DESCRIPTION: number of events kept in a processor's ring
+ * INPUT: cpu -- index of the processor
+ * OUTPUT: none
+ * RETURN: events kept
+ * SIDE AFFECTS: none
+ */
+static uint32_t trace_count(uint32_t cpu)
+{
+    if (trace_rings[cpu].buf == NULL)
+        return 0;
+    return (trace_rings[cpu].head < TRACE_SIZE) ? trace_rings[cpu].head : TRACE_SIZE;
+}
@@ -0,0 +1,74 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "types.h"
+
+/*
+    event trace, a ring per processor of TSC stamped scheduler switches, system calls,
+    interrupts and execute/halt. recording is a slot reservation that interrupts on the
+    same processor cannot split and six stores (two for the TSC), cheap enough to stay
+    on. the "trace" device returns the events, trace2json.py in this directory
+    converts them for chrome://tracing or Perfetto
+*/
+
+#define TRACE_DEV_NAME      "trace"
+#define TRACE_SIZE          4096        /* events per processor, power of 2 */
+#define TRACE_MASK          (TRACE_SIZE - 1)
+
+/* event types */
+#define TRACE_SWITCH        1           /* pid switched out, arg TRACE_SWITCH_ARG       */
+#define TRACE_SYSCALL_ENTER 2           /* arg system call number                       */
+#define TRACE_SYSCALL_EXIT  3           /* arg return value                             */
+#define TRACE_IRQ_ENTER     4           /* arg IRQ line, LINKAGE_IRQ_LAPIC_TIMER        */
+#define TRACE_IRQ_EXIT      5
+#define TRACE_EXECUTE       6           /* pid the new process, arg its parent          */
+#define TRACE_HALT          7           /* pid the halting process, arg its status      */
+
+/* switch reasons */
+#define TRACE_SW_TICK       0           /* preempted by the scheduler tick  */
+#define TRACE_SW_EXECUTE    1           /* a new program starts             */
+#define TRACE_SW_HALT       2           /* back to the parent               */
+
+/* arg of TRACE_SWITCH, next pid, its terminal and the reason a byte each */
+#define TRACE_SWITCH_ARG(pid, term, reason) \
+    (((pid) & 0xFF) | (((term) & 0xFF) << 8) | (((reason) & 0xFF) << 16))
+
+/* values written to the device */
+#define TRACE_OFF           0
+#define TRACE_ON            1
+#define TRACE_CLEAR         2           /* forget every event, on/off unchanged */
+
+/* one event, as read from the device */
+typedef struct trace_event_t {
+    uint64_t tsc;
+    uint8_t type;
+    uint8_t cpu;
+    int16_t pid;            /* running process when recorded, -1 for the idle loop */
+    uint32_t arg;
+} trace_event_t;
+
+/* ring of one processor */
+typedef struct trace_ring_t {
+    trace_event_t* buf;     /* from the kernel heap, NULL before trace_init     */
+    uint32_t head;          /* events recorded, the next goes to head & MASK    */
+} trace_ring_t;
+
+/* 1 while events are recorded */
+volatile uint32_t trace_on;
+
+/* allocate the rings of the online processors and start recording */
+extern void trace_init();
+/* record an event on this processor */
+extern void trace(uint32_t type, uint32_t pid, uint32_t arg);
+/* called by the system call linkage */
+extern void trace_syscall_enter(uint32_t nr);
+extern void trace_syscall_exit(int32_t ret);
+
+/* trace device */
+extern int32_t trace_open(const char* filename);
+extern int32_t trace_close(int32_t fd);
+extern int32_t trace_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t trace_write(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t trace_poll(int32_t fd, uint32_t* stamp);
+
+#endif /* _TRACE_H */
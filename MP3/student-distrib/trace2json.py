@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Chrome trace (chrome://tracing, Perfetto) from the events dumped by "trace".
+
+usage: trace2json.py LOG [-o trace.json]
+
+LOG is a capture of the serial line (or of the screen) holding the
+"trace khz <khz>" line and the "T <cpu> <type> <pid> <arg> <tsc hi> <tsc lo>"
+lines printed by the "trace" user program. each processor gets a row of the
+processes it ran and the interrupts it took, each process a row of its system
+calls, execute and halt.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+KHZ_RE = re.compile(r"^trace khz (\d+)\s*$")
+EVENT_RE = re.compile(r"^T (\d+) (\d+) (-?\d+) ([0-9A-Fa-f]+) ([0-9A-Fa-f]+) ([0-9A-Fa-f]+)\s*$")
+
+# event types, as in trace.h
+SWITCH, SYSCALL_ENTER, SYSCALL_EXIT, IRQ_ENTER, IRQ_EXIT, EXECUTE, HALT = range(1, 8)
+SW_REASONS = ["tick", "execute", "halt"]
+
+SYSCALLS = ["", "halt", "execute", "read", "write", "open", "close", "getargs",
+            "vidmap", "set_handler", "sigreturn", "shmget", "shmat", "shmdt",
+            "poll", "fcntl", "gettime", "nanosleep", "profctl", "thread_create", "futex",
+            "sleep", "alarm", "vidmap_ex", "present", "sbrk"]
+IRQS = {0: "pit", 1: "keyboard", 4: "serial", 8: "rtc", 16: "lapic timer"}
+
+CPU_PID = 0             # chrome "process" holding a row per processor
+PROC_PID = 1            # chrome "process" holding a row per ece391 process
+
+
+def load(path):
+    khz, events = 0, []
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.strip("\r\n")
+            m = KHZ_RE.match(line)
+            if m:
+                khz = int(m.group(1))
+                continue
+            m = EVENT_RE.match(line)
+            if m:
+                tsc = (int(m.group(5), 16) << 32) | int(m.group(6), 16)
+                events.append((tsc, int(m.group(1)), int(m.group(2)),
+                               int(m.group(3)), int(m.group(4), 16)))
+    events.sort(key=lambda e: e[0])
+    return khz, events
+
+
+def convert(khz, events):
+    tsc0 = events[0][0]
+    out = []
+    running = {}        # cpu -> (pid, start us) of the slice being run
+    open_calls = {}     # pid -> names of the system calls not returned yet
+
+    def us(tsc):
+        return (tsc - tsc0) * 1000.0 / khz
+
+    def name_pid(pid):
+        return "idle" if pid < 0 else "pid %d" % pid
+
+    for tsc, cpu, typ, pid, arg in events:
+        t = us(tsc)
+        if typ == SWITCH:
+            nxt, term, reason = arg & 0xFF, (arg >> 8) & 0xFF, (arg >> 16) & 0xFF
+            if nxt == 0xFF:
+                nxt = -1
+            prev = running.get(cpu)
+            if prev is not None:
+                out.append({"name": name_pid(prev[0]), "ph": "X", "pid": CPU_PID, "tid": cpu,
+                            "ts": prev[1], "dur": t - prev[1]})
+            running[cpu] = (nxt, t)
+            out.append({"name": "switch", "ph": "i", "s": "t", "pid": CPU_PID, "tid": cpu, "ts": t,
+                        "args": {"from": pid, "to": nxt, "terminal": term,
+                                 "reason": SW_REASONS[reason] if reason < len(SW_REASONS) else reason}})
+        elif typ == SYSCALL_ENTER:
+            name = SYSCALLS[arg] if 0 < arg < len(SYSCALLS) else "syscall %d" % arg
+            open_calls.setdefault(pid, []).append(name)
+            out.append({"name": name, "ph": "B", "pid": PROC_PID, "tid": pid, "ts": t,
+                        "args": {"cpu": cpu}})
+        elif typ == SYSCALL_EXIT:
+            if open_calls.get(pid):
+                open_calls[pid].pop()
+                ret = arg - (1 << 32) if arg & 0x80000000 else arg
+                out.append({"name": "", "ph": "E", "pid": PROC_PID, "tid": pid, "ts": t,
+                            "args": {"ret": ret}})
+        elif typ in (IRQ_ENTER, IRQ_EXIT):
+            out.append({"name": "irq " + IRQS.get(arg, str(arg)),
+                        "ph": "B" if typ == IRQ_ENTER else "E",
+                        "pid": CPU_PID, "tid": cpu, "ts": t})
+        elif typ == EXECUTE:
+            out.append({"name": "execute", "ph": "i", "s": "t", "pid": PROC_PID, "tid": pid,
+                        "ts": t, "args": {"parent": arg - (1 << 32) if arg & 0x80000000 else arg}})
+        elif typ == HALT:
+            # halt never returns, close whatever the process had open
+            for _ in open_calls.pop(pid, []):
+                out.append({"name": "", "ph": "E", "pid": PROC_PID, "tid": pid, "ts": t})
+            out.append({"name": "halt", "ph": "i", "s": "t", "pid": PROC_PID, "tid": pid,
+                        "ts": t, "args": {"status": arg}})
+
+    # slices still running when the dump started
+    end = us(events[-1][0])
+    for cpu, (pid, start) in running.items():
+        out.append({"name": name_pid(pid), "ph": "X", "pid": CPU_PID, "tid": cpu,
+                    "ts": start, "dur": end - start})
+
+    # row names
+    out.append({"name": "process_name", "ph": "M", "pid": CPU_PID, "args": {"name": "cpus"}})
+    out.append({"name": "process_name", "ph": "M", "pid": PROC_PID, "args": {"name": "processes"}})
+    for cpu in sorted({e[1] for e in events}):
+        out.append({"name": "thread_name", "ph": "M", "pid": CPU_PID, "tid": cpu,
+                    "args": {"name": "cpu %d" % cpu}})
+    for pid in sorted({e[3] for e in events if e[3] >= 0}):
+        out.append({"name": "thread_name", "ph": "M", "pid": PROC_PID, "tid": pid,
+                    "args": {"name": "pid %d" % pid}})
+    return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log")
+    ap.add_argument("-o", "--output", help="output file, default stdout")
+    args = ap.parse_args()
+
+    khz, events = load(args.log)
+    if not events:
+        sys.exit("no events in %s" % args.log)
+    if khz == 0:
+        sys.exit("no TSC frequency in %s, the kernel clock has no TSC" % args.log)
+
+    trace = {"traceEvents": convert(khz, events), "displayTimeUnit": "ns"}
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
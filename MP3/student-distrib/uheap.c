@@ -0,0 +1,143 @@
+/*
+    user heap
+    each process' heap is the 4MB at UHEAP_VIRTUAL_ADDR, mapped with 4kB pages onto
+    its own 4MB of physical memory, sbrk makes the pages up to the break present
+*/
+
+#include "uheap.h"
+#include "lib.h"
+#include "klog.h"
+#include "smp.h"
+
+/* heap page table of each process, the entries point at its physical 4MB */
+static page_table_entry_t uheap_page_table[NUM_PROCESS][NUM_PT_ENTRY] __attribute__((aligned(PAGE_4KB_SIZE)));
+/* break of each process, bytes from UHEAP_VIRTUAL_ADDR */
+static uint32_t uheap_brk[NUM_PROCESS];
+/* set if the physical memory of the heaps exists */
+static uint32_t uheap_ok;
+
+/* pages needed to hold size bytes */
+#define UHEAP_PAGES(size)   (((size) + PAGE_4KB_SIZE - 1) / PAGE_4KB_SIZE)
+
+/*
+ * uheap_init
+ * DESCRIPTION: prepare the heap page table of every process, no page present, if the
+ *              memory above the back buffer holds all the heaps
+ * INPUT: mem_end -- end of physical memory, 0 if the boot loader did not tell
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: sbrk fails for good if there is not enough memory
+ */
+void uheap_init(uint32_t mem_end)
+{
+    int pid, i;     /* loop indices */
+
+    uheap_ok = 0;
+    if (mem_end < UHEAP_PHYS_ADDR + NUM_PROCESS * UHEAP_MAX_SIZE)
+    {
+        klog(KLOG_WARN, "uheap: %u kB of memory, no user heap", mem_end >> 10);
+        return;
+    }
+
+    for (pid = 0; pid < NUM_PROCESS; pid++)
+    {
+        uheap_brk[pid] = 0;
+        for (i = 0; i < NUM_PT_ENTRY; i++)
+        {
+            uheap_page_table[pid][i].p = 0;     // not present until sbrk reaches it
+            uheap_page_table[pid][i].r_w = 1;   // enable r/w
+            uheap_page_table[pid][i].u_s = 1;   // user mode
+            uheap_page_table[pid][i].base_addr = (UHEAP_PHYS_ADDR + pid * UHEAP_MAX_SIZE + i * PAGE_4KB_SIZE) >> MEM_OFFSET_BITS;
+        }
+    }
+    uheap_ok = 1;
+}
+
+/*
+ * sbrk
+ * DESCRIPTION: system call sbrk, move the break of the current process by increment
+ *              bytes, pages that become used are mapped and zeroed, pages that become
+ *              unused are unmapped. the threads of a process share its heap, those
+ *              on other processors flush TLB by the remap IPI when it shrinks
+ * INPUT: increment -- bytes to grow the heap by, negative to shrink it, 0 to ask
+ * OUTPUT: none
+ * RETURN: the old break for success, -1 for fail
+ * SIDE AFFECTS: TLB flushed if pages are mapped or unmapped
+ */
+int32_t sbrk(int32_t increment)
+{
+    uint32_t pid, old, brk, old_pages, new_pages, i;
+
+    /* sanity check, the break stays in the region */
+    if (!uheap_ok || increment > UHEAP_MAX_SIZE || increment < -UHEAP_MAX_SIZE)
+        return -1;
+    pid = curr_mm_pid;
+    old = uheap_brk[pid];
+    if (increment > (int32_t)(UHEAP_MAX_SIZE - old) || increment < -(int32_t)old)
+        return -1;
+
+    brk = old + increment;
+    old_pages = UHEAP_PAGES(old);
+    new_pages = UHEAP_PAGES(brk);
+    uheap_brk[pid] = brk;
+
+    if (new_pages > old_pages)
+    {
+        for (i = old_pages; i < new_pages; i++)
+            uheap_page_table[pid][i].p = 1;
+        flush_TLB();
+        /* the pages held another process' heap */
+        memset((void*)(UHEAP_VIRTUAL_ADDR + old_pages * PAGE_4KB_SIZE), 0, (new_pages - old_pages) * PAGE_4KB_SIZE);
+    }
+    else if (new_pages < old_pages)
+    {
+        for (i = new_pages; i < old_pages; i++)
+            uheap_page_table[pid][i].p = 0;
+        flush_TLB();
+        /* the page table is the process', other processors running its threads only
+           flush. the frames stay the process', so they are not waited for */
+        smp_remap_others(pid, 0);
+    }
+
+    return UHEAP_VIRTUAL_ADDR + old;
+}
+
+/*
+ * uheap_release
+ * DESCRIPTION: empty the heap of a process, used by halt after its threads are gone,
+ *              the caller is in charge of flushing TLB
+ * INPUT: pid -- process id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: heap page table changed
+ */
+void uheap_release(uint32_t pid)
+{
+    uint32_t i;     /* loop index */
+
+    if (!uheap_ok)
+        return;
+    for (i = 0; i < UHEAP_PAGES(uheap_brk[pid]); i++)
+        uheap_page_table[pid][i].p = 0;
+    uheap_brk[pid] = 0;
+}
+
+/*
+ * uheap_remap
+ * DESCRIPTION: point the heap entry of the page directory at the page table of a
+ *              process, the caller is in charge of flushing TLB
+ * INPUT: pid -- process id
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: page directory changed
+ */
+void uheap_remap(uint32_t pid)
+{
+    if (!uheap_ok)
+        return;
+    page_directory[UHEAP_OFFSET].p           = 1;    // present
+    page_directory[UHEAP_OFFSET].r_w         = 1;    // enable r/w, each page table entry decides
+    page_directory[UHEAP_OFFSET].u_s         = 1;    // user mode
+    page_directory[UHEAP_OFFSET].ps          = 0;    // 4kB pages
+    page_directory[UHEAP_OFFSET].base_addr   = (unsigned int)uheap_page_table[pid] >> MEM_OFFSET_BITS;
+}
@@ -0,0 +1,31 @@
+#ifndef _UHEAP_H
+#define _UHEAP_H
+
+#include "types.h"
+#include "paging.h"
+#include "syscall.h"
+#include "vbe.h"
+
+/*
+    user heap, a region of each process above its program page grown and shrunk by
+    sbrk in 4kB pages. every process has a page table for the region, backed by its
+    own 4MB of physical memory above the back buffer, pages up to the break are
+    present. the heap exists if there is memory for all processes, it is emptied
+    when a process halts and fresh pages are zeroed
+*/
+
+#define UHEAP_PHYS_ADDR     (VBE_BACK_PHYS + PAGE_4MB_SIZE)         /* heap of process 0, 36MB  */
+#define UHEAP_VIRTUAL_ADDR  (VBE_BACK_VIRTUAL + PAGE_4MB_SIZE)      /* 152MB                    */
+#define UHEAP_MAX_SIZE      PAGE_4MB_SIZE
+#define UHEAP_OFFSET        (UHEAP_VIRTUAL_ADDR / PAGE_4MB_SIZE)    /* page directory index     */
+
+/* prepare the heap page tables if there is memory for them */
+extern void uheap_init(uint32_t mem_end);
+/* system call sbrk, move the break of the current process */
+extern int32_t sbrk(int32_t increment);
+/* empty the heap of a process, used by halt */
+extern void uheap_release(uint32_t pid);
+/* point the page directory at the heap page table of a process */
+extern void uheap_remap(uint32_t pid);
+
+#endif /* _UHEAP_H */
@@ -0,0 +1,449 @@
+#include "vbe.h"
+#include "lib.h"
+#include "klog.h"
+#include "smp.h"
+
+/* the display, owner is the process (mm pid) in graphics mode, VBE_NO_OWNER in text */
+static struct {
+    uint32_t found;
+    uint32_t lfb;                   /* 4MB page holding the framebuffer     */
+    uint32_t lfb_offset;            /* framebuffer BAR in that page         */
+    uint32_t back;                  /* 1 if the back buffer exists          */
+    int32_t owner;
+    uint32_t mapped;                /* bit VIDMAP_FB/VIDMAP_BACK if mapped  */
+    fbinfo_t mode;
+    uint32_t fb_offset;             /* start of the screen in the lfb page  */
+} vbe;
+
+/* VGA registers the dispi mode change overwrites, saved while a process owns the display */
+#define VGA_SEQ_PORT        0x03C4
+#define VGA_GFX_PORT        0x03CE
+#define VGA_CRTC_PORT       0x03D4
+#define VGA_CRTC_VSYNC_END  0x11        /* bit 7 write protects CRTC 0-7   */
+#define VGA_CRTC_PROTECT    0x80
+#define VGA_SAVED_REGS      12
+
+static const struct {
+    uint16_t port;
+    uint8_t index;
+} vga_regs[VGA_SAVED_REGS] = {
+    {VGA_SEQ_PORT, 0x01}, {VGA_SEQ_PORT, 0x02}, {VGA_SEQ_PORT, 0x04},
+    {VGA_GFX_PORT, 0x05}, {VGA_GFX_PORT, 0x06},
+    {VGA_CRTC_PORT, 0x01}, {VGA_CRTC_PORT, 0x07}, {VGA_CRTC_PORT, 0x09}, {VGA_CRTC_PORT, 0x12},
+    {VGA_CRTC_PORT, 0x13}, {VGA_CRTC_PORT, 0x17}, {VGA_CRTC_PORT, 0x18},
+};
+static uint8_t vga_saved[VGA_SAVED_REGS];
+static uint8_t vga_saved_vsync_end;
+
+static uint16_t dispi_read(uint16_t index);
+static void dispi_write(uint16_t index, uint16_t val);
+static uint32_t pci_find_lfb();
+static int32_t vbe_set_mode(uint32_t width, uint32_t height);
+static void vbe_text_mode();
+static void vga_wait_retrace();
+static uint32_t user_range_ok(const void* p, uint32_t size);
+
+/*
+ * vbe_init
+ * DESCRIPTION: look for the Bochs VBE display and map its framebuffer and the back
+ *              buffer for the kernel, the display stays in text mode
+ * INPUT: mem_end -- end of physical memory, 0 if the boot loader did not tell
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: kernel page directory entries added
+ */
+void vbe_init(uint32_t mem_end)
+{
+    uint16_t id = dispi_read(VBE_DISPI_INDEX_ID);
+
+    vbe.found = 0;
+    vbe.back = 0;
+    vbe.owner = VBE_NO_OWNER;
+    vbe.mapped = 0;
+
+    if (id < VBE_DISPI_ID2 || id > VBE_DISPI_ID_MAX)
+    {
+        klog(KLOG_INFO, "vbe: no Bochs VBE display");
+        return;
+    }
+
+    /* the BAR need not be 4MB aligned, map the page holding it and keep the offset */
+    vbe.lfb = pci_find_lfb();
+    vbe.lfb_offset = vbe.lfb & (PAGE_4MB_SIZE - 1);
+    vbe.lfb -= vbe.lfb_offset;
+    if (map_phys_4mb(vbe.lfb, 1) < 0)
+    {
+        klog(KLOG_WARN, "vbe: cannot map framebuffer %#x", vbe.lfb);
+        return;
+    }
+    vbe.found = 1;
+
+    if (mem_end >= VBE_BACK_PHYS + PAGE_4MB_SIZE && map_phys_4mb(VBE_BACK_PHYS, 0) >= 0)
+        vbe.back = 1;
+
+    klog(KLOG_INFO, "vbe: id %#x, framebuffer %#x, back buffer %s", id, vbe.lfb + vbe.lfb_offset, vbe.back ? "yes" : "no");
+}
+
+/*
+ * vbe_remap
+ * DESCRIPTION: set the framebuffer and back buffer pages present for the process
+ *              owning the display, not present for the others, the caller is in
+ *              charge of flushing TLB
+ * INPUT: pid -- process id, its mm pid
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: page directory changed
+ */
+void vbe_remap(uint32_t pid)
+{
+    uint32_t own = (vbe.owner == (int32_t)pid);
+    page_dir_entry_t* fb = &page_directory[VBE_FB_VIRTUAL / PAGE_4MB_SIZE];
+    page_dir_entry_t* back = &page_directory[VBE_BACK_VIRTUAL / PAGE_4MB_SIZE];
+
+    fb->p = 0;
+    back->p = 0;
+    if (own && (vbe.mapped & (1 << VIDMAP_FB)))
+    {
+        fb->r_w         = 1;
+        fb->u_s         = 1;    // user mode
+        fb->pwt         = 1;    // device memory, not cached
+        fb->pcd         = 1;
+        fb->ps          = 1;    // 4mB page
+        fb->base_addr   = vbe.lfb >> MEM_OFFSET_BITS;
+        fb->p           = 1;
+    }
+    if (own && (vbe.mapped & (1 << VIDMAP_BACK)))
+    {
+        back->r_w       = 1;
+        back->u_s       = 1;    // user mode
+        back->pwt       = 0;
+        back->pcd       = 0;
+        back->ps        = 1;    // 4mB page
+        back->base_addr = VBE_BACK_PHYS >> MEM_OFFSET_BITS;
+        back->p         = 1;
+    }
+}
+
+/*
+ * vbe_release
+ * DESCRIPTION: if a process owns the display, go back to text mode and unmap the buffers
+ * INPUT: pid -- process id, its mm pid
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: display mode changed, TLB flushed
+ */
+void vbe_release(uint32_t pid)
+{
+    if (!vbe.found || vbe.owner != (int32_t)pid)
+        return;
+
+    vbe_text_mode();
+    vbe.owner = VBE_NO_OWNER;
+    vbe.mapped = 0;
+    vbe_remap(pid);
+    flush_TLB();
+    smp_remap_others(pid, 0);
+}
+
+/*
+ * vidmap_ex
+ * DESCRIPTION: system call vidmap_ex, VIDMAP_TEXT is vidmap and gives the display
+ *              back to text mode if the process had it. VIDMAP_FB and VIDMAP_BACK set
+ *              the graphics mode if the display is free and map the framebuffer or
+ *              the back buffer, the mode is asked in info (0 for the default) when
+ *              the process takes the display
+ * INPUT: which -- VIDMAP_TEXT, VIDMAP_FB or VIDMAP_BACK
+ *        screen_start -- where to output the user address of the first pixel
+ *        info -- mode asked and returned, may be NULL for the default
+ * OUTPUT: *screen_start, *info
+ * RETURN: 0 for success, -1 for fail
+ * SIDE AFFECTS: display mode may change
+ */
+int32_t vidmap_ex(int32_t which, uint8_t** screen_start, fbinfo_t* info)
+{
+    uint32_t pid;
+    uint32_t width = 0, height = 0;
+
+    /* sanity check */
+    if (which != VIDMAP_TEXT && which != VIDMAP_FB && which != VIDMAP_BACK)
+        return -1;
+    if (!user_range_ok(screen_start, sizeof(uint8_t*)))
+        return -1;
+    if (info != NULL && !user_range_ok(info, sizeof(fbinfo_t)))
+        return -1;
+
+    pid = curr_mm_pid;
+    if (which == VIDMAP_TEXT)
+    {
+        vbe_release(pid);
+        return vidmap(screen_start);
+    }
+    if (!vbe.found || (which == VIDMAP_BACK && !vbe.back))
+        return -1;
+
+    if (info != NULL)
+    {
+        width = info->width;
+        height = info->height;
+    }
+
+    if (vbe.owner == VBE_NO_OWNER)
+    {
+        if (vbe_set_mode(width ? width : VBE_DEF_WIDTH, height ? height : VBE_DEF_HEIGHT) == -1)
+            return -1;
+        vbe.owner = pid;
+    }
+    else if (vbe.owner != (int32_t)pid)
+        return -1;
+    else if ((width && width != vbe.mode.width) || (height && height != vbe.mode.height))
+        return -1;
+
+    vbe.mapped |= 1 << which;
+    vbe_remap(pid);
+    flush_TLB();
+    /* and for the threads of the process on other processors */
+    smp_remap_others(pid, 0);
+
+    *screen_start = (uint8_t*)((which == VIDMAP_FB) ? VBE_FB_VIRTUAL + vbe.fb_offset : VBE_BACK_VIRTUAL);
+    if (info != NULL)
+        *info = vbe.mode;
+    return 0;
+}
+
+/*
+ * present
+ * DESCRIPTION: system call present, copy rectangles of the back buffer to the screen.
+ *              the copy runs without the kernel lock, only the caller's process uses
+ *              the buffers
+ * INPUT: rects -- dirty rectangles, clipped to the screen
+ *        n -- number of rectangles, 0 for the whole screen
+ *        flags -- PRESENT_VSYNC to start at the next vertical retrace
+ * OUTPUT: none
+ * RETURN: number of pixels copied for success, -1 for fail
+ * SIDE AFFECTS: none
+ */
+int32_t present(const fbrect_t* rects, int32_t n, int32_t flags)
+{
+    fbrect_t r[VBE_MAX_RECTS];
+    uint8_t *fb, *back;
+    uint32_t i, y, w, h, pitch, depth;
+    int32_t pixels = 0;
+
+    /* sanity check, the caller owns the display and has a back buffer */
+    if (n < 0 || n > VBE_MAX_RECTS || (n > 0 && !user_range_ok(rects, n * sizeof(fbrect_t))))
+        return -1;
+    if (!vbe.found || vbe.owner != (int32_t)curr_mm_pid || !vbe.back)
+        return -1;
+
+    if (n == 0)
+    {
+        r[0].x = 0;
+        r[0].y = 0;
+        r[0].w = vbe.mode.width;
+        r[0].h = vbe.mode.height;
+        n = 1;
+    }
+    else
+        memcpy(r, rects, n * sizeof(fbrect_t));
+
+    fb = (uint8_t*)(vbe.lfb + vbe.fb_offset);
+    back = (uint8_t*)VBE_BACK_PHYS;
+    pitch = vbe.mode.pitch;
+
+    depth = kernel_lock_drop();
+    if (flags & PRESENT_VSYNC)
+        vga_wait_retrace();
+
+    for (i = 0; i < n; i++)
+    {
+        if (r[i].x >= vbe.mode.width || r[i].y >= vbe.mode.height)
+            continue;
+        w = (r[i].x + r[i].w > vbe.mode.width) ? vbe.mode.width - r[i].x : r[i].w;
+        h = (r[i].y + r[i].h > vbe.mode.height) ? vbe.mode.height - r[i].y : r[i].h;
+        pixels += w * h;
+
+        /* full lines are one block */
+        if (w == vbe.mode.width)
+        {
+            memcpy(fb + r[i].y * pitch, back + r[i].y * pitch, h * pitch);
+            continue;
+        }
+        for (y = r[i].y; y < r[i].y + h; y++)
+            memcpy(fb + y * pitch + r[i].x * VBE_BYTES_PP, back + y * pitch + r[i].x * VBE_BYTES_PP, w * VBE_BYTES_PP);
+    }
+    kernel_lock_retake(depth);
+
+    return pixels;
+}
+
+/*
+ * vbe_set_mode
+ * DESCRIPTION: save the VGA text state and switch to a linear framebuffer mode whose
+ *              screen starts above the text video memory, the screen and the back
+ *              buffer are cleared
+ * INPUT: width, height -- mode size
+ * OUTPUT: none
+ * RETURN: 0 for success, -1 if the mode is not supported or the screen does not fit
+ *         in the 4MB page mapped for it
+ * SIDE AFFECTS: vbe.mode and vbe.fb_offset set
+ */
+static int32_t vbe_set_mode(uint32_t width, uint32_t height)
+{
+    uint32_t pitch = width * VBE_BYTES_PP;
+    uint32_t rows = (VBE_TEXT_VRAM + pitch - 1) / pitch;
+    int i;
+
+    if (width < VBE_MIN_WIDTH || width > VBE_MAX_WIDTH || (width & (VBE_WIDTH_ALIGN - 1)) ||
+        height < VBE_MIN_HEIGHT || height > VBE_MAX_HEIGHT)
+        return -1;
+    /* a BAR that is not 4MB aligned leaves less of the page for the screen */
+    if (vbe.lfb_offset + (rows + height) * pitch > PAGE_4MB_SIZE)
+        return -1;
+
+    for (i = 0; i < VGA_SAVED_REGS; i++)
+    {
+        outb(vga_regs[i].index, vga_regs[i].port);
+        vga_saved[i] = inb(vga_regs[i].port + 1);
+    }
+    outb(VGA_CRTC_VSYNC_END, VGA_CRTC_PORT);
+    vga_saved_vsync_end = inb(VGA_CRTC_PORT + 1);
+
+    /* the device would clear the start of the video memory, the text is kept instead */
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_DISABLED);
+    dispi_write(VBE_DISPI_INDEX_XRES, width);
+    dispi_write(VBE_DISPI_INDEX_YRES, height);
+    dispi_write(VBE_DISPI_INDEX_BPP, VBE_BPP);
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED | VBE_DISPI_NOCLEARMEM);
+    dispi_write(VBE_DISPI_INDEX_VIRT_WIDTH, width);
+    dispi_write(VBE_DISPI_INDEX_Y_OFFSET, rows);
+
+    /* the device clamps the offset to its video memory */
+    if (dispi_read(VBE_DISPI_INDEX_XRES) != width || dispi_read(VBE_DISPI_INDEX_YRES) != height ||
+        dispi_read(VBE_DISPI_INDEX_Y_OFFSET) != rows)
+    {
+        vbe_text_mode();
+        return -1;
+    }
+
+    vbe.mode.width = width;
+    vbe.mode.height = height;
+    vbe.mode.pitch = pitch;
+    vbe.mode.bpp = VBE_BPP;
+    vbe.fb_offset = vbe.lfb_offset + rows * pitch;
+
+    memset((uint8_t*)(vbe.lfb + vbe.fb_offset), 0, height * pitch);
+    if (vbe.back)
+        memset((uint8_t*)VBE_BACK_PHYS, 0, height * pitch);
+    return 0;
+}
+
+/*
+ * vbe_text_mode
+ * DESCRIPTION: turn the dispi mode off and restore the VGA text registers
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: display back in text mode
+ */
+static void vbe_text_mode()
+{
+    int i;
+
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_DISABLED);
+
+    /* unprotect CRTC 0-7 while they are written */
+    outb(VGA_CRTC_VSYNC_END, VGA_CRTC_PORT);
+    outb(vga_saved_vsync_end & ~VGA_CRTC_PROTECT, VGA_CRTC_PORT + 1);
+    for (i = 0; i < VGA_SAVED_REGS; i++)
+    {
+        outb(vga_regs[i].index, vga_regs[i].port);
+        outb(vga_saved[i], vga_regs[i].port + 1);
+    }
+    outb(VGA_CRTC_VSYNC_END, VGA_CRTC_PORT);
+    outb(vga_saved_vsync_end, VGA_CRTC_PORT + 1);
+}
+
+/*
+ * vga_wait_retrace
+ * DESCRIPTION: wait for the start of the next vertical retrace, give up after
+ *              VBE_RETRACE_SPIN polls of each phase
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void vga_wait_retrace()
+{
+    uint32_t spin;
+
+    for (spin = 0; spin < VBE_RETRACE_SPIN && (inb(VGA_INPUT_STATUS_1) & VGA_VRETRACE); spin++)
+        asm volatile ("pause");
+    for (spin = 0; spin < VBE_RETRACE_SPIN && !(inb(VGA_INPUT_STATUS_1) & VGA_VRETRACE); spin++)
+        asm volatile ("pause");
+}
+
+/*
+ * dispi_read
+ * DESCRIPTION: read a dispi register
+ * INPUT: index -- register index
+ * OUTPUT: none
+ * RETURN: register value
+ * SIDE AFFECTS: none
+ */
+static uint16_t dispi_read(uint16_t index)
+{
+    outw(index, VBE_DISPI_PORT_INDEX);
+    return inw(VBE_DISPI_PORT_DATA);
+}
+
+/*
+ * dispi_write
+ * DESCRIPTION: write a dispi register
+ * INPUT: index -- register index
+ *        val -- value
+ * OUTPUT: none
+ * RETURN: none
+ * SIDE AFFECTS: none
+ */
+static void dispi_write(uint16_t index, uint16_t val)
+{
+    outw(index, VBE_DISPI_PORT_INDEX);
+    outw(val, VBE_DISPI_PORT_DATA);
+}
+
+/*
+ * pci_find_lfb
+ * DESCRIPTION: find the Bochs/QEMU display on PCI bus 0, its BAR 0 is the framebuffer
+ * INPUT: none
+ * OUTPUT: none
+ * RETURN: physical framebuffer address, VBE_LFB_DEFAULT if there is no such device
+ * SIDE AFFECTS: none
+ */
+static uint32_t pci_find_lfb()
+{
+    uint32_t slot;
+
+    for (slot = 0; slot < PCI_SLOTS; slot++)
+    {
+        outl(PCI_CONFIG_ENABLE | (slot << 11), PCI_CONFIG_ADDR);
+        if (inl(PCI_CONFIG_DATA) != VBE_PCI_ID)
+            continue;
+        outl(PCI_CONFIG_ENABLE | (slot << 11) | PCI_BAR0, PCI_CONFIG_ADDR);
+        return inl(PCI_CONFIG_DATA) & PCI_BAR_MEM_MASK;
+    }
+    return VBE_LFB_DEFAULT;
+}
+
+/*
+ * user_range_ok
+ * DESCRIPTION: check that a buffer is in the user page
+ * INPUT: p -- pointer from the user
+ *        size -- bytes
+ * OUTPUT: none
+ * RETURN: 1 if usable, 0 otherwise
+ * SIDE AFFECTS: none
+ */
+static uint32_t user_range_ok(const void* p, uint32_t size)
+{
+    return (uint32_t)p >= ADDR_128MB && (uint32_t)p + size <= ADDR_132MB && (uint32_t)p + size >= (uint32_t)p;
+}
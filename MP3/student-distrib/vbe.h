@@ -0,0 +1,110 @@
+#ifndef _VBE_H
+#define _VBE_H
+
+#include "types.h"
+#include "paging.h"
+#include "syscall.h"
+
+/*
+    linear framebuffer graphics on QEMU's std-vga and Bochs, through the Bochs VBE
+    "dispi" registers. one process at a time owns the display, vidmap_ex maps it the
+    framebuffer (what is on screen) and a back buffer of the same layout, present
+    copies dirty rectangles of the back buffer to the screen. the back buffer is the
+    4MB page of physical memory above the user pages, it exists if there is memory.
+
+    the framebuffer starts VBE_TEXT_VRAM bytes into the video memory (the display
+    start is moved there), the text pages and the font below are kept, and the VGA
+    registers the mode change overwrites are restored when the owner goes back to
+    text or halts. text written to the terminals meanwhile does not reach the screen
+*/
+
+/* dispi index and data ports, registers and values */
+#define VBE_DISPI_PORT_INDEX        0x01CE
+#define VBE_DISPI_PORT_DATA         0x01CF
+#define VBE_DISPI_INDEX_ID          0
+#define VBE_DISPI_INDEX_XRES        1
+#define VBE_DISPI_INDEX_YRES        2
+#define VBE_DISPI_INDEX_BPP         3
+#define VBE_DISPI_INDEX_ENABLE      4
+#define VBE_DISPI_INDEX_VIRT_WIDTH  6
+#define VBE_DISPI_INDEX_Y_OFFSET    9
+#define VBE_DISPI_ID2               0xB0C2  /* first version with the linear framebuffer    */
+#define VBE_DISPI_ID_MAX            0xB0CF
+#define VBE_DISPI_DISABLED          0x00
+#define VBE_DISPI_ENABLED           0x01
+#define VBE_DISPI_LFB_ENABLED       0x40
+#define VBE_DISPI_NOCLEARMEM        0x80
+
+/* the framebuffer is BAR 0 of the PCI display, at the Bochs default without one */
+#define PCI_CONFIG_ADDR             0x0CF8
+#define PCI_CONFIG_DATA             0x0CFC
+#define PCI_CONFIG_ENABLE           0x80000000
+#define PCI_BAR0                    0x10
+#define PCI_BAR_MEM_MASK            0xFFFFFFF0
+#define PCI_SLOTS                   32
+#define VBE_PCI_ID                  0x11111234  /* device 0x1111, vendor 0x1234     */
+#define VBE_LFB_DEFAULT             0xE0000000
+
+/* vertical retrace bit of VGA input status 1, and how long present waits for it */
+#define VGA_INPUT_STATUS_1          0x03DA
+#define VGA_VRETRACE                0x08
+#define VBE_RETRACE_SPIN            1000000
+
+/* modes, 32 bits per pixel, the default and the largest that fit the 4MB pages */
+#define VBE_BPP                     32
+#define VBE_BYTES_PP                (VBE_BPP / 8)
+#define VBE_DEF_WIDTH               640
+#define VBE_DEF_HEIGHT              480
+#define VBE_MIN_WIDTH               320
+#define VBE_MIN_HEIGHT              200
+#define VBE_MAX_WIDTH               1024
+#define VBE_MAX_HEIGHT              768
+#define VBE_WIDTH_ALIGN             8
+
+/* video memory of the text mode, text pages and font planes, the framebuffer starts above */
+#define VBE_TEXT_VRAM               0x40000
+
+/* physical back buffer after the user pages, and where the buffers are in user space */
+#define VBE_BACK_PHYS               (0x800000 + NUM_PROCESS * PAGE_4MB_SIZE)
+#define VBE_FB_VIRTUAL              (VID_VIRTUAL_ADDR + PAGE_4MB_SIZE)      /* 144MB */
+#define VBE_BACK_VIRTUAL            (VBE_FB_VIRTUAL + PAGE_4MB_SIZE)        /* 148MB */
+
+/* vidmap_ex targets */
+#define VIDMAP_TEXT                 0
+#define VIDMAP_FB                   1
+#define VIDMAP_BACK                 2
+
+/* present flags, most rectangles per call */
+#define PRESENT_VSYNC               1
+#define VBE_MAX_RECTS               32
+
+#define VBE_NO_OWNER                -1
+
+/* mode of the display, width and height also ask for a mode in vidmap_ex, 0 for the default */
+typedef struct fbinfo_t {
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;                 /* bytes per line       */
+    uint32_t bpp;
+} fbinfo_t;
+
+/* dirty rectangle for present, clipped to the screen */
+typedef struct fbrect_t {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+} fbrect_t;
+
+/* find the display and map its buffers for the kernel */
+extern void vbe_init(uint32_t mem_end);
+/* set the framebuffer pages of a process present in the page directory */
+extern void vbe_remap(uint32_t pid);
+/* give the display back to text mode if a process owns it, used by halt */
+extern void vbe_release(uint32_t pid);
+
+/* system calls, map the text screen or a graphics buffer, and show dirty rectangles */
+int32_t vidmap_ex(int32_t which, uint8_t** screen_start, fbinfo_t* info);
+int32_t present(const fbrect_t* rects, int32_t n, int32_t flags);
+
+#endif /* _VBE_H */
@@ -14,7 +14,12 @@
 #define USER_CS     0x0023
 #define USER_DS     0x002B
 #define KERNEL_TSS  0x0030
-#define KERNEL_LDT  0x0038
+/* one TSS descriptor per processor from KERNEL_TSS, the LDT follows them */
+#define CPU_TSS(n)  (KERNEL_TSS + 8 * (n))
+#define KERNEL_LDT  CPU_TSS(MAX_CPUS)
+
+/* Most processors brought up, each needs a TSS */
+#define MAX_CPUS    8
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
@@ -122,8 +127,8 @@ extern seg_desc_t gdt_desc_ptr;
 extern uint32_t ldt;
 
 extern uint32_t tss_size;
-extern seg_desc_t tss_desc_ptr;
-extern tss_t tss;
+extern seg_desc_t tss_desc_ptr[MAX_CPUS];
+extern tss_t tss[MAX_CPUS];
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \
@@ -215,6 +220,17 @@ do {                                    \
     );                                  \
 } while (0)
 
+/* Index of the processor running this, from its task register. Every
+ * processor loads its own TSS, CPU_TSS(n), and the boot processor runs
+ * with TR 0 until it loads its TSS */
+static inline uint32_t cpu_id(void) {
+    uint16_t sel;
+    asm volatile ("str %0"
+            : "=r"(sel)
+    );
+    return (sel < KERNEL_TSS) ? 0 : (sel - KERNEL_TSS) >> 3;
+}
+
 #endif /* ASM */
 
 #endif /* _x86_DESC_H */
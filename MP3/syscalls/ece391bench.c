@@ -0,0 +1,126 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * user half of the benchmark run
+ * a kernel built by "make bench" runs this in place of the first shell. it
+ * times a system call round trip, terminal_write and execute/halt and prints
+ * "BENCH <name> <value> <unit>" lines to COM1 like the kernel benchmarks,
+ * the status it halts with ends the run. "bench exit" is the child the
+ * execute/halt benchmark runs, it returns at once.
+ */
+
+#define BUFSIZE     128
+#define RUNS        16          /* repeats of each benchmark, the best is reported */
+#define SYSCALLS    1000
+#define WRITE_KB    16
+#define KB          1024
+#define LINE_LEN    64
+#define EXECUTES    32
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+static void report (const char* name, uint32_t value, const char* unit)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)"BENCH ");
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, (uint8_t*)unit);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+/* close of a bad descriptor, the shortest path through the system call linkage */
+static uint32_t bench_syscall ()
+{
+    uint32_t run, i, cycles, best = (uint32_t)-1;
+    uint64_t start;
+
+    for (run = 0; run < RUNS; run++) {
+        start = rdtsc ();
+        for (i = 0; i < SYSCALLS; i++)
+            (void)ece391_close (-1);
+        cycles = (uint32_t)(rdtsc () - start);
+        if (cycles < best)
+            best = cycles;
+    }
+    return best / SYSCALLS;
+}
+
+/* a KB of full lines at a time, the screen scrolls */
+static uint32_t bench_write ()
+{
+    uint8_t text[KB];
+    uint32_t run, i, cycles, best = (uint32_t)-1;
+    uint64_t start;
+
+    for (i = 0; i < KB; i++)
+        text[i] = (LINE_LEN - 1 == i % LINE_LEN) ? '\n' : 'a' + i % 26;
+
+    for (run = 0; run < RUNS; run++) {
+        start = rdtsc ();
+        for (i = 0; i < WRITE_KB; i++)
+            (void)ece391_write (1, text, KB);
+        cycles = (uint32_t)(rdtsc () - start);
+        if (cycles < best)
+            best = cycles;
+    }
+    return best / WRITE_KB;
+}
+
+/* a child that halts at once */
+static uint32_t bench_execute ()
+{
+    uint32_t run, i, cycles, best = (uint32_t)-1;
+    uint64_t start;
+
+    for (run = 0; run < RUNS; run++) {
+        start = rdtsc ();
+        for (i = 0; i < EXECUTES; i++) {
+            if (0 != ece391_execute ((uint8_t*)"bench exit"))
+                return 0;
+        }
+        cycles = (uint32_t)(rdtsc () - start);
+        if (cycles < best)
+            best = cycles;
+    }
+    return best / EXECUTES;
+}
+
+int main ()
+{
+    uint8_t arg[BUFSIZE];
+    uint32_t syscall, write, execute;
+    int32_t mode;
+
+    if (0 == ece391_getargs (arg, BUFSIZE) && 0 == ece391_strcmp (arg, (uint8_t*)"exit"))
+        return 0;
+
+    syscall = bench_syscall ();
+    write = bench_write ();
+    execute = bench_execute ();
+
+    /* results go to COM1 with the kernel's */
+    mode = ece391_fcntl (0, F_GETTTY, 0);
+    if (-1 != mode)
+        (void)ece391_fcntl (0, F_SETTTY, mode | TTY_SERIAL);
+    report ("syscall", syscall, "cycles");
+    report ("terminal_write", write, "cycles/KB");
+    if (0 == execute) {
+        ece391_fdputs (1, (uint8_t*)"bench: execute failed\n");
+        return 1;
+    }
+    report ("execute_halt", execute, "cycles");
+    return 0;
+}
@@ -3,30 +3,45 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
+#define NAMESIZE 1024
+#define CHUNK 4096          /* first read size, doubled while reads fill the buffer */
+#define MAX_CHUNK 65536
+
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[1024];
+    int32_t fd, cnt, size;
+    uint8_t name[NAMESIZE];
+    uint8_t *buf, *bigger;
 
-    if (0 != ece391_getargs (buf, 1024)) {
+    if (0 != ece391_getargs (name, NAMESIZE)) {
         ece391_fdputs (1, (uint8_t*)"could not read arguments\n");
 	return 3;
     }
 
-    if (-1 == (fd = ece391_open (buf))) {
+    if (-1 == (fd = ece391_open (name))) {
         ece391_fdputs (1, (uint8_t*)"file not found\n");
 	return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, 1024))) {
+    size = CHUNK;
+    if (0 == (buf = ece391_malloc (size))) {
+        ece391_fdputs (1, (uint8_t*)"out of memory\n");
+	return 3;
+    }
+
+    while (0 != (cnt = ece391_read (fd, buf, size))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"file read failed\n");
 	    return 3;
 	}
 	if (-1 == ece391_write (1, buf, cnt))
 	    return 3;
+	/* a large file takes fewer, larger reads and writes */
+	if (cnt == size && size < MAX_CHUNK && 0 != (bigger = ece391_realloc (buf, 2 * size))) {
+	    buf = bigger;
+	    size *= 2;
+	}
     }
 
     return 0;
 }
-
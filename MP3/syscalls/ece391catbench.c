@@ -0,0 +1,93 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * terminal write benchmark
+ * "catbench <file>" cats the file ROUNDS times to the terminal with 1kB writes and reports
+ * the characters written per second. the TSC is calibrated against rtc
+ * ticks first, so run it alone (one terminal) for a steady rtc rate.
+ */
+
+#define BUFSIZE     1024
+#define NAMESIZE    128
+#define ROUNDS      32
+#define RTC_FREQ    64
+#define CAL_TICKS   16
+#define KCYCLE_BITS 10
+#define TICK_FRAC   16
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+static void put_num (const char* name, uint32_t value)
+{
+    uint8_t buf[NAMESIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+int main ()
+{
+    uint8_t name[NAMESIZE];
+    uint8_t buf[BUFSIZE];
+    int32_t fd, rtc_fd, cnt, ret, round, i;
+    int32_t freq = RTC_FREQ;
+    uint32_t chars = 0, ktick, kcycles, ticks;
+    uint64_t start;
+
+    if (0 != ece391_getargs (name, NAMESIZE)) {
+        ece391_fdputs (1, (uint8_t*)"usage: catbench <file>\n");
+        return 3;
+    }
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &freq, sizeof (freq))) {
+        ece391_fdputs (1, (uint8_t*)"rtc unavailable\n");
+        return 2;
+    }
+
+    /* kcycles per rtc tick, starting on a tick boundary */
+    ece391_read (rtc_fd, &freq, sizeof (freq));
+    start = rdtsc ();
+    for (i = 0; i < CAL_TICKS; i++)
+        ece391_read (rtc_fd, &freq, sizeof (freq));
+    ktick = (uint32_t)((rdtsc () - start) >> KCYCLE_BITS) / CAL_TICKS;
+    ece391_close (rtc_fd);
+
+    start = rdtsc ();
+    for (round = 0; round < ROUNDS; round++) {
+        if (-1 == (fd = ece391_open (name))) {
+            ece391_fdputs (1, (uint8_t*)"file not found\n");
+            return 2;
+        }
+        while (0 != (cnt = ece391_read (fd, buf, BUFSIZE))) {
+            if (-1 == cnt || -1 == (ret = ece391_write (1, buf, cnt))) {
+                ece391_fdputs (1, (uint8_t*)"file read failed\n");
+                return 3;
+            }
+            chars += ret;
+        }
+        ece391_close (fd);
+    }
+    kcycles = (uint32_t)((rdtsc () - start) >> KCYCLE_BITS);
+
+    /* elapsed time in 1/TICK_FRAC rtc ticks, at least one to avoid dividing by zero */
+    ticks = (0 == ktick) ? 0 : kcycles * TICK_FRAC / ktick;
+    if (0 == ticks)
+        ticks = 1;
+
+    put_num ("chars written: ", chars);
+    put_num ("kcycles: ", kcycles);
+    put_num ("kcycles per rtc tick: ", ktick);
+    put_num ("chars per second: ", chars * RTC_FREQ * TICK_FRAC / ticks);
+    return 0;
+}
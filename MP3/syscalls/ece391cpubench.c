@@ -0,0 +1,73 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * processor scaling benchmark
+ * "cpubench [rounds]" runs a loop with no system call for rounds (default
+ * DEF_ROUNDS) times 1M iterations and reports the elapsed TSC kcycles. start
+ * it in all three terminals at once: with one processor each run takes about
+ * three times as long as a lone run, with three or more processors about as
+ * long, CTRL+P shows where the runs went.
+ */
+
+#define NAMESIZE    128
+#define ARGSIZE     16
+#define DEF_ROUNDS  64
+#define ROUND_ITERS (1 << 20)
+#define KCYCLE_BITS 10
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+static void put_num (const char* name, uint32_t value)
+{
+    uint8_t buf[NAMESIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+int main ()
+{
+    uint8_t arg[ARGSIZE];
+    int32_t round, i;
+    uint32_t rounds = DEF_ROUNDS;
+    uint32_t kcycles;
+    volatile uint32_t seed = 1;
+    uint32_t x;
+    uint64_t start;
+
+    if (0 == ece391_getargs (arg, ARGSIZE)) {
+        rounds = 0;
+        for (i = 0; '\0' != arg[i]; i++) {
+            if (arg[i] < '0' || arg[i] > '9') {
+                ece391_fdputs (1, (uint8_t*)"usage: cpubench [rounds]\n");
+                return 3;
+            }
+            rounds = rounds * 10 + arg[i] - '0';
+        }
+    }
+
+    start = rdtsc ();
+    x = seed;
+    for (round = 0; round < rounds; round++) {
+        /* a linear congruential generator, nothing the compiler can fold */
+        for (i = 0; i < ROUND_ITERS; i++)
+            x = x * 1664525 + 1013904223;
+        seed = x;
+    }
+    kcycles = (uint32_t)((rdtsc () - start) >> KCYCLE_BITS);
+
+    put_num ("rounds: ", rounds);
+    put_num ("kcycles: ", kcycles);
+    put_num ("kcycles per round: ", (0 == rounds) ? 0 : kcycles / rounds);
+    return 0;
+}
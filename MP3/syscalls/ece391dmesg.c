@@ -0,0 +1,49 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * kernel log reader
+ * "dmesg" prints the records kept in the kernel log, oldest first, as
+ * "<level>[kcycles] message" where level is E, W, I or D and kcycles is the
+ * TSC in units of 1024 cycles. "dmesg <0-3>" sets the level instead, records
+ * more verbose than it are not logged (3 logs every rtc, pit and keyboard irq).
+ */
+
+#define BUFSIZE     1024
+#define ARGSIZE     16
+#define MAX_LEVEL   3
+
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    uint8_t arg[ARGSIZE];
+    int32_t fd, cnt, level;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"dmesg"))) {
+        ece391_fdputs (1, (uint8_t*)"no kernel log device\n");
+        return 2;
+    }
+
+    if (0 == ece391_getargs (arg, ARGSIZE)) {
+        level = arg[0] - '0';
+        if ('\0' != arg[1] || level < 0 || level > MAX_LEVEL ||
+            -1 == ece391_write (fd, &level, sizeof (level))) {
+            ece391_fdputs (1, (uint8_t*)"usage: dmesg [0-3]\n");
+            return 3;
+        }
+        return 0;
+    }
+
+    while (0 != (cnt = ece391_read (fd, buf, BUFSIZE))) {
+        if (-1 == cnt) {
+            ece391_fdputs (1, (uint8_t*)"kernel log read failed\n");
+            return 3;
+        }
+        if (-1 == ece391_write (1, buf, cnt))
+            return 3;
+    }
+    ece391_close (fd);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * FPU/SSE context switch test
+ * "fputest [rounds]" loads a value of its own into the x87 stack and xmm0,
+ * spins long enough to be switched out and checks that both come back intact,
+ * for rounds (default DEF_ROUNDS) rounds. run it in all three terminals at
+ * once, each run picks a different value from the TSC. CTRL+P then shows the
+ * cost of switches out of runs that used the FPU against those that did not.
+ */
+
+#define NAMESIZE    128
+#define ARGSIZE     16
+#define DEF_ROUNDS  32
+#define SPIN_ITERS  (1 << 24)
+
+static uint32_t rdtsc_low ()
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static void put_num (const char* name, uint32_t value)
+{
+    uint8_t buf[NAMESIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+int main ()
+{
+    uint8_t arg[ARGSIZE];
+    uint32_t rounds = DEF_ROUNDS;
+    uint32_t round, i;
+    uint32_t value, x87_out, sse_out;
+    uint32_t bad = 0;
+
+    if (0 == ece391_getargs (arg, ARGSIZE)) {
+        rounds = 0;
+        for (i = 0; '\0' != arg[i]; i++) {
+            if (arg[i] < '0' || arg[i] > '9') {
+                ece391_fdputs (1, (uint8_t*)"usage: fputest [rounds]\n");
+                return 3;
+            }
+            rounds = rounds * 10 + arg[i] - '0';
+        }
+    }
+
+    for (round = 0; round < rounds; round++) {
+        /* keep it below 2^31 so fild/fistp round trip exactly */
+        value = (rdtsc_low () >> 1) | 1;
+        /* the registers are not touched while spinning, only a switch could change them */
+        asm volatile ("                         \n\
+            fninit                              \n\
+            fildl   %2                          \n\
+            movd    %2, %%xmm0                  \n\
+            movl    %3, %%ecx                   \n\
+        1:                                      \n\
+            decl    %%ecx                       \n\
+            jnz     1b                          \n\
+            fistpl  %0                          \n\
+            movd    %%xmm0, %1                  \n\
+            "
+            : "=m"(x87_out), "=r"(sse_out)
+            : "m"(value), "i"(SPIN_ITERS)
+            : "ecx", "memory"
+        );
+        if (x87_out != value || sse_out != value)
+            bad++;
+    }
+
+    put_num ("rounds: ", rounds);
+    put_num ("corrupted: ", bad);
+    if (0 != bad) {
+        ece391_fdputs (1, (uint8_t*)"fpu state lost across a switch\n");
+        return 1;
+    }
+    ece391_fdputs (1, (uint8_t*)"fpu state ok\n");
+    return 0;
+}
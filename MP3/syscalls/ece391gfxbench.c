@@ -0,0 +1,163 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * frame rate benchmark of the graphics device
+ * draws into the back buffer and presents it: full frames, a sprite moving
+ * over a still background (two dirty rectangles a frame), then full frames
+ * synced to the vertical retrace. the screen goes back to text before the
+ * results are printed as "BENCH <name> <value> <unit>" lines like "bench".
+ */
+
+#define BUFSIZE         16
+#define FULL_FRAMES     60
+#define SPRITE_FRAMES   600
+#define VSYNC_FRAMES    30
+#define SPRITE_SIZE     64
+#define SPRITE_STEP     3
+#define NS_PER_US       1000
+
+static ece391_fbinfo_t info;
+static uint32_t* back;
+
+static void report (const char* name, uint32_t value, const char* unit)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)"BENCH ");
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, (uint8_t*)unit);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+static uint64_t now ()
+{
+    uint64_t ns = 0;
+
+    ece391_gettime (&ns);
+    return ns;
+}
+
+/* fill a rectangle of the back buffer */
+static void fill (uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color)
+{
+    uint32_t* row = back + y * (info.pitch / 4) + x;
+    uint32_t i, j;
+
+    for (j = 0; j < h; j++, row += info.pitch / 4) {
+        for (i = 0; i < w; i++)
+            row[i] = color;
+    }
+}
+
+/* a gradient scrolled by frame over the whole back buffer */
+static void draw_frame (uint32_t frame)
+{
+    uint32_t* row = back;
+    uint32_t x, y;
+
+    for (y = 0; y < info.height; y++, row += info.pitch / 4) {
+        for (x = 0; x < info.width; x++)
+            row[x] = ((x + frame) & 0xFF) << 16 | ((y + frame) & 0xFF) << 8 | (frame & 0xFF);
+    }
+}
+
+/* microseconds per frame of full screen presents, with flags, and the drawing if draw */
+static uint32_t bench_full (uint32_t frames, int32_t flags, uint32_t draw, uint32_t* present_us)
+{
+    uint64_t start, t, in_present = 0;
+    uint32_t i;
+
+    start = now ();
+    for (i = 0; i < frames; i++) {
+        if (draw)
+            draw_frame (i);
+        t = now ();
+        if (-1 == ece391_present (0, 0, flags))
+            return 0;
+        in_present += now () - t;
+    }
+    *present_us = (uint32_t)in_present / NS_PER_US / frames;
+    return (uint32_t)(now () - start) / NS_PER_US / frames;
+}
+
+/* microseconds per frame of a sprite bouncing around, only its old and new place are presented */
+static uint32_t bench_sprite (uint32_t* pixels)
+{
+    ece391_rect_t dirty[2];
+    int32_t x = 0, y = 0, dx = SPRITE_STEP, dy = SPRITE_STEP;
+    uint32_t i;
+    uint64_t start;
+    int32_t n;
+
+    fill (0, 0, info.width, info.height, 0x00203040);
+    if (-1 == ece391_present (0, 0, 0))
+        return 0;
+
+    *pixels = 0;
+    start = now ();
+    for (i = 0; i < SPRITE_FRAMES; i++) {
+        dirty[0].x = x;
+        dirty[0].y = y;
+        dirty[0].w = dirty[0].h = SPRITE_SIZE;
+        fill (x, y, SPRITE_SIZE, SPRITE_SIZE, 0x00203040);
+
+        if (x + dx < 0 || x + dx + SPRITE_SIZE > (int32_t)info.width)
+            dx = -dx;
+        if (y + dy < 0 || y + dy + SPRITE_SIZE > (int32_t)info.height)
+            dy = -dy;
+        x += dx;
+        y += dy;
+
+        dirty[1].x = x;
+        dirty[1].y = y;
+        dirty[1].w = dirty[1].h = SPRITE_SIZE;
+        fill (x, y, SPRITE_SIZE, SPRITE_SIZE, 0x00FFC000 | (i & 0xFF));
+
+        if (-1 == (n = ece391_present (dirty, 2, 0)))
+            return 0;
+        *pixels += n;
+    }
+    *pixels /= SPRITE_FRAMES;
+    return (uint32_t)(now () - start) / NS_PER_US / SPRITE_FRAMES;
+}
+
+int main ()
+{
+    uint8_t *fb, *text;
+    uint32_t frame_us, present_us, sprite_us, sprite_px, vsync_us, dummy;
+
+    /* default mode, the loader does not clear static data */
+    info.width = info.height = 0;
+    if (-1 == ece391_vidmap_ex (VIDMAP_BACK, (uint8_t**)&back, &info) ||
+        -1 == ece391_vidmap_ex (VIDMAP_FB, &fb, 0)) {
+        ece391_fdputs (1, (uint8_t*)"gfxbench: no graphics device or back buffer\n");
+        return 1;
+    }
+
+    frame_us = bench_full (FULL_FRAMES, 0, 1, &present_us);
+    sprite_us = bench_sprite (&sprite_px);
+    vsync_us = bench_full (VSYNC_FRAMES, PRESENT_VSYNC, 0, &dummy);
+
+    /* results go to the terminal, back to text first */
+    ece391_vidmap_ex (VIDMAP_TEXT, &text, 0);
+    if (0 == frame_us || 0 == sprite_us || 0 == vsync_us) {
+        ece391_fdputs (1, (uint8_t*)"gfxbench: present failed\n");
+        return 1;
+    }
+
+    report ("gfx_width", info.width, "pixels");
+    report ("gfx_height", info.height, "pixels");
+    report ("gfx_full_frame", frame_us, "us");
+    report ("gfx_full_present", present_us, "us");
+    report ("gfx_sprite_frame", sprite_us, "us");
+    report ("gfx_sprite_pixels", sprite_px, "pixels");
+    report ("gfx_vsync_frame", vsync_us, "us");
+    return 0;
+}
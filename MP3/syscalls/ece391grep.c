@@ -5,12 +5,17 @@
 
 #define BUFSIZE 1024
 #define SBUFSIZE 33
+#define CHUNK 4096      /* initial line buffer, and the least room left for a read */
+
+/* line buffer on the heap, doubled when a line does not fit */
+static uint8_t* data;
+static int32_t data_size;
 
 int32_t
-do_one_file (const char* s, const char* fname) 
+do_one_file (const char* s, const char* fname)
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
-    uint8_t data[BUFSIZE+1];
+    int32_t fd, cnt, last, line_start, line_end, scan, check, s_len;
+    uint8_t* bigger;
 
     s_len = ece391_strlen ((uint8_t*)s);
     if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
@@ -18,29 +23,37 @@ do_one_file (const char* s, const char* fname)
         return -1;
     }
     last = 0;
+    scan = 0;
     while (1) {
-        cnt = ece391_read (fd, data + last, BUFSIZE - last);
+	/* keep a full chunk free for the read, a long line doubles the buffer */
+	if (data_size - last < CHUNK) {
+	    if (0 == (bigger = ece391_realloc (data, 2 * data_size + 1))) {
+		ece391_fdputs (1, (uint8_t*)"out of memory\n");
+		ece391_close (fd);
+		return -1;
+	    }
+	    data = bigger;
+	    data_size *= 2;
+	}
+        cnt = ece391_read (fd, data + last, data_size - last);
 	if (-1 == cnt) {
             ece391_fdputs (1, (uint8_t*)"file read failed\n");
             return -1;
 	}
 	last += cnt;
 	line_start = 0;
-	while (1) {
-	    line_end = line_start;
+	/* the bytes before scan hold no newline, they were searched before the read */
+	line_end = scan;
+	while (line_start < last) {
 	    while (line_end < last && '\n' != data[line_end])
 		line_end++;
-	    if ('\n' != data[line_end] && 0 != cnt && line_start != 0) {
-		/* copy from line_start to last down to 0 and fix last */
-		data[line_end] = '\0';
-		ece391_strcpy (data, data + line_start);
-		last -= line_start;
+	    /* an unfinished line waits for more data, unless the file ended */
+	    if (line_end == last && 0 != cnt)
 		break;
-	    }
-	    /* search the line */
+	    /* search the line, the buffer has room for the terminator */
 	    data[line_end] = '\0';
 	    for (check = line_start; check < line_end; check++) {
-		if (s[0] == data[check] && 
+		if (s[0] == data[check] &&
 		    0 == ece391_strncmp ((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
 		    ece391_fdputs (1, (uint8_t*)fname);
 		    ece391_fdputs (1, (uint8_t*)":");
@@ -50,13 +63,19 @@ do_one_file (const char* s, const char* fname)
 		}
 	    }
 	    line_start = line_end + 1;
-	    if (line_start >= last) {
-	        last = 0;
-		break;
-	    }
+	    line_end = line_start;
 	}
 	if (0 == cnt)
 	    break;
+	/* move the unfinished line down */
+	if (line_start >= last) {
+	    last = 0;
+	} else if (0 != line_start) {
+	    for (check = line_start; check < last; check++)
+		data[check - line_start] = data[check];
+	    last -= line_start;
+	}
+	scan = last;
     }
     if (-1 == ece391_close (fd)) {
         ece391_fdputs (1, (uint8_t*)"file close failed\n");
@@ -76,6 +95,12 @@ int main ()
         return 3;
     }
 
+    data_size = CHUNK;
+    if (0 == (data = ece391_malloc (data_size + 1))) {
+        ece391_fdputs (1, (uint8_t*)"out of memory\n");
+	return 3;
+    }
+
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 	return 2;
@@ -0,0 +1,183 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * heap benchmark
+ * "heapbench [file]" times malloc/free pairs of mixed small sizes, a buffer
+ * doubled with realloc up to 1MB, reading the file (default "fish", the
+ * largest) whole into a heap buffer against 1kB reads into a stack buffer as
+ * cat and grep did, and grep through every file for a string no file has.
+ * results are "BENCH <name> <value> <unit>" lines like "bench".
+ */
+
+#define NAMESIZE        128
+#define SLOTS           256
+#define PAIRS           16384
+#define MAX_SMALL       2000
+#define GROW_START      4096
+#define GROW_END        0x100000
+#define ROUNDS          32
+#define GREP_ROUNDS     8
+#define SMALL_READ      1024
+#define CHUNK           4096
+
+static void* slot[SLOTS];
+
+static void report (const char* name, uint32_t value, const char* unit)
+{
+    uint8_t buf[NAMESIZE];
+
+    ece391_fdputs (1, (uint8_t*)"BENCH ");
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, (uint8_t*)unit);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+/* ns per malloc/free pair, each replaces a random block of a window of live ones */
+static uint32_t bench_pairs ()
+{
+    uint32_t i, elapsed, seed = 1;
+    uint64_t start;
+
+    for (i = 0; i < SLOTS; i++)
+        slot[i] = 0;
+    start = ece391_clock_ns ();
+    for (i = 0; i < PAIRS; i++) {
+        seed = seed * 1103515245 + 12345;
+        ece391_free (slot[(seed >> 8) % SLOTS]);
+        if (0 == (slot[(seed >> 8) % SLOTS] = ece391_malloc ((seed >> 16) % MAX_SMALL + 1)))
+            return 0;
+    }
+    elapsed = (uint32_t)(ece391_clock_ns () - start);
+    for (i = 0; i < SLOTS; i++)
+        ece391_free (slot[i]);
+    return elapsed / PAIRS;
+}
+
+/* us to double a buffer from 4kB to 1MB, touching each new half */
+static uint32_t bench_grow ()
+{
+    uint8_t *buf, *bigger;
+    uint32_t size, i;
+    uint64_t start;
+
+    start = ece391_clock_ns ();
+    if (0 == (buf = ece391_malloc (GROW_START)))
+        return 0;
+    for (size = GROW_START; size < GROW_END; size *= 2) {
+        if (0 == (bigger = ece391_realloc (buf, 2 * size))) {
+            ece391_free (buf);
+            return 0;
+        }
+        buf = bigger;
+        for (i = size; i < 2 * size; i += CHUNK)
+            buf[i] = 1;
+    }
+    ece391_free (buf);
+    return (uint32_t)(ece391_clock_ns () - start) / 1000;
+}
+
+/* us to read the file whole into a buffer doubled as it fills, 0 if it fails */
+static uint32_t bench_slurp (const uint8_t* name, uint32_t* bytes)
+{
+    uint8_t *buf, *bigger;
+    int32_t fd, cnt;
+    uint32_t size, last, round;
+    uint64_t start;
+
+    start = ece391_clock_ns ();
+    for (round = 0; round < ROUNDS; round++) {
+        if (-1 == (fd = ece391_open (name)))
+            return 0;
+        size = CHUNK;
+        last = 0;
+        if (0 == (buf = ece391_malloc (size)))
+            return 0;
+        while (0 != (cnt = ece391_read (fd, buf + last, size - last))) {
+            if (-1 == cnt)
+                return 0;
+            last += cnt;
+            if (last == size) {
+                if (0 == (bigger = ece391_realloc (buf, 2 * size)))
+                    return 0;
+                buf = bigger;
+                size *= 2;
+            }
+        }
+        ece391_close (fd);
+        ece391_free (buf);
+    }
+    *bytes = last;
+    return (uint32_t)(ece391_clock_ns () - start) / 1000 / ROUNDS;
+}
+
+/* us to read the file through a 1kB stack buffer */
+static uint32_t bench_small_reads (const uint8_t* name)
+{
+    uint8_t buf[SMALL_READ];
+    int32_t fd, cnt;
+    uint32_t round;
+    uint64_t start;
+
+    start = ece391_clock_ns ();
+    for (round = 0; round < ROUNDS; round++) {
+        if (-1 == (fd = ece391_open (name)))
+            return 0;
+        while (0 != (cnt = ece391_read (fd, buf, SMALL_READ))) {
+            if (-1 == cnt)
+                return 0;
+        }
+        ece391_close (fd);
+    }
+    return (uint32_t)(ece391_clock_ns () - start) / 1000 / ROUNDS;
+}
+
+/* us for grep to search every file, it prints nothing */
+static uint32_t bench_grep ()
+{
+    uint32_t round;
+    uint64_t start;
+
+    start = ece391_clock_ns ();
+    for (round = 0; round < GREP_ROUNDS; round++) {
+        if (0 != ece391_execute ((uint8_t*)"grep zq#no-such-text#qz"))
+            return 0;
+    }
+    return (uint32_t)(ece391_clock_ns () - start) / 1000 / GREP_ROUNDS;
+}
+
+int main ()
+{
+    uint8_t name[NAMESIZE];
+    uint32_t pair_ns, grow_us, slurp_us, small_us, grep_us, bytes = 0;
+
+    if (0 != ece391_getargs (name, NAMESIZE))
+        ece391_strcpy (name, (uint8_t*)"fish");
+
+    if (0 == (pair_ns = bench_pairs ()) || 0 == (grow_us = bench_grow ())) {
+        ece391_fdputs (1, (uint8_t*)"heapbench: no heap\n");
+        return 1;
+    }
+    if (0 == (slurp_us = bench_slurp (name, &bytes)) || 0 == (small_us = bench_small_reads (name))) {
+        ece391_fdputs (1, (uint8_t*)"heapbench: cannot read the file\n");
+        return 2;
+    }
+    if (0 == (grep_us = bench_grep ())) {
+        ece391_fdputs (1, (uint8_t*)"heapbench: grep failed\n");
+        return 3;
+    }
+
+    report ("heap_malloc_free", pair_ns, "ns");
+    report ("heap_grow_1mb", grow_us, "us");
+    report ("file_bytes", bytes, "bytes");
+    report ("file_read_heap", slurp_us, "us");
+    report ("file_read_1k", small_us, "us");
+    report ("grep_all_files", grep_us, "us");
+    return 0;
+}
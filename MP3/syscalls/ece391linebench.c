@@ -0,0 +1,81 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * terminal line output benchmark
+ * writes LINES short lines to the terminal, one write per line, so every
+ * write scrolls the screen, and reports the lines written per second. the
+ * TSC is calibrated against rtc ticks first, so run it alone (one terminal)
+ * for a steady rtc rate.
+ */
+
+#define BUFSIZE     128
+#define LINES       4096
+#define RTC_FREQ    64
+#define CAL_TICKS   16
+#define KCYCLE_BITS 10
+#define TICK_FRAC   16
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+static void put_num (const char* name, uint32_t value)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+int main ()
+{
+    uint8_t line[BUFSIZE];
+    int32_t rtc_fd, len, i;
+    int32_t freq = RTC_FREQ;
+    uint32_t ktick, kcycles, ticks;
+    uint64_t start;
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &freq, sizeof (freq))) {
+        ece391_fdputs (1, (uint8_t*)"rtc unavailable\n");
+        return 2;
+    }
+
+    /* kcycles per rtc tick, starting on a tick boundary */
+    ece391_read (rtc_fd, &freq, sizeof (freq));
+    start = rdtsc ();
+    for (i = 0; i < CAL_TICKS; i++)
+        ece391_read (rtc_fd, &freq, sizeof (freq));
+    ktick = (uint32_t)((rdtsc () - start) >> KCYCLE_BITS) / CAL_TICKS;
+    ece391_close (rtc_fd);
+
+    start = rdtsc ();
+    for (i = 0; i < LINES; i++) {
+        ece391_strcpy (line, (uint8_t*)"line ");
+        ece391_itoa (i, line + 5, 10);
+        len = ece391_strlen (line);
+        line[len++] = '\n';
+        if (-1 == ece391_write (1, line, len))
+            return 3;
+    }
+    kcycles = (uint32_t)((rdtsc () - start) >> KCYCLE_BITS);
+
+    /* elapsed time in 1/TICK_FRAC rtc ticks, at least one to avoid dividing by zero */
+    ticks = (0 == ktick) ? 0 : kcycles * TICK_FRAC / ktick;
+    if (0 == ticks)
+        ticks = 1;
+
+    put_num ("lines written: ", LINES);
+    put_num ("kcycles: ", kcycles);
+    put_num ("kcycles per rtc tick: ", ktick);
+    put_num ("lines per second: ", LINES * RTC_FREQ * TICK_FRAC / ticks);
+    return 0;
+}
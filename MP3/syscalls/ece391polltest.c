@@ -0,0 +1,95 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * poll wakeup latency test
+ * waits on the keyboard (stdin) and the rtc at the same time with poll,
+ * and reports the cycles between the enter key interrupt and the return
+ * of poll for every line typed. type "q" to quit.
+ */
+
+#define BUFSIZE     128
+#define RTC_FREQ    2
+#define TIMEOUT_MS  5000
+#define NUM_FDS     2
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+static void put_num (const char* name, uint32_t value)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    int32_t rtc_fd, ret, cnt;
+    int32_t freq = RTC_FREQ;
+    uint32_t latency, ticks = 0, lines = 0, total = 0, worst = 0;
+    ece391_pollfd_t fds[NUM_FDS];
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &freq, sizeof (freq))) {
+        ece391_fdputs (1, (uint8_t*)"rtc unavailable\n");
+        return 2;
+    }
+    /* an idle stdin must not block the read after a spurious wakeup */
+    ece391_fcntl (0, F_SETFL, O_NONBLOCK);
+
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    fds[1].fd = rtc_fd;
+    fds[1].events = POLLIN;
+
+    ece391_fdputs (1, (uint8_t*)"type lines, \"q\" to quit\n");
+    while (1) {
+        ret = ece391_poll (fds, NUM_FDS, TIMEOUT_MS);
+        if (-1 == ret) {
+            ece391_fdputs (1, (uint8_t*)"poll failed\n");
+            break;
+        }
+        if (0 == ret) {
+            ece391_fdputs (1, (uint8_t*)"timeout\n");
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            ece391_read (rtc_fd, &freq, sizeof (freq));
+            ticks++;
+        }
+        if (fds[0].revents & POLLIN) {
+            latency = (uint32_t)rdtsc () - fds[0].stamp;
+            if (0 >= (cnt = ece391_read (0, buf, BUFSIZE - 1)))
+                continue;
+            buf[cnt] = '\0';
+            lines++;
+            total += latency;
+            if (latency > worst)
+                worst = latency;
+            put_num ("wakeup cycles: ", latency);
+            if (0 == ece391_strcmp (buf, (uint8_t*)"q"))
+                break;
+        }
+    }
+
+    ece391_fcntl (0, F_SETFL, 0);
+    ece391_close (rtc_fd);
+
+    put_num ("rtc ticks: ", ticks);
+    put_num ("lines: ", lines);
+    if (0 != lines)
+        put_num ("average wakeup cycles: ", total / lines);
+    put_num ("worst wakeup cycles: ", worst);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * sampling profiler control
+ * "prof start" and "prof stop" start and stop sampling, "prof dump" prints
+ * the samples as "P <cpu> <pid> <user> <eip in hex>" lines, "prof <command>"
+ * profiles one run of the command and dumps. the dump also goes to COM1 if
+ * there is a serial port, capture it on the host and run
+ * "student-distrib/profile.py student-distrib/bootimg log" for the profile.
+ */
+
+#define BUFSIZE     128
+#define NUM_SAMPLES 32
+#define HEX         16
+
+static void put_field (uint32_t value, int32_t radix, const char* sep)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_itoa (value, buf, radix);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)sep);
+}
+
+static int32_t dump ()
+{
+    ece391_prof_sample_t samples[NUM_SAMPLES];
+    int32_t fd, cnt, i, mode;
+    uint32_t total = 0;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"prof"))) {
+        ece391_fdputs (1, (uint8_t*)"no prof device\n");
+        return 2;
+    }
+
+    /* copy the dump to the serial line for the host, if there is one */
+    mode = ece391_fcntl (0, F_GETTTY, 0);
+    if (-1 != mode)
+        (void)ece391_fcntl (0, F_SETTTY, mode | TTY_SERIAL);
+
+    ece391_fdputs (1, (uint8_t*)"prof begin\n");
+    while (0 < (cnt = ece391_read (fd, samples, sizeof (samples)))) {
+        for (i = 0; i < cnt / (int32_t)sizeof (ece391_prof_sample_t); i++) {
+            ece391_fdputs (1, (uint8_t*)"P ");
+            put_field (samples[i].cpu, 10, " ");
+            if (samples[i].pid < 0)
+                ece391_fdputs (1, (uint8_t*)"-1 ");
+            else
+                put_field (samples[i].pid, 10, " ");
+            put_field (samples[i].user, 10, " ");
+            put_field (samples[i].eip, HEX, "\n");
+        }
+        total += cnt / sizeof (ece391_prof_sample_t);
+    }
+    ece391_fdputs (1, (uint8_t*)"prof end ");
+    put_field (total, 10, "\n");
+
+    if (-1 != mode)
+        (void)ece391_fcntl (0, F_SETTTY, mode);
+    ece391_close (fd);
+    return (-1 == cnt) ? 3 : 0;
+}
+
+int main ()
+{
+    uint8_t arg[BUFSIZE];
+
+    if (0 != ece391_getargs (arg, BUFSIZE)) {
+        ece391_fdputs (1, (uint8_t*)"usage: prof start|stop|dump|<command>\n");
+        return 3;
+    }
+
+    if (0 == ece391_strcmp (arg, (uint8_t*)"start"))
+        return (-1 == ece391_profctl (PROF_START)) ? 2 : 0;
+    if (0 == ece391_strcmp (arg, (uint8_t*)"stop")) {
+        put_field (ece391_profctl (PROF_STOP), 10, " samples\n");
+        return 0;
+    }
+    if (0 == ece391_strcmp (arg, (uint8_t*)"dump"))
+        return dump ();
+
+    /* profile one run of a command */
+    if (-1 == ece391_profctl (PROF_START)) {
+        ece391_fdputs (1, (uint8_t*)"cannot start the profiler\n");
+        return 2;
+    }
+    if (-1 == ece391_execute (arg))
+        ece391_fdputs (1, (uint8_t*)"no such command\n");
+    (void)ece391_profctl (PROF_STOP);
+    return dump ();
+}
@@ -0,0 +1,62 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * raw terminal mode test
+ * switches the terminal to raw mode without echo and prints the code of
+ * every key as soon as it is typed, with the cycles between the keyboard
+ * interrupt and the return of read. type "q" to quit.
+ */
+
+#define BUFSIZE     32
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    uint8_t num[BUFSIZE];
+    ece391_pollfd_t pfd;
+    int32_t mode, cnt, i;
+    uint32_t latency;
+
+    if (-1 == (mode = ece391_fcntl (0, F_GETTTY, 0)) ||
+        -1 == ece391_fcntl (0, F_SETTTY, 0)) {
+        ece391_fdputs (1, (uint8_t*)"stdin is not a terminal\n");
+        return 2;
+    }
+    ece391_fdputs (1, (uint8_t*)"raw mode, type q to quit\n");
+
+    pfd.fd = 0;
+    pfd.events = POLLIN;
+    while (1) {
+        if (-1 == ece391_poll (&pfd, 1, POLL_NO_TIMEOUT) ||
+            -1 == (cnt = ece391_read (0, buf, BUFSIZE)))
+            break;
+        latency = (uint32_t)rdtsc () - pfd.stamp;
+        for (i = 0; i < cnt; i++) {
+            ece391_itoa (buf[i], num, 10);
+            ece391_fdputs (1, num);
+            ece391_fdputs (1, (uint8_t*)" ");
+        }
+        ece391_fdputs (1, (uint8_t*)"cycles: ");
+        ece391_itoa (latency, num, 10);
+        ece391_fdputs (1, num);
+        ece391_fdputs (1, (uint8_t*)"\n");
+        for (i = 0; i < cnt; i++)
+            if ('q' == buf[i])
+                break;
+        if (i < cnt)
+            break;
+    }
+
+    ece391_fcntl (0, F_SETTTY, mode);
+    return 0;
+}
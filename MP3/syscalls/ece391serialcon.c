@@ -0,0 +1,39 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * serial console switch
+ * "serialcon on" makes this terminal the serial console: its output is also
+ * sent to COM1 and lines typed on COM1 are read by it. "serialcon off" stops it.
+ * only one terminal is the serial console at a time.
+ */
+
+#define BUFSIZE     16
+
+int main ()
+{
+    uint8_t arg[BUFSIZE];
+    int32_t mode;
+
+    if (0 != ece391_getargs (arg, BUFSIZE) || -1 == (mode = ece391_fcntl (0, F_GETTTY, 0))) {
+        ece391_fdputs (1, (uint8_t*)"usage: serialcon on|off\n");
+        return 3;
+    }
+
+    if (0 == ece391_strcmp (arg, (uint8_t*)"on"))
+        mode |= TTY_SERIAL;
+    else if (0 == ece391_strcmp (arg, (uint8_t*)"off"))
+        mode &= ~TTY_SERIAL;
+    else {
+        ece391_fdputs (1, (uint8_t*)"usage: serialcon on|off\n");
+        return 3;
+    }
+
+    if (-1 == ece391_fcntl (0, F_SETTTY, mode)) {
+        ece391_fdputs (1, (uint8_t*)"no serial port\n");
+        return 2;
+    }
+    return 0;
+}
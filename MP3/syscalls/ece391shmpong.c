@@ -0,0 +1,163 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * shared memory ping-pong benchmark
+ * run "shmpong pong" in one terminal, then "shmpong shm" or
+ * "shmpong copy" in another one.
+ *   shm  -- messages are produced and consumed in place in the shared page
+ *   copy -- every message is staged through a private buffer on both ends
+ *           (copy-in and copy-out, like a pipe), as a copy-based channel
+ */
+
+#define BUFSIZE     128
+#define SHM_KEY     391
+#define MSG_SIZE    2048
+#define ROUNDS      256
+#define KCYCLE_BITS 10
+
+#define MODE_SHM    1
+#define MODE_COPY   2
+#define MODE_DONE   3
+
+typedef struct channel_t {
+    volatile uint32_t ping_seq;     /* last message posted by ping      */
+    volatile uint32_t pong_seq;     /* last message answered by pong    */
+    volatile uint32_t mode;         /* transfer mode of current run     */
+    volatile uint32_t sum;          /* checksum computed by pong        */
+    uint8_t data[MSG_SIZE];         /* message body                     */
+} channel_t;
+
+static uint8_t private_buf[MSG_SIZE];
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+static void copy (uint8_t* dst, const uint8_t* src, uint32_t n)
+{
+    while (n--)
+        *dst++ = *src++;
+}
+
+static uint32_t checksum (const uint8_t* buf, uint32_t n)
+{
+    uint32_t sum = 0;
+    while (n--)
+        sum += *buf++;
+    return sum;
+}
+
+static void put_num (const char* name, uint32_t value)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+static int pong (channel_t* chan)
+{
+    uint32_t seq = chan->pong_seq;
+
+    ece391_fdputs (1, (uint8_t*)"waiting for ping...\n");
+    while (1) {
+        while (chan->ping_seq == seq);
+        seq = chan->ping_seq;
+        if (MODE_DONE == chan->mode)
+            break;
+        if (MODE_COPY == chan->mode) {
+            /* copy out, consume, copy the echo back in */
+            copy (private_buf, chan->data, MSG_SIZE);
+            chan->sum = checksum (private_buf, MSG_SIZE);
+            copy (chan->data, private_buf, MSG_SIZE);
+        } else {
+            chan->sum = checksum (chan->data, MSG_SIZE);
+        }
+        chan->pong_seq = seq;
+    }
+    chan->pong_seq = seq;
+    ece391_fdputs (1, (uint8_t*)"pong done\n");
+    return 0;
+}
+
+static int ping (channel_t* chan, uint32_t mode)
+{
+    uint32_t i, j, sum, seq;
+    uint64_t start, t0, busy = 0;
+    uint8_t* msg = (MODE_COPY == mode) ? private_buf : chan->data;
+
+    chan->mode = mode;
+    seq = chan->ping_seq;
+    start = rdtsc ();
+    for (i = 0; i < ROUNDS; i++) {
+        t0 = rdtsc ();
+        for (j = 0, sum = 0; j < MSG_SIZE; j++) {
+            msg[j] = (uint8_t)(i + j);
+            sum += msg[j];
+        }
+        if (MODE_COPY == mode)
+            copy (chan->data, private_buf, MSG_SIZE);
+        busy += rdtsc () - t0;
+
+        chan->ping_seq = ++seq;
+        while (chan->pong_seq != seq);
+
+        if (chan->sum != sum) {
+            ece391_fdputs (1, (uint8_t*)"checksum mismatch\n");
+            return 3;
+        }
+        if (MODE_COPY == mode) {
+            t0 = rdtsc ();
+            copy (private_buf, chan->data, MSG_SIZE);
+            busy += rdtsc () - t0;
+        }
+    }
+    start = rdtsc () - start;
+
+    chan->mode = MODE_DONE;
+    chan->ping_seq = ++seq;
+
+    ece391_fdputs (1, (uint8_t*)((MODE_COPY == mode) ? "mode: copy\n" : "mode: shm\n"));
+    put_num ("round trips: ", ROUNDS);
+    put_num ("bytes per message: ", MSG_SIZE);
+    put_num ("total kcycles: ", (uint32_t)(start >> KCYCLE_BITS));
+    put_num ("kcycles per round trip: ", (uint32_t)(start >> KCYCLE_BITS) / ROUNDS);
+    put_num ("ping transfer kcycles: ", (uint32_t)(busy >> KCYCLE_BITS));
+    return 0;
+}
+
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    int32_t shmid;
+    channel_t* chan;
+
+    if (0 != ece391_getargs (buf, BUFSIZE)) {
+        ece391_fdputs (1, (uint8_t*)"usage: shmpong pong|shm|copy\n");
+        return 3;
+    }
+
+    if (-1 == (shmid = ece391_shmget (SHM_KEY)) ||
+        -1 == ece391_shmat (shmid, (uint8_t**)&chan)) {
+        ece391_fdputs (1, (uint8_t*)"shared memory unavailable\n");
+        return 2;
+    }
+
+    if (0 == ece391_strcmp (buf, (uint8_t*)"pong"))
+        return pong (chan);
+    if (0 == ece391_strcmp (buf, (uint8_t*)"shm"))
+        return ping (chan, MODE_SHM);
+    if (0 == ece391_strcmp (buf, (uint8_t*)"copy"))
+        return ping (chan, MODE_COPY);
+
+    ece391_fdputs (1, (uint8_t*)"usage: shmpong pong|shm|copy\n");
+    return 3;
+}
@@ -0,0 +1,113 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * process spawn benchmark
+ * loops execute of a child that halts, timing each execute/halt round trip,
+ * and prints spawns per second, then the mean, median and 99th percentile
+ * latency as "BENCH <name> <value> <unit>" lines like "bench". the child is
+ * "spawnbench exit", which returns at once, or the program named in the
+ * argument (it should not wait for input, "hello" does).
+ */
+
+#define BUFSIZE         128
+#define SPAWNS          256
+#define WARMUP          4           /* first spawns fill the kernel's exec cache */
+#define NS_PER_US       1000
+#define PERCENT         100
+#define P99             99
+#define US_PER_SEC      1000000
+
+static uint32_t lat[SPAWNS];
+
+static void report (const char* name, uint32_t value, const char* unit)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)"BENCH ");
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, (uint8_t*)unit);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+static uint64_t now ()
+{
+    uint64_t ns = 0;
+
+    ece391_gettime (&ns);
+    return ns;
+}
+
+/* (edx:eax) / d with no libgcc, the quotient MUST fit in 32 bits */
+static uint32_t div64_32 (uint64_t n, uint32_t d)
+{
+    uint32_t q, r;
+
+    asm ("divl %4" : "=a"(q), "=d"(r) : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+    return q;
+}
+
+/* insertion sort, the latencies are few */
+static void sort (uint32_t* a, uint32_t n)
+{
+    uint32_t i, j, v;
+
+    for (i = 1; i < n; i++) {
+        v = a[i];
+        for (j = i; j > 0 && a[j - 1] > v; j--)
+            a[j] = a[j - 1];
+        a[j] = v;
+    }
+}
+
+int main ()
+{
+    uint8_t arg[BUFSIZE];
+    uint8_t cmd[BUFSIZE];
+    uint64_t start, t;
+    uint32_t i, total_us;
+
+    if (0 == ece391_getargs (arg, BUFSIZE)) {
+        if (0 == ece391_strcmp (arg, (uint8_t*)"exit"))
+            return 0;
+        ece391_strcpy (cmd, arg);
+    } else
+        ece391_strcpy (cmd, (uint8_t*)"spawnbench exit");
+
+    for (i = 0; i < WARMUP; i++) {
+        if (-1 == ece391_execute (cmd)) {
+            ece391_fdputs (1, (uint8_t*)"spawnbench: cannot execute the child\n");
+            return 1;
+        }
+    }
+
+    start = now ();
+    for (i = 0; i < SPAWNS; i++) {
+        t = now ();
+        if (-1 == ece391_execute (cmd)) {
+            ece391_fdputs (1, (uint8_t*)"spawnbench: execute failed\n");
+            return 1;
+        }
+        lat[i] = (uint32_t)(now () - t);
+    }
+    /* divided before narrowing, a long run does not wrap */
+    total_us = div64_32 (now () - start, NS_PER_US);
+
+    sort (lat, SPAWNS);
+    if (total_us) {
+        ece391_itoa (SPAWNS * US_PER_SEC / total_us, cmd, 10);
+        ece391_fdputs (1, cmd);
+        ece391_fdputs (1, (uint8_t*)" spawns/s\n");
+    }
+    /* lower is better for the BENCH lines, so the rate is given as its inverse */
+    report ("spawn_mean", total_us / SPAWNS, "us");
+    report ("spawn_p50", lat[SPAWNS / 2] / NS_PER_US, "us");
+    report ("spawn_p99", lat[SPAWNS * P99 / PERCENT] / NS_PER_US, "us");
+    return 0;
+}
@@ -102,3 +102,330 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+/* Nanoseconds since boot from the clock page, with no system call */
+uint64_t ece391_clock_ns(void)
+{
+    volatile ece391_clock_t* clk = (volatile ece391_clock_t*)ECE391_CLOCK_ADDR;
+    uint32_t seq, mult, shift;
+    uint64_t delta, ns;
+
+    if (0 == clk->tsc_khz) {
+        (void)ece391_gettime (&ns);
+        return ns;
+    }
+    do {
+        seq = clk->seq;
+        mult = clk->mult;
+        shift = clk->shift;
+        asm volatile ("rdtsc" : "=A"(delta));
+        delta -= clk->tsc_base;
+    } while ((seq & 1) || seq != clk->seq);
+
+    /* split so the product does not lose the high bits */
+    return (((uint64_t)(uint32_t)delta * mult) >> shift) +
+           (((uint64_t)(uint32_t)(delta >> 32) * mult) << (32 - shift));
+}
+
+
+/* Atomic helpers for the mutex and condition variable */
+static uint32_t atomic_xchg(volatile uint32_t* p, uint32_t v)
+{
+    asm volatile ("xchgl %0, %1" : "+r"(v), "+m"(*p) : : "memory");
+    return v;
+}
+
+static uint32_t atomic_cmpxchg(volatile uint32_t* p, uint32_t old, uint32_t v)
+{
+    asm volatile ("lock; cmpxchgl %2, %1" : "+a"(old), "+m"(*p) : "r"(v) : "memory");
+    return old;
+}
+
+static uint32_t atomic_add(volatile uint32_t* p, uint32_t v)
+{
+    asm volatile ("lock; xaddl %0, %1" : "+r"(v), "+m"(*p) : : "memory");
+    return v;
+}
+
+/* First code of a thread, its handle was pushed as the argument */
+static void thread_entry(ece391_thread_t* t)
+{
+    t->fn (t->arg);
+    ece391_halt (0);
+}
+
+/*
+ * Start fn(arg) in a thread of this program on the given stack. The kernel
+ * clears t->alive and wakes the joiners once the stack is no longer used.
+ * Returns the thread id, or -1 if the kernel has no pid left.
+ */
+int32_t ece391_thread_spawn(ece391_thread_t* t, void (*fn)(void* arg), void* arg,
+                            uint8_t* stack, uint32_t size)
+{
+    uint32_t* sp = (uint32_t*)(((uint32_t)stack + size) & ~0xF);
+
+    t->fn = fn;
+    t->arg = arg;
+    *--sp = (uint32_t)t;        /* argument of thread_entry */
+    *--sp = 0;                  /* it never returns         */
+    t->tid = ece391_thread_create ((void*)thread_entry, sp, &t->alive);
+    return t->tid;
+}
+
+/* Wait until a spawned thread exits */
+void ece391_thread_join(ece391_thread_t* t)
+{
+    if (-1 == t->tid)
+        return;
+    while (THREAD_ALIVE == t->alive)
+        (void)ece391_futex (&t->alive, FUTEX_WAIT, THREAD_ALIVE);
+}
+
+/* Take the mutex, sleeping in the kernel only when it is contended */
+void ece391_mutex_lock(ece391_mutex_t* m)
+{
+    uint32_t c;
+
+    if (0 == (c = atomic_cmpxchg (&m->state, 0, 1)))
+        return;
+    /* mark it waited for, then sleep until it is handed back unlocked */
+    if (2 != c)
+        c = atomic_xchg (&m->state, 2);
+    while (0 != c) {
+        (void)ece391_futex (&m->state, FUTEX_WAIT, 2);
+        c = atomic_xchg (&m->state, 2);
+    }
+}
+
+/* Release the mutex, the system call is made only if someone may wait */
+void ece391_mutex_unlock(ece391_mutex_t* m)
+{
+    if (1 != atomic_add (&m->state, (uint32_t)-1)) {
+        m->state = 0;
+        (void)ece391_futex (&m->state, FUTEX_WAKE, 1);
+    }
+}
+
+/* Release m, sleep until signalled, take m again */
+void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m)
+{
+    uint32_t seq = c->seq;
+
+    ece391_mutex_unlock (m);
+    (void)ece391_futex (&c->seq, FUTEX_WAIT, seq);
+    ece391_mutex_lock (m);
+}
+
+/* Wake one waiter of c */
+void ece391_cond_signal(ece391_cond_t* c)
+{
+    (void)atomic_add (&c->seq, 1);
+    (void)ece391_futex (&c->seq, FUTEX_WAKE, 1);
+}
+
+/* Wake every waiter of c */
+void ece391_cond_broadcast(ece391_cond_t* c)
+{
+    (void)atomic_add (&c->seq, 1);
+    (void)ece391_futex (&c->seq, FUTEX_WAKE, (uint32_t)-1);
+}
+
+
+/*
+ * Heap allocator. Blocks of up to 2kB come in power of two size classes cut
+ * from pages taken with ece391_sbrk, larger blocks are whole pages. A block
+ * starts with a header holding its size, freed blocks go on the list of their
+ * class. Freed large blocks are merged with their free neighbours on one list
+ * and split when reused, or go back to the kernel if they end at the break. Not thread safe, threads that
+ * allocate must hold a mutex.
+ */
+
+#define HEAP_PAGE       4096
+#define HEAP_MIN_SHIFT  4                   /* smallest class, 16 bytes     */
+#define HEAP_MAX_SHIFT  11                  /* largest class, 2kB           */
+#define HEAP_CLASSES    (HEAP_MAX_SHIFT - HEAP_MIN_SHIFT + 1)
+#define HEAP_MAX_SMALL  (1 << HEAP_MAX_SHIFT)
+#define HEAP_MAX_ALLOC  0x400000            /* the whole heap               */
+
+typedef struct heap_block_t {
+    uint32_t size;                  /* bytes with this header               */
+    struct heap_block_t* next;      /* next free block, while it is free    */
+} heap_block_t;
+
+static heap_block_t* heap_free[HEAP_CLASSES];
+static heap_block_t* heap_large;
+
+/* Empty the free lists, _start calls it as the loader does not clear static data */
+void ece391_heap_reset(void)
+{
+    int32_t c;
+
+    for (c = 0; c < HEAP_CLASSES; c++)
+        heap_free[c] = 0;
+    heap_large = 0;
+}
+
+/* Smallest class holding size bytes with the header */
+static int32_t heap_class(uint32_t size)
+{
+    int32_t c = 0;
+
+    while ((1U << (c + HEAP_MIN_SHIFT)) < size)
+        c++;
+    return c;
+}
+
+/* Cut a new page into blocks of class c */
+static int32_t heap_refill(int32_t c)
+{
+    uint32_t bsize = 1U << (c + HEAP_MIN_SHIFT);
+    uint8_t* page = ece391_sbrk (HEAP_PAGE);
+    heap_block_t* b;
+    uint32_t off;
+
+    if (SBRK_FAILED == page)
+        return -1;
+    /* pushed from the end so the list starts at the low addresses */
+    for (off = HEAP_PAGE; off > 0; off -= bsize) {
+        b = (heap_block_t*)(page + off - bsize);
+        b->size = bsize;
+        b->next = heap_free[c];
+        heap_free[c] = b;
+    }
+    return 0;
+}
+
+/* Give the pages at the break back to the kernel, with the freed large blocks below them */
+static void heap_trim(uint8_t* top)
+{
+    heap_block_t *b, **prev;
+
+    prev = &heap_large;
+    while (0 != (b = *prev)) {
+        if ((uint8_t*)b + b->size == top) {
+            *prev = b->next;
+            (void)ece391_sbrk (-(int32_t)b->size);
+            top = (uint8_t*)b;
+            prev = &heap_large;
+        } else
+            prev = &b->next;
+    }
+}
+
+/* Allocate size bytes, 8 byte aligned, NULL if the heap is full */
+void* ece391_malloc(uint32_t size)
+{
+    heap_block_t *b, *rest, **prev;
+    int32_t c;
+
+    if (0 == size || size > HEAP_MAX_ALLOC)
+        return 0;
+    size += sizeof (heap_block_t);
+
+    if (size <= HEAP_MAX_SMALL) {
+        c = heap_class (size);
+        if (0 == heap_free[c] && -1 == heap_refill (c))
+            return 0;
+        b = heap_free[c];
+        heap_free[c] = b->next;
+        return b + 1;
+    }
+
+    /* first fit among the freed large blocks, or new pages */
+    size = (size + HEAP_PAGE - 1) & ~(HEAP_PAGE - 1);
+    for (prev = &heap_large; 0 != (b = *prev); prev = &b->next) {
+        if (b->size >= size) {
+            *prev = b->next;
+            if (b->size > size) {
+                rest = (heap_block_t*)((uint8_t*)b + size);
+                rest->size = b->size - size;
+                rest->next = heap_large;
+                heap_large = rest;
+                b->size = size;
+            }
+            return b + 1;
+        }
+    }
+    if (SBRK_FAILED == (b = ece391_sbrk (size)))
+        return 0;
+    b->size = size;
+    return b + 1;
+}
+
+/* Free a block from ece391_malloc or ece391_realloc, NULL is ignored */
+void ece391_free(void* ptr)
+{
+    heap_block_t *b, *n, **prev;
+    int32_t c;
+
+    if (0 == ptr)
+        return;
+    b = (heap_block_t*)ptr - 1;
+    if (b->size <= HEAP_MAX_SMALL) {
+        c = heap_class (b->size);
+        b->next = heap_free[c];
+        heap_free[c] = b;
+        return;
+    }
+    /* no two blocks of the list touch, so one pass finds both neighbours */
+    prev = &heap_large;
+    while (0 != (n = *prev)) {
+        if ((uint8_t*)n + n->size == (uint8_t*)b) {
+            *prev = n->next;
+            n->size += b->size;
+            b = n;
+        } else if ((uint8_t*)b + b->size == (uint8_t*)n) {
+            *prev = n->next;
+            b->size += n->size;
+        } else
+            prev = &n->next;
+    }
+    b->next = heap_large;
+    heap_large = b;
+    if ((uint8_t*)b + b->size == ece391_sbrk (0))
+        heap_trim ((uint8_t*)b + b->size);
+}
+
+/*
+ * Resize a block, keeping its contents. A large block that ends at the break
+ * grows in place, so a buffer doubled again and again is not copied. Returns
+ * NULL and leaves the block alone if there is no memory.
+ */
+void* ece391_realloc(void* ptr, uint32_t size)
+{
+    heap_block_t* b;
+    uint8_t *dst, *src;
+    uint32_t need, n;
+    void* p;
+
+    if (0 == ptr)
+        return ece391_malloc (size);
+    if (0 == size) {
+        ece391_free (ptr);
+        return 0;
+    }
+    if (size > HEAP_MAX_ALLOC)
+        return 0;
+
+    b = (heap_block_t*)ptr - 1;
+    need = size + sizeof (heap_block_t);
+    if (need <= b->size)
+        return ptr;
+
+    if (b->size > HEAP_MAX_SMALL && (uint8_t*)b + b->size == ece391_sbrk (0)) {
+        need = (need + HEAP_PAGE - 1) & ~(HEAP_PAGE - 1);
+        if (SBRK_FAILED != ece391_sbrk (need - b->size)) {
+            b->size = need;
+            return ptr;
+        }
+    }
+
+    if (0 == (p = ece391_malloc (size)))
+        return 0;
+    dst = p;
+    src = ptr;
+    for (n = b->size - sizeof (heap_block_t); n > 0; n--)
+        *dst++ = *src++;
+    ece391_free (ptr);
+    return p;
+}
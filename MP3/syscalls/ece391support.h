@@ -8,6 +8,43 @@ extern int32_t ece391_strcmp(const uint8_t* s1, const uint8_t* s2);
 extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
+extern uint64_t ece391_clock_ns(void);
+
+/* heap on ece391_sbrk, not thread safe */
+extern void ece391_heap_reset(void);
+extern void* ece391_malloc(uint32_t size);
+extern void ece391_free(void* ptr);
+extern void* ece391_realloc(void* ptr, uint32_t size);
+
+/* threads, the caller gives the stack and keeps the handle until the join */
+typedef struct ece391_thread_t {
+    volatile uint32_t alive;    /* THREAD_ALIVE until the thread exits  */
+    int32_t tid;
+    void (*fn)(void* arg);
+    void* arg;
+} ece391_thread_t;
+
+/* 0 unlocked, 1 locked, 2 locked and maybe waited for */
+typedef struct ece391_mutex_t {
+    volatile uint32_t state;
+} ece391_mutex_t;
+
+/* bumped by each signal, waiters sleep on the value they saw */
+typedef struct ece391_cond_t {
+    volatile uint32_t seq;
+} ece391_cond_t;
+
+#define ECE391_MUTEX_INIT   {0}
+#define ECE391_COND_INIT    {0}
+
+extern int32_t ece391_thread_spawn(ece391_thread_t* t, void (*fn)(void* arg), void* arg,
+                                   uint8_t* stack, uint32_t size);
+extern void ece391_thread_join(ece391_thread_t* t);
+extern void ece391_mutex_lock(ece391_mutex_t* m);
+extern void ece391_mutex_unlock(ece391_mutex_t* m);
+extern void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m);
+extern void ece391_cond_signal(ece391_cond_t* c);
+extern void ece391_cond_broadcast(ece391_cond_t* c);
 
 #endif /* ECE391SUPPORT_H */
 
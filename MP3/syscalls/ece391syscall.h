@@ -5,6 +5,96 @@
 
 /* All calls return >= 0 on success or -1 on failure. */
 
+/* poll events and fcntl commands/flags */
+#define POLLIN          1
+#define POLLNVAL        32
+#define POLL_NO_TIMEOUT (-1)
+#define F_GETFL         1
+#define F_SETFL         2
+#define O_NONBLOCK      2
+#define F_GETTTY        3
+#define F_SETTTY        4
+#define TTY_ICANON      1
+#define TTY_ECHO        2
+#define TTY_SERIAL      4
+
+/* poll request for a file descriptor */
+typedef struct ece391_pollfd_t {
+	int32_t fd;         /* file descriptor to wait for                  */
+	uint16_t events;    /* requested events                             */
+	uint16_t revents;   /* returned events                              */
+	uint32_t stamp;     /* low 32 bits of TSC when the fd became ready  */
+} ece391_pollfd_t;
+
+/* clock page, mapped read-only in every program, see ece391_clock_ns */
+#define ECE391_CLOCK_ADDR   0x08FFF000
+
+/* ns = ((rdtsc - tsc_base) * mult) >> shift, retried while seq is odd or changes */
+typedef struct ece391_clock_t {
+	volatile uint32_t seq;
+	uint32_t tsc_khz;   /* 0 if the kernel clock has no TSC, use ece391_gettime */
+	uint32_t mult;
+	uint32_t shift;
+	uint64_t tsc_base;
+} ece391_clock_t;
+
+/* profctl commands, and a sample read from the "prof" device */
+#define PROF_START      1
+#define PROF_STOP       2
+
+typedef struct ece391_prof_sample_t {
+	uint32_t eip;
+	int16_t pid;        /* -1 for the idle loop                 */
+	uint8_t cpu;
+	uint8_t user;       /* 1 if the tick came from user mode    */
+} ece391_prof_sample_t;
+
+/* values written to the "trace" device, and an event read from it */
+#define TRACE_OFF       0
+#define TRACE_ON        1
+#define TRACE_CLEAR     2
+
+typedef struct ece391_trace_event_t {
+	uint64_t tsc;
+	uint8_t type;       /* 1 switch, 2/3 syscall enter/exit, 4/5 irq enter/exit, 6 execute, 7 halt */
+	uint8_t cpu;
+	int16_t pid;        /* -1 for the idle loop                 */
+	uint32_t arg;
+} ece391_trace_event_t;
+
+/* futex operations, and the exit word of a running thread, see ece391_thread_create */
+#define FUTEX_WAIT      0
+#define FUTEX_WAKE      1
+#define THREAD_ALIVE    1
+
+/* ece391_alarm(ALARM_WAIT) blocks until the next alarm, returns the periods since the last */
+#define ALARM_WAIT      (-1)
+
+/* ece391_vidmap_ex targets, ece391_present flags */
+#define VIDMAP_TEXT     0
+#define VIDMAP_FB       1
+#define VIDMAP_BACK     2
+#define PRESENT_VSYNC   1
+
+/* heap from ece391_sbrk, 4kB pages mapped as the break moves, at most 4MB */
+#define SBRK_FAILED     ((void*)-1)
+
+/* display mode, width and height ask for a mode when the display is taken, 0 for 640x480 */
+typedef struct ece391_fbinfo_t {
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;     /* bytes per line, 4 bytes per pixel 0x00RRGGBB    */
+	uint32_t bpp;
+} ece391_fbinfo_t;
+
+/* dirty rectangle of the back buffer, up to 32 per ece391_present */
+typedef struct ece391_rect_t {
+	uint16_t x;
+	uint16_t y;
+	uint16_t w;
+	uint16_t h;
+} ece391_rect_t;
+
 /*  
  * Note that the system call for halt will have to make sure that only
  * the low byte of EBX (the status argument) is returned to the calling
@@ -21,6 +111,21 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_shmget (int32_t key);
+extern int32_t ece391_shmat (int32_t shmid, uint8_t** addr);
+extern int32_t ece391_shmdt (int32_t shmid);
+extern int32_t ece391_poll (ece391_pollfd_t* fds, int32_t nfds, int32_t timeout);
+extern int32_t ece391_fcntl (int32_t fd, int32_t cmd, int32_t arg);
+extern int32_t ece391_gettime (uint64_t* ns);
+extern int32_t ece391_nanosleep (const uint64_t* ns);
+extern int32_t ece391_profctl (int32_t cmd);
+extern int32_t ece391_thread_create (void* entry, void* stack, volatile uint32_t* exit_word);
+extern int32_t ece391_futex (volatile uint32_t* addr, int32_t op, uint32_t val);
+extern int32_t ece391_sleep (uint32_t ms);
+extern int32_t ece391_alarm (int32_t ms);
+extern int32_t ece391_vidmap_ex (int32_t which, uint8_t** screen_start, ece391_fbinfo_t* info);
+extern int32_t ece391_present (const ece391_rect_t* rects, int32_t n, int32_t flags);
+extern void* ece391_sbrk (int32_t increment);
 
 enum signums {
 	DIV_ZERO = 0,
@@ -11,5 +11,20 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_SHMGET  11
+#define SYS_SHMAT   12
+#define SYS_SHMDT   13
+#define SYS_POLL    14
+#define SYS_FCNTL   15
+#define SYS_GETTIME 16
+#define SYS_NANOSLEEP   17
+#define SYS_PROFCTL 18
+#define SYS_THREAD_CREATE  19
+#define SYS_FUTEX   20
+#define SYS_SLEEP   21
+#define SYS_ALARM   22
+#define SYS_VIDMAP_EX   23
+#define SYS_PRESENT 24
+#define SYS_SBRK    25
 
 #endif /* ECE391SYSNUM_H */
@@ -0,0 +1,159 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * contention benchmark of the threading library
+ * times an uncontended lock/unlock pair, then WORKERS threads adding to one
+ * counter under a mutex, then a condition variable ping-pong between two
+ * threads. prints "BENCH <name> <value> <unit>" lines like "bench". the
+ * kernel has few pids, fewer workers run if it cannot start them all.
+ */
+
+#define BUFSIZE         16
+#define WORKERS         3
+#define STACK_SIZE      8192
+#define UNCONTENDED     10000
+#define ITERS           20000       /* increments per worker         */
+#define SPIN            20          /* work done outside the mutex   */
+#define ROUNDS          1000        /* ping-pong round trips         */
+
+static uint8_t stacks[WORKERS][STACK_SIZE];
+static ece391_thread_t workers[WORKERS];
+
+static ece391_mutex_t lock = ECE391_MUTEX_INIT;
+static volatile uint32_t counter;
+
+static ece391_cond_t ping = ECE391_COND_INIT;
+static ece391_cond_t pong = ECE391_COND_INIT;
+static volatile uint32_t turn;
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+static void report (const char* name, uint32_t value, const char* unit)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)"BENCH ");
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, (uint8_t*)unit);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+static void adder (void* arg)
+{
+    volatile uint32_t spin;
+    uint32_t i;
+
+    for (i = 0; i < ITERS; i++) {
+        ece391_mutex_lock (&lock);
+        counter++;
+        ece391_mutex_unlock (&lock);
+        for (spin = 0; spin < SPIN; spin++);
+    }
+}
+
+/* the other side of the ping-pong, answers every ping */
+static void ponger (void* arg)
+{
+    uint32_t i;
+
+    ece391_mutex_lock (&lock);
+    for (i = 0; i < ROUNDS; i++) {
+        while (0 == turn)
+            ece391_cond_wait (&ping, &lock);
+        turn = 0;
+        ece391_cond_signal (&pong);
+    }
+    ece391_mutex_unlock (&lock);
+}
+
+/* cycles per lock/unlock pair with nobody else around */
+static uint32_t bench_uncontended ()
+{
+    uint32_t i;
+    uint64_t start = rdtsc ();
+
+    for (i = 0; i < UNCONTENDED; i++) {
+        ece391_mutex_lock (&lock);
+        ece391_mutex_unlock (&lock);
+    }
+    return (uint32_t)(rdtsc () - start) / UNCONTENDED;
+}
+
+/* cycles per increment with every worker on the same mutex, 0 if the count is wrong */
+static uint32_t bench_contended (uint32_t* nworkers)
+{
+    uint32_t i, n = 0;
+    uint64_t start;
+
+    counter = 0;
+    start = rdtsc ();
+    for (i = 0; i < WORKERS; i++) {
+        if (-1 != ece391_thread_spawn (&workers[i], adder, 0, stacks[i], STACK_SIZE))
+            n++;
+    }
+    for (i = 0; i < WORKERS; i++)
+        ece391_thread_join (&workers[i]);
+    *nworkers = n;
+    if (0 == n || counter != n * ITERS)
+        return 0;
+    return (uint32_t)(rdtsc () - start) / (n * ITERS);
+}
+
+/* cycles per ping-pong round trip, 0 if the other thread could not start */
+static uint32_t bench_pingpong ()
+{
+    uint32_t i;
+    uint64_t start;
+
+    turn = 0;
+    if (-1 == ece391_thread_spawn (&workers[0], ponger, 0, stacks[0], STACK_SIZE))
+        return 0;
+    start = rdtsc ();
+    ece391_mutex_lock (&lock);
+    for (i = 0; i < ROUNDS; i++) {
+        turn = 1;
+        ece391_cond_signal (&ping);
+        while (1 == turn)
+            ece391_cond_wait (&pong, &lock);
+    }
+    ece391_mutex_unlock (&lock);
+    ece391_thread_join (&workers[0]);
+    return (uint32_t)(rdtsc () - start) / ROUNDS;
+}
+
+int main ()
+{
+    uint32_t value, n;
+
+    /* the loader does not clear static data */
+    lock.state = 0;
+
+    report ("mutex_uncontended", bench_uncontended (), "cycles");
+
+    value = bench_contended (&n);
+    if (0 == value) {
+        ece391_fdputs (1, (uint8_t*)"threadbench: no worker started or lost increments\n");
+        return 1;
+    }
+    report ("mutex_workers", n, "threads");
+    report ("mutex_contended", value, "cycles/op");
+
+    if (0 == (value = bench_pingpong ())) {
+        ece391_fdputs (1, (uint8_t*)"threadbench: ping-pong thread did not start\n");
+        return 1;
+    }
+    report ("cond_pingpong", value, "cycles");
+    return 0;
+}
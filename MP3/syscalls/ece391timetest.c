@@ -0,0 +1,143 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * clock and sleep test
+ * "timetest" reports the cost of reading the clock from the clock page and
+ * with the gettime system call, checks that the clock never goes back, and
+ * sleeps for several durations with nanosleep to show how late each wake up
+ * is. then it checks the sleep system call and a periodic alarm. run it on an
+ * idle terminal and on a loaded one (cpubench elsewhere).
+ */
+
+#define NAMESIZE    128
+#define NUM_READS   10000
+#define NUM_SLEEPS  5
+#define NUM_DURS    6
+#define NS_PER_US   1000
+#define NS_PER_MS   1000000
+#define SLEEP_MS    50
+#define ALARM_MS    20
+#define NUM_ALARMS  10
+
+static const uint32_t durs_us[NUM_DURS] = {10, 100, 1000, 5000, 20000, 100000};
+
+static uint64_t rdtsc ()
+{
+    uint64_t val;
+    asm volatile ("rdtsc" : "=A"(val));
+    return val;
+}
+
+static void put_num (const char* name, uint32_t value)
+{
+    uint8_t buf[NAMESIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (value, buf, 10);
+    ece391_fdputs (1, buf);
+}
+
+int main ()
+{
+    uint64_t start, prev, now, req;
+    uint32_t i, d, back = 0;
+    uint32_t took, total, late_max;
+    int32_t n;
+
+    /* clock page, no system call */
+    prev = ece391_clock_ns ();
+    start = rdtsc ();
+    for (i = 0; i < NUM_READS; i++) {
+        now = ece391_clock_ns ();
+        if (now < prev)
+            back++;
+        prev = now;
+    }
+    put_num ("clock page: cycles per read ", (uint32_t)(rdtsc () - start) / NUM_READS);
+    put_num (", went back ", back);
+    ece391_fdputs (1, (uint8_t*)"\n");
+
+    /* system call */
+    back = 0;
+    start = rdtsc ();
+    for (i = 0; i < NUM_READS; i++) {
+        if (0 != ece391_gettime (&now)) {
+            ece391_fdputs (1, (uint8_t*)"gettime failed\n");
+            return 2;
+        }
+        if (now < prev)
+            back++;
+        prev = now;
+    }
+    put_num ("gettime: cycles per call ", (uint32_t)(rdtsc () - start) / NUM_READS);
+    put_num (", went back ", back);
+    ece391_fdputs (1, (uint8_t*)"\n");
+
+    /* sleeps, every duration below 4s so the 32-bit differences hold */
+    for (d = 0; d < NUM_DURS; d++) {
+        req = (uint64_t)durs_us[d] * NS_PER_US;
+        total = 0;
+        late_max = 0;
+        for (i = 0; i < NUM_SLEEPS; i++) {
+            start = ece391_clock_ns ();
+            if (0 != ece391_nanosleep (&req)) {
+                ece391_fdputs (1, (uint8_t*)"nanosleep failed\n");
+                return 2;
+            }
+            took = (uint32_t)(ece391_clock_ns () - start);
+            if (took < (uint32_t)req) {
+                ece391_fdputs (1, (uint8_t*)"woke up early\n");
+                return 1;
+            }
+            total += took / NS_PER_US;
+            if (took - (uint32_t)req > late_max)
+                late_max = took - (uint32_t)req;
+        }
+        put_num ("sleep ", durs_us[d]);
+        put_num (" us: avg ", total / NUM_SLEEPS);
+        put_num (" us, max late ", late_max / NS_PER_US);
+        ece391_fdputs (1, (uint8_t*)" us\n");
+    }
+
+    /* sleep system call, tick resolution */
+    start = ece391_clock_ns ();
+    if (0 != ece391_sleep (SLEEP_MS)) {
+        ece391_fdputs (1, (uint8_t*)"sleep failed\n");
+        return 2;
+    }
+    took = (uint32_t)(ece391_clock_ns () - start);
+    if (took < SLEEP_MS * NS_PER_MS) {
+        ece391_fdputs (1, (uint8_t*)"sleep woke up early\n");
+        return 1;
+    }
+    put_num ("sleep(", SLEEP_MS);
+    put_num (") took ", took / NS_PER_US);
+    ece391_fdputs (1, (uint8_t*)" us\n");
+
+    /* periodic alarm, the periods add up without drift */
+    if (0 != ece391_alarm (ALARM_MS)) {
+        ece391_fdputs (1, (uint8_t*)"alarm failed\n");
+        return 2;
+    }
+    start = ece391_clock_ns ();
+    for (i = 0; i < NUM_ALARMS; i += n) {
+        if ((n = ece391_alarm (ALARM_WAIT)) <= 0) {
+            ece391_fdputs (1, (uint8_t*)"alarm wait failed\n");
+            return 2;
+        }
+    }
+    took = (uint32_t)(ece391_clock_ns () - start);
+    (void)ece391_alarm (0);
+    put_num ("alarm ", ALARM_MS);
+    put_num (" ms x ", i);
+    put_num (": took ", took / NS_PER_US);
+    ece391_fdputs (1, (uint8_t*)" us\n");
+    if (-1 != ece391_alarm (ALARM_WAIT)) {
+        ece391_fdputs (1, (uint8_t*)"stopped alarm still waits\n");
+        return 1;
+    }
+    return 0;
+}
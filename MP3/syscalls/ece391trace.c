@@ -0,0 +1,101 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * event trace dump
+ * "trace" stops recording, prints the events as
+ * "T <cpu> <type> <pid> <arg in hex> <tsc high in hex> <tsc low in hex>"
+ * lines, clears them and records again. "trace clear" only clears,
+ * "trace <command>" traces one run of the command and dumps. the dump also
+ * goes to COM1 if there is a serial port, capture it on the host and run
+ * "student-distrib/trace2json.py log > trace.json" for chrome://tracing.
+ */
+
+#define BUFSIZE     128
+#define NUM_EVENTS  32
+#define HEX         16
+
+static void put_field (uint32_t value, int32_t radix, const char* sep)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_itoa (value, buf, radix);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)sep);
+}
+
+static int32_t set (int32_t fd, int32_t value)
+{
+    return ece391_write (fd, &value, sizeof (value));
+}
+
+static int32_t dump (int32_t fd)
+{
+    ece391_trace_event_t events[NUM_EVENTS];
+    ece391_clock_t* clk = (ece391_clock_t*)ECE391_CLOCK_ADDR;
+    int32_t cnt, i, mode;
+    uint32_t total = 0;
+
+    /* copy the dump to the serial line for the host, if there is one */
+    mode = ece391_fcntl (0, F_GETTTY, 0);
+    if (-1 != mode)
+        (void)ece391_fcntl (0, F_SETTTY, mode | TTY_SERIAL);
+
+    ece391_fdputs (1, (uint8_t*)"trace khz ");
+    put_field (clk->tsc_khz, 10, "\n");
+    while (0 < (cnt = ece391_read (fd, events, sizeof (events)))) {
+        for (i = 0; i < cnt / (int32_t)sizeof (ece391_trace_event_t); i++) {
+            ece391_fdputs (1, (uint8_t*)"T ");
+            put_field (events[i].cpu, 10, " ");
+            put_field (events[i].type, 10, " ");
+            if (events[i].pid < 0)
+                ece391_fdputs (1, (uint8_t*)"-1 ");
+            else
+                put_field (events[i].pid, 10, " ");
+            put_field (events[i].arg, HEX, " ");
+            put_field ((uint32_t)(events[i].tsc >> 32), HEX, " ");
+            put_field ((uint32_t)events[i].tsc, HEX, "\n");
+        }
+        total += cnt / sizeof (ece391_trace_event_t);
+    }
+    ece391_fdputs (1, (uint8_t*)"trace end ");
+    put_field (total, 10, "\n");
+
+    if (-1 != mode)
+        (void)ece391_fcntl (0, F_SETTTY, mode);
+    return (-1 == cnt) ? 3 : 0;
+}
+
+int main ()
+{
+    uint8_t arg[BUFSIZE];
+    int32_t fd, ret;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"trace"))) {
+        ece391_fdputs (1, (uint8_t*)"no trace device\n");
+        return 2;
+    }
+
+    if (0 != ece391_getargs (arg, BUFSIZE)) {
+        /* dump what was recorded so far */
+        (void)set (fd, TRACE_OFF);
+        ret = dump (fd);
+    } else if (0 == ece391_strcmp (arg, (uint8_t*)"clear")) {
+        ret = (-1 == set (fd, TRACE_CLEAR)) ? 2 : 0;
+    } else {
+        /* trace one run of a command */
+        (void)set (fd, TRACE_CLEAR);
+        (void)set (fd, TRACE_ON);
+        if (-1 == ece391_execute (arg))
+            ece391_fdputs (1, (uint8_t*)"no such command\n");
+        (void)set (fd, TRACE_OFF);
+        ret = dump (fd);
+    }
+
+    (void)set (fd, TRACE_CLEAR);
+    (void)set (fd, TRACE_ON);
+    ece391_close (fd);
+    return ret;
+}